@@ -37,6 +37,14 @@ Z1=0
 Z2=0
 EOL
 
+# The SIMD kernel widths this CPU can run (unsupported ones are rejected)
+SIMD_FLAGS=""
+for width in scalar sse2 avx2; do
+    if "$COMPILER" --simd=$width --sheet /dev/null > /dev/null 2>&1; then
+        SIMD_FLAGS="$SIMD_FLAGS --simd=$width"
+    fi
+done
+
 echo "======================================"
 echo " SPREADSHEET COMPILER TEST SUITE"
 echo "======================================"
@@ -64,6 +72,50 @@ while read -r test_file; do
     # Special case for the "arithmetic" test to show full verbose output
     if [[ "$test_file" == *"syntax/test_arithmetic.txt"* ]]; then
         "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --verbose --ast-tree --bytecode --trace > "$actual_file" 2>&1
+    elif [[ "$category" == "sheet" ]]; then
+        # Sheet tests: the input is a whole sheet, compare the cell results only.
+        # A 'test_*.args' file next to it adds options (e.g. --set edits) to every run.
+        args=""
+        if [ -f "${base_name}.args" ]; then
+            args=$(cat "${base_name}.args")
+        fi
+        "$COMPILER" --sheet "$test_file" $args 2>&1 \
+            | grep -E "^[A-Z]+[0-9]+ += |^Error: " \
+            > "$actual_file"
+        # Neither the optimizer, the caches, the range index, the JIT, the SIMD width
+        # nor the parallel schedulers may change any result
+        for flag in --optimize --range-cache --range-index --formula-cache "--jit 1" --aot $SIMD_FLAGS \
+                    "--threads 4" "--threads 4 --schedule=steal"; do
+            if ! "$COMPILER" --sheet "$test_file" $args $flag 2>&1 \
+                | grep -E "^[A-Z]+[0-9]+ += |^Error: " \
+                | diff -q - "$actual_file" > /dev/null; then
+                echo "$flag gives different results" >> "$actual_file"
+            fi
+        done
+    elif [[ "$category" == "scenarios" ]]; then
+        # Scenario tests: the formula runs once per row of the 'test_*.csv' next to it,
+        # in VM lanes (see --scenarios). Compare the scenario results only.
+        "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --no-ast --scenarios "${base_name}.csv" 2>&1 \
+            | grep -E "^[0-9]+ scenario|^[0-9]+ +\| " \
+            > "$actual_file"
+        if ! "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --no-ast --scenarios "${base_name}.csv" --optimize 2>&1 \
+            | grep -E "^[0-9]+ scenario|^[0-9]+ +\| " \
+            | diff -q - "$actual_file" > /dev/null; then
+            echo "--optimize gives different results" >> "$actual_file"
+        fi
+    elif [[ "$category" == "regvm" ]]; then
+        # Register VM tests: run the formula on the register VM (a fallback to the
+        # stack VM shows up in the output), and it must give the stack VM's result
+        "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --no-ast --mode=regvm 2>&1 \
+            | grep -E "^Method|^RESULT|registers; using" \
+            > "$actual_file"
+        for flag in "--mode=vm" "--mode=regvm --optimize"; do
+            if ! "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --no-ast $flag 2>&1 \
+                | grep "^RESULT" \
+                | diff -q - <(grep "^RESULT" "$actual_file") > /dev/null; then
+                echo "$flag gives a different result" >> "$actual_file"
+            fi
+        done
     else
         # Default run: minimal output
         "$COMPILER" --input "$test_file" --cells "$CELL_FILE" --no-ast 2>&1 \
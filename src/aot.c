@@ -0,0 +1,985 @@
+/*
+ * --- Ahead-of-Time Sheet Compiler Implementation ---
+ *
+ * Each formula becomes one static C function. Its stack slots
+ * become locals: sK holds the number (0.0 / 1.0 for a boolean)
+ * and tK its AotKind. The stack depth at every instruction is
+ * known statically, as in the JIT (jit.c), so IF branches are
+ * plain gotos between labels. An error (a zero divisor, an empty
+ * AVERAGE, an error cell read alone or in a range) jumps to the
+ * function's 'error' label, which stores it in the cell.
+ *
+ * A range is never a value at run time: PUSH_RANGE only records
+ * which range a slot holds, and the CALL that consumes it folds
+ * the range's columns straight from 'cells'.
+ *
+ * Every cell position the code uses is a parameter, p[k], so two
+ * formulas that differ only in their cells get the same text and
+ * share one function.
+ */
+
+#include "aot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "parser.tab.h" // For SUM, AVERAGE, MIN, MAX, NOT
+
+
+/* --- Private Helpers --- */
+
+static void aot_oom(void) {
+    fprintf(stderr, "Fatal: Out of memory generating native code\n");
+    exit(1);
+}
+
+// A growing text buffer
+typedef struct {
+    char* text;
+    long length;
+    long capacity;
+} Source;
+
+static void source_printf(Source* src, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (src->length + n + 1 > src->capacity) {
+        long new_capacity = src->capacity < 4096 ? 4096 : src->capacity;
+        while (new_capacity < src->length + n + 1) {
+            new_capacity *= 2;
+        }
+        src->text = (char*)realloc(src->text, new_capacity);
+        if (src->text == NULL) {
+            aot_oom();
+        }
+        src->capacity = new_capacity;
+    }
+    va_start(args, format);
+    vsnprintf(src->text + src->length, n + 1, format, args);
+    va_end(args);
+    src->length += n;
+}
+
+// Writes a constant with its exact bits (hex floats, or the raw bits of inf/NaN)
+static void source_number(Source* src, double x) {
+    if (isfinite(x)) {
+        source_printf(src, "%a", x);
+    } else {
+        unsigned long long bits;
+        memcpy(&bits, &x, sizeof(bits));
+        source_printf(src, "bits(0x%llxULL)", bits);
+    }
+}
+
+static char* join_path(const char* directory, const char* name) {
+    char* path = (char*)malloc(strlen(directory) + strlen(name) + 2);
+    if (path == NULL) {
+        aot_oom();
+    }
+    sprintf(path, "%s/%s", directory, name);
+    return path;
+}
+
+static const SymbolTable* sort_table; // For compare_ids
+
+// Sorts ids by coordinate: column by column, then row by row
+static int compare_ids(const void* a, const void* b) {
+    CellCoord x = sort_table->cells[*(const int*)a].coord;
+    CellCoord y = sort_table->cells[*(const int*)b].coord;
+    return (x > y) - (x < y);
+}
+
+// What a stack slot holds while translating: a value, or a known range
+typedef struct {
+    int is_range;
+    CellRange range;
+} SlotState;
+
+// Everything one translation needs
+typedef struct {
+    SymbolTable* table;
+    const int* slot_of_id;
+    int slot_count;
+    Source body;            // The formula being translated
+    int* params;            // Its cell positions, read by the code as p[0], p[1], ...
+    int param_count;
+    int param_capacity;
+    int* target_depth;      // Stack depth at each jump target, -1 if none
+    int* target_state;      // Where its slots are in 'states'
+    int target_capacity;
+    SlotState* states;      // Slots at the jump targets, 'depth' entries each
+    int state_count;
+    int state_capacity;
+    const char* reason;     // Why the last translation failed
+} Translator;
+
+// Position of a cell in 'cells', -1 if it is not in the symbol table
+static int slot_of(const Translator* tr, CellCoord coord) {
+    int id = cellstore_id(&tr->table->grid, coord);
+    return (id < 0 || id >= tr->slot_count) ? -1 : tr->slot_of_id[id];
+}
+
+// Adds a parameter of the formula being translated, returns its index in p[]
+static int add_param(Translator* tr, int value) {
+    if (tr->param_count >= tr->param_capacity) {
+        tr->param_capacity = tr->param_capacity < 16 ? 16 : tr->param_capacity * 2;
+        tr->params = (int*)realloc(tr->params, tr->param_capacity * sizeof(int));
+        if (tr->params == NULL) {
+            aot_oom();
+        }
+    }
+    tr->params[tr->param_count] = value;
+    return tr->param_count++;
+}
+
+// The prelude function for +, - and * (see emit_prelude)
+static const char* arithmetic(OpCode opcode) {
+    switch (opcode) {
+        case OP_ADD: return "add";
+        case OP_SUB: return "sub";
+        default: return "mul"; // OP_MUL
+    }
+}
+
+// The plain operator a fused cell superinstruction applies
+static OpCode superinstruction_op(OpCode opcode) {
+    switch (opcode) {
+        case OP_ADD_CELL_CELL: case OP_ADD_CELL_CONST: return OP_ADD;
+        case OP_SUB_CELL_CELL: return OP_SUB;
+        default: return OP_MUL; // OP_MUL_CELL_CELL, OP_MUL_CELL_CONST
+    }
+}
+
+static const char* comparison(OpCode opcode) {
+    switch (opcode) {
+        case OP_GT: return ">";
+        case OP_LT: return "<";
+        case OP_GTE: return ">=";
+        case OP_LTE: return "<=";
+        case OP_EQ: return "==";
+        default: return "!="; // OP_NEQ
+    }
+}
+
+// The comparison tested by a fused compare-jump (OP_JMP_IF_NOT_GT -> ">")
+static const char* jump_comparison(OpCode opcode) {
+    switch (opcode) {
+        case OP_JMP_IF_NOT_GT: return ">";
+        case OP_JMP_IF_NOT_LT: return "<";
+        case OP_JMP_IF_NOT_GTE: return ">=";
+        case OP_JMP_IF_NOT_LTE: return "<=";
+        case OP_JMP_IF_NOT_EQ: return "==";
+        default: return "!="; // OP_JMP_IF_NOT_NEQ
+    }
+}
+
+// Records the slots at a forward jump target, or checks them against
+// an earlier jump there. 0 if it can't be translated.
+static int add_target(Translator* tr, int pc, int target, int depth, const SlotState* slots) {
+    if (target <= pc) {
+        tr->reason = "a backward jump";
+        return 0;
+    }
+    if (tr->target_depth[target] >= 0) {
+        const SlotState* seen = &tr->states[tr->target_state[target]];
+        if (tr->target_depth[target] != depth) {
+            tr->reason = "inconsistent stack depths";
+            return 0;
+        }
+        for (int i = 0; i < depth; i++) {
+            if (seen[i].is_range != slots[i].is_range || (slots[i].is_range &&
+                (seen[i].range.start != slots[i].range.start || seen[i].range.end != slots[i].range.end))) {
+                tr->reason = "a range that differs between IF branches";
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    if (tr->state_count + depth > tr->state_capacity) {
+        tr->state_capacity = (tr->state_count + depth) * 2;
+        tr->states = (SlotState*)realloc(tr->states, tr->state_capacity * sizeof(SlotState));
+        if (tr->states == NULL) {
+            aot_oom();
+        }
+    }
+    memcpy(&tr->states[tr->state_count], slots, depth * sizeof(SlotState));
+    tr->target_depth[target] = depth;
+    tr->target_state[target] = tr->state_count;
+    tr->state_count += depth;
+    return 1;
+}
+
+// Emits a jump to the 'error' label with 'code' when 'condition' holds
+static void emit_raise(Source* out, ErrorCode code, const char* condition, int slot) {
+    source_printf(out, "    if (");
+    source_printf(out, condition, slot);
+    source_printf(out, ") { err = ");
+    source_number(out, cellstore_error(code));
+    source_printf(out, "; goto error; }\n");
+}
+
+// Emits the fold of one SUM/AVERAGE/MIN/MAX argument into 'acc'
+static int emit_argument(Translator* tr, const char* kind, int slot, const CellRange* range) {
+    Source* out = &tr->body;
+    if (range == NULL) {
+        // Only numbers count; booleans are skipped
+        source_printf(out, "    if (t%d == K_NUMBER) fold(rt, %s, &acc, &s%d, 0, 1, &err);\n", slot, kind, slot);
+        return 1;
+    }
+    int row_start = cell_row(range->start);
+    int rows = cell_row(range->end) - row_start + 1;
+    for (int c = cell_col(range->start); c <= cell_col(range->end); c++) {
+        int first = slot_of(tr, cell_coord(c, row_start));
+        int last = slot_of(tr, cell_coord(c, row_start + rows - 1));
+        if (first < 0 || last - first != rows - 1) {
+            // Some cell of the column is not in the table (not contiguous)
+            tr->reason = "a range with cells outside the symbol table";
+            return 0;
+        }
+        int values = add_param(tr, first);
+        int row = add_param(tr, row_start);
+        source_printf(out, "    if (!fold(rt, %s, &acc, cells + p[%d], p[%d], p[%d], &err)) goto error;\n",
+            kind, values, row, add_param(tr, rows));
+    }
+    return 1;
+}
+
+// Translates formula 'index' into the body of its function. Every cell
+// position is a parameter (p[0] is the formula's cell, p[1] its index),
+// so formulas with the same shape get the same text.
+static int translate(Translator* tr, int index, const FormulaCell* fc, int* max_depth, int* raises) {
+    const CodeArray* code = fc->code;
+    Source* out = &tr->body;
+    out->length = 0;
+    source_printf(out, "%s", ""); // Allocates the buffer
+    tr->param_count = 0;
+
+    if (tr->target_capacity < code->count + 1) {
+        tr->target_capacity = code->count + 1;
+        tr->target_depth = (int*)realloc(tr->target_depth, tr->target_capacity * sizeof(int));
+        tr->target_state = (int*)realloc(tr->target_state, tr->target_capacity * sizeof(int));
+        if (tr->target_depth == NULL || tr->target_state == NULL) {
+            aot_oom();
+        }
+    }
+    for (int pc = 0; pc <= code->count; pc++) {
+        tr->target_depth[pc] = -1;
+    }
+    tr->state_count = 0;
+
+    int result = slot_of(tr, fc->coord);
+    if (result < 0) {
+        tr->reason = "a formula cell outside the symbol table";
+        return 0;
+    }
+    add_param(tr, result);
+    add_param(tr, index);
+
+    SlotState slots[VM_STACK_SIZE];
+    int depth = 0;
+    int reachable = 1;
+    *max_depth = 0;
+    *raises = 0;
+
+    for (int pc = 0; pc < code->count; pc++) {
+        if (tr->target_depth[pc] >= 0) {
+            depth = tr->target_depth[pc];
+            reachable = 1;
+            memcpy(slots, &tr->states[tr->target_state[pc]], depth * sizeof(SlotState));
+            source_printf(out, "L%d:;\n", pc);
+        }
+        if (!reachable) {
+            continue; // Dead code
+        }
+
+        const Instruction* inst = &code->code[pc];
+        int top = depth - 1;
+        if (depth > *max_depth) {
+            *max_depth = depth;
+        }
+
+        // Every operator but CALL needs plain values
+        int operands = 0;
+        switch (opcode_generic(inst->opcode)) {
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+            case OP_EQ: case OP_NEQ: case OP_GT: case OP_LT: case OP_GTE:
+            case OP_LTE: case OP_AND: case OP_OR:
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ:
+                operands = 2;
+                break;
+            case OP_NEG: case OP_NOT: case OP_JMP_IF_FALSE: case OP_STORE_LOCAL:
+            case OP_ADD_CELL: case OP_MUL_CONST: case OP_HALT:
+                operands = 1;
+                break;
+            default:
+                break;
+        }
+        for (int i = depth - operands; i < depth; i++) {
+            if (i >= 0 && slots[i].is_range) {
+                tr->reason = "a range outside a function call";
+                return 0;
+            }
+        }
+
+        switch (inst->opcode) {
+            case OP_HALT:
+                if (depth == 0) {
+                    tr->reason = "an empty stack at HALT";
+                    return 0;
+                }
+                source_printf(out, "    cells[p[0]] = s%d;\n    kinds[p[1]] = t%d;\n    return;\n", top, top);
+                reachable = 0;
+                break;
+
+            case OP_PUSH:
+                source_printf(out, "    s%d = ", depth);
+                source_number(out, inst->operand.number);
+                source_printf(out, "; t%d = K_NUMBER;\n", depth);
+                slots[depth++].is_range = 0;
+                break;
+
+            case OP_PUSH_CELL: {
+                int slot = slot_of(tr, inst->operand.cell.coord);
+                if (slot < 0) {
+                    tr->reason = "a cell outside the symbol table";
+                    return 0;
+                }
+                source_printf(out, "    s%d = cells[p[%d]]; t%d = K_NUMBER;\n", depth, add_param(tr, slot), depth);
+                source_printf(out, "    CHECK(s%d);\n", depth);
+                *raises = 1;
+                slots[depth++].is_range = 0;
+                break;
+            }
+
+            case OP_PUSH_RANGE:
+                slots[depth].range = inst->operand.range;
+                slots[depth++].is_range = 1;
+                break;
+
+            case OP_ADD: case OP_ADD_NUM:
+            case OP_SUB: case OP_SUB_NUM:
+            case OP_MUL: case OP_MUL_NUM: {
+                source_printf(out, "    s%d = %s(s%d, s%d); t%d = K_NUMBER;\n", top - 1,
+                    arithmetic(opcode_generic(inst->opcode)), top - 1, top, top - 1);
+                depth--;
+                break;
+            }
+
+            case OP_DIV: case OP_DIV_NUM:
+                emit_raise(out, ERROR_DIV_ZERO, "s%d == 0", top);
+                source_printf(out, "    s%d = s%d / s%d; t%d = K_NUMBER;\n", top - 1, top - 1, top, top - 1);
+                *raises = 1;
+                depth--;
+                break;
+
+            case OP_POW: case OP_POW_NUM:
+                source_printf(out, "    s%d = pow(s%d, s%d); t%d = K_NUMBER;\n", top - 1, top - 1, top, top - 1);
+                depth--;
+                break;
+
+            case OP_EQ: case OP_EQ_NUM:
+            case OP_NEQ: case OP_NEQ_NUM:
+            case OP_GT: case OP_GT_NUM:
+            case OP_LT: case OP_LT_NUM:
+            case OP_GTE: case OP_GTE_NUM:
+            case OP_LTE: case OP_LTE_NUM:
+                source_printf(out, "    s%d = s%d %s s%d; t%d = K_BOOLEAN;\n", top - 1, top - 1,
+                    comparison(opcode_generic(inst->opcode)), top, top - 1);
+                depth--;
+                break;
+
+            case OP_AND:
+            case OP_OR:
+                source_printf(out, "    s%d = s%d != 0 %s s%d != 0; t%d = K_BOOLEAN;\n", top - 1, top - 1,
+                    inst->opcode == OP_AND ? "&&" : "||", top, top - 1);
+                depth--;
+                break;
+
+            case OP_NEG: case OP_NEG_NUM:
+                source_printf(out, "    s%d = negate(s%d); t%d = K_NUMBER;\n", top, top, top);
+                break;
+
+            case OP_NOT:
+                source_printf(out, "    s%d = s%d == 0; t%d = K_BOOLEAN;\n", top, top, top);
+                break;
+
+            case OP_JMP:
+            case OP_JMP_IF_FALSE:
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ: {
+                int target = inst->operand.address;
+                if (inst->opcode == OP_JMP) {
+                    source_printf(out, "    goto L%d;\n", target);
+                    reachable = 0;
+                } else if (inst->opcode == OP_JMP_IF_FALSE) {
+                    source_printf(out, "    if (s%d == 0) goto L%d;\n", top, target);
+                    depth--;
+                } else {
+                    source_printf(out, "    if (!(s%d %s s%d)) goto L%d;\n", top - 1,
+                        jump_comparison(inst->opcode), top, target);
+                    depth -= 2;
+                }
+                if (!add_target(tr, pc, target, depth, slots)) {
+                    return 0;
+                }
+                break;
+            }
+
+            case OP_CALL: {
+                int token = inst->operand.func_call.token;
+                int argc = inst->operand.func_call.arg_count;
+                int first = depth - argc;
+                if (token == NOT) {
+                    if (argc != 1 || slots[first].is_range) {
+                        tr->reason = "NOT of a range";
+                        return 0;
+                    }
+                    source_printf(out, "    s%d = s%d == 0; t%d = K_BOOLEAN;\n", first, first, first);
+                    break;
+                }
+                const char* kind = (token == MIN) ? "AGG_MIN" : (token == MAX) ? "AGG_MAX" : "AGG_SUM";
+                if (token != SUM && token != AVERAGE && token != MIN && token != MAX) {
+                    tr->reason = "an unknown function";
+                    return 0;
+                }
+                source_printf(out, "    agg_init(&acc);\n");
+                *raises = 1; // An error cell in a range
+                for (int i = first; i < depth; i++) {
+                    if (!emit_argument(tr, kind, i, slots[i].is_range ? &slots[i].range : NULL)) {
+                        return 0;
+                    }
+                }
+                if (token == SUM) {
+                    source_printf(out, "    s%d = acc.sum.sum + acc.sum.compensation; t%d = K_NUMBER;\n", first, first);
+                } else if (token == AVERAGE) {
+                    emit_raise(out, ERROR_AVERAGE_EMPTY, "acc.count == 0", 0);
+                    source_printf(out, "    s%d = (acc.sum.sum + acc.sum.compensation) / acc.count; t%d = K_NUMBER;\n",
+                        first, first);
+                } else {
+                    source_printf(out, "    s%d = acc.count > 0 ? acc.%s : 0.0; t%d = K_NUMBER;\n", first,
+                        token == MIN ? "min" : "max", first);
+                }
+                slots[first].is_range = 0;
+                depth = first + 1;
+                break;
+            }
+
+            case OP_STORE_LOCAL:
+                source_printf(out, "    l%d = s%d;\n", inst->operand.slot, top);
+                break;
+
+            case OP_LOAD_LOCAL:
+                source_printf(out, "    s%d = l%d; t%d = K_NUMBER;\n", depth, inst->operand.slot, depth);
+                slots[depth++].is_range = 0;
+                break;
+
+            case OP_ADD_CELL_CELL:
+            case OP_SUB_CELL_CELL:
+            case OP_MUL_CELL_CELL: {
+                int a = slot_of(tr, inst->operand.cells.a);
+                int b = slot_of(tr, inst->operand.cells.b);
+                if (a < 0 || b < 0) {
+                    tr->reason = "a cell outside the symbol table";
+                    return 0;
+                }
+                a = add_param(tr, a);
+                b = add_param(tr, b);
+                source_printf(out, "    CHECK(cells[p[%d]]);\n    CHECK(cells[p[%d]]);\n", a, b);
+                source_printf(out, "    s%d = %s(cells[p[%d]], cells[p[%d]]); t%d = K_NUMBER;\n", depth,
+                    arithmetic(superinstruction_op(inst->opcode)), a, b, depth);
+                *raises = 1;
+                slots[depth++].is_range = 0;
+                break;
+            }
+
+            case OP_ADD_CELL_CONST:
+            case OP_MUL_CELL_CONST: {
+                int a = slot_of(tr, inst->operand.cell_const.coord);
+                if (a < 0) {
+                    tr->reason = "a cell outside the symbol table";
+                    return 0;
+                }
+                a = add_param(tr, a);
+                source_printf(out, "    CHECK(cells[p[%d]]);\n", a);
+                source_printf(out, "    s%d = %s(cells[p[%d]], ", depth, arithmetic(superinstruction_op(inst->opcode)), a);
+                *raises = 1;
+                source_number(out, inst->operand.cell_const.number);
+                source_printf(out, "); t%d = K_NUMBER;\n", depth);
+                slots[depth++].is_range = 0;
+                break;
+            }
+
+            case OP_ADD_CELL: {
+                int a = slot_of(tr, inst->operand.cell.coord);
+                if (a < 0) {
+                    tr->reason = "a cell outside the symbol table";
+                    return 0;
+                }
+                a = add_param(tr, a);
+                source_printf(out, "    CHECK(cells[p[%d]]);\n", a);
+                source_printf(out, "    s%d = add(s%d, cells[p[%d]]); t%d = K_NUMBER;\n", top, top, a, top);
+                *raises = 1;
+                break;
+            }
+
+            case OP_MUL_CONST:
+                source_printf(out, "    s%d = mul(s%d, ", top, top);
+                source_number(out, inst->operand.number);
+                source_printf(out, "); t%d = K_NUMBER;\n", top);
+                break;
+
+            case OP_NOP:
+                break;
+
+            default:
+                tr->reason = "an unknown opcode";
+                return 0;
+        }
+    }
+    if (depth > *max_depth) {
+        *max_depth = depth;
+    }
+    return 1;
+}
+
+// The definitions every generated file starts with
+static void emit_prelude(Source* out) {
+    source_printf(out,
+        "/* Generated by the spreadsheet compiler (--aot). Do not edit. */\n"
+        "#include <math.h>\n"
+        "#include <string.h>\n"
+        "\n"
+        "typedef struct { double sum; double compensation; } SimdSum;\n"
+        "typedef struct {\n"
+        "    void (*sum)(SimdSum* acc, const double* values, int n);\n"
+        "    double (*min)(const double* values, int n);\n"
+        "    double (*max)(const double* values, int n);\n"
+        "    int errors;\n"
+        "} AotRuntime;\n"
+        "typedef struct { SimdSum sum; double min; double max; int count; } Agg;\n"
+        "\n"
+        "enum { K_NUMBER = %d, K_BOOLEAN = %d, K_ERROR = %d };\n"
+        "enum { AGG_SUM, AGG_MIN, AGG_MAX };\n"
+        "#define CHUNK_ROWS %d\n"
+        "\n"
+        "static double bits(unsigned long long b) { double d; memcpy(&d, &b, sizeof(d)); return d; }\n"
+        "\n"
+        "/* Error cells, boxed in a NaN as in the cell store */\n"
+        "static inline int is_error(double x) {\n"
+        "    unsigned long long b;\n"
+        "    memcpy(&b, &x, sizeof(b));\n"
+        "    return (b & 0x%llxULL) == 0x%llxULL;\n"
+        "}\n"
+        "#define CHECK(x) if (is_error(x)) { err = (x); goto error; }\n"
+        "static int errors; /* Error cells so far: none, and no range needs a scan */\n"
+        "\n"
+        "/* + and * with the VM's operand order: with two NaNs, x86 keeps the first one,\n"
+        "   and the C compiler may swap the operands of a commutative operator */\n"
+        "#if defined(__x86_64__) && defined(__GNUC__)\n"
+        "static inline double add(double a, double b) { __asm__(\"addsd %%1, %%0\" : \"+x\"(a) : \"x\"(b)); return a; }\n"
+        "static inline double mul(double a, double b) { __asm__(\"mulsd %%1, %%0\" : \"+x\"(a) : \"x\"(b)); return a; }\n"
+        "#else\n"
+        "static inline double add(double a, double b) { return a + b; }\n"
+        "static inline double mul(double a, double b) { return a * b; }\n"
+        "#endif\n"
+        "static inline double sub(double a, double b) { return a - b; }\n"
+        "\n"
+        "/* A negation the C compiler can't move into the next operator (x / -y -> -x / y\n"
+        "   flips the sign of a NaN x) */\n"
+        "static double negate(double x) {\n"
+        "    x = -x;\n"
+        "    __asm__(\"\" : \"+m\"(x));\n"
+        "    return x;\n"
+        "}\n"
+        "\n"
+        "/* fmin()/fmax() with the VM's tie rule: of +0 and -0 the running value is kept.\n"
+        "   Which zero fmin() itself returns depends on the C compiler and its flags */\n"
+        "static inline double min2(double acc, double x) { return (x < acc || acc != acc) ? x : acc; }\n"
+        "static inline double max2(double acc, double x) { return (x > acc || acc != acc) ? x : acc; }\n"
+        "\n"
+        "static void agg_init(Agg* acc) {\n"
+        "    acc->sum.sum = 0.0;\n"
+        "    acc->sum.compensation = 0.0;\n"
+        "    acc->min = INFINITY;\n"
+        "    acc->max = -INFINITY;\n"
+        "    acc->count = 0;\n"
+        "}\n"
+        "\n"
+        "/* Folds rows row .. row + n - 1 of a column, one cell store chunk at a time (as the VM does).\n"
+        "   0 (and the error in *err) if one of them is an error cell */\n"
+        "static int fold(const AotRuntime* rt, int kind, Agg* acc, const double* values, int row, int n, double* err) {\n"
+        "    if (errors > 0) {\n"
+        "        for (int i = 0; i < n; i++) {\n"
+        "            if (is_error(values[i])) { *err = values[i]; return 0; }\n"
+        "        }\n"
+        "    }\n"
+        "    while (n > 0) {\n"
+        "        int len = CHUNK_ROWS - (row & (CHUNK_ROWS - 1));\n"
+        "        if (len > n) len = n;\n"
+        "        if (kind == AGG_SUM) rt->sum(&acc->sum, values, len);\n"
+        "        else if (kind == AGG_MIN) acc->min = min2(acc->min, rt->min(values, len));\n"
+        "        else acc->max = max2(acc->max, rt->max(values, len));\n"
+        "        acc->count += len;\n"
+        "        values += len;\n"
+        "        row += len;\n"
+        "        n -= len;\n"
+        "    }\n"
+        "    return 1;\n"
+        "}\n",
+        AOT_NUMBER, AOT_BOOLEAN, AOT_ERROR, CELLSTORE_CHUNK_ROWS,
+        (unsigned long long)CELLSTORE_ERROR_MASK, (unsigned long long)CELLSTORE_ERROR_TAG);
+}
+
+// Writes a whole file
+static int write_file(const char* path, const Source* src) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = fwrite(src->text, 1, src->length, file) == (size_t)src->length;
+    return (fclose(file) == 0) && ok;
+}
+
+// The distinct formula functions of a model, keyed by their text
+typedef struct {
+    char** texts;           // Shape i's function, from its opening brace
+    int count;
+    int capacity;
+    int* slots;             // Open addressing: shape index, -1 = empty
+    int slot_count;         // A power of two, at least twice 'count'
+} ShapeTable;
+
+static unsigned int hash_text(const char* text) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (const char* p = text; *p != '\0'; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    return h;
+}
+
+// Gets the slot of a shape: its own slot, or the empty slot where it goes
+static int find_shape(const ShapeTable* shapes, const char* text) {
+    unsigned int mask = (unsigned int)shapes->slot_count - 1;
+    unsigned int i = hash_text(text) & mask;
+    while (shapes->slots[i] >= 0 && strcmp(shapes->texts[shapes->slots[i]], text) != 0) {
+        i = (i + 1) & mask;
+    }
+    return (int)i;
+}
+
+// Gets the index of a shape, adding it if it is new ('*added' set to 1)
+static int intern_shape(ShapeTable* shapes, const char* text, int* added) {
+    if ((shapes->count + 1) * 2 > shapes->slot_count) {
+        free(shapes->slots);
+        shapes->slot_count = shapes->slot_count < 64 ? 64 : shapes->slot_count * 2;
+        shapes->slots = (int*)malloc(shapes->slot_count * sizeof(int));
+        if (shapes->slots == NULL) {
+            aot_oom();
+        }
+        memset(shapes->slots, -1, shapes->slot_count * sizeof(int));
+        for (int t = 0; t < shapes->count; t++) {
+            shapes->slots[find_shape(shapes, shapes->texts[t])] = t;
+        }
+    }
+    int slot = find_shape(shapes, text);
+    *added = (shapes->slots[slot] < 0);
+    if (*added) {
+        if (shapes->count >= shapes->capacity) {
+            shapes->capacity = shapes->capacity < 16 ? 16 : shapes->capacity * 2;
+            shapes->texts = (char**)realloc(shapes->texts, shapes->capacity * sizeof(char*));
+            if (shapes->texts == NULL) {
+                aot_oom();
+            }
+        }
+        shapes->texts[shapes->count] = strdup(text);
+        if (shapes->texts[shapes->count] == NULL) {
+            aot_oom();
+        }
+        shapes->slots[slot] = shapes->count++;
+    }
+    return shapes->slots[slot];
+}
+
+// Translates every scheduled formula into 'out': one function per
+// formula shape, and the schedule recalc() walks, calling each
+// formula's shape with that formula's cell positions. (One call per
+// formula written out would take the C compiler minutes on a large
+// sheet; a constant table takes no time.) 0 if a formula can't be
+// translated.
+static int emit_model(Workbook* wb, AotModel* model, Source* out, const char** reason) {
+    Translator tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.table = wb->symtab;
+    tr.slot_of_id = model->slot_of_id;
+    tr.slot_count = model->slot_count;
+    ShapeTable shapes;
+    memset(&shapes, 0, sizeof(shapes));
+    Source function = { NULL, 0, 0 };
+    Source calls = { NULL, 0, 0 };   // The shape of each formula, in order
+    Source offsets = { NULL, 0, 0 }; // Where its p[] starts in P
+    Source params = { NULL, 0, 0 };  // Every formula's p[], one after the other
+    int param_offset = 0;
+
+    emit_prelude(out);
+    source_printf(&calls, "%s", "");
+    source_printf(&offsets, "%s", "");
+    source_printf(&params, "%s", "");
+    int ok = 1;
+    for (int k = 0; k < wb->order_count; k++) {
+        int i = wb->order[k];
+        const FormulaCell* fc = &wb->cells[i];
+        if (fc->code == NULL) {
+            continue; // Failed to compile, keeps its error
+        }
+        int max_depth, raises;
+        if (!translate(&tr, i, fc, &max_depth, &raises)) {
+            ok = 0;
+            break;
+        }
+
+        function.length = 0;
+        source_printf(&function, "{\n");
+        for (int d = 0; d < max_depth; d++) {
+            source_printf(&function, "    double s%d; int t%d;\n", d, d);
+        }
+        for (int l = 0; l < fc->code->local_count; l++) {
+            source_printf(&function, "    double l%d = 0.0;\n", l);
+        }
+        if (raises) {
+            source_printf(&function, "    double err;\n");
+        }
+        source_printf(&function, "    Agg acc;\n%s", tr.body.text);
+        if (raises) {
+            source_printf(&function, "error:\n    cells[p[0]] = err;\n    kinds[p[1]] = K_ERROR;\n    errors++;\n");
+        }
+        source_printf(&function, "}\n");
+
+        int added;
+        int shape = intern_shape(&shapes, function.text, &added);
+        char name[CELLREF_MAX];
+        cellref_format(fc->coord, name);
+        if (added) {
+            source_printf(out, "\n/* First used by %s */\n", name);
+            source_printf(out, "static void shape%d(double* cells, unsigned char* kinds, const AotRuntime* rt, const int* p)\n%s",
+                shape, function.text);
+        }
+        source_printf(&calls, "    shape%d, /* %s */\n", shape, name);
+        source_printf(&offsets, "%d,\n", param_offset);
+        for (int q = 0; q < tr.param_count; q++) {
+            source_printf(&params, "%d,%s", tr.params[q], (q + 1 == tr.param_count) ? "\n" : "");
+        }
+        param_offset += tr.param_count;
+        model->formula_count++;
+    }
+
+    if (ok) {
+        source_printf(out, "\nstatic const int P[] = {\n%s0\n};\n", params.text);
+        source_printf(out, "\ntypedef void (*Shape)(double* cells, unsigned char* kinds, const AotRuntime* rt, const int* p);\n");
+        source_printf(out, "static const Shape F[] = {\n%s    0\n};\n", calls.text);
+        source_printf(out, "static const int O[] = {\n%s0\n};\n", offsets.text);
+        source_printf(out, "\nvoid recalc(double* cells, unsigned char* kinds, const AotRuntime* rt) {\n"
+            "    errors = rt->errors;\n"
+            "    for (int k = 0; k < %d; k++) {\n"
+            "        F[k](cells, kinds, rt, P + O[k]);\n"
+            "    }\n"
+            "}\n", model->formula_count);
+        model->shape_count = shapes.count;
+    } else {
+        *reason = tr.reason;
+    }
+    for (int t = 0; t < shapes.count; t++) {
+        free(shapes.texts[t]);
+    }
+    free(shapes.texts);
+    free(shapes.slots);
+    free(function.text);
+    free(calls.text);
+    free(offsets.text);
+    free(params.text);
+    free(tr.body.text);
+    free(tr.params);
+    free(tr.target_depth);
+    free(tr.target_state);
+    free(tr.states);
+    return ok;
+}
+
+// Compiles model.c into model.so and loads it. 0 on failure.
+static int compile_model(AotModel* model, const char** reason) {
+    const char* cc = getenv("CC");
+    if (cc == NULL || *cc == '\0') {
+        cc = "cc";
+    }
+    // The same bits as the VM: no FMA contraction, no constant-folded pow(),
+    // no rewrites that flip the sign of a NaN (x / -1 -> -x; see also negate())
+    const char* format = "%s -O2 -ffp-contract=off -fno-builtin-pow -fsignaling-nans -fPIC -shared -w -o '%s' '%s' -lm";
+    size_t size = strlen(format) + strlen(cc) + strlen(model->library_path) + strlen(model->source_path);
+    char* command = (char*)malloc(size);
+    if (command == NULL) {
+        aot_oom();
+    }
+    snprintf(command, size, format, cc, model->library_path, model->source_path);
+    int status = system(command);
+    free(command);
+    if (status != 0) {
+        *reason = "the C compiler failed";
+        return 0;
+    }
+
+    model->library = dlopen(model->library_path, RTLD_NOW | RTLD_LOCAL);
+    if (model->library == NULL) {
+        *reason = "the compiled model could not be loaded";
+        return 0;
+    }
+    model->entry = (AotEntry)dlsym(model->library, "recalc");
+    if (model->entry == NULL) {
+        *reason = "the compiled model has no recalc()";
+        return 0;
+    }
+    return 1;
+}
+
+
+/* --- Public API --- */
+
+AotModel* aot_build(Workbook* wb, const char** reason) {
+    SymbolTable* table = wb->symtab;
+    if (wb->trace) {
+        *reason = "--trace-vm traces the VM";
+        return NULL;
+    }
+
+    AotModel* model = (AotModel*)calloc(1, sizeof(AotModel));
+    if (model == NULL) {
+        aot_oom();
+    }
+
+    // 1. Lay the cells out column by column, with every cell a range
+    // reads (ranges are dependencies as a whole, so their empty cells
+    // have no entry yet)
+    for (int i = 0; i < wb->count; i++) {
+        int range_count = symtab_cell(table, wb->cells[i].cell_id)->range_count;
+        for (int k = 0; k < range_count; k++) {
+            CellRange range = symtab_cell(table, wb->cells[i].cell_id)->ranges[k];
+            for (int c = cell_col(range.start); c <= cell_col(range.end); c++) {
+                for (int r = cell_row(range.start); r <= cell_row(range.end); r++) {
+                    symtab_intern(table, cell_coord(c, r));
+                }
+            }
+        }
+    }
+    model->slot_count = table->count;
+    model->slot_of_id = (int*)malloc((table->count + 1) * sizeof(int));
+    int* ids = (int*)malloc((table->count + 1) * sizeof(int));
+    model->cells = (double*)malloc((table->count + 1) * sizeof(double));
+    model->kinds = (unsigned char*)calloc(wb->count + 1, 1);
+    if (model->slot_of_id == NULL || ids == NULL || model->cells == NULL || model->kinds == NULL) {
+        aot_oom();
+    }
+    for (int id = 0; id < table->count; id++) {
+        ids[id] = id;
+    }
+    sort_table = table;
+    qsort(ids, table->count, sizeof(int), compare_ids);
+    for (int slot = 0; slot < table->count; slot++) {
+        model->slot_of_id[ids[slot]] = slot;
+    }
+    free(ids);
+
+    // 2. Translate every scheduled formula
+    Source source = { NULL, 0, 0 };
+    if (!emit_model(wb, model, &source, reason)) {
+        free(source.text);
+        aot_free(model);
+        return NULL;
+    }
+    model->source_bytes = source.length;
+
+    // 3. Write it out, compile it, load it
+    const char* tmp = getenv("TMPDIR");
+    char* directory = join_path((tmp != NULL && *tmp != '\0') ? tmp : "/tmp", "sheet-aot-XXXXXX");
+    if (mkdtemp(directory) == NULL) {
+        free(directory);
+        free(source.text);
+        aot_free(model);
+        *reason = "no temporary directory";
+        return NULL;
+    }
+    model->directory = directory;
+    model->source_path = join_path(directory, "model.c");
+    model->library_path = join_path(directory, "model.so");
+    int written = write_file(model->source_path, &source);
+    free(source.text);
+    if (!written) {
+        aot_free(model);
+        *reason = "the generated source could not be written";
+        return NULL;
+    }
+    if (!compile_model(model, reason)) {
+        aot_free(model);
+        return NULL;
+    }
+    return model;
+}
+
+void aot_recalc(AotModel* model, Workbook* wb) {
+    SymbolTable* table = wb->symtab;
+    AotRuntime runtime = { simd_sum, simd_min, simd_max, table->grid.error_count };
+
+    // 1. The inputs (and every other cell) as they are now
+    for (int id = 0; id < model->slot_count; id++) {
+        model->cells[model->slot_of_id[id]] = cellstore_get(&table->grid, symtab_cell(table, id)->coord);
+    }
+
+    // 2. Every formula, natively
+    model->entry(model->cells, model->kinds, &runtime);
+
+    // 3. The results, as the VM would have produced them
+    for (int k = 0; k < wb->order_count; k++) {
+        int i = wb->order[k];
+        FormulaCell* fc = &wb->cells[i];
+        if (fc->code == NULL) {
+            continue;
+        }
+        double x = model->cells[model->slot_of_id[fc->cell_id]];
+        Value result;
+        switch (model->kinds[i]) {
+            case AOT_BOOLEAN: result = create_boolean_value(x != 0); break;
+            case AOT_ERROR:   result = cell_value(x); break;
+            default:          result = create_number_value(x); break;
+        }
+        workbook_store_result(wb, fc, result);
+    }
+    symtab_clear_dirty(table);
+}
+
+void aot_free(AotModel* model) {
+    if (model == NULL) return;
+    if (model->library != NULL) {
+        dlclose(model->library);
+    }
+    if (model->library_path != NULL) {
+        unlink(model->library_path);
+    }
+    if (model->source_path != NULL) {
+        unlink(model->source_path);
+    }
+    if (model->directory != NULL) {
+        rmdir(model->directory);
+    }
+    free(model->library_path);
+    free(model->source_path);
+    free(model->directory);
+    free(model->slot_of_id);
+    free(model->cells);
+    free(model->kinds);
+    free(model);
+}
@@ -0,0 +1,95 @@
+/*
+ * --- Ahead-of-Time Sheet Compiler Header ---
+ *
+ * For a model that is recalculated many times with different
+ * inputs, the whole sheet can be compiled to native code once:
+ * every scheduled formula is translated into one C translation
+ * unit, with an entry point
+ *
+ *     void recalc(double* cells, unsigned char* kinds, const AotRuntime* rt);
+ *
+ * that runs them all in topological order. The system C compiler
+ * ('cc', or $CC) builds it into a shared object that is then
+ * dlopen'd. Formulas of the same shape (as in the formula cache)
+ * share one C function, called with their own cell positions.
+ *
+ * 'cells' holds every cell of the symbol table, laid out column
+ * by column (sorted by coordinate), so each column of a range
+ * is a contiguous slice that SUM/MIN/MAX stream straight from
+ * the array. 'kinds' receives the type of each formula's result
+ * (AotKind, indexed like Workbook.cells). 'rt' supplies the SIMD
+ * kernels, so aggregates are summed exactly as on the VM. Error
+ * cells hold their error as the grid does, so the formulas that
+ * read them fail with it, as on the VM.
+ *
+ * The translation works from each cell's bytecode (not its AST),
+ * so cells compiled through the formula cache are covered too.
+ * A sheet using anything it can't translate (e.g., NOT of a
+ * range) is left to the VM, and so is a failed C compile.
+ */
+
+#ifndef AOT_H
+#define AOT_H
+
+#include "workbook.h"
+#include "simd.h" // For SimdSum
+
+// The type of a formula's result, as recalc() reports it
+typedef enum {
+    AOT_NUMBER,
+    AOT_BOOLEAN,
+    AOT_ERROR           // The cell holds the error, as the grid stores it (cellstore.h)
+} AotKind;
+
+// What the generated code calls back into (same layout in the prelude)
+typedef struct {
+    void (*sum)(SimdSum* acc, const double* values, int n);
+    double (*min)(const double* values, int n);
+    double (*max)(const double* values, int n);
+    int errors;         // Error cells in 'cells' when recalc() starts
+} AotRuntime;
+
+typedef void (*AotEntry)(double* cells, unsigned char* kinds, const AotRuntime* rt);
+
+typedef struct {
+    void* library;          // The dlopen handle
+    AotEntry entry;         // Its recalc()
+    char* directory;        // Temporary directory holding the files below
+    char* source_path;      // model.c
+    char* library_path;     // model.so
+    long source_bytes;
+
+    int* slot_of_id;        // Position of each symbol table id in 'cells'
+    int slot_count;         // Ids known when the model was built
+    double* cells;
+    unsigned char* kinds;   // One per formula cell
+    int formula_count;      // Formulas translated (the scheduled, compiled ones)
+    int shape_count;        // Distinct C functions they share
+} AotModel;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Translates every scheduled formula of a compiled and
+ * scheduled workbook to C, compiles it and loads the result.
+ * @param reason Set to why no model was built, when NULL is returned.
+ * @return The model, or NULL if the sheet uses something the
+ * translator does not support or the C compiler failed.
+ */
+AotModel* aot_build(Workbook* wb, const char** reason);
+
+/**
+ * @brief Recalculates every scheduled formula with the native
+ * model, from the current values in the symbol table, and stores
+ * the results as workbook_recalc() does (then clears dirty marks).
+ */
+void aot_recalc(AotModel* model, Workbook* wb);
+
+/**
+ * @brief Unloads the model and removes its temporary files.
+ */
+void aot_free(AotModel* model);
+
+
+#endif // AOT_H
@@ -0,0 +1,70 @@
+/*
+ * --- Arena Allocator Implementation ---
+ *
+ * Chunks are kept newest first. The oldest chunk is always a
+ * regular ARENA_CHUNK_SIZE one (unless the very first request
+ * was bigger), and it is the one arena_reset() keeps.
+ */
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* arena_alloc_slow(Arena* arena, size_t size) {
+    size_t chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + chunk_size);
+    if (chunk == NULL) {
+        fprintf(stderr, "Fatal: Out of memory growing arena\n");
+        exit(1);
+    }
+    chunk->size = chunk_size;
+    chunk->used = size;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->chunk_count++;
+    arena->bytes += size;
+    return chunk->data;
+}
+
+char* arena_strndup(Arena* arena, const char* text, size_t len) {
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(Arena* arena, const char* text) {
+    return arena_strndup(arena, text, strlen(text));
+}
+
+void arena_reset(Arena* arena) {
+    if (arena->bytes > arena->peak_bytes) {
+        arena->peak_bytes = arena->bytes;
+    }
+    arena->bytes = 0;
+    if (arena->head == NULL) {
+        return;
+    }
+    // Free all but the oldest chunk
+    while (arena->head->next != NULL) {
+        ArenaChunk* next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+        arena->chunk_count--;
+    }
+    arena->head->used = 0;
+}
+
+void arena_release(Arena* arena) {
+    if (arena->bytes > arena->peak_bytes) {
+        arena->peak_bytes = arena->bytes;
+    }
+    while (arena->head != NULL) {
+        ArenaChunk* next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->chunk_count = 0;
+    arena->bytes = 0;
+}
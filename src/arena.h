@@ -0,0 +1,83 @@
+/*
+ * --- Arena Allocator Header ---
+ *
+ * A bump allocator for data that dies all at once: the AST
+ * nodes and token strings of the formulas being compiled.
+ * Memory comes from a list of large chunks; an allocation
+ * only moves a pointer, and nothing is freed one by one.
+ * arena_reset() rewinds the arena for the next formula
+ * (keeping its first chunk), arena_release() returns every
+ * chunk. Both take O(chunks).
+ *
+ * A zero-initialized Arena is ready to use. Not thread-safe.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024) // Bytes per chunk (bigger requests get their own)
+#define ARENA_ALIGN 16               // Every allocation is aligned to this
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next; // The chunk allocated before this one
+    size_t size;             // Usable bytes in 'data'
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk* head;   // Current chunk; older ones follow 'next'
+    int chunk_count;
+    size_t peak_bytes;  // Most bytes handed out between two resets
+    size_t bytes;       // Bytes handed out since the last reset
+} Arena;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Adds a chunk of at least 'size' bytes and allocates from it.
+ * Called by arena_alloc() when the current chunk is full.
+ */
+void* arena_alloc_slow(Arena* arena, size_t size);
+
+/**
+ * @brief Allocates 'size' bytes (not zeroed). Exits on out of memory.
+ */
+static inline void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaChunk* chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        return arena_alloc_slow(arena, size);
+    }
+    void* p = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->bytes += size;
+    return p;
+}
+
+/**
+ * @brief Copies the first 'len' characters of 'text' into the arena.
+ */
+char* arena_strndup(Arena* arena, const char* text, size_t len);
+
+/**
+ * @brief Copies a string into the arena.
+ */
+char* arena_strdup(Arena* arena, const char* text);
+
+/**
+ * @brief Frees every allocation at once, keeping the first chunk
+ * for reuse, so an arena rewound per formula stops calling malloc.
+ */
+void arena_reset(Arena* arena);
+
+/**
+ * @brief Frees every chunk. The arena can be used again afterwards.
+ */
+void arena_release(Arena* arena);
+
+
+#endif // ARENA_H
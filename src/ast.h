@@ -8,6 +8,10 @@
  * 1. Added 'line' member to ASTNode.
  * 2. Updated all constructors to accept 'line'.
  * 3. Added 'g_node_count' to count all created nodes.
+ *
+ * Nodes (and the strings they hold) live in 'ast_arena', so
+ * a tree is never freed node by node: free_all_asts() drops
+ * every tree built since it was last called.
  */
 #ifndef AST_H
 #define AST_H
@@ -15,10 +19,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "cellref.h" // For CellCoord
+#include "arena.h"
 
 // Connect to global counter in parser.y
 extern int g_node_count;
 
+// Every node and token string of the formulas being compiled (parser.y)
+extern Arena ast_arena;
+
 /* --- Node Type Enum --- */
 typedef enum {
     NODE_NUMBER,
@@ -39,7 +48,9 @@ typedef struct ASTNode {
 
     union {
         double number;
-        char* str_value; // For STRING, CELL_REF, RANGE
+        CellCoord cell;  // For CELL_REF (decoded by the lexer)
+        CellRange range; // For RANGE (decoded by the lexer)
+        char* str_value; // For STRING (in ast_arena)
 
         struct {
             int op_token; // e.g., PLUS, MINUS, NOT
@@ -66,12 +77,8 @@ static inline ASTNode* create_node(NodeType type, int line) {
     // FIX: Increment global node counter
     g_node_count++;
     
-    // Use calloc to zero-initialize
-    ASTNode* node = (ASTNode*)calloc(1, sizeof(ASTNode));
-    if (node == NULL) {
-        fprintf(stderr, "Fatal: Out of memory\n");
-        exit(1);
-    }
+    ASTNode* node = (ASTNode*)arena_alloc(&ast_arena, sizeof(ASTNode));
+    memset(node, 0, sizeof(ASTNode));
     node->type = type;
     node->line = line;
     return node;
@@ -92,15 +99,15 @@ static inline ASTNode* create_string_node(char* value, int line) {
     return node;
 }
 
-static inline ASTNode* create_cell_ref_node(char* cell_ref, int line) {
+static inline ASTNode* create_cell_ref_node(CellCoord cell, int line) {
     ASTNode* node = create_node(NODE_CELL_REF, line);
-    node->data.str_value = cell_ref;
+    node->data.cell = cell;
     return node;
 }
 
-static inline ASTNode* create_range_node(char* range_str, int line) {
+static inline ASTNode* create_range_node(CellRange range, int line) {
     ASTNode* node = create_node(NODE_RANGE, line);
-    node->data.str_value = range_str;
+    node->data.range = range;
     return node;
 }
 
@@ -137,40 +144,14 @@ static inline ASTNode* create_arg_list_node(ASTNode* expr, ASTNode* next, int li
 
 /* --- Utility Functions --- */
 
-static inline void free_ast(ASTNode* node) {
-    if (node == NULL) {
-        return;
-    }
-
-    switch (node->type) {
-        case NODE_UNARY_OP:
-            free_ast(node->data.op.left);
-            break;
-        case NODE_BINARY_OP:
-            free_ast(node->data.op.left);
-            free_ast(node->data.op.right);
-            break;
-        case NODE_FUNCTION_CALL:
-            free_ast(node->data.func.arguments);
-            break;
-        case NODE_ARG_LIST:
-            free_ast(node->data.arg.expression);
-            free_ast(node->data.arg.next_arg);
-            break;
-        
-        case NODE_STRING:
-        case NODE_CELL_REF:
-        case NODE_RANGE:
-            free(node->data.str_value); // Free the string copied by strdup()
-            break;
-
-        case NODE_NUMBER:
-            // No dynamic data
-            break;
-    }
-    
-    // Free the node itself
-    free(node);
+/**
+ * @brief Frees every tree in ast_arena at once, in O(chunks),
+ * keeping one chunk for the next formula. Trees are never freed
+ * node by node, so call this once the formulas compiled since the
+ * last call no longer need theirs.
+ */
+static inline void free_all_asts(void) {
+    arena_reset(&ast_arena);
 }
 
 #endif // AST_H
@@ -48,6 +48,8 @@ void print_ast(ASTNode* node, PrintFormat format) {
  */
 static void print_ast_tree(ASTNode* node, const char* prefix, int is_last) {
     if (node == NULL) return;
+    char name[CELLREF_MAX]; // For CELL_REF
+    char range[CELLRANGE_MAX]; // For RANGE
 
     // Print the prefix and the connector (├── or └──)
     printf("%s", prefix);
@@ -62,10 +64,10 @@ static void print_ast_tree(ASTNode* node, const char* prefix, int is_last) {
             printf("STRING (\"%s\")\n", node->data.str_value);
             break;
         case NODE_CELL_REF:
-            printf("CELL_REF (%s)\n", node->data.str_value);
+            printf("CELL_REF (%s)\n", cellref_format(node->data.cell, name));
             break;
         case NODE_RANGE:
-            printf("RANGE (%s)\n", node->data.str_value);
+            printf("RANGE (%s)\n", cellrange_format(node->data.range, range));
             break;
         case NODE_UNARY_OP:
             printf("UNARY_OP (%s)\n", node->data.op.op_token == MINUS ? "-" : "NOT");
@@ -140,6 +142,8 @@ static void print_ast_dot(ASTNode* node) {
     if (node == NULL) return;
 
     long id = get_node_id(node);
+    char name[CELLREF_MAX]; // For CELL_REF
+    char range[CELLRANGE_MAX]; // For RANGE
 
     // 1. Define the current node
     switch (node->type) {
@@ -150,10 +154,10 @@ static void print_ast_dot(ASTNode* node) {
             printf("  node%ld [label=\"STRING\\n(\\\"%s\\\")\"];\n", id, node->data.str_value);
             break;
         case NODE_CELL_REF:
-            printf("  node%ld [label=\"CELL_REF\\n(%s)\"];\n", id, node->data.str_value);
+            printf("  node%ld [label=\"CELL_REF\\n(%s)\"];\n", id, cellref_format(node->data.cell, name));
             break;
         case NODE_RANGE:
-            printf("  node%ld [label=\"RANGE\\n(%s)\"];\n", id, node->data.str_value);
+            printf("  node%ld [label=\"RANGE\\n(%s)\"];\n", id, cellrange_format(node->data.range, range));
             break;
         case NODE_UNARY_OP:
             printf("  node%ld [label=\"UNARY_OP\\n(%s)\"];\n", id, node->data.op.op_token == MINUS ? "-" : "NOT");
@@ -271,6 +275,8 @@ static void print_ast_lisp(ASTNode* node) {
         printf("NIL");
         return;
     }
+    char name[CELLREF_MAX]; // For CELL_REF
+    char range[CELLRANGE_MAX]; // For RANGE
 
     switch (node->type) {
         case NODE_NUMBER:
@@ -280,10 +286,10 @@ static void print_ast_lisp(ASTNode* node) {
             printf("\"%s\"", node->data.str_value);
             break;
         case NODE_CELL_REF:
-            printf("(CELL_REF %s)", node->data.str_value);
+            printf("(CELL_REF %s)", cellref_format(node->data.cell, name));
             break;
         case NODE_RANGE:
-            printf("(RANGE %s)", node->data.str_value);
+            printf("(RANGE %s)", cellrange_format(node->data.range, range));
             break;
         case NODE_UNARY_OP:
             printf("(%s ", get_op_symbol(node->data.op.op_token));
@@ -0,0 +1,155 @@
+/*
+ * --- Cell Reference Header ---
+ *
+ * Cell references (e.g., "B12") are decoded once, by the
+ * lexer, into a packed integer coordinate, and ranges
+ * (e.g., "A1:B10") into a pair of coordinates. Everything
+ * after the lexer (AST, symbol table, bytecode, VM) works on
+ * coordinates; the text form is only rebuilt for printing.
+ */
+
+#ifndef CELLREF_H
+#define CELLREF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* --- Packed Coordinate --- */
+
+// (column << 32) | row, both 0-based: "A1" is column 0, row 0
+typedef uint64_t CellCoord;
+
+#define CELL_COORD_INVALID ((CellCoord)-1)
+#define CELLREF_MAX 16 // Buffer size for cellref_format()
+
+// Sheet limits (as in Excel): columns A..XFD, rows 1..1048576
+#define CELLREF_MAX_COLS 16384
+#define CELLREF_MAX_ROWS 1048576
+#define CELLREF_MAX_LETTERS 3
+#define CELLRANGE_MAX (2 * CELLREF_MAX) // Buffer size for cellrange_format()
+
+static inline CellCoord cell_coord(int col, int row) {
+    return ((CellCoord)(uint32_t)col << 32) | (uint32_t)row;
+}
+
+static inline int cell_col(CellCoord coord) {
+    return (int)(coord >> 32);
+}
+
+static inline int cell_row(CellCoord coord) {
+    return (int)(coord & 0xFFFFFFFFu);
+}
+
+/*
+ * A rectangular range, corners as written (e.g., A1:B10).
+ * Semantic analysis rejects ranges whose start is not the
+ * top-left corner, so later phases can rely on start <= end.
+ */
+typedef struct {
+    CellCoord start;
+    CellCoord end;
+} CellRange;
+
+
+/* --- Decoding / Printing --- */
+
+/**
+ * @brief Decodes a reference like "B12" or "XFD1048576" at the
+ * start of 'text'. Columns are bijective base 26 (A=1 .. Z=26,
+ * AA=27 ...), decoded with integer arithmetic only.
+ * @return The number of characters consumed, or 0 if 'text' does
+ * not start with a valid reference inside the sheet limits.
+ */
+static inline int cellref_decode(const char* text, CellCoord* out) {
+    int i = 0;
+    int col = 0;
+    while (text[i] >= 'A' && text[i] <= 'Z') {
+        if (i == CELLREF_MAX_LETTERS) {
+            return 0; // Past XFD
+        }
+        col = col * 26 + (text[i] - 'A' + 1);
+        i++;
+    }
+    int letters = i;
+    if (letters == 0 || col > CELLREF_MAX_COLS) {
+        return 0;
+    }
+
+    int row = 0;
+    while (text[i] >= '0' && text[i] <= '9') {
+        row = row * 10 + (text[i] - '0');
+        if (row > CELLREF_MAX_ROWS) {
+            return 0; // Also stops overflow
+        }
+        i++;
+    }
+    if (i == letters || row == 0) {
+        return 0; // No row digits, or row 0
+    }
+
+    *out = cell_coord(col - 1, row - 1);
+    return i;
+}
+
+/**
+ * @brief Decodes a whole string (e.g., "B12").
+ * @return The coordinate, or CELL_COORD_INVALID.
+ */
+static inline CellCoord cellref_from_string(const char* text) {
+    CellCoord coord;
+    int n = cellref_decode(text, &coord);
+    return (n > 0 && text[n] == '\0') ? coord : CELL_COORD_INVALID;
+}
+
+/**
+ * @brief Writes the text form of a coordinate (e.g., "B12") into
+ * 'buf' (at least CELLREF_MAX bytes) and returns 'buf'.
+ */
+static inline char* cellref_format(CellCoord coord, char* buf) {
+    // Column letters, least significant first, then reversed
+    char letters[8];
+    int n = 0;
+    for (int col = cell_col(coord) + 1; col > 0 && n < 7; col = (col - 1) / 26) {
+        letters[n++] = (char)('A' + (col - 1) % 26);
+    }
+    for (int k = 0; k < n; k++) {
+        buf[k] = letters[n - 1 - k];
+    }
+    snprintf(buf + n, CELLREF_MAX - n, "%d", cell_row(coord) + 1);
+    return buf;
+}
+
+/**
+ * @brief Decodes a whole range string (e.g., "A1:B10").
+ * @return The range; both corners are CELL_COORD_INVALID if
+ * 'text' is not a valid range.
+ */
+static inline CellRange cellrange_from_string(const char* text) {
+    CellRange range = { CELL_COORD_INVALID, CELL_COORD_INVALID };
+    CellCoord start, end;
+    int n = cellref_decode(text, &start);
+    if (n == 0 || text[n] != ':') {
+        return range;
+    }
+    int m = cellref_decode(text + n + 1, &end);
+    if (m == 0 || text[n + 1 + m] != '\0') {
+        return range;
+    }
+    range.start = start;
+    range.end = end;
+    return range;
+}
+
+/**
+ * @brief Writes the text form of a range (e.g., "A1:B10") into
+ * 'buf' (at least CELLRANGE_MAX bytes) and returns 'buf'.
+ */
+static inline char* cellrange_format(CellRange range, char* buf) {
+    char start[CELLREF_MAX];
+    char end[CELLREF_MAX];
+    snprintf(buf, CELLRANGE_MAX, "%s:%s", cellref_format(range.start, start), cellref_format(range.end, end));
+    return buf;
+}
+
+
+#endif // CELLREF_H
@@ -0,0 +1,110 @@
+/*
+ * --- Columnar Cell Store Implementation ---
+ *
+ * Allocation and growth of the column directories and
+ * row chunks. Reads are inline in cellstore.h.
+ */
+
+#include "cellstore.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* --- Private Helpers --- */
+
+// Grows an array of 'elem_size' items to hold at least 'needed' items,
+// zeroing the new ones
+static void* grow_zeroed(void* array, int* count, int needed, size_t elem_size) {
+    int new_count = *count < 4 ? 4 : *count * 2;
+    if (new_count < needed) {
+        new_count = needed;
+    }
+    array = realloc(array, new_count * elem_size);
+    if (array == NULL) {
+        fprintf(stderr, "Fatal: Out of memory growing cell store\n");
+        exit(1);
+    }
+    memset((char*)array + *count * elem_size, 0, (new_count - *count) * elem_size);
+    *count = new_count;
+    return array;
+}
+
+
+/* --- Public API --- */
+
+void cellstore_init(CellStore* store) {
+    store->columns = NULL;
+    store->column_count = 0;
+    store->chunks_allocated = 0;
+    store->error_count = 0;
+}
+
+void cellstore_free(CellStore* store) {
+    for (int c = 0; c < store->column_count; c++) {
+        CellColumn* column = &store->columns[c];
+        for (int k = 0; k < column->chunk_count; k++) {
+            free(column->chunks[k]);
+        }
+        free(column->chunks);
+    }
+    free(store->columns);
+    cellstore_init(store);
+}
+
+CellChunk* cellstore_chunk_for_write(CellStore* store, CellCoord coord) {
+    int col = cell_col(coord);
+    int chunk = (int)((unsigned int)cell_row(coord) >> CELLSTORE_CHUNK_BITS);
+
+    if (col >= store->column_count) {
+        store->columns = (CellColumn*)grow_zeroed(store->columns, &store->column_count,
+                                                  col + 1, sizeof(CellColumn));
+    }
+    CellColumn* column = &store->columns[col];
+    if (chunk >= column->chunk_count) {
+        column->chunks = (CellChunk**)grow_zeroed(column->chunks, &column->chunk_count,
+                                                  chunk + 1, sizeof(CellChunk*));
+    }
+
+    if (column->chunks[chunk] == NULL) {
+        // New chunk: all rows empty
+        CellChunk* fresh = (CellChunk*)malloc(sizeof(CellChunk));
+        if (fresh == NULL) {
+            fprintf(stderr, "Fatal: Out of memory allocating cell chunk\n");
+            exit(1);
+        }
+        for (int r = 0; r < CELLSTORE_CHUNK_ROWS; r++) {
+            fresh->values[r] = 0.0;
+            fresh->ids[r] = -1;
+        }
+        fresh->errors = 0;
+        column->chunks[chunk] = fresh;
+        store->chunks_allocated++;
+    }
+    return column->chunks[chunk];
+}
+
+int cellstore_find_error(const CellStore* store, CellRange range, double* error) {
+    if (__atomic_load_n(&store->error_count, __ATOMIC_RELAXED) == 0) {
+        return 0; // The common case: no error anywhere
+    }
+    int row_start = cell_row(range.start);
+    int row_end = cell_row(range.end);
+    for (int c = cell_col(range.start); c <= cell_col(range.end); c++) {
+        int r = row_start;
+        while (r <= row_end) {
+            int len;
+            const double* values = cellstore_run(store, cell_coord(c, r), row_end - r + 1, &len);
+            CellChunk* chunk = cellstore_chunk(store, cell_coord(c, r));
+            if (values != NULL && __atomic_load_n(&chunk->errors, __ATOMIC_RELAXED) > 0) {
+                for (int i = 0; i < len; i++) {
+                    if (cellstore_is_error(values[i])) {
+                        *error = values[i];
+                        return 1;
+                    }
+                }
+            }
+            r += len;
+        }
+    }
+    return 0;
+}
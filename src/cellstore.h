@@ -0,0 +1,187 @@
+/*
+ * --- Columnar Cell Store Header ---
+ *
+ * A grid-shaped store for cell values. Each column is an
+ * array of fixed-size row chunks; each chunk holds the
+ * values of CELLSTORE_CHUNK_ROWS consecutive rows in one
+ * contiguous 'double' array, plus the id of each cell's
+ * metadata entry in the symbol table.
+ *
+ * Chunks are only allocated when a cell in them is written,
+ * so a huge, mostly empty sheet costs one NULL pointer per
+ * empty chunk. Every read is O(1): column, chunk, offset.
+ * Empty cells read as 0.0 with id -1.
+ *
+ * A cell whose formula failed holds its error as a NaN with
+ * the error code in the payload. Chunks count their error
+ * cells, so a range with none is cleared without a scan.
+ */
+
+#ifndef CELLSTORE_H
+#define CELLSTORE_H
+
+#include <string.h>  // For memcpy
+#include "cellref.h" // For CellCoord
+
+#define CELLSTORE_CHUNK_BITS 10
+#define CELLSTORE_CHUNK_ROWS (1 << CELLSTORE_CHUNK_BITS) // Rows per chunk
+
+// An error cell: a quiet NaN tagged in bits 48-50, with the code in
+// the low bits. Operations only produce this NaN from an operand that
+// already is one (a new NaN has no payload), so no number computed
+// from numbers ever reads as an error.
+#define CELLSTORE_ERROR_TAG  0x7FFF000000000000ULL
+#define CELLSTORE_ERROR_MASK 0xFFFF000000000000ULL
+
+/*
+ * CELLSTORE_CHUNK_ROWS consecutive rows of one column.
+ */
+typedef struct {
+    double values[CELLSTORE_CHUNK_ROWS]; // Cell values, 0.0 if empty
+    int ids[CELLSTORE_CHUNK_ROWS];       // Symbol table ids, -1 if empty
+    int errors;                          // Cells holding an error
+} CellChunk;
+
+/*
+ * One column: a directory of chunks, NULL where all rows are empty.
+ */
+typedef struct {
+    CellChunk** chunks;
+    int chunk_count;    // Size of the directory
+} CellColumn;
+
+/*
+ * The whole grid, indexed by column.
+ */
+typedef struct {
+    CellColumn* columns;
+    int column_count;
+    int chunks_allocated; // For statistics
+    int error_count;      // Cells holding an error, in every chunk
+} CellStore;
+
+
+/* --- Error Cells --- */
+
+/**
+ * @brief Gets the stored form of an error code.
+ */
+static inline double cellstore_error(int code) {
+    unsigned long long bits = CELLSTORE_ERROR_TAG | (unsigned int)code;
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+/**
+ * @brief Checks whether a stored value is an error.
+ */
+static inline int cellstore_is_error(double x) {
+    unsigned long long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits & CELLSTORE_ERROR_MASK) == CELLSTORE_ERROR_TAG;
+}
+
+/**
+ * @brief Gets the code of a stored error.
+ */
+static inline int cellstore_error_code(double x) {
+    unsigned long long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (int)(bits & ~CELLSTORE_ERROR_MASK);
+}
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Initializes an empty store.
+ */
+void cellstore_init(CellStore* store);
+
+/**
+ * @brief Frees every chunk of the store.
+ */
+void cellstore_free(CellStore* store);
+
+/**
+ * @brief Gets the chunk holding 'coord', or NULL if it was never written.
+ */
+static inline CellChunk* cellstore_chunk(const CellStore* store, CellCoord coord) {
+    unsigned int col = (unsigned int)cell_col(coord);
+    unsigned int chunk = (unsigned int)cell_row(coord) >> CELLSTORE_CHUNK_BITS;
+    if (col >= (unsigned int)store->column_count ||
+        chunk >= (unsigned int)store->columns[col].chunk_count) {
+        return NULL;
+    }
+    return store->columns[col].chunks[chunk];
+}
+
+/**
+ * @brief Gets the value at 'coord' (0.0 for an empty cell).
+ */
+static inline double cellstore_get(const CellStore* store, CellCoord coord) {
+    CellChunk* chunk = cellstore_chunk(store, coord);
+    return chunk ? chunk->values[cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1)] : 0.0;
+}
+
+/**
+ * @brief Gets the symbol table id at 'coord', or -1 for an empty cell.
+ */
+static inline int cellstore_id(const CellStore* store, CellCoord coord) {
+    CellChunk* chunk = cellstore_chunk(store, coord);
+    return chunk ? chunk->ids[cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1)] : -1;
+}
+
+/**
+ * @brief Gets the contiguous run of values that starts at 'coord':
+ * at most 'max_rows' rows down its column, never crossing a chunk.
+ * Range aggregates stream through a column one run at a time.
+ * @param len Set to the number of rows in the run.
+ * @return The values, or NULL if the run is in an empty chunk (all 0.0).
+ */
+static inline const double* cellstore_run(const CellStore* store, CellCoord coord, int max_rows, int* len) {
+    int offset = cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1);
+    int available = CELLSTORE_CHUNK_ROWS - offset;
+    *len = available < max_rows ? available : max_rows;
+    CellChunk* chunk = cellstore_chunk(store, coord);
+    return chunk ? chunk->values + offset : NULL;
+}
+
+/**
+ * @brief Gets the chunk holding 'coord', allocating it (and growing
+ * the column directory) if needed.
+ */
+CellChunk* cellstore_chunk_for_write(CellStore* store, CellCoord coord);
+
+/**
+ * @brief Sets the value at 'coord'.
+ */
+static inline void cellstore_set(CellStore* store, CellCoord coord, double value) {
+    CellChunk* chunk = cellstore_chunk_for_write(store, coord);
+    double* slot = &chunk->values[cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1)];
+    int change = cellstore_is_error(value) - cellstore_is_error(*slot);
+    if (change != 0) {
+        // Parallel recalculation writes cells of one chunk from several threads
+        __atomic_add_fetch(&chunk->errors, change, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&store->error_count, change, __ATOMIC_RELAXED);
+    }
+    *slot = value;
+}
+
+/**
+ * @brief Finds the first error cell of a range, column by column.
+ * @param error Set to the stored error, if one is found.
+ * @return 1 if the range holds an error, 0 if not.
+ */
+int cellstore_find_error(const CellStore* store, CellRange range, double* error);
+
+/**
+ * @brief Sets the symbol table id at 'coord'.
+ */
+static inline void cellstore_set_id(CellStore* store, CellCoord coord, int id) {
+    cellstore_chunk_for_write(store, coord)->ids[cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1)] = id;
+}
+
+
+#endif // CELLSTORE_H
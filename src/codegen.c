@@ -15,17 +15,335 @@
 #include "codegen.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "parser.tab.h" // For token enums (PLUS, MINUS, etc.)
 
+
+/*
+ * --- Common Subexpressions ---
+ *
+ * Hash-consing: every subtree gets the id of its shape, so two
+ * copies of "SUM(A1:A500)" share an id however far apart they
+ * are. A shape used more than once that always yields a number
+ * is given a local slot: its first copy is computed as usual and
+ * then stored, the later ones just load it.
+ *
+ * A stored value can only be loaded where the store is sure to
+ * have run. Inside an IF branch, stores are forgotten when the
+ * branch ends; the condition always runs, so its stores are kept.
+ */
+
+// One distinct subtree shape
+typedef struct {
+    const ASTNode* node; // The first subtree with this shape
+    unsigned int hash;
+    int left, right;     // Shape ids of the children, -1 if none
+    int uses;            // Copies, not counting those inside a repeated larger shape
+    int slot;            // Local slot, -1 if computed every time
+} Shape;
+
+typedef struct {
+    Shape* shapes;       // One per distinct shape (at most one per node)
+    int count;
+    int* by_hash;        // Open addressing: shape id, -1 = empty
+    int hash_size;
+    const ASTNode** nodes; // Open addressing: node -> shape id in 'ids'
+    int* ids;
+    int node_size;
+    char* available;     // Per shape: stored on every path to here
+} CseTable;
+
+// State of one generate_code() call
+typedef struct {
+    SymbolTable* table;
+    CseTable* cse; // NULL: no sharing
+} Codegen;
+
+static void cse_oom(void) {
+    fprintf(stderr, "Fatal: Out of memory in code generator\n");
+    exit(1);
+}
+
+static unsigned int hash_mix(unsigned int h, unsigned int v) {
+    return (h ^ v) * 16777619u;
+}
+
+static unsigned int hash_bytes(unsigned int h, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h = hash_mix(h, bytes[i]);
+    }
+    return h;
+}
+
+static unsigned int hash_node_pointer(const CseTable* cse, const ASTNode* node) {
+    return (unsigned int)(((size_t)node >> 4) * 2654435761u) & (cse->node_size - 1);
+}
+
+// Shape id of an already numbered node
+static int cse_node_id(const CseTable* cse, const ASTNode* node) {
+    unsigned int i = hash_node_pointer(cse, node);
+    while (cse->nodes[i] != node) {
+        i = (i + 1) & (cse->node_size - 1);
+    }
+    return cse->ids[i];
+}
+
+static void cse_set_node_id(CseTable* cse, const ASTNode* node, int id) {
+    unsigned int i = hash_node_pointer(cse, node);
+    while (cse->nodes[i] != NULL) {
+        i = (i + 1) & (cse->node_size - 1);
+    }
+    cse->nodes[i] = node;
+    cse->ids[i] = id;
+}
+
+// 1 if two nodes whose children have the same shapes have the same shape
+static int same_payload(const ASTNode* a, const ASTNode* b) {
+    if (a->type != b->type) {
+        return 0;
+    }
+    switch (a->type) {
+        case NODE_NUMBER:        return memcmp(&a->data.number, &b->data.number, sizeof(double)) == 0;
+        case NODE_STRING:        return a == b; // Never shared
+        case NODE_CELL_REF:      return a->data.cell == b->data.cell;
+        case NODE_RANGE:         return a->data.range.start == b->data.range.start &&
+                                        a->data.range.end == b->data.range.end;
+        case NODE_UNARY_OP:
+        case NODE_BINARY_OP:     return a->data.op.op_token == b->data.op.op_token;
+        case NODE_FUNCTION_CALL: return a->data.func.function_token == b->data.func.function_token;
+        default:                 return 1; // NODE_ARG_LIST
+    }
+}
+
+// Numbers a subtree bottom-up. Returns its shape id.
+static int cse_number(CseTable* cse, const ASTNode* node) {
+    if (node == NULL) {
+        return -1;
+    }
+    int left = -1, right = -1;
+    unsigned int h = hash_mix(2166136261u, node->type);
+    switch (node->type) {
+        case NODE_NUMBER:   h = hash_bytes(h, &node->data.number, sizeof(double)); break;
+        case NODE_STRING:   h = hash_bytes(h, &node, sizeof(node)); break;
+        case NODE_CELL_REF: h = hash_bytes(h, &node->data.cell, sizeof(CellCoord)); break;
+        case NODE_RANGE:
+            h = hash_bytes(h, &node->data.range.start, sizeof(CellCoord));
+            h = hash_bytes(h, &node->data.range.end, sizeof(CellCoord));
+            break;
+        case NODE_UNARY_OP:
+        case NODE_BINARY_OP:
+            h = hash_mix(h, node->data.op.op_token);
+            left = cse_number(cse, node->data.op.left);
+            right = cse_number(cse, node->data.op.right);
+            break;
+        case NODE_FUNCTION_CALL:
+            h = hash_mix(h, node->data.func.function_token);
+            left = cse_number(cse, node->data.func.arguments);
+            break;
+        case NODE_ARG_LIST:
+            left = cse_number(cse, node->data.arg.expression);
+            right = cse_number(cse, node->data.arg.next_arg);
+            break;
+    }
+    h = hash_mix(hash_mix(h, (unsigned int)left), (unsigned int)right);
+
+    // Find the shape, or add it
+    unsigned int i = h & (cse->hash_size - 1);
+    int id;
+    for (;;) {
+        id = cse->by_hash[i];
+        if (id < 0) {
+            break;
+        }
+        const Shape* shape = &cse->shapes[id];
+        if (shape->hash == h && shape->left == left && shape->right == right &&
+            same_payload(shape->node, node)) {
+            break;
+        }
+        i = (i + 1) & (cse->hash_size - 1);
+    }
+    if (id < 0) {
+        id = cse->count++;
+        Shape* shape = &cse->shapes[id];
+        shape->node = node;
+        shape->hash = h;
+        shape->left = left;
+        shape->right = right;
+        shape->uses = 0;
+        shape->slot = -1;
+        cse->by_hash[i] = id;
+    }
+    cse_set_node_id(cse, node, id);
+    return id;
+}
+
+// Counts copies in evaluation order; the insides of a repeated copy are not counted again
+static void cse_count_uses(CseTable* cse, const ASTNode* node) {
+    if (node == NULL) {
+        return;
+    }
+    Shape* shape = &cse->shapes[cse_node_id(cse, node)];
+    if (shape->uses++ > 0 && node->type != NODE_ARG_LIST) {
+        return;
+    }
+    switch (node->type) {
+        case NODE_UNARY_OP:
+        case NODE_BINARY_OP:
+            cse_count_uses(cse, node->data.op.left);
+            cse_count_uses(cse, node->data.op.right);
+            break;
+        case NODE_FUNCTION_CALL:
+            cse_count_uses(cse, node->data.func.arguments);
+            break;
+        case NODE_ARG_LIST:
+            cse_count_uses(cse, node->data.arg.expression);
+            cse_count_uses(cse, node->data.arg.next_arg);
+            break;
+        default:
+            break;
+    }
+}
+
+static int count_nodes(const ASTNode* node) {
+    if (node == NULL) {
+        return 0;
+    }
+    switch (node->type) {
+        case NODE_UNARY_OP:
+        case NODE_BINARY_OP:
+            return 1 + count_nodes(node->data.op.left) + count_nodes(node->data.op.right);
+        case NODE_FUNCTION_CALL:
+            return 1 + count_nodes(node->data.func.arguments);
+        case NODE_ARG_LIST:
+            return 1 + count_nodes(node->data.arg.expression) + count_nodes(node->data.arg.next_arg);
+        default:
+            return 1;
+    }
+}
+
+// Numbers the tree and gives a slot to every repeated numeric shape
+static CseTable* cse_build(const ASTNode* root, int* shared) {
+    int n = count_nodes(root);
+    CseTable* cse = (CseTable*)calloc(1, sizeof(CseTable));
+    if (cse == NULL) {
+        cse_oom();
+    }
+    cse->hash_size = 16;
+    while (cse->hash_size < 2 * n) {
+        cse->hash_size *= 2; // At most half full
+    }
+    cse->node_size = cse->hash_size;
+    cse->shapes = (Shape*)malloc(n * sizeof(Shape));
+    cse->by_hash = (int*)malloc(cse->hash_size * sizeof(int));
+    cse->nodes = (const ASTNode**)calloc(cse->node_size, sizeof(ASTNode*));
+    cse->ids = (int*)malloc(cse->node_size * sizeof(int));
+    cse->available = (char*)calloc(n, 1);
+    if (cse->shapes == NULL || cse->by_hash == NULL || cse->nodes == NULL ||
+        cse->ids == NULL || cse->available == NULL) {
+        cse_oom();
+    }
+    memset(cse->by_hash, -1, cse->hash_size * sizeof(int));
+
+    cse_number(cse, root);
+    cse_count_uses(cse, root);
+
+    // Leaves are one instruction already; only numbers fit a slot
+    int slots = 0;
+    for (int id = 0; id < cse->count && slots < MAX_LOCAL_SLOTS; id++) {
+        Shape* shape = &cse->shapes[id];
+        int leaf = (shape->node->type == NODE_NUMBER || shape->node->type == NODE_CELL_REF);
+        if (shape->uses > 1 && !leaf && ast_is_numeric(shape->node)) {
+            shape->slot = slots++;
+        }
+    }
+    *shared = slots;
+    return cse;
+}
+
+static void cse_free(CseTable* cse) {
+    free(cse->shapes);
+    free(cse->by_hash);
+    free(cse->nodes);
+    free(cse->ids);
+    free(cse->available);
+    free(cse);
+}
+
+// Copies which shapes are stored, to restore after an IF branch
+static char* cse_save(const Codegen* gen) {
+    if (gen->cse == NULL) {
+        return NULL;
+    }
+    char* saved = (char*)malloc(gen->cse->count);
+    if (saved == NULL) {
+        cse_oom();
+    }
+    memcpy(saved, gen->cse->available, gen->cse->count);
+    return saved;
+}
+
+static void cse_restore(Codegen* gen, const char* saved) {
+    if (saved != NULL) {
+        memcpy(gen->cse->available, saved, gen->cse->count);
+    }
+}
+
+/*
+ * Copies that only ever sit in different IF branches are each
+ * computed and stored, but never loaded. Those stores become NOPs
+ * (removed by the optimizer). Returns the number of slots loaded.
+ */
+static int drop_unloaded_stores(CodeArray* code) {
+    char loaded[MAX_LOCAL_SLOTS] = {0};
+    int count = 0;
+    for (int i = 0; i < code->count; i++) {
+        const Instruction* inst = &code->code[i];
+        if (inst->opcode == OP_LOAD_LOCAL && !loaded[inst->operand.slot]) {
+            loaded[inst->operand.slot] = 1;
+            count++;
+        }
+    }
+    for (int i = 0; i < code->count; i++) {
+        Instruction* inst = &code->code[i];
+        if (inst->opcode == OP_STORE_LOCAL && !loaded[inst->operand.slot]) {
+            inst->opcode = OP_NOP;
+        }
+    }
+    return count;
+}
+
 /* --- Private Helper Prototypes --- */
-static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table);
+static void generate_expr(ASTNode* node, CodeArray* code, Codegen* gen);
+static void generate_node(ASTNode* node, CodeArray* code, Codegen* gen);
 
 /* --- Recursive Traversal Function --- */
 
-static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
+static void generate_expr(ASTNode* node, CodeArray* code, Codegen* gen) {
     if (node == NULL) {
         return;
     }
+    if (gen->cse == NULL || node->type == NODE_ARG_LIST) {
+        generate_node(node, code, gen);
+        return;
+    }
+
+    // A shared subexpression: load it if it's stored, else compute and store it
+    int id = cse_node_id(gen->cse, node);
+    int slot = gen->cse->shapes[id].slot;
+    if (slot >= 0 && gen->cse->available[id]) {
+        emit_local(code, OP_LOAD_LOCAL, slot, node->line);
+        return;
+    }
+    generate_node(node, code, gen);
+    if (slot >= 0) {
+        emit_local(code, OP_STORE_LOCAL, slot, node->line);
+        gen->cse->available[id] = 1;
+    }
+}
+
+static void generate_node(ASTNode* node, CodeArray* code, Codegen* gen) {
+    SymbolTable* table = gen->table;
 
     // Use node->line for all emitted instructions
     int line = node->line;
@@ -45,18 +363,19 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
             
         case NODE_CELL_REF:
             // FIX: Was emit_cell_ref
-            emit_push_cell(code, node->data.str_value, line);
+            // Resolve the cell to its symbol table id once, here
+            emit_push_cell(code, node->data.cell, symtab_intern(table, node->data.cell), line);
             break;
             
         case NODE_RANGE:
             // Ranges are only valid as function args. We push the string.
             // FIX: Was emit_range_str
-            emit_push_range(code, node->data.str_value, line);
+            emit_push_range(code, node->data.range, line);
             break;
 
         case NODE_UNARY_OP:
             // 1. Generate code for the child
-            generate_expr(node->data.op.left, code, table);
+            generate_expr(node->data.op.left, code, gen);
             // 2. Emit the operator
             if (node->data.op.op_token == MINUS) {
                 // FIX: Added line number
@@ -69,9 +388,9 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
 
         case NODE_BINARY_OP:
             // 1. Generate code for left child
-            generate_expr(node->data.op.left, code, table);
+            generate_expr(node->data.op.left, code, gen);
             // 2. Generate code for right child
-            generate_expr(node->data.op.right, code, table);
+            generate_expr(node->data.op.right, code, gen);
             // 3. Emit the operator
             switch(node->data.op.op_token) {
                 // FIX: Added line number to all
@@ -105,14 +424,15 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
                 ASTNode* false_node = args->data.arg.next_arg->data.arg.next_arg->data.arg.expression;
 
                 // 1. Generate code for condition
-                generate_expr(cond_node, code, table);
+                generate_expr(cond_node, code, gen);
+                char* stored = cse_save(gen); // Stores in one branch don't reach the other
                 
                 // 2. Emit JMP_IF_FALSE. We'll patch the address later.
                 // FIX: Added line number
                 int false_jump_idx = emit_jump(code, OP_JMP_IF_FALSE, line);
                 
                 // 3. Generate code for true branch
-                generate_expr(true_node, code, table);
+                generate_expr(true_node, code, gen);
                 
                 // 4. Emit JMP (to skip the false branch). Patch later.
                 // FIX: Added line number
@@ -122,10 +442,13 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
                 patch_jump(code, false_jump_idx);
                 
                 // 6. Generate code for false branch
-                generate_expr(false_node, code, table);
+                cse_restore(gen, stored);
+                generate_expr(false_node, code, gen);
                 
                 // 7. Patch the end_jump to point to *here*
                 patch_jump(code, end_jump_idx);
+                cse_restore(gen, stored); // Nor past the IF
+                free(stored);
 
             } else {
                 // Standard function call: SUM, AVG, etc.
@@ -133,7 +456,7 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
                 ASTNode* arg = node->data.func.arguments;
                 int arg_count = 0;
                 while (arg != NULL) {
-                    generate_expr(arg->data.arg.expression, code, table);
+                    generate_expr(arg->data.arg.expression, code, gen);
                     arg_count++;
                     arg = arg->data.arg.next_arg;
                 }
@@ -159,15 +482,59 @@ static void generate_expr(ASTNode* node, CodeArray* code, SymbolTable* table) {
 
 /* --- Public API --- */
 
+int ast_is_numeric(const ASTNode* node) {
+    switch (node->type) {
+        case NODE_NUMBER:
+        case NODE_CELL_REF:
+            return 1;
+        case NODE_UNARY_OP:
+            return node->data.op.op_token == MINUS;
+        case NODE_BINARY_OP:
+            switch (node->data.op.op_token) {
+                case PLUS: case MINUS: case MULTIPLY: case DIVIDE: case POWER:
+                    return 1;
+                default:
+                    return 0;
+            }
+        case NODE_FUNCTION_CALL: {
+            int func = node->data.func.function_token;
+            if (func == IF) {
+                const ASTNode* args = node->data.func.arguments;
+                return ast_is_numeric(args->data.arg.next_arg->data.arg.expression) &&
+                       ast_is_numeric(args->data.arg.next_arg->data.arg.next_arg->data.arg.expression);
+            }
+            return func == SUM || func == MIN || func == MAX;
+        }
+        default:
+            return 0;
+    }
+}
+
 CodeArray* generate_code(ASTNode* root, SymbolTable* table) {
+    return generate_code_cse(root, table, 0, NULL);
+}
+
+CodeArray* generate_code_cse(ASTNode* root, SymbolTable* table, int share, int* shared) {
     if (root == NULL) {
         return NULL;
     }
 
     CodeArray* code = create_code_array();
+    Codegen gen = { table, NULL };
+    int slots = 0;
+    if (share) {
+        gen.cse = cse_build(root, &slots);
+    }
     
     // Start recursive generation
-    generate_expr(root, code, table);
+    generate_expr(root, code, &gen);
+    if (gen.cse != NULL) {
+        slots = drop_unloaded_stores(code);
+        cse_free(gen.cse);
+    }
+    if (shared != NULL) {
+        *shared = slots;
+    }
     
     // 3. Finish with HALT
     // FIX: Added line (use root->line as the "end" line)
@@ -19,5 +19,23 @@
  */
 CodeArray* generate_code(ASTNode* root, SymbolTable* table);
 
+/*
+ * Like generate_code(), with common subexpression elimination when
+ * 'share' is 1: a pure numeric subexpression that appears more than
+ * once (e.g., SUM(A1:A500) in both the condition and a branch of an
+ * IF) is computed once per evaluation, kept in a local slot
+ * (OP_STORE_LOCAL) and reloaded (OP_LOAD_LOCAL) wherever the store
+ * is sure to have run.
+ *
+ * @param shared If not NULL, set to the number of local slots used.
+ */
+CodeArray* generate_code_cse(ASTNode* root, SymbolTable* table, int share, int* shared);
+
+/*
+ * Returns 1 if an expression always yields a number when it
+ * yields at all (a division by zero stops the whole formula).
+ */
+int ast_is_numeric(const ASTNode* node);
+
 #endif // CODEGEN_H
 
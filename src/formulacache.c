@@ -0,0 +1,327 @@
+/*
+ * --- Compiled Formula Cache Implementation ---
+ *
+ * The template scanner follows the lexer's longest-match rules
+ * (lexer.l), so two formulas with the same template lex to the
+ * same tokens except for their cell references. Anything it
+ * can't be sure about makes the formula uncacheable.
+ */
+
+#include "formulacache.h"
+#include "vm.h" // For vm_verify
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* --- Private Helpers --- */
+
+static void cache_oom(void) {
+    fprintf(stderr, "Fatal: Out of memory growing formula cache\n");
+    exit(1);
+}
+
+static int is_upper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+static int is_letter(char c) {
+    return is_upper(c) || (c >= 'a' && c <= 'z');
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Appends 'n' characters to the template being built
+static void append_text(FormulaCache* cache, const char* text, int n) {
+    if (cache->length + n + 1 > cache->text_capacity) {
+        int new_capacity = cache->text_capacity < 64 ? 64 : cache->text_capacity;
+        while (new_capacity < cache->length + n + 1) {
+            new_capacity *= 2;
+        }
+        cache->text = (char*)realloc(cache->text, new_capacity);
+        if (cache->text == NULL) {
+            cache_oom();
+        }
+        cache->text_capacity = new_capacity;
+    }
+    memcpy(cache->text + cache->length, text, n);
+    cache->length += n;
+    cache->text[cache->length] = '\0';
+}
+
+// Appends a reference relative to the formula's cell (e.g., "R[0]C[-2]")
+static void append_relative(FormulaCache* cache, CellCoord ref, CellCoord cell) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "R[%d]C[%d]",
+        cell_row(ref) - cell_row(cell), cell_col(ref) - cell_col(cell));
+    append_text(cache, buf, n);
+}
+
+static void add_ref(FormulaCache* cache, CellCoord ref) {
+    if (cache->ref_count >= cache->ref_capacity) {
+        cache->ref_capacity = cache->ref_capacity < 8 ? 8 : cache->ref_capacity * 2;
+        cache->refs = (CellCoord*)realloc(cache->refs, cache->ref_capacity * sizeof(CellCoord));
+        if (cache->refs == NULL) {
+            cache_oom();
+        }
+    }
+    cache->refs[cache->ref_count++] = ref;
+}
+
+// Length of the [A-Z]+[0-9]+ match at 'text', 0 if none (the lexer's CELL_REF)
+static int match_cell_ref(const char* text) {
+    int i = 0;
+    while (is_upper(text[i])) {
+        i++;
+    }
+    if (i == 0 || !is_digit(text[i])) {
+        return 0;
+    }
+    while (is_digit(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+static unsigned int hash_text(const char* text) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (const char* p = text; *p != '\0'; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    return h;
+}
+
+// Gets the slot of a template: its own slot, or the empty slot where it goes
+static int find_slot(const FormulaCache* cache, const char* text) {
+    unsigned int mask = (unsigned int)cache->slot_count - 1;
+    unsigned int i = hash_text(text) & mask;
+    for (;;) {
+        int t = cache->slots[i];
+        if (t < 0 || strcmp(cache->templates[t].text, text) == 0) {
+            return (int)i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// Doubles the hash table and re-inserts every template
+static void grow_slots(FormulaCache* cache) {
+    free(cache->slots);
+    cache->slot_count *= 2;
+    cache->slots = (int*)malloc(cache->slot_count * sizeof(int));
+    if (cache->slots == NULL) {
+        cache_oom();
+    }
+    memset(cache->slots, -1, cache->slot_count * sizeof(int));
+    for (int t = 0; t < cache->count; t++) {
+        cache->slots[find_slot(cache, cache->templates[t].text)] = t;
+    }
+}
+
+static CellCoord shift(CellCoord coord, int dcol, int drow) {
+    return cell_coord(cell_col(coord) + dcol, cell_row(coord) + drow);
+}
+
+
+/* --- Public API --- */
+
+FormulaCache* formula_cache_create(void) {
+    FormulaCache* cache = (FormulaCache*)calloc(1, sizeof(FormulaCache));
+    if (cache == NULL) {
+        cache_oom();
+    }
+    cache->slot_count = 64;
+    cache->slots = (int*)malloc(cache->slot_count * sizeof(int));
+    if (cache->slots == NULL) {
+        cache_oom();
+    }
+    memset(cache->slots, -1, cache->slot_count * sizeof(int));
+    return cache;
+}
+
+void formula_cache_free(FormulaCache* cache) {
+    if (cache == NULL) return;
+    for (int t = 0; t < cache->count; t++) {
+        free(cache->templates[t].text);
+    }
+    free(cache->templates);
+    free(cache->slots);
+    free(cache->text);
+    free(cache->refs);
+    free(cache);
+}
+
+int formula_cache_shape(FormulaCache* cache, const char* formula, CellCoord cell) {
+    cache->length = 0;
+    cache->ref_count = 0;
+    append_text(cache, "", 0);
+
+    const char* p = formula;
+    while (*p != '\0') {
+        if (is_letter(*p)) {
+            int n = match_cell_ref(p);
+            if (n == 0) {
+                // A keyword or a stray word: copy it whole, unless it
+                // ends in digits the lexer would split differently
+                const char* word = p;
+                while (is_letter(*p)) {
+                    p++;
+                }
+                if (is_digit(*p)) {
+                    cache->uncacheable++;
+                    return 0;
+                }
+                append_text(cache, word, (int)(p - word));
+                continue;
+            }
+
+            CellCoord start;
+            if (cellref_decode(p, &start) != n) {
+                cache->uncacheable++;
+                return 0; // Out of the sheet: the lexer reports it
+            }
+            int m = (p[n] == ':') ? match_cell_ref(p + n + 1) : 0;
+            if (m == 0) {
+                append_relative(cache, start, cell);
+                add_ref(cache, start);
+                p += n;
+                continue;
+            }
+
+            // A range: its corners need not be defined
+            CellCoord end;
+            if (cellref_decode(p + n + 1, &end) != m) {
+                cache->uncacheable++;
+                return 0;
+            }
+            append_relative(cache, start, cell);
+            append_text(cache, ":", 1);
+            append_relative(cache, end, cell);
+            p += n + 1 + m;
+        } else if (*p == '"') {
+            const char* string = p++;
+            while (*p != '"') {
+                if (*p == '\0' || (*p == '\\' && p[1] == '\0')) {
+                    cache->uncacheable++;
+                    return 0; // Unterminated
+                }
+                p += (*p == '\\') ? 2 : 1;
+            }
+            p++;
+            append_text(cache, string, (int)(p - string));
+        } else if (*p == '[') {
+            cache->uncacheable++;
+            return 0; // Could be mistaken for a relative reference
+        } else {
+            append_text(cache, p, 1);
+            p++;
+        }
+    }
+    return 1;
+}
+
+CodeArray* formula_cache_instantiate(FormulaCache* cache, SymbolTable* table, CellCoord cell, int line) {
+    int t = cache->slots[find_slot(cache, cache->text)];
+    if (t < 0) {
+        cache->misses++;
+        return NULL;
+    }
+    const FormulaTemplate* tmpl = &cache->templates[t];
+
+    // 1. Define the cell, then check its references, as semantic_check_formula does
+    CellEntry* entry = symtab_get_cell(table, cell);
+    if (entry == NULL) {
+        symtab_define_cell(table, cell, 0.0, NULL, 0);
+        entry = symtab_get_cell(table, cell);
+    }
+    entry->is_defined = 1;
+    for (int r = 0; r < cache->ref_count; r++) {
+        CellEntry* ref = symtab_get_cell(table, cache->refs[r]);
+        if (ref == NULL || !ref->is_defined) {
+            cache->fallbacks++;
+            return NULL; // Compiled the long way, which reports it
+        }
+    }
+    cache->hits++;
+
+    // 2. The dependencies: the cell's own references, then the template's ranges, moved
+    for (int r = 0; r < cache->ref_count; r++) {
+        symtab_add_dependency(table, cell, cache->refs[r]);
+    }
+    int dcol = cell_col(cell) - cell_col(tmpl->base);
+    int drow = cell_row(cell) - cell_row(tmpl->base);
+    int range_count = symtab_cell(table, tmpl->base_id)->range_count;
+    for (int d = 0; d < range_count; d++) {
+        // Fetched again each time: adding a dependency may move the table
+        CellRange range = symtab_cell(table, tmpl->base_id)->ranges[d];
+        range.start = shift(range.start, dcol, drow);
+        range.end = shift(range.end, dcol, drow);
+        symtab_add_range_dependency(table, cell, range);
+    }
+
+    // 3. The template's bytecode, with its cell operands moved
+    CodeArray* code = create_code_array();
+    for (int k = 0; k < tmpl->code->count; k++) {
+        Instruction inst = tmpl->code->code[k];
+        inst.line = line;
+        switch (inst.opcode) {
+            case OP_PUSH_CELL:
+            case OP_ADD_CELL:
+                inst.operand.cell.coord = shift(inst.operand.cell.coord, dcol, drow);
+                inst.operand.cell.id = symtab_intern(table, inst.operand.cell.coord);
+                break;
+            case OP_PUSH_RANGE:
+                inst.operand.range.start = shift(inst.operand.range.start, dcol, drow);
+                inst.operand.range.end = shift(inst.operand.range.end, dcol, drow);
+                break;
+            case OP_ADD_CELL_CELL:
+            case OP_SUB_CELL_CELL:
+            case OP_MUL_CELL_CELL:
+                inst.operand.cells.a = shift(inst.operand.cells.a, dcol, drow);
+                inst.operand.cells.b = shift(inst.operand.cells.b, dcol, drow);
+                break;
+            case OP_ADD_CELL_CONST:
+            case OP_MUL_CELL_CONST:
+                inst.operand.cell_const.coord = shift(inst.operand.cell_const.coord, dcol, drow);
+                break;
+            default:
+                break; // No cell operand
+        }
+        emit_instruction(code, inst);
+    }
+    code->local_count = tmpl->code->local_count;
+    vm_verify(code);
+    return code;
+}
+
+void formula_cache_add(FormulaCache* cache, CellCoord cell, int cell_id, const CodeArray* code) {
+    int slot = find_slot(cache, cache->text);
+    if (cache->slots[slot] >= 0) {
+        return; // Already cached
+    }
+    if (cache->count >= cache->capacity) {
+        cache->capacity = cache->capacity < 16 ? 16 : cache->capacity * 2;
+        cache->templates = (FormulaTemplate*)realloc(cache->templates, cache->capacity * sizeof(FormulaTemplate));
+        if (cache->templates == NULL) {
+            cache_oom();
+        }
+    }
+    FormulaTemplate* tmpl = &cache->templates[cache->count];
+    tmpl->text = strdup(cache->text);
+    if (tmpl->text == NULL) {
+        cache_oom();
+    }
+    tmpl->base = cell;
+    tmpl->base_id = cell_id;
+    tmpl->code = code;
+    cache->slots[slot] = cache->count++;
+    if (cache->count * 2 > cache->slot_count) {
+        grow_slots(cache);
+    }
+}
+
+void formula_cache_print_stats(const FormulaCache* cache) {
+    printf("✓ Formula cache: %d template(s), %ld hit(s), %ld miss(es), %ld uncacheable, %ld fallback(s)\n",
+        cache->count, cache->hits, cache->misses, cache->uncacheable, cache->fallbacks);
+}
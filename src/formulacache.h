@@ -0,0 +1,104 @@
+/*
+ * --- Compiled Formula Cache Header ---
+ *
+ * Sheets repeat the same formula shape many times: C1 holds
+ * =A1*B1, C2 holds =A2*B2, and so on down the column. With
+ * every reference written relative to the formula's own cell
+ * (R1C1 style), they are all one template:
+ *
+ *     R[0]C[-2]*R[0]C[-1]
+ *
+ * The cache compiles the first cell of each template as usual
+ * and keeps its bytecode. Every later cell with the same
+ * template gets a copy whose cell operands are moved by the
+ * offset between the two cells: no lexing, parsing, semantic
+ * analysis, optimization or code generation.
+ *
+ * A copy records the dependencies the semantic checker would
+ * have recorded: those of the first cell, moved the same way.
+ * A cell that refers to an undefined cell is compiled the long
+ * way, so it reports exactly the same errors.
+ */
+
+#ifndef FORMULACACHE_H
+#define FORMULACACHE_H
+
+#include "ir.h"     // For CodeArray
+#include "symtab.h" // For SymbolTable
+
+/*
+ * One compiled template.
+ */
+typedef struct {
+    char* text;             // The R1C1 template (the key)
+    CellCoord base;         // The cell it was compiled for
+    int base_id;            // Symbol table id of that cell (for its dependencies)
+    const CodeArray* code;  // Its bytecode, owned by that cell
+} FormulaTemplate;
+
+typedef struct {
+    FormulaTemplate* templates;
+    int count;
+    int capacity;
+    int* slots;             // Open addressing: template index, -1 = empty
+    int slot_count;         // A power of two, at least twice 'count'
+
+    // The shape of the formula being compiled (formula_cache_shape)
+    char* text;
+    int length;
+    int text_capacity;
+    CellCoord* refs;        // Its single-cell references (they must be defined)
+    int ref_count;
+    int ref_capacity;
+
+    // Statistics
+    long hits;
+    long misses;
+    long uncacheable;       // Formulas the template scanner gave up on
+    long fallbacks;         // Hits compiled the long way (undefined reference)
+} FormulaCache;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Creates an empty cache.
+ */
+FormulaCache* formula_cache_create(void);
+
+/**
+ * @brief Frees the cache (not the bytecode it points to).
+ */
+void formula_cache_free(FormulaCache* cache);
+
+/**
+ * @brief Computes the template of a formula (without its '=')
+ * held in 'cell', following the lexer's token rules, and keeps
+ * it for formula_cache_instantiate() and formula_cache_add().
+ * @return 1 on success, 0 if the formula can't be cached
+ * (e.g., a reference out of the sheet, or an unterminated string).
+ */
+int formula_cache_shape(FormulaCache* cache, const char* formula, CellCoord cell);
+
+/**
+ * @brief Builds the bytecode of the shaped formula from its
+ * template, and records its dependencies in the symbol table.
+ * @param line The line every instruction is tagged with.
+ * @return The new bytecode (verified), or NULL if the template
+ * is not cached yet or the formula must be compiled the long way.
+ */
+CodeArray* formula_cache_instantiate(FormulaCache* cache, SymbolTable* table, CellCoord cell, int line);
+
+/**
+ * @brief Caches the bytecode compiled for the shaped formula.
+ * 'code' must outlive the cache and not change afterwards.
+ */
+void formula_cache_add(FormulaCache* cache, CellCoord cell, int cell_id, const CodeArray* code);
+
+/**
+ * @brief Prints the template, hit and miss counters.
+ */
+void formula_cache_print_stats(const FormulaCache* cache);
+
+
+#endif // FORMULACACHE_H
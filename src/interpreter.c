@@ -17,7 +17,7 @@
 static Value eval_binary_op(Value left, Value right, int op_token);
 static Value eval_unary_op(Value right, int op_token);
 static Value eval_function_call(ASTNode* node, SymbolTable* table, int trace_level);
-static ValueNode* eval_arg_list(ASTNode* arg_node, SymbolTable* table, int* arg_count, int trace_level);
+static int eval_arg_list(ASTNode* arg_node, SymbolTable* table, Value* args, int trace_level);
 
 // Helper for tracing
 static void print_trace(const char* msg, int trace_level) {
@@ -60,23 +60,20 @@ Value interpreter_evaluate(ASTNode* node, SymbolTable* table, int trace_level) {
             break;
 
         case NODE_CELL_REF: {
-            CellEntry* cell = symtab_get_cell(table, node->data.str_value);
-            double val = 0.0;
-            if (cell != NULL && cell->is_defined) {
-                val = cell->value;
-            }
+            double val = symtab_value(table, node->data.cell); // Undefined cells are 0
             if (trace_level > 0) {
                 char msg[64];
-                snprintf(msg, 64, "Evaluating NODE_CELL(%s) = %.2f", node->data.str_value, val);
+                char name[CELLREF_MAX];
+                snprintf(msg, 64, "Evaluating NODE_CELL(%s) = %.2f", cellref_format(node->data.cell, name), val);
                 print_trace(msg, trace_level);
             }
-            result = create_number_value(val);
+            result = cell_value(val); // Or the error the cell holds
             break;
         }
             
         case NODE_RANGE:
             if (trace_level > 0) print_trace("Evaluating NODE_RANGE", trace_level);
-            result = create_string_value(node->data.str_value);
+            result = create_range_value(node->data.range);
             break;
 
         // --- Operators ---
@@ -139,7 +136,7 @@ static Value eval_binary_op(Value left, Value right, int op_token) {
         case MULTIPLY: return create_number_value(left_num * right_num);
         case DIVIDE:
             if (right_num == 0) {
-                return create_error_value("Division by zero");
+                return create_error(ERROR_DIV_ZERO);
             }
             return create_number_value(left_num / right_num);
         case POWER:
@@ -190,56 +187,36 @@ static Value eval_function_call(ASTNode* node, SymbolTable* table, int trace_lev
         return result;
     }
     
+    // Count the arguments, then evaluate them into one array
     int arg_count = 0;
-    ValueNode* arg_head = eval_arg_list(node->data.func.arguments, table, &arg_count, trace_level + 1);
+    for (ASTNode* arg = node->data.func.arguments; arg != NULL; arg = arg->data.arg.next_arg) {
+        arg_count++;
+    }
+    Value* args = (Value*)malloc((arg_count + 1) * sizeof(Value));
+    eval_arg_list(node->data.func.arguments, table, args, trace_level + 1);
     
     Value result;
     switch (func_token) {
-        case SUM:     result = rt_sum(arg_head); break;
-        case AVERAGE: result = rt_average(arg_head); break;
-        case MIN:     result = rt_min(arg_head); break;
-        case MAX:     result = rt_max(arg_head); break;
-        case NOT:     result = rt_not(arg_head); break;
+        case SUM:     result = rt_sum(args, arg_count, table); break;
+        case AVERAGE: result = rt_average(args, arg_count, table); break;
+        case MIN:     result = rt_min(args, arg_count, table); break;
+        case MAX:     result = rt_max(args, arg_count, table); break;
+        case NOT:     result = rt_not(args, arg_count, table); break;
         default:      result = create_error_value("Unknown function");
     }
     
-    free_value_list(arg_head);
+    for (int i = 0; i < arg_count; i++) {
+        free_value(args[i]);
+    }
+    free(args);
     return result;
 }
 
-static ValueNode* eval_arg_list(ASTNode* arg_node, SymbolTable* table, int* arg_count, int trace_level) {
-    if (arg_node == NULL) {
-        *arg_count = 0;
-        return NULL;
+// Evaluates each argument into 'args', in order. Ranges stay ranges.
+static int eval_arg_list(ASTNode* arg_node, SymbolTable* table, Value* args, int trace_level) {
+    int count = 0;
+    for (; arg_node != NULL; arg_node = arg_node->data.arg.next_arg) {
+        args[count++] = interpreter_evaluate(arg_node->data.arg.expression, table, trace_level);
     }
-
-    ValueNode* next_values = eval_arg_list(arg_node->data.arg.next_arg, table, arg_count, trace_level);
-    Value current_val = interpreter_evaluate(arg_node->data.arg.expression, table, trace_level);
-    
-    if (current_val.type == TYPE_STRING) {
-        ValueNode* range_head = rt_expand_range(current_val.as.string, table);
-        if (range_head != NULL) {
-            free_value(current_val);
-            if (range_head == NULL) {
-                return next_values;
-            }
-            ValueNode* tail = range_head;
-            int range_count = 1;
-            while (tail->next != NULL) {
-                tail = tail->next;
-                range_count++;
-            }
-            tail->next = next_values;
-            *arg_count += range_count;
-            return range_head;
-        }
-    }
-    
-    ValueNode* new_head = (ValueNode*)malloc(sizeof(ValueNode));
-    new_head->value = current_val;
-    new_head->next = next_values;
-    *arg_count += 1;
-    
-    return new_head;
+    return count;
 }
-
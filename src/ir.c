@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "parser.tab.h" // For token names
+#include "jit.h"        // For jit_free
 
 /* --- Private Helper --- */
 
@@ -47,6 +48,7 @@ static int write_instruction(CodeArray* code, Instruction inst) {
         resize_code_array(code);
     }
     code->code[code->count] = inst;
+    code->verified = 0; // Changed: the VM must check it again
     return code->count++; // Return index of this new instruction
 }
 
@@ -58,6 +60,12 @@ CodeArray* create_code_array() {
     code->capacity = 0;
     code->count = 0;
     code->code = NULL;
+    code->local_count = 0;
+    code->verified = 0;
+    code->verify_error = NULL;
+    code->exec_count = 0;
+    code->jit_status = 0;
+    code->jit = NULL;
     resize_code_array(code); // Initialize with default capacity
     return code;
 }
@@ -65,15 +73,8 @@ CodeArray* create_code_array() {
 void free_bytecode(CodeArray *code) {
     if (code == NULL) return;
     
-    // Free any heap-allocated strings inside instructions
-    for (int i = 0; i < code->count; i++) {
-        OpCode op = code->code[i].opcode;
-        if (op == OP_PUSH_CELL || op == OP_PUSH_RANGE) {
-            // Note: We don't free here, as the string is
-            // owned by the AST, which is freed separately.
-        }
-    }
-    
+    // No instruction owns heap data: cells and ranges are coordinates
+    jit_free(code->jit);
     free(code->code);
     free(code);
 }
@@ -95,19 +96,20 @@ int emit_push(CodeArray* code, double number, int line) {
     return write_instruction(code, inst);
 }
 
-int emit_push_cell(CodeArray* code, char* cell_ref, int line) {
+int emit_push_cell(CodeArray* code, CellCoord coord, int cell_id, int line) {
     Instruction inst;
     inst.opcode = OP_PUSH_CELL;
     inst.line = line;
-    inst.operand.cell_ref = cell_ref;
+    inst.operand.cell.coord = coord;
+    inst.operand.cell.id = cell_id;
     return write_instruction(code, inst);
 }
 
-int emit_push_range(CodeArray* code, char* range_str, int line) {
+int emit_push_range(CodeArray* code, CellRange range, int line) {
     Instruction inst;
     inst.opcode = OP_PUSH_RANGE;
     inst.line = line;
-    inst.operand.range_str = range_str;
+    inst.operand.range = range;
     return write_instruction(code, inst);
 }
 
@@ -129,6 +131,25 @@ int emit_call(CodeArray* code, int func_token, int arg_count, int line) {
     return write_instruction(code, inst);
 }
 
+int emit_local(CodeArray* code, OpCode opcode, int slot, int line) {
+    Instruction inst;
+    inst.opcode = opcode;
+    inst.line = line;
+    inst.operand.slot = slot;
+    if (slot >= code->local_count) {
+        code->local_count = slot + 1;
+    }
+    return write_instruction(code, inst);
+}
+
+int emit_instruction(CodeArray* code, Instruction inst) {
+    if ((inst.opcode == OP_STORE_LOCAL || inst.opcode == OP_LOAD_LOCAL) &&
+        inst.operand.slot >= code->local_count) {
+        code->local_count = inst.operand.slot + 1;
+    }
+    return write_instruction(code, inst);
+}
+
 void patch_jump(CodeArray* code, int jump_instruction_index) {
     if (jump_instruction_index < 0 || jump_instruction_index >= code->count) {
         fprintf(stderr, "Error: Invalid jump index to patch.\n");
@@ -137,33 +158,77 @@ void patch_jump(CodeArray* code, int jump_instruction_index) {
     // Set the jump target to the *next* instruction's address
     int target_address = code->count;
     code->code[jump_instruction_index].operand.address = target_address;
+    code->verified = 0;
 }
 
 
 /* --- Debugging --- */
 
+const char* opcode_name(OpCode opcode) {
+    switch(opcode) {
+        case OP_HALT:         return "HALT";
+        case OP_PUSH:         return "PUSH";
+        case OP_PUSH_CELL:    return "PUSH_CELL";
+        case OP_PUSH_RANGE:   return "PUSH_RANGE";
+        case OP_ADD:          return "ADD";
+        case OP_SUB:          return "SUB";
+        case OP_MUL:          return "MUL";
+        case OP_DIV:          return "DIV";
+        case OP_POW:          return "POW";
+        case OP_EQ:           return "EQ";
+        case OP_NEQ:          return "NEQ";
+        case OP_GT:           return "GT";
+        case OP_LT:           return "LT";
+        case OP_GTE:          return "GTE";
+        case OP_LTE:          return "LTE";
+        case OP_AND:          return "AND";
+        case OP_OR:           return "OR";
+        case OP_NEG:          return "NEG";
+        case OP_NOT:          return "NOT";
+        case OP_JMP:          return "JMP";
+        case OP_JMP_IF_FALSE: return "JMP_IF_FALSE";
+        case OP_CALL:         return "CALL";
+        case OP_STORE_LOCAL:  return "STORE_LOCAL";
+        case OP_LOAD_LOCAL:   return "LOAD_LOCAL";
+        case OP_ADD_NUM:      return "ADD_NUM";
+        case OP_SUB_NUM:      return "SUB_NUM";
+        case OP_MUL_NUM:      return "MUL_NUM";
+        case OP_DIV_NUM:      return "DIV_NUM";
+        case OP_POW_NUM:      return "POW_NUM";
+        case OP_EQ_NUM:       return "EQ_NUM";
+        case OP_NEQ_NUM:      return "NEQ_NUM";
+        case OP_GT_NUM:       return "GT_NUM";
+        case OP_LT_NUM:       return "LT_NUM";
+        case OP_GTE_NUM:      return "GTE_NUM";
+        case OP_LTE_NUM:      return "LTE_NUM";
+        case OP_NEG_NUM:      return "NEG_NUM";
+        case OP_ADD_CELL_CELL:  return "ADD_CELL_CELL";
+        case OP_SUB_CELL_CELL:  return "SUB_CELL_CELL";
+        case OP_MUL_CELL_CELL:  return "MUL_CELL_CELL";
+        case OP_ADD_CELL_CONST: return "ADD_CELL_CONST";
+        case OP_MUL_CELL_CONST: return "MUL_CELL_CONST";
+        case OP_ADD_CELL:       return "ADD_CELL";
+        case OP_MUL_CONST:      return "MUL_CONST";
+        case OP_JMP_IF_NOT_GT:  return "JMP_IF_NOT_GT";
+        case OP_JMP_IF_NOT_LT:  return "JMP_IF_NOT_LT";
+        case OP_JMP_IF_NOT_GTE: return "JMP_IF_NOT_GTE";
+        case OP_JMP_IF_NOT_LTE: return "JMP_IF_NOT_LTE";
+        case OP_JMP_IF_NOT_EQ:  return "JMP_IF_NOT_EQ";
+        case OP_JMP_IF_NOT_NEQ: return "JMP_IF_NOT_NEQ";
+        case OP_NOP:          return "NOP";
+        default:              return NULL;
+    }
+}
+
 void print_instruction(Instruction inst, int index) {
+    char name[CELLREF_MAX]; // For PUSH_CELL
+    char second[CELLREF_MAX];
+    char range[CELLRANGE_MAX];
     printf("%04d: ", index);
     switch(inst.opcode) {
-        case OP_HALT:         printf("HALT\n"); break;
         case OP_PUSH:         printf("PUSH %f\n", inst.operand.number); break;
-        case OP_PUSH_CELL:    printf("PUSH_CELL %s\n", inst.operand.cell_ref); break;
-        case OP_PUSH_RANGE:   printf("PUSH_RANGE %s\n", inst.operand.range_str); break;
-        case OP_ADD:          printf("ADD\n"); break;
-        case OP_SUB:          printf("SUB\n"); break;
-        case OP_MUL:          printf("MUL\n"); break;
-        case OP_DIV:          printf("DIV\n"); break;
-        case OP_POW:          printf("POW\n"); break;
-        case OP_EQ:           printf("EQ\n"); break;
-        case OP_NEQ:          printf("NEQ\n"); break;
-        case OP_GT:           printf("GT\n"); break;
-        case OP_LT:           printf("LT\n"); break;
-        case OP_GTE:          printf("GTE\n"); break;
-        case OP_LTE:          printf("LTE\n"); break;
-        case OP_AND:          printf("AND\n"); break;
-        case OP_OR:           printf("OR\n"); break;
-        case OP_NEG:          printf("NEG\n"); break;
-        case OP_NOT:          printf("NOT\n"); break;
+        case OP_PUSH_CELL:    printf("PUSH_CELL %s\n", cellref_format(inst.operand.cell.coord, name)); break;
+        case OP_PUSH_RANGE:   printf("PUSH_RANGE %s\n", cellrange_format(inst.operand.range, range)); break;
         case OP_JMP:          printf("JMP -> %d\n", inst.operand.address); break;
         case OP_JMP_IF_FALSE: printf("JMP_IF_FALSE -> %d\n", inst.operand.address); break;
         case OP_CALL:
@@ -172,11 +237,39 @@ void print_instruction(Instruction inst, int index) {
                 get_func_name(inst.operand.func_call.token),
                 inst.operand.func_call.arg_count);
             break;
-        case OP_NOP:
-            printf("NOP\n");
+        case OP_ADD_CELL_CELL:
+        case OP_SUB_CELL_CELL:
+        case OP_MUL_CELL_CELL:
+            printf("%s %s, %s\n", opcode_name(inst.opcode),
+                cellref_format(inst.operand.cells.a, name),
+                cellref_format(inst.operand.cells.b, second));
+            break;
+        case OP_ADD_CELL_CONST:
+        case OP_MUL_CELL_CONST:
+            printf("%s %s, %f\n", opcode_name(inst.opcode),
+                cellref_format(inst.operand.cell_const.coord, name),
+                inst.operand.cell_const.number);
+            break;
+        case OP_STORE_LOCAL:
+        case OP_LOAD_LOCAL:
+            printf("%s %d\n", opcode_name(inst.opcode), inst.operand.slot);
+            break;
+        case OP_ADD_CELL:     printf("ADD_CELL %s\n", cellref_format(inst.operand.cell.coord, name)); break;
+        case OP_MUL_CONST:    printf("MUL_CONST %f\n", inst.operand.number); break;
+        case OP_JMP_IF_NOT_GT:
+        case OP_JMP_IF_NOT_LT:
+        case OP_JMP_IF_NOT_GTE:
+        case OP_JMP_IF_NOT_LTE:
+        case OP_JMP_IF_NOT_EQ:
+        case OP_JMP_IF_NOT_NEQ:
+            printf("%s -> %d\n", opcode_name(inst.opcode), inst.operand.address);
             break;
         default:
-            printf("UNKNOWN (0x%X)\n", inst.opcode);
+            if (opcode_name(inst.opcode) != NULL) {
+                printf("%s\n", opcode_name(inst.opcode)); // No operand
+            } else {
+                printf("UNKNOWN (0x%X)\n", inst.opcode);
+            }
             break;
     }
 }
@@ -12,13 +12,14 @@
 #define IR_H
 
 #include <stdlib.h>
+#include "cellref.h" // For CellCoord
 
 /* --- OpCodes --- */
 typedef enum {
     OP_HALT,        // Stop execution
     OP_PUSH,        // Push constant number
-    OP_PUSH_CELL,   // Push cell value
-    OP_PUSH_RANGE,  // Push a string literal for a range (e.g., "A1:B10")
+    OP_PUSH_CELL,   // Push cell value (by symbol table id)
+    OP_PUSH_RANGE,  // Push a range (e.g., A1:B10) as a function argument
     
     // Binary Ops
     OP_ADD,
@@ -46,11 +47,49 @@ typedef enum {
     // Functions
     OP_CALL,        // Call a built-in function
     
+    // Locals: a numeric subexpression computed once per evaluation
+    OP_STORE_LOCAL, // Copy the top of the stack (a number) into a slot
+    OP_LOAD_LOCAL,  // Push the number in a slot
+    
+    // Typed Numeric Ops: both operands are proven numbers, so the VM
+    // works on the raw doubles with no tag checks, conversions or frees
+    OP_ADD_NUM,
+    OP_SUB_NUM,
+    OP_MUL_NUM,
+    OP_DIV_NUM,
+    OP_POW_NUM,
+    OP_EQ_NUM,
+    OP_NEQ_NUM,
+    OP_GT_NUM,
+    OP_LT_NUM,
+    OP_GTE_NUM,
+    OP_LTE_NUM,
+    OP_NEG_NUM,
+    
+    // Superinstructions: a frequent sequence fused into one dispatch
+    // (see fuse_superinstructions)
+    OP_ADD_CELL_CELL,   // PUSH_CELL a, PUSH_CELL b, ADD
+    OP_SUB_CELL_CELL,   // PUSH_CELL a, PUSH_CELL b, SUB
+    OP_MUL_CELL_CELL,   // PUSH_CELL a, PUSH_CELL b, MUL
+    OP_ADD_CELL_CONST,  // PUSH_CELL a, PUSH k, ADD (or k + a)
+    OP_MUL_CELL_CONST,  // PUSH_CELL a, PUSH k, MUL (or k * a)
+    OP_ADD_CELL,        // PUSH_CELL a, ADD: top = top + a
+    OP_MUL_CONST,       // PUSH k, MUL: top = top * k
+    OP_JMP_IF_NOT_GT,   // GT, JMP_IF_FALSE: pop b, a; jump unless a > b
+    OP_JMP_IF_NOT_LT,
+    OP_JMP_IF_NOT_GTE,
+    OP_JMP_IF_NOT_LTE,
+    OP_JMP_IF_NOT_EQ,
+    OP_JMP_IF_NOT_NEQ,
+    
     // Optimizer
     OP_NOP          // No-operation
     
 } OpCode;
 
+#define OP_COUNT (OP_NOP + 1) // Number of opcodes
+#define MAX_LOCAL_SLOTS 64    // Local slots per formula
+
 /* --- Instruction Operand --- */
 
 // Struct to hold function call info
@@ -60,6 +99,20 @@ typedef struct {
 } FuncCallInfo;
 
 
+// Cell operand: resolved once by the code generator
+typedef struct {
+    CellCoord coord; // For printing (e.g., "A1")
+    int id;          // Symbol table id: the VM indexes the cell directly
+} CellOperand;
+
+
+// Operand of a superinstruction on one cell and one constant
+typedef struct {
+    CellCoord coord;
+    double number;
+} CellConstOperand;
+
+
 // An instruction is an opcode + an optional operand
 typedef struct {
     OpCode opcode;
@@ -67,20 +120,64 @@ typedef struct {
     
     union {
         double number;
-        char *cell_ref; // For PUSH_CELL (e.g., "A1")
-        char *range_str; // For PUSH_RANGE (e.g., "A1:B10")
+        CellOperand cell; // For PUSH_CELL
+        CellRange range; // For PUSH_RANGE (e.g., A1:B10)
         int address;    // For JMP targets
+        int slot;       // For OP_STORE_LOCAL, OP_LOAD_LOCAL
         FuncCallInfo func_call; // For OP_CALL
+        struct {
+            CellCoord a, b;
+        } cells;        // For OP_*_CELL_CELL
+        CellConstOperand cell_const; // For OP_*_CELL_CONST
     } operand;
     
 } Instruction;
 
 
+/**
+ * @brief Maps a typed numeric opcode (e.g., OP_ADD_NUM) to the generic
+ * opcode with the same meaning (OP_ADD). Other opcodes map to themselves.
+ */
+static inline OpCode opcode_generic(OpCode opcode) {
+    switch (opcode) {
+        case OP_ADD_NUM: return OP_ADD;
+        case OP_SUB_NUM: return OP_SUB;
+        case OP_MUL_NUM: return OP_MUL;
+        case OP_DIV_NUM: return OP_DIV;
+        case OP_POW_NUM: return OP_POW;
+        case OP_EQ_NUM:  return OP_EQ;
+        case OP_NEQ_NUM: return OP_NEQ;
+        case OP_GT_NUM:  return OP_GT;
+        case OP_LT_NUM:  return OP_LT;
+        case OP_GTE_NUM: return OP_GTE;
+        case OP_LTE_NUM: return OP_LTE;
+        case OP_NEG_NUM: return OP_NEG;
+        default:         return opcode;
+    }
+}
+
+/**
+ * @brief 1 if the opcode's operand is a jump target address.
+ */
+static inline int opcode_is_jump(OpCode opcode) {
+    return opcode == OP_JMP || opcode == OP_JMP_IF_FALSE ||
+           (opcode >= OP_JMP_IF_NOT_GT && opcode <= OP_JMP_IF_NOT_NEQ);
+}
+
+
 /* --- Code Array (Chunk) --- */
+struct JitCode; // jit.h
+
 typedef struct {
     Instruction *code;
     int capacity;
     int count;
+    int local_count;          // Local slots used (OP_STORE_LOCAL / OP_LOAD_LOCAL)
+    int verified;             // Set by vm_verify(): 0 = not checked, 1 = safe to run, -1 = rejected
+    const char* verify_error; // Why it was rejected
+    int exec_count;           // VM runs so far (see VM.jit_threshold)
+    int jit_status;           // 0 = not tried yet, 1 = compiled, -1 = left on the VM
+    struct JitCode* jit;      // Native code, or NULL
 } CodeArray;
 
 
@@ -92,15 +189,18 @@ void free_bytecode(CodeArray *code);
 // Emitter functions
 int emit_op(CodeArray* code, OpCode opcode, int line);
 int emit_push(CodeArray* code, double number, int line);
-int emit_push_cell(CodeArray* code, char* cell_ref, int line);
-int emit_push_range(CodeArray* code, char* range_str, int line);
+int emit_push_cell(CodeArray* code, CellCoord coord, int cell_id, int line);
+int emit_push_range(CodeArray* code, CellRange range, int line);
 int emit_jump(CodeArray* code, OpCode opcode, int line);
 int emit_call(CodeArray* code, int func_token, int arg_count, int line);
+int emit_local(CodeArray* code, OpCode opcode, int slot, int line);
+int emit_instruction(CodeArray* code, Instruction inst); // Appends a copy (e.g., of another CodeArray's)
 void patch_jump(CodeArray* code, int jump_instruction_index);
 
 // Debugging
 void print_bytecode(CodeArray* code);
 void print_instruction(Instruction instruction, int index); // FIX: Added prototype
+const char* opcode_name(OpCode opcode); // e.g., "PUSH_CELL", or NULL if unknown
 
 
 #endif // IR_H
@@ -0,0 +1,633 @@
+/*
+ * --- Native Code JIT Implementation ---
+ *
+ * One forward pass over the bytecode emits machine code and
+ * tracks, for every instruction, the stack depth and which
+ * slots hold booleans. IF only jumps forward, so the state at
+ * a jump target is known (from its jumps, and from the
+ * instruction before it) by the time the pass reaches it.
+ *
+ * Register use (System V): rdi = result, rsi = locals,
+ * rax/rcx/rdx = scratch, xmm0 .. xmm13 = stack slots,
+ * xmm14 = second operand of fused ops, xmm15 = constants.
+ */
+
+#include "jit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+JitStats jit_stats;
+
+#ifdef JIT_X86_64
+
+/* --- Machine Code Buffer --- */
+
+typedef struct {
+    unsigned char* bytes;
+    int count;
+    int capacity;
+} JitBuffer;
+
+enum { RAX = 0, RSP = 4, RSI = 6, RDI = 7 }; // Base registers for memory operands
+enum { XMM_TMP = 14, XMM_CONST = 15 };
+
+#define FRAME_SIZE 136   // Slot spills + rdi, rsi; keeps rsp 16-byte aligned for calls
+#define FRAME_RDI 112
+#define FRAME_RSI 120
+
+static void put(JitBuffer* b, unsigned char byte) {
+    if (b->count >= b->capacity) {
+        b->capacity = b->capacity < 256 ? 256 : b->capacity * 2;
+        b->bytes = (unsigned char*)realloc(b->bytes, b->capacity);
+        if (b->bytes == NULL) {
+            fprintf(stderr, "Fatal: Out of memory emitting native code\n");
+            exit(1);
+        }
+    }
+    b->bytes[b->count++] = byte;
+}
+
+static void put32(JitBuffer* b, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        put(b, (unsigned char)(value >> (8 * i)));
+    }
+}
+
+static void put64(JitBuffer* b, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        put(b, (unsigned char)(value >> (8 * i)));
+    }
+}
+
+// prefix [REX] 0F op, register to register
+static void sse_rr(JitBuffer* b, unsigned char prefix, unsigned char op, int dst, int src) {
+    put(b, prefix);
+    if (dst >= 8 || src >= 8) {
+        put(b, (unsigned char)(0x40 | ((dst >> 3) << 2) | (src >> 3)));
+    }
+    put(b, 0x0F);
+    put(b, op);
+    put(b, (unsigned char)(0xC0 | ((dst & 7) << 3) | (src & 7)));
+}
+
+// prefix [REX] 0F op, register and [base + disp32]
+static void sse_mem(JitBuffer* b, unsigned char prefix, unsigned char op, int reg, int base, int disp) {
+    put(b, prefix);
+    if (reg >= 8) {
+        put(b, 0x44);
+    }
+    put(b, 0x0F);
+    put(b, op);
+    put(b, (unsigned char)(0x80 | ((reg & 7) << 3) | base));
+    if (base == RSP) {
+        put(b, 0x24); // SIB: no index
+    }
+    put32(b, (unsigned int)disp);
+}
+
+static void movsd_rr(JitBuffer* b, int dst, int src) {
+    if (dst != src) {
+        sse_rr(b, 0xF2, 0x10, dst, src);
+    }
+}
+
+static void movsd_load(JitBuffer* b, int reg, int base, int disp) {
+    sse_mem(b, 0xF2, 0x10, reg, base, disp);
+}
+
+static void movsd_store(JitBuffer* b, int reg, int base, int disp) {
+    sse_mem(b, 0xF2, 0x11, reg, base, disp);
+}
+
+// mov rax, imm64
+static void mov_rax(JitBuffer* b, unsigned long long value) {
+    put(b, 0x48);
+    put(b, 0xB8);
+    put64(b, value);
+}
+
+// xmm = the bits of a double
+static void load_constant(JitBuffer* b, int reg, double value) {
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0) {
+        sse_rr(b, 0x66, 0x57, reg, reg); // xorpd: +0.0
+        return;
+    }
+    mov_rax(b, bits);
+    put(b, 0x66); // movq xmm, rax
+    put(b, (unsigned char)(0x48 | ((reg >> 3) << 2)));
+    put(b, 0x0F);
+    put(b, 0x6E);
+    put(b, (unsigned char)(0xC0 | ((reg & 7) << 3)));
+}
+
+// xmm = *address
+static void load_address(JitBuffer* b, int reg, const double* address) {
+    mov_rax(b, (unsigned long long)(size_t)address);
+    movsd_load(b, reg, RAX, 0);
+}
+
+// ucomisd a, b
+static void compare(JitBuffer* b, int a, int c) {
+    sse_rr(b, 0x66, 0x2E, a, c);
+}
+
+// Sets the flags for "xmm != 0" (ZF = 0 or PF = 1: truthy, NaN included)
+static void test_zero(JitBuffer* b, int reg) {
+    sse_rr(b, 0x66, 0x57, XMM_CONST, XMM_CONST);
+    compare(b, reg, XMM_CONST);
+}
+
+// setcc al (reg = 0) or cl (reg = 1) or dl (reg = 2)
+static void setcc(JitBuffer* b, unsigned char cc, int reg) {
+    put(b, 0x0F);
+    put(b, cc);
+    put(b, (unsigned char)(0xC0 | reg));
+}
+
+enum { CC_B = 0x92, CC_AE = 0x93, CC_E = 0x94, CC_NE = 0x95, CC_BE = 0x96,
+       CC_A = 0x97, CC_P = 0x9A, CC_NP = 0x9B };
+
+// al = truth of the flags set by test_zero
+static void set_truth(JitBuffer* b) {
+    setcc(b, CC_NE, 0);
+    setcc(b, CC_P, 1);
+    put(b, 0x08); put(b, 0xC8); // or al, cl
+}
+
+// xmm = al (0.0 or 1.0)
+static void boolean_from_al(JitBuffer* b, int reg) {
+    put(b, 0x0F); put(b, 0xB6); put(b, 0xC0); // movzx eax, al
+    sse_rr(b, 0xF2, 0x2A, reg, RAX);          // cvtsi2sd xmm, eax
+}
+
+// Emits a jump (jcc = 0 for jmp) to be patched, and returns the offset of its rel32
+static int jump(JitBuffer* b, unsigned char jcc) {
+    if (jcc == 0) {
+        put(b, 0xE9);
+    } else {
+        put(b, 0x0F);
+        put(b, (unsigned char)(jcc - 0x10)); // setcc 0F 9x -> jcc 0F 8x
+    }
+    put32(b, 0);
+    return b->count - 4;
+}
+
+// Emits a jump, to be patched to the bail-out path, taken if xmm 'reg' is NaN.
+// An error cell is a NaN (cellstore.h), and only the VM reports errors.
+static int bail_if_nan(JitBuffer* b, int reg) {
+    compare(b, reg, reg);
+    return jump(b, CC_P);
+}
+
+static void patch(JitBuffer* b, int at, int target) {
+    unsigned int rel = (unsigned int)(target - (at + 4));
+    memcpy(b->bytes + at, &rel, 4);
+}
+
+static void epilogue(JitBuffer* b) {
+    put(b, 0x48); put(b, 0x81); put(b, 0xC4); put32(b, FRAME_SIZE); // add rsp, FRAME_SIZE
+    put(b, 0xC3);                                                    // ret
+}
+
+// Calls pow(xmm[a], xmm[a + 1]) into xmm[a], keeping slots 0 .. a - 1
+static void call_pow(JitBuffer* b, int a) {
+    for (int i = 0; i <= a + 1; i++) {
+        movsd_store(b, i, RSP, 8 * i);
+    }
+    movsd_load(b, 0, RSP, 8 * a);
+    movsd_load(b, 1, RSP, 8 * (a + 1));
+    double (*fn)(double, double) = pow;
+    mov_rax(b, (unsigned long long)(size_t)fn);
+    put(b, 0xFF); put(b, 0xD0); // call rax
+    movsd_rr(b, a, 0);
+    for (int i = 0; i < a; i++) {
+        movsd_load(b, i, RSP, 8 * i);
+    }
+    put(b, 0x48); put(b, 0x8B); put(b, 0xBC); put(b, 0x24); put32(b, FRAME_RDI); // mov rdi, [rsp + FRAME_RDI]
+    put(b, 0x48); put(b, 0x8B); put(b, 0xB4); put(b, 0x24); put32(b, FRAME_RSI); // mov rsi, [rsp + FRAME_RSI]
+}
+
+
+/* --- Translation --- */
+
+// The address of a cell's grid slot, or NULL if its chunk does not exist yet
+static const double* cell_address(SymbolTable* table, CellCoord coord) {
+    CellChunk* chunk = cellstore_chunk(&table->grid, coord);
+    return chunk ? &chunk->values[cell_row(coord) & (CELLSTORE_CHUNK_ROWS - 1)] : NULL;
+}
+
+typedef struct {
+    int depth;      // -1: not reached by a jump yet
+    int booleans;   // Bit i set: slot i holds a boolean
+} SlotState;
+
+// Records the state at a jump target. 0 if it conflicts with an earlier jump.
+static int join(SlotState* at, int depth, int booleans) {
+    if (at->depth < 0) {
+        at->depth = depth;
+        at->booleans = booleans;
+        return 1;
+    }
+    return at->depth == depth && at->booleans == booleans;
+}
+
+// Emits the whole function into 'b'. Returns 0 if the code is not supported.
+static int translate(JitBuffer* b, const CodeArray* code, SymbolTable* table, int* boolean_result) {
+    int n = code->count;
+    SlotState* targets = (SlotState*)malloc((n + 1) * sizeof(SlotState));
+    int* labels = (int*)malloc((n + 1) * sizeof(int));     // Native offset of each instruction
+    int* fixups = (int*)malloc((2 * n + 1) * sizeof(int)); // rel32 offsets to patch...
+    int* fixup_pc = (int*)malloc((2 * n + 1) * sizeof(int)); // ...and their bytecode targets
+    int* bails = (int*)malloc((2 * n + 1) * sizeof(int)); // At most two per instruction
+    if (targets == NULL || labels == NULL || fixups == NULL || fixup_pc == NULL || bails == NULL) {
+        fprintf(stderr, "Fatal: Out of memory compiling native code\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        targets[i].depth = -1;
+    }
+    int fixup_count = 0;
+    int bail_count = 0;
+    int result_type = -1;
+    int ok = 1;
+
+    // Prologue: frame for pow() calls, rdi and rsi saved in it
+    put(b, 0x48); put(b, 0x81); put(b, 0xEC); put32(b, FRAME_SIZE); // sub rsp, FRAME_SIZE
+    put(b, 0x48); put(b, 0x89); put(b, 0xBC); put(b, 0x24); put32(b, FRAME_RDI); // mov [rsp + FRAME_RDI], rdi
+    put(b, 0x48); put(b, 0x89); put(b, 0xB4); put(b, 0x24); put32(b, FRAME_RSI); // mov [rsp + FRAME_RSI], rsi
+
+    int depth = 0;      // State of the fall-through path
+    int booleans = 0;
+    int reachable = 1;
+
+    for (int pc = 0; pc < n && ok; pc++) {
+        labels[pc] = b->count;
+        if (targets[pc].depth >= 0) {
+            if (reachable && !join(&targets[pc], depth, booleans)) {
+                ok = 0; // e.g., IF(c, A1 > 1, 2): a boolean on one branch only
+                break;
+            }
+            depth = targets[pc].depth;
+            booleans = targets[pc].booleans;
+            reachable = 1;
+        }
+        if (!reachable) {
+            continue; // Dead code
+        }
+
+        const Instruction* inst = &code->code[pc];
+        int top = depth - 1;    // Slot of the top of the stack
+        OpCode op = opcode_generic(inst->opcode);
+        switch (op) {
+            case OP_PUSH:
+                load_constant(b, depth, inst->operand.number);
+                booleans &= ~(1 << depth);
+                depth++;
+                break;
+
+            case OP_PUSH_CELL:
+            case OP_ADD_CELL_CELL:
+            case OP_SUB_CELL_CELL:
+            case OP_MUL_CELL_CELL:
+            case OP_ADD_CELL_CONST:
+            case OP_MUL_CELL_CONST: {
+                const double* x;
+                const double* y = NULL;
+                if (op == OP_PUSH_CELL) {
+                    x = cell_address(table, inst->operand.cell.coord);
+                } else if (op == OP_ADD_CELL_CONST || op == OP_MUL_CELL_CONST) {
+                    x = cell_address(table, inst->operand.cell_const.coord);
+                } else {
+                    x = cell_address(table, inst->operand.cells.a);
+                    y = cell_address(table, inst->operand.cells.b);
+                    if (y == NULL) {
+                        ok = 0;
+                        break;
+                    }
+                }
+                if (x == NULL) {
+                    ok = 0;
+                    break;
+                }
+                load_address(b, depth, x);
+                bails[bail_count++] = bail_if_nan(b, depth);
+                if (y != NULL) {
+                    load_address(b, XMM_TMP, y);
+                    bails[bail_count++] = bail_if_nan(b, XMM_TMP);
+                } else if (op != OP_PUSH_CELL) {
+                    load_constant(b, XMM_TMP, inst->operand.cell_const.number);
+                }
+                switch (op) {
+                    case OP_ADD_CELL_CELL: case OP_ADD_CELL_CONST:
+                        sse_rr(b, 0xF2, 0x58, depth, XMM_TMP); break; // addsd
+                    case OP_SUB_CELL_CELL:
+                        sse_rr(b, 0xF2, 0x5C, depth, XMM_TMP); break; // subsd
+                    case OP_MUL_CELL_CELL: case OP_MUL_CELL_CONST:
+                        sse_rr(b, 0xF2, 0x59, depth, XMM_TMP); break; // mulsd
+                    default:
+                        break;
+                }
+                booleans &= ~(1 << depth);
+                depth++;
+                break;
+            }
+
+            case OP_LOAD_LOCAL:
+                movsd_load(b, depth, RSI, 8 * inst->operand.slot);
+                booleans &= ~(1 << depth);
+                depth++;
+                break;
+
+            case OP_STORE_LOCAL:
+                movsd_store(b, top, RSI, 8 * inst->operand.slot); // A boolean stores as 0 / 1
+                break;
+
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: {
+                int a = top - 1;
+                if (op == OP_DIV) {
+                    test_zero(b, top);
+                    bails[bail_count++] = jump(b, CC_E); // Zero (or NaN): the VM reports it
+                }
+                unsigned char opcode = (op == OP_ADD) ? 0x58 : (op == OP_SUB) ? 0x5C
+                                     : (op == OP_MUL) ? 0x59 : 0x5E;
+                sse_rr(b, 0xF2, opcode, a, top);
+                depth--;
+                booleans &= ~(1 << a);
+                break;
+            }
+
+            case OP_POW:
+                call_pow(b, top - 1);
+                depth--;
+                booleans &= ~(1 << (top - 1));
+                break;
+
+            case OP_GT: case OP_GTE: case OP_LT: case OP_LTE: case OP_EQ: case OP_NEQ: {
+                int a = top - 1;
+                switch (op) {
+                    case OP_GT:  compare(b, a, top); setcc(b, CC_A, 0); break;
+                    case OP_GTE: compare(b, a, top); setcc(b, CC_AE, 0); break;
+                    case OP_LT:  compare(b, top, a); setcc(b, CC_A, 0); break;
+                    case OP_LTE: compare(b, top, a); setcc(b, CC_AE, 0); break;
+                    case OP_EQ:
+                        compare(b, a, top);
+                        setcc(b, CC_E, 0);
+                        setcc(b, CC_NP, 1);
+                        put(b, 0x20); put(b, 0xC8); // and al, cl
+                        break;
+                    default:
+                        compare(b, a, top);
+                        set_truth(b);
+                        break;
+                }
+                boolean_from_al(b, a);
+                depth--;
+                booleans |= 1 << a;
+                break;
+            }
+
+            case OP_AND: case OP_OR: {
+                int a = top - 1;
+                test_zero(b, a);
+                set_truth(b);
+                put(b, 0x88); put(b, 0xC2); // mov dl, al
+                test_zero(b, top);
+                set_truth(b);
+                put(b, op == OP_AND ? 0x20 : 0x08); put(b, 0xD0); // and/or al, dl
+                boolean_from_al(b, a);
+                depth--;
+                booleans |= 1 << a;
+                break;
+            }
+
+            case OP_NEG:
+                load_constant(b, XMM_CONST, -0.0);
+                sse_rr(b, 0x66, 0x57, top, XMM_CONST); // xorpd: flip the sign
+                booleans &= ~(1 << top);
+                break;
+
+            case OP_NOT:
+                test_zero(b, top);
+                set_truth(b);
+                put(b, 0x34); put(b, 0x01); // xor al, 1
+                boolean_from_al(b, top);
+                booleans |= 1 << top;
+                break;
+
+            case OP_ADD_CELL: {
+                const double* y = cell_address(table, inst->operand.cell.coord);
+                if (y == NULL) {
+                    ok = 0;
+                    break;
+                }
+                load_address(b, XMM_TMP, y);
+                bails[bail_count++] = bail_if_nan(b, XMM_TMP);
+                sse_rr(b, 0xF2, 0x58, top, XMM_TMP);
+                booleans &= ~(1 << top);
+                break;
+            }
+
+            case OP_MUL_CONST:
+                load_constant(b, XMM_TMP, inst->operand.number);
+                sse_rr(b, 0xF2, 0x59, top, XMM_TMP);
+                booleans &= ~(1 << top);
+                break;
+
+            case OP_JMP_IF_FALSE:
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ:
+            case OP_JMP: {
+                int target = inst->operand.address;
+                int popped = (op == OP_JMP) ? 0 : (op == OP_JMP_IF_FALSE) ? 1 : 2;
+                int a = depth - popped;
+                if (target <= pc) {
+                    ok = 0; // Only forward jumps are translated
+                    break;
+                }
+                int skip = -1; // A jp over the je, for "false" tests that NaN must fail
+                switch (op) {
+                    case OP_JMP:
+                        fixups[fixup_count] = jump(b, 0);
+                        break;
+                    case OP_JMP_IF_FALSE:
+                        test_zero(b, top);
+                        skip = jump(b, CC_P);
+                        fixups[fixup_count] = jump(b, CC_E);
+                        break;
+                    case OP_JMP_IF_NOT_GT:  compare(b, a, a + 1); fixups[fixup_count] = jump(b, CC_BE); break;
+                    case OP_JMP_IF_NOT_LT:  compare(b, a + 1, a); fixups[fixup_count] = jump(b, CC_BE); break;
+                    case OP_JMP_IF_NOT_GTE: compare(b, a, a + 1); fixups[fixup_count] = jump(b, CC_B); break;
+                    case OP_JMP_IF_NOT_LTE: compare(b, a + 1, a); fixups[fixup_count] = jump(b, CC_B); break;
+                    case OP_JMP_IF_NOT_EQ:
+                        compare(b, a, a + 1);
+                        fixup_pc[fixup_count] = target;
+                        fixups[fixup_count++] = jump(b, CC_NE);
+                        fixups[fixup_count] = jump(b, CC_P);
+                        break;
+                    default: // OP_JMP_IF_NOT_NEQ
+                        compare(b, a, a + 1);
+                        skip = jump(b, CC_P);
+                        fixups[fixup_count] = jump(b, CC_E);
+                        break;
+                }
+                fixup_pc[fixup_count++] = target;
+                if (skip >= 0) {
+                    patch(b, skip, b->count);
+                }
+                depth = a;
+                booleans &= (1 << depth) - 1;
+                if (!join(&targets[target], depth, booleans)) {
+                    ok = 0;
+                    break;
+                }
+                if (op == OP_JMP) {
+                    reachable = 0;
+                }
+                break;
+            }
+
+            case OP_HALT: {
+                if (depth == 0) {
+                    ok = 0; // The VM's "halted on empty stack" error
+                    break;
+                }
+                int type = (booleans >> top) & 1;
+                if (result_type >= 0 && result_type != type) {
+                    ok = 0;
+                    break;
+                }
+                result_type = type;
+                movsd_store(b, top, RDI, 0);
+                put(b, 0xB8); put32(b, 1); // mov eax, 1
+                epilogue(b);
+                reachable = 0;
+                break;
+            }
+
+            case OP_NOP:
+                break;
+
+            default:
+                ok = 0; // OP_PUSH_RANGE, OP_CALL: stay on the VM
+                break;
+        }
+        if (depth > JIT_MAX_DEPTH) {
+            ok = 0;
+        }
+    }
+
+    if (ok && result_type < 0) {
+        ok = 0; // No reachable HALT
+    }
+    if (ok) {
+        // Bail-out path: the VM runs the formula instead
+        int bail = b->count;
+        put(b, 0x31); put(b, 0xC0); // xor eax, eax
+        epilogue(b);
+        for (int i = 0; i < bail_count; i++) {
+            patch(b, bails[i], bail);
+        }
+        for (int i = 0; i < fixup_count; i++) {
+            patch(b, fixups[i], labels[fixup_pc[i]]);
+        }
+        *boolean_result = result_type;
+    }
+
+    free(targets);
+    free(labels);
+    free(fixups);
+    free(fixup_pc);
+    free(bails);
+    return ok;
+}
+
+#endif // JIT_X86_64
+
+
+/* --- Public API --- */
+
+JitCode* jit_compile(const CodeArray* code, SymbolTable* table) {
+#ifdef JIT_X86_64
+    if (code->verified != 1) {
+        jit_stats.declined++;
+        return NULL;
+    }
+
+    JitBuffer b = { NULL, 0, 0 };
+    int boolean = 0;
+    if (!translate(&b, code, table, &boolean)) {
+        free(b.bytes);
+        jit_stats.declined++;
+        return NULL;
+    }
+
+    // Copy into fresh pages, then make them executable (never writable and executable)
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = ((size_t)b.count + page - 1) / page * page;
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        free(b.bytes);
+        jit_stats.declined++;
+        return NULL;
+    }
+    memcpy(memory, b.bytes, b.count);
+    free(b.bytes);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        jit_stats.declined++;
+        return NULL;
+    }
+
+    JitCode* jit = (JitCode*)malloc(sizeof(JitCode));
+    if (jit == NULL) {
+        fprintf(stderr, "Fatal: Out of memory compiling native code\n");
+        exit(1);
+    }
+    jit->memory = memory;
+    jit->size = size;
+    jit->code_bytes = b.count;
+    jit->boolean = boolean;
+    memcpy(&jit->entry, &memory, sizeof(memory)); // Data pointer to function pointer
+    jit_stats.compiled++;
+    jit_stats.bytes += b.count;
+    return jit;
+#else
+    (void)code;
+    (void)table;
+    jit_stats.declined++;
+    return NULL;
+#endif
+}
+
+int jit_run(const JitCode* jit, double* locals, Value* result) {
+    double value;
+    if (!jit->entry(&value, locals)) {
+        jit_stats.bailouts++;
+        return 0;
+    }
+    jit_stats.native_runs++;
+    *result = jit->boolean ? create_boolean_value(value != 0.0) : create_number_value(value);
+    return 1;
+}
+
+void jit_free(JitCode* jit) {
+    if (jit == NULL) return;
+#ifdef JIT_X86_64
+    munmap(jit->memory, jit->size);
+#endif
+    free(jit);
+}
+
+void jit_print_stats(void) {
+    printf("✓ JIT: %ld formula(s) compiled (%ld bytes), %ld left on the VM, %ld native run(s), %ld bail-out(s)\n",
+        jit_stats.compiled, jit_stats.bytes, jit_stats.declined, jit_stats.native_runs, jit_stats.bailouts);
+}
@@ -0,0 +1,96 @@
+/*
+ * --- Native Code JIT Header ---
+ *
+ * A second tier for hot formulas. Once a CodeArray has run
+ * vm->jit_threshold times, its bytecode is translated to
+ * x86-64 machine code in its own mmap'd page:
+ * - stack slot i lives in SSE register xmm<i>, so a formula
+ *   whose stack grows deeper than JIT_MAX_DEPTH is not compiled;
+ * - cell loads are direct reads of the cell's grid slot (its
+ *   address is fixed once the cell's chunk exists);
+ * - IF branches and fused compare-jumps become native jumps.
+ *
+ * Booleans are kept as 0.0 / 1.0. The type of every slot is
+ * known at compile time, so the result gets the same Value
+ * type the VM would give it.
+ *
+ * Code using anything else (function calls, ranges) stays on
+ * the VM. Native code never reports errors itself: on a
+ * division by zero, or a cell that reads as NaN (as error
+ * cells do), it bails out, and the VM runs the formula again
+ * to produce the error value.
+ *
+ * Only built on x86-64 Linux/macOS; elsewhere (or with
+ * -DVM_NO_JIT) jit_compile() always declines.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include "ir.h"
+#include "symtab.h"
+#include "value.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__)) && !defined(VM_NO_JIT)
+#define JIT_X86_64 1
+#endif
+
+#define JIT_MAX_DEPTH 14 // xmm0 .. xmm13; xmm14 and xmm15 are scratch
+
+// Native entry point: writes the result, returns 1, or 0 to bail out
+typedef int (*JitFunction)(double* result, double* locals);
+
+typedef struct JitCode {
+    JitFunction entry;
+    void* memory;       // The mmap'd pages
+    size_t size;        // Their size
+    int code_bytes;     // Machine code emitted
+    int boolean;        // 1 if the result is a TYPE_BOOLEAN
+} JitCode;
+
+/*
+ * Counters for the summary (compilation only happens on the
+ * serial recalculation path).
+ */
+typedef struct {
+    long compiled;
+    long declined;      // Unsupported bytecode
+    long bytes;
+    long native_runs;
+    long bailouts;
+} JitStats;
+
+extern JitStats jit_stats;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Translates verified bytecode to native code. Cell
+ * addresses are resolved in 'table', which must outlive it.
+ * @return The native code, or NULL if the code uses something
+ * the JIT does not support (the VM keeps running it).
+ */
+JitCode* jit_compile(const CodeArray* code, SymbolTable* table);
+
+/**
+ * @brief Runs native code.
+ * @param locals Scratch for OP_STORE_LOCAL / OP_LOAD_LOCAL.
+ * @return 1 with the result in 'result', or 0 if the VM must
+ * run the formula instead.
+ */
+int jit_run(const JitCode* jit, double* locals, Value* result);
+
+/**
+ * @brief Unmaps native code.
+ */
+void jit_free(JitCode* jit);
+
+/**
+ * @brief Prints the compile, bail-out and run counters.
+ */
+void jit_print_stats(void);
+
+
+#endif // JIT_H
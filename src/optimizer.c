@@ -1,5 +1,218 @@
 #include "optimizer.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "parser.tab.h" // For SUM, MIN, MAX
+#include "vm.h"         // For vm_verify, VM_STACK_SIZE
+#include "codegen.h"    // For ast_is_numeric
+
+/*
+ * --- AST Simplification ---
+ *
+ * Folds constant subtrees and applies algebraic identities on the
+ * tree, before any code is generated, so every engine (AST, stack
+ * VM, register VM) runs the smaller formula:
+ *
+ * (1+2)*3        ->  9
+ * A1*1 - 0       ->  A1
+ * IF(2>1, A1, B1) -> A1
+ *
+ * Folding must not change what a formula returns, including its
+ * type: "1>0" is the boolean TRUE, which has no literal node, so a
+ * comparison is only folded (to 1 or 0) where its user only looks
+ * at its number or its truth. Each node is simplified knowing how
+ * its parent uses it.
+ */
+
+typedef enum {
+    USE_VALUE,  // The exact value is used (a result, a function argument)
+    USE_NUMBER, // Only get_numeric() of it is used (an arithmetic operand)
+    USE_TRUTH   // Only is_truthy() of it is used (a condition)
+} ValueUse;
+
+/*
+ * Nodes live in ast_arena, so the subtrees a rewrite drops are
+ * simply left behind until the arena is rewound.
+ */
+
+// Turns 'node' into the literal 'value', dropping its children
+static void make_number(ASTNode* node, double value) {
+    node->type = NODE_NUMBER;
+    node->data.number = value;
+}
+
+// Drops 'node' but keeps '*slot', one of its subtrees, which is returned
+static ASTNode* keep_child(ASTNode* node, ASTNode** slot) {
+    (void)node;
+    return *slot;
+}
+
+// Value of a comparison, AND or OR of two constants
+static double fold_logic(int op_token, double x, double y) {
+    switch (op_token) {
+        case GT:     return x > y;
+        case LT:     return x < y;
+        case GTE:    return x >= y;
+        case LTE:    return x <= y;
+        case EQUALS: return x == y;
+        case NE:     return x != y;
+        case AND:    return (x != 0) && (y != 0);
+        default:     return (x != 0) || (y != 0); // OR
+    }
+}
+
+static ASTNode* simplify(ASTNode* node, ValueUse use, int* rewrites);
+
+static ASTNode* simplify_binary(ASTNode* node, ValueUse use, int* rewrites) {
+    int op = node->data.op.op_token;
+    int arithmetic = (op == PLUS || op == MINUS || op == MULTIPLY || op == DIVIDE || op == POWER);
+    ValueUse operand_use = (op == AND || op == OR) ? USE_TRUTH : USE_NUMBER;
+    node->data.op.left = simplify(node->data.op.left, operand_use, rewrites);
+    node->data.op.right = simplify(node->data.op.right, operand_use, rewrites);
+    ASTNode* left = node->data.op.left;
+    ASTNode* right = node->data.op.right;
+
+    // 1. Both operands known
+    if (left->type == NODE_NUMBER && right->type == NODE_NUMBER) {
+        double x = left->data.number, y = right->data.number;
+        if (arithmetic) {
+            double value;
+            switch (op) {
+                case PLUS:     value = x + y; break;
+                case MINUS:    value = x - y; break;
+                case MULTIPLY: value = x * y; break;
+                case DIVIDE:
+                    if (y == 0) {
+                        return node; // Left for the runtime to report
+                    }
+                    value = x / y;
+                    break;
+                default:       value = pow(x, y); break;
+            }
+            make_number(node, value);
+            (*rewrites)++;
+        } else if (use != USE_VALUE) {
+            make_number(node, fold_logic(op, x, y)); // A boolean, as its number
+            (*rewrites)++;
+        }
+        return node;
+    }
+
+    // 2. Identities. Dropping the operator also drops its conversion to
+    // a number, so the other operand must be a number already, or
+    // only be used as one. There is no x + 0: -0 + 0 is 0, and the sign
+    // shows (-0 prints as -0.000000). x - 0 keeps it, but x - -0 does not.
+    if (!arithmetic) {
+        return node;
+    }
+    int is_zero_r = (right->type == NODE_NUMBER && right->data.number == 0 && !signbit(right->data.number));
+    int is_one_r = (right->type == NODE_NUMBER && right->data.number == 1);
+    int is_one_l = (left->type == NODE_NUMBER && left->data.number == 1);
+    if ((op == MINUS && is_zero_r) ||
+        (op == MULTIPLY && is_one_r) || (op == DIVIDE && is_one_r) || (op == POWER && is_one_r)) {
+        if (use == USE_NUMBER || ast_is_numeric(left)) {
+            (*rewrites)++;
+            return keep_child(node, &node->data.op.left); // x
+        }
+    } else if (op == MULTIPLY && is_one_l) {
+        if (use == USE_NUMBER || ast_is_numeric(right)) {
+            (*rewrites)++;
+            return keep_child(node, &node->data.op.right); // x
+        }
+    }
+    return node;
+}
+
+static ASTNode* simplify_unary(ASTNode* node, ValueUse use, int* rewrites) {
+    int op = node->data.op.op_token;
+    node->data.op.left = simplify(node->data.op.left, op == NOT ? USE_TRUTH : USE_NUMBER, rewrites);
+    ASTNode* operand = node->data.op.left;
+
+    if (operand->type == NODE_NUMBER) {
+        if (op == MINUS) {
+            make_number(node, -operand->data.number);
+            (*rewrites)++;
+        } else if (use != USE_VALUE) {
+            make_number(node, operand->data.number == 0); // NOT, as a number
+            (*rewrites)++;
+        }
+        return node;
+    }
+
+    // -(-x) -> x
+    if (op == MINUS && operand->type == NODE_UNARY_OP && operand->data.op.op_token == MINUS &&
+        (use == USE_NUMBER || ast_is_numeric(operand->data.op.left))) {
+        (*rewrites)++;
+        return keep_child(operand, &operand->data.op.left);
+    }
+    return node;
+}
+
+static ASTNode* simplify_call(ASTNode* node, ValueUse use, int* rewrites) {
+    ASTNode* args = node->data.func.arguments;
+    if (node->data.func.function_token != IF) {
+        for (ASTNode* arg = args; arg != NULL; arg = arg->data.arg.next_arg) {
+            arg->data.arg.expression = simplify(arg->data.arg.expression, USE_VALUE, rewrites);
+        }
+        return node;
+    }
+
+    // IF(cond, a, b): the branches are used as the IF itself is
+    ASTNode* cond_arg = args;
+    ASTNode* true_arg = cond_arg->data.arg.next_arg;
+    ASTNode* false_arg = true_arg->data.arg.next_arg;
+    cond_arg->data.arg.expression = simplify(cond_arg->data.arg.expression, USE_TRUTH, rewrites);
+    true_arg->data.arg.expression = simplify(true_arg->data.arg.expression, use, rewrites);
+    false_arg->data.arg.expression = simplify(false_arg->data.arg.expression, use, rewrites);
+
+    ASTNode* cond = cond_arg->data.arg.expression;
+    if (cond->type != NODE_NUMBER) {
+        return node;
+    }
+    (*rewrites)++;
+    ASTNode* taken = (cond->data.number != 0) ? true_arg : false_arg;
+    return keep_child(node, &taken->data.arg.expression); // The other branch never runs
+}
+
+// Simplifies one subtree, bottom-up. Returns its (possibly new) root.
+static ASTNode* simplify(ASTNode* node, ValueUse use, int* rewrites) {
+    if (node == NULL) {
+        return NULL;
+    }
+    switch (node->type) {
+        case NODE_BINARY_OP:
+            return simplify_binary(node, use, rewrites);
+        case NODE_UNARY_OP:
+            return simplify_unary(node, use, rewrites);
+        case NODE_FUNCTION_CALL:
+            return simplify_call(node, use, rewrites);
+        default:
+            return node; // Leaves
+    }
+}
+
+
+/* --- Jump Targets --- */
+
+// Marks every instruction a jump can land on. The caller frees it.
+static char* find_jump_targets(const CodeArray* code) {
+    char* target = (char*)calloc(code->count + 1, 1);
+    if (target == NULL) {
+        fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+        exit(1);
+    }
+    for (int pc = 0; pc < code->count; pc++) {
+        const Instruction* inst = &code->code[pc];
+        if (opcode_is_jump(inst->opcode) &&
+            inst->operand.address >= 0 && inst->operand.address < code->count) {
+            target[inst->operand.address] = 1;
+        }
+    }
+    return target;
+}
+
 
 /*
  * --- Constant Folding ---
@@ -12,16 +225,20 @@
  * PUSH <result>
  * NOP
  * NOP
+ * unless a jump lands on the second PUSH or the OP (as after
+ * "IF(c, 1, 2) + 3", where the JMP past the false branch
+ * lands on "PUSH 3").
  */
-static void fold_constants(CodeArray* code) {
+static void fold_constants(CodeArray* code, int verbose) {
     int instructions_folded = 0;
+    char* target = find_jump_targets(code);
     for (int i = 0; i < code->count - 2; i++) {
         Instruction* inst1 = &code->code[i];
         Instruction* inst2 = &code->code[i+1];
         Instruction* inst3 = &code->code[i+2];
 
         // Look for PUSH, PUSH, OP
-        if (inst1->opcode == OP_PUSH && inst2->opcode == OP_PUSH) {
+        if (inst1->opcode == OP_PUSH && inst2->opcode == OP_PUSH && !target[i+1] && !target[i+2]) {
             double num1 = inst1->operand.number;
             double num2 = inst2->operand.number;
             double result = 0.0;
@@ -59,22 +276,518 @@ static void fold_constants(CodeArray* code) {
             }
         }
     }
-    if (instructions_folded > 0) {
+    free(target);
+    if (verbose && instructions_folded > 0) {
         printf("Optimizer: Constant folding pass complete. %d instructions folded.\n", instructions_folded);
     }
 }
 
 
+/*
+ * --- Type Specialization ---
+ *
+ * Infers the possible types of every stack slot before each
+ * instruction, as a set of TY_* bits, joining the sets where
+ * the two branches of an IF meet. Arithmetic and comparisons
+ * whose operands can only be numbers are then rewritten to
+ * their typed forms (OP_ADD -> OP_ADD_NUM, ...).
+ */
+
+#define TY_NUM   1
+#define TY_BOOL  2
+#define TY_OTHER 4 // Strings, errors, ranges
+#define TY_ANY   (TY_NUM | TY_BOOL | TY_OTHER)
+
+// Stack slot types before one instruction
+typedef struct {
+    int depth;
+    unsigned char* types; // NULL until the instruction is reached
+} StackShape;
+
+// Typed form of a generic opcode, or the opcode itself if there is none
+static OpCode typed_opcode(OpCode opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_NUM;
+        case OP_SUB: return OP_SUB_NUM;
+        case OP_MUL: return OP_MUL_NUM;
+        case OP_DIV: return OP_DIV_NUM;
+        case OP_POW: return OP_POW_NUM;
+        case OP_EQ:  return OP_EQ_NUM;
+        case OP_NEQ: return OP_NEQ_NUM;
+        case OP_GT:  return OP_GT_NUM;
+        case OP_LT:  return OP_LT_NUM;
+        case OP_GTE: return OP_GTE_NUM;
+        case OP_LTE: return OP_LTE_NUM;
+        case OP_NEG: return OP_NEG_NUM;
+        default:     return opcode;
+    }
+}
+
+// Type of a built-in's result: AVERAGE and NOT can return errors
+static unsigned char call_type(int func_token) {
+    switch (func_token) {
+        case SUM:
+        case MIN:
+        case MAX:
+            return TY_NUM;
+        default:
+            return TY_ANY;
+    }
+}
+
+// Merges a shape into the one before instruction 's', queueing 's' if it changed
+static void flow_into(StackShape* shapes, int s, const unsigned char* types, int depth,
+                      int* work, int* work_count, char* queued) {
+    StackShape* shape = &shapes[s];
+    int changed = 0;
+    if (shape->types == NULL) {
+        shape->types = (unsigned char*)malloc(depth + 1);
+        if (shape->types == NULL) {
+            fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+            exit(1);
+        }
+        memcpy(shape->types, types, depth);
+        shape->depth = depth; // Same on every path (checked by vm_verify)
+        changed = 1;
+    } else {
+        for (int i = 0; i < depth; i++) {
+            unsigned char merged = shape->types[i] | types[i];
+            if (merged != shape->types[i]) {
+                shape->types[i] = merged;
+                changed = 1;
+            }
+        }
+    }
+    if (changed && !queued[s]) {
+        queued[s] = 1;
+        work[(*work_count)++] = s;
+    }
+}
+
+static void specialize_types(CodeArray* code, int verbose) {
+    if (!vm_verify(code)) {
+        return; // Left for the VM to reject
+    }
+
+    int n = code->count;
+    StackShape* shapes = (StackShape*)calloc(n, sizeof(StackShape));
+    int* work = (int*)malloc(n * sizeof(int));
+    char* queued = (char*)calloc(n, 1);
+    if (shapes == NULL || work == NULL || queued == NULL) {
+        fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+        exit(1);
+    }
+
+    // 1. Propagate slot types to a fixed point
+    unsigned char types[VM_STACK_SIZE + 1];
+    int work_count = 0;
+    flow_into(shapes, 0, types, 0, work, &work_count, queued);
+    while (work_count > 0) {
+        int pc = work[--work_count];
+        queued[pc] = 0;
+        const Instruction* inst = &code->code[pc];
+        int d = shapes[pc].depth;
+        memcpy(types, shapes[pc].types, d);
+
+        int falls_through = 1;
+        int jumps = 0;
+        switch (opcode_generic(inst->opcode)) {
+            case OP_HALT:
+                falls_through = 0;
+                break;
+            case OP_PUSH:
+            case OP_PUSH_CELL:
+            case OP_LOAD_LOCAL:
+                types[d++] = TY_NUM;
+                break;
+            case OP_PUSH_RANGE:
+                types[d++] = TY_OTHER;
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+                types[--d - 1] = TY_NUM;
+                break;
+            case OP_EQ: case OP_NEQ: case OP_GT: case OP_LT: case OP_GTE:
+            case OP_LTE: case OP_AND: case OP_OR:
+                types[--d - 1] = TY_BOOL;
+                break;
+            case OP_NEG:
+                types[d - 1] = TY_NUM;
+                break;
+            case OP_NOT:
+                types[d - 1] = TY_BOOL;
+                break;
+            case OP_JMP:
+                falls_through = 0;
+                jumps = 1;
+                break;
+            case OP_JMP_IF_FALSE:
+                d--;
+                jumps = 1;
+                break;
+            case OP_CALL:
+                d -= inst->operand.func_call.arg_count;
+                types[d++] = call_type(inst->operand.func_call.token);
+                break;
+            default:
+                break;
+        }
+        if (falls_through) {
+            flow_into(shapes, pc + 1, types, d, work, &work_count, queued);
+        }
+        if (jumps) {
+            flow_into(shapes, inst->operand.address, types, d, work, &work_count, queued);
+        }
+    }
+
+    // 2. Rewrite the ops whose operands are numbers on every path
+    int specialized = 0;
+    for (int pc = 0; pc < n; pc++) {
+        Instruction* inst = &code->code[pc];
+        const StackShape* shape = &shapes[pc];
+        OpCode typed = typed_opcode(inst->opcode);
+        if (shape->types == NULL || typed == inst->opcode) {
+            continue; // Unreachable, or no typed form
+        }
+        int operands = (inst->opcode == OP_NEG) ? 1 : 2;
+        int numeric = 1;
+        for (int k = 1; k <= operands; k++) {
+            numeric &= (shape->types[shape->depth - k] == TY_NUM);
+        }
+        if (numeric) {
+            inst->opcode = typed;
+            specialized++;
+        }
+    }
+
+    for (int pc = 0; pc < n; pc++) {
+        free(shapes[pc].types);
+    }
+    free(shapes);
+    free(work);
+    free(queued);
+
+    if (verbose && specialized > 0) {
+        printf("Optimizer: Type specialization pass complete. %d instructions specialized.\n", specialized);
+    }
+}
+
+
+/*
+ * --- Superinstructions ---
+ *
+ * Fuses the sequences that dominate real sheets into single
+ * opcodes, so one dispatch does the work of two or three and
+ * the operands never touch the stack:
+ *
+ * PUSH_CELL A1          ADD_CELL_CELL A1, B1
+ * PUSH_CELL B1    ->    NOP
+ * ADD                   NOP
+ *
+ * The set comes from --opcode-stats over the sample sheets:
+ * cell-cell arithmetic, cell-constant arithmetic and "running
+ * total" chains (PUSH_CELL, ADD) cover most straight-line code,
+ * and every IF condition is a comparison right before its
+ * JMP_IF_FALSE. A sequence is only fused if no jump lands
+ * inside it. The NOPs are removed by compact_code().
+ */
+
+// Fused form of PUSH_CELL, PUSH_CELL, <op>
+static OpCode fuse_cell_cell(OpCode op) {
+    switch (opcode_generic(op)) {
+        case OP_ADD: return OP_ADD_CELL_CELL;
+        case OP_SUB: return OP_SUB_CELL_CELL;
+        case OP_MUL: return OP_MUL_CELL_CELL;
+        default:     return OP_NOP;
+    }
+}
+
+// Fused form of PUSH_CELL, PUSH, <op> (commutative ops only)
+static OpCode fuse_cell_const(OpCode op) {
+    switch (opcode_generic(op)) {
+        case OP_ADD: return OP_ADD_CELL_CONST;
+        case OP_MUL: return OP_MUL_CELL_CONST;
+        default:     return OP_NOP;
+    }
+}
+
+// Fused form of <compare>, JMP_IF_FALSE
+static OpCode fuse_compare_jump(OpCode op) {
+    switch (opcode_generic(op)) {
+        case OP_GT:  return OP_JMP_IF_NOT_GT;
+        case OP_LT:  return OP_JMP_IF_NOT_LT;
+        case OP_GTE: return OP_JMP_IF_NOT_GTE;
+        case OP_LTE: return OP_JMP_IF_NOT_LTE;
+        case OP_EQ:  return OP_JMP_IF_NOT_EQ;
+        case OP_NEQ: return OP_JMP_IF_NOT_NEQ;
+        default:     return OP_NOP;
+    }
+}
+
+static void fuse_superinstructions(CodeArray* code, int verbose) {
+    if (!vm_verify(code)) {
+        return; // Left for the VM to reject
+    }
+
+    char* target = find_jump_targets(code);
+    int fused = 0;
+    for (int i = 0; i < code->count; i++) {
+        Instruction* inst = &code->code[i];
+        Instruction* next = (i + 1 < code->count) ? &code->code[i + 1] : NULL;
+        Instruction* third = (i + 2 < code->count) ? &code->code[i + 2] : NULL;
+        if (next == NULL || target[i + 1]) {
+            continue;
+        }
+        int third_ok = (third != NULL && !target[i + 2]);
+
+        Instruction result = *inst;
+        OpCode op;
+        int slots = 3; // Instructions replaced
+        if (inst->opcode == OP_PUSH_CELL && next->opcode == OP_PUSH_CELL && third_ok &&
+            (op = fuse_cell_cell(third->opcode)) != OP_NOP) {
+            result.opcode = op;
+            result.operand.cells.a = inst->operand.cell.coord;
+            result.operand.cells.b = next->operand.cell.coord;
+        } else if (inst->opcode == OP_PUSH_CELL && next->opcode == OP_PUSH && third_ok &&
+                   (op = fuse_cell_const(third->opcode)) != OP_NOP) {
+            result.opcode = op;
+            result.operand.cell_const.coord = inst->operand.cell.coord;
+            result.operand.cell_const.number = next->operand.number;
+        } else if (inst->opcode == OP_PUSH && next->opcode == OP_PUSH_CELL && third_ok &&
+                   (op = fuse_cell_const(third->opcode)) != OP_NOP) {
+            result.opcode = op; // k + a == a + k, k * a == a * k
+            result.operand.cell_const.coord = next->operand.cell.coord;
+            result.operand.cell_const.number = inst->operand.number;
+        } else if (inst->opcode == OP_PUSH_CELL && opcode_generic(next->opcode) == OP_ADD) {
+            result.opcode = OP_ADD_CELL;
+            slots = 2;
+        } else if (inst->opcode == OP_PUSH && opcode_generic(next->opcode) == OP_MUL) {
+            result.opcode = OP_MUL_CONST;
+            slots = 2;
+        } else if (next->opcode == OP_JMP_IF_FALSE &&
+                   (op = fuse_compare_jump(inst->opcode)) != OP_NOP) {
+            result.opcode = op;
+            result.operand.address = next->operand.address;
+            slots = 2;
+        } else {
+            continue;
+        }
+
+        // Keep the fused op in the first slot, where jumps may land
+        *inst = result;
+        for (int k = 1; k < slots; k++) {
+            code->code[i + k].opcode = OP_NOP;
+        }
+        fused += slots - 1;
+        i += slots - 1;
+    }
+    free(target);
+
+    if (verbose && fused > 0) {
+        printf("Optimizer: Superinstruction pass complete. %d instructions fused.\n", fused);
+    }
+}
+
+
+/*
+ * --- NOP Compaction ---
+ *
+ * Removes the NOPs the other passes leave behind, so the VM
+ * never fetches them. Every jump is retargeted through an
+ * old -> new address map; a jump to a NOP lands on the first
+ * instruction after it, which is where the NOP would have
+ * fallen through to.
+ */
+static void compact_code(CodeArray* code, int verbose) {
+    if (!vm_verify(code)) {
+        return; // Jump targets can't be trusted
+    }
+
+    // 1. Map every old address to its new one
+    int n = code->count;
+    int* new_address = (int*)malloc((n + 1) * sizeof(int));
+    if (new_address == NULL) {
+        fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+        exit(1);
+    }
+    int kept = 0;
+    for (int pc = 0; pc < n; pc++) {
+        new_address[pc] = kept;
+        if (code->code[pc].opcode != OP_NOP) {
+            kept++;
+        }
+    }
+    new_address[n] = kept;
+
+    // 2. Slide the kept instructions down, retargeting jumps
+    if (kept < n) {
+        for (int pc = 0; pc < n; pc++) {
+            Instruction inst = code->code[pc];
+            if (inst.opcode == OP_NOP) {
+                continue;
+            }
+            if (opcode_is_jump(inst.opcode)) {
+                inst.operand.address = new_address[inst.operand.address];
+            }
+            code->code[new_address[pc]] = inst;
+        }
+
+        // 3. Give the unused capacity back
+        Instruction* shrunk = (Instruction*)realloc(code->code, kept * sizeof(Instruction));
+        if (shrunk != NULL) {
+            code->code = shrunk;
+            code->capacity = kept;
+        }
+        code->count = kept;
+    }
+    free(new_address);
+
+    if (verbose && kept < n) {
+        printf("Optimizer: NOP compaction pass complete. %d instructions removed (%zu bytes saved).\n",
+               n - kept, (size_t)(n - kept) * sizeof(Instruction));
+    }
+}
+
+
 /* --- Public API --- */
 
-void optimize_bytecode(CodeArray* code) {
+ASTNode* optimize_ast(ASTNode* root, int verbose) {
+    int total = 0;
+    int rounds = 0;
+    int rewrites;
+    do {
+        rewrites = 0;
+        root = simplify(root, USE_VALUE, &rewrites);
+        total += rewrites;
+        rounds++;
+    } while (rewrites > 0); // To a fixed point: each round shrinks the tree
+
+    if (verbose && total > 0) {
+        printf("Optimizer: AST simplification pass complete. %d rewrites in %d round(s).\n", total, rounds);
+    }
+    return root;
+}
+
+void optimize_bytecode(CodeArray* code, int verbose) {
     if (code == NULL) return;
     
-    printf("Running Optimizer...\n");
+    if (verbose) printf("Running Optimizer...\n");
     
     // We can add more optimization passes here
-    fold_constants(code);
-    
+    fold_constants(code, verbose);
+    specialize_types(code, verbose);
+    fuse_superinstructions(code, verbose); // After the passes that match plain opcodes
+    compact_code(code, verbose);           // Last: removes every pass's NOPs
+
     // ...
+    code->verified = 0; // Rewritten in place: the VM must check it again
+}
+
+
+
+/* --- Opcode Sequence Statistics --- */
+
+OpcodeStats* opcode_stats_create(void) {
+    OpcodeStats* stats = (OpcodeStats*)calloc(1, sizeof(OpcodeStats));
+    if (stats != NULL) {
+        stats->pairs = (long*)calloc((size_t)OP_COUNT * OP_COUNT, sizeof(long));
+        stats->triples = (long*)calloc((size_t)OP_COUNT * OP_COUNT * OP_COUNT, sizeof(long));
+    }
+    if (stats == NULL || stats->pairs == NULL || stats->triples == NULL) {
+        fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+        exit(1);
+    }
+    return stats;
+}
+
+void opcode_stats_add(OpcodeStats* stats, const CodeArray* code) {
+    char* target = find_jump_targets(code);
+    int window[2] = { -1, -1 }; // The two opcodes before this one, -1 = none
+    for (int pc = 0; pc < code->count; pc++) {
+        OpCode op = code->code[pc].opcode;
+        if (op == OP_NOP) {
+            continue;
+        }
+        if (target[pc]) {
+            window[0] = window[1] = -1; // Control flow joins here
+        }
+        stats->instructions++;
+        if (window[1] >= 0) {
+            stats->pairs[window[1] * OP_COUNT + op]++;
+            if (window[0] >= 0) {
+                stats->triples[(window[0] * OP_COUNT + window[1]) * OP_COUNT + op]++;
+            }
+        }
+        window[0] = window[1];
+        window[1] = op;
+        if (opcode_is_jump(op) || op == OP_HALT) {
+            window[0] = window[1] = -1; // Nothing falls through into a fused op
+        }
+    }
+    stats->formulas++;
+    free(target);
 }
 
+// A counter and where it is, for sorting
+typedef struct {
+    long count;
+    int index;
+} SequenceCount;
+
+static int compare_counts(const void* a, const void* b) {
+    const SequenceCount* x = (const SequenceCount*)a;
+    const SequenceCount* y = (const SequenceCount*)b;
+    if (x->count != y->count) {
+        return (x->count < y->count) ? 1 : -1; // Most frequent first
+    }
+    return x->index - y->index;
+}
+
+// Prints the 'top' largest of 'n' counters of sequences 'length' long
+static void print_top_sequences(const long* counts, int n, int length, int top, long total) {
+    SequenceCount* sorted = (SequenceCount*)malloc(n * sizeof(SequenceCount));
+    if (sorted == NULL) {
+        fprintf(stderr, "Fatal: Out of memory in optimizer\n");
+        exit(1);
+    }
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        if (counts[i] > 0) {
+            sorted[used].count = counts[i];
+            sorted[used].index = i;
+            used++;
+        }
+    }
+    qsort(sorted, used, sizeof(SequenceCount), compare_counts);
+
+    for (int k = 0; k < used && k < top; k++) {
+        int ops[3];
+        int index = sorted[k].index;
+        for (int j = length - 1; j >= 0; j--) {
+            ops[j] = index % OP_COUNT;
+            index /= OP_COUNT;
+        }
+        printf("  %8ld  %5.1f%%  ", sorted[k].count, 100.0 * sorted[k].count / total);
+        for (int j = 0; j < length; j++) {
+            printf("%s%s", j > 0 ? ", " : "", opcode_name((OpCode)ops[j]));
+        }
+        printf("\n");
+    }
+    free(sorted);
+}
+
+void opcode_stats_print(const OpcodeStats* stats, int top) {
+    long total = stats->instructions > 0 ? stats->instructions : 1;
+    printf("%ld instructions in %d formulas (NOPs excluded)\n", stats->instructions, stats->formulas);
+    printf("\nPairs:\n");
+    print_top_sequences(stats->pairs, OP_COUNT * OP_COUNT, 2, top, total);
+    printf("\nTriples:\n");
+    print_top_sequences(stats->triples, OP_COUNT * OP_COUNT * OP_COUNT, 3, top, total);
+}
+
+void opcode_stats_free(OpcodeStats* stats) {
+    if (stats != NULL) {
+        free(stats->pairs);
+        free(stats->triples);
+        free(stats);
+    }
+}
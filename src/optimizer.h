@@ -2,13 +2,63 @@
 #define OPTIMIZER_H
 
 #include "ir.h"
+#include "ast.h"
+
+/**
+ * @brief Simplifies a checked AST in place, to a fixed point: folds
+ * constant subtrees, removes identities (x*1, x-0, x^1, ...) and
+ * replaces an IF whose condition is constant by the branch it takes.
+ * Run it after semantic analysis and before generate_code().
+ *
+ * @return The new root (the old one may have been freed).
+ */
+ASTNode* optimize_ast(ASTNode* root, int verbose);
 
 /**
  * @brief Optimizes the given bytecode array in place.
  *
  * @param code The CodeArray to optimize.
+ * @param verbose 1 to print a report for each pass, 0 to run silently
+ * (used when compiling every formula of a sheet).
+ */
+void optimize_bytecode(CodeArray* code, int verbose);
+
+
+/* --- Opcode Sequence Statistics --- */
+
+/*
+ * Counts how often each pair and triple of opcodes runs back to
+ * back over a corpus of compiled formulas. The superinstructions
+ * were chosen from these counts (--opcode-stats).
+ */
+typedef struct {
+    long* pairs;   // OP_COUNT^2 counters
+    long* triples; // OP_COUNT^3 counters
+    long instructions;
+    int formulas;
+} OpcodeStats;
+
+/**
+ * @brief Creates an empty set of counters.
+ */
+OpcodeStats* opcode_stats_create(void);
+
+/**
+ * @brief Counts the sequences of one formula. NOPs are skipped;
+ * a sequence never spans a jump or a jump target, since those
+ * can never be fused.
+ */
+void opcode_stats_add(OpcodeStats* stats, const CodeArray* code);
+
+/**
+ * @brief Prints the 'top' most frequent pairs and triples.
+ */
+void opcode_stats_print(const OpcodeStats* stats, int top);
+
+/**
+ * @brief Frees the counters.
  */
-void optimize_bytecode(CodeArray* code);
+void opcode_stats_free(OpcodeStats* stats);
 
 #endif // OPTIMIZER_H
 
@@ -0,0 +1,347 @@
+/*
+ * --- Parallel Recalculation Implementation ---
+ *
+ * Level-synchronous scheduling: the cells of one dependency
+ * level never depend on each other, so workers claim them
+ * in small batches from a shared atomic counter. A barrier
+ * between levels makes every result of level L visible
+ * before any cell of level L + 1 reads it, so cell values
+ * are written without locks.
+ *
+ * Work stealing: no levels, no barriers. A cell becomes ready
+ * when the atomic decrement of its pending counter reaches
+ * zero; that decrement (acquire-release) orders the writes of
+ * all its dependencies before its own evaluation.
+ */
+
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "simd.h"
+
+#define LEVEL_GRAIN 8 // Cells claimed per atomic step
+
+
+/* --- Private Helpers --- */
+
+// The range cache and index are not thread-safe: workers run without
+// them. They see none of the workers' writes, so they start over once
+// the workers are done.
+typedef struct {
+    RangeCache* cache;
+    RangeIndex* index;
+} RangeHelpers;
+
+static RangeHelpers detach_range_helpers(SymbolTable* table) {
+    RangeHelpers helpers = { table->range_cache, table->range_index };
+    table->range_cache = NULL;
+    table->range_index = NULL;
+    return helpers;
+}
+
+static void attach_range_helpers(SymbolTable* table, RangeHelpers helpers) {
+    if (helpers.cache != NULL) {
+        range_cache_clear(helpers.cache);
+    }
+    if (helpers.index != NULL) {
+        range_index_clear(helpers.index);
+    }
+    table->range_cache = helpers.cache;
+    table->range_index = helpers.index;
+}
+
+// State shared by every worker of one recalculation
+typedef struct {
+    Workbook* wb;
+    pthread_barrier_t barrier;
+    int* next;  // Per level: next unclaimed index into wb->level_order
+} LevelJob;
+
+// Runs every level, taking a share of each, on this worker's VM
+static void run_levels(LevelJob* job, VM* vm) {
+    Workbook* wb = job->wb;
+    for (int l = 0; l < wb->level_count; l++) {
+        int end = wb->level_start[l + 1];
+        for (;;) {
+            int k = __atomic_fetch_add(&job->next[l], LEVEL_GRAIN, __ATOMIC_RELAXED);
+            if (k >= end) {
+                break;
+            }
+            int stop = (k + LEVEL_GRAIN < end) ? k + LEVEL_GRAIN : end;
+            for (; k < stop; k++) {
+                workbook_evaluate_cell(wb, vm, wb->level_order[k]);
+            }
+        }
+        pthread_barrier_wait(&job->barrier); // Level done everywhere
+    }
+}
+
+static void* level_worker(void* arg) {
+    LevelJob* job = (LevelJob*)arg;
+    VM* vm = vm_create(NULL, job->wb->symtab);
+    run_levels(job, vm);
+    vm_free(vm);
+    return NULL;
+}
+
+
+/* --- Work Stealing --- */
+
+/*
+ * A deque of ready cells. The owner pushes and pops at the bottom
+ * (newest first, for locality); thieves take from the top (oldest).
+ * Every cell is pushed once per recalculation, so 'capacity' =
+ * number of cells never overflows.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    int* cells;
+    int top;     // Next cell to steal
+    int bottom;  // One past the newest cell
+} ReadyDeque;
+
+// State shared by every worker of one recalculation
+typedef struct {
+    Workbook* wb;
+    int threads;
+    ReadyDeque* deques;   // One per worker
+    int* pending;         // Per node: dependencies not yet evaluated
+    int remaining;        // Scheduled cells not yet evaluated
+    WorkerStats* stats;   // One per worker
+} StealJob;
+
+// Arguments of one worker thread
+typedef struct {
+    StealJob* job;
+    int id;
+} StealWorker;
+
+static void deque_push(ReadyDeque* dq, int cell) {
+    pthread_mutex_lock(&dq->lock);
+    dq->cells[dq->bottom++] = cell;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+// Owner side: newest cell, or -1 if empty
+static int deque_pop(ReadyDeque* dq) {
+    int cell = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        cell = dq->cells[--dq->bottom];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return cell;
+}
+
+// Thief side: oldest cell, or -1 if empty
+static int deque_steal(ReadyDeque* dq) {
+    int cell = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        cell = dq->cells[dq->top++];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return cell;
+}
+
+// Tries every other deque once, starting at a rotating victim
+static int steal_cell(StealJob* job, int self, unsigned int* seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    int start = (int)((*seed >> 16) % (unsigned int)job->threads);
+    for (int k = 0; k < job->threads; k++) {
+        int victim = (start + k) % job->threads;
+        if (victim != self) {
+            int cell = deque_steal(&job->deques[victim]);
+            if (cell >= 0) {
+                return cell;
+            }
+        }
+    }
+    return -1;
+}
+
+// Pushes the dependents of 'node' that it was the last one to wait for.
+// A released range node has nothing to evaluate: its readers are
+// released at once (its dependents are always formula cells).
+static void release_dependents(StealJob* job, int self, int node) {
+    Workbook* wb = job->wb;
+    for (int e = wb->edge_start[node]; e < wb->edge_start[node + 1]; e++) {
+        int dependent = wb->edges[e];
+        if (__atomic_sub_fetch(&job->pending[dependent], 1, __ATOMIC_ACQ_REL) == 0) {
+            if (dependent >= wb->count) {
+                release_dependents(job, self, dependent);
+            } else {
+                deque_push(&job->deques[self], dependent);
+            }
+        }
+    }
+}
+
+static void* steal_worker(void* arg) {
+    StealJob* job = ((StealWorker*)arg)->job;
+    int self = ((StealWorker*)arg)->id;
+    Workbook* wb = job->wb;
+    WorkerStats stats = { 0, 0, 0 }; // Kept local: no false sharing
+    unsigned int seed = (unsigned int)self * 2654435761u + 1;
+    VM* vm = vm_create(NULL, wb->symtab);
+
+    while (__atomic_load_n(&job->remaining, __ATOMIC_ACQUIRE) > 0) {
+        // 1. Own work first, then someone else's
+        int cell = deque_pop(&job->deques[self]);
+        if (cell < 0) {
+            cell = steal_cell(job, self, &seed);
+            if (cell < 0) {
+                stats.idle++;
+                sched_yield();
+                continue;
+            }
+            stats.steals++;
+        }
+
+        // 2. Evaluate, then release the dependents that are now ready
+        workbook_evaluate_cell(wb, vm, cell);
+        stats.executed++;
+        release_dependents(job, self, cell);
+        __atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL);
+    }
+
+    job->stats[self] = stats;
+    vm_free(vm);
+    return NULL;
+}
+
+
+/* --- Public API --- */
+
+int parallel_cpu_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+void parallel_recalc_levels(Workbook* wb, int threads) {
+    if (threads <= 1 || wb->trace || wb->order_count == 0) {
+        workbook_recalc(wb); // Traces would interleave
+        return;
+    }
+
+    // Pick the SIMD kernels now, not in a race between workers
+    simd_active_name();
+
+    LevelJob job;
+    job.wb = wb;
+    job.next = (int*)malloc((wb->level_count + 1) * sizeof(int));
+    for (int l = 0; l < wb->level_count; l++) {
+        job.next[l] = wb->level_start[l];
+    }
+    pthread_barrier_init(&job.barrier, NULL, threads);
+    RangeHelpers helpers = detach_range_helpers(wb->symtab);
+
+    // The calling thread is worker 0
+    pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[t], NULL, level_worker, &job) != 0) {
+            fprintf(stderr, "Fatal: Could not start worker thread\n");
+            exit(1);
+        }
+    }
+    level_worker(&job);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(workers[t], NULL);
+    }
+
+    attach_range_helpers(wb->symtab, helpers);
+    pthread_barrier_destroy(&job.barrier);
+    free(workers);
+    free(job.next);
+    symtab_clear_dirty(wb->symtab);
+}
+
+void parallel_recalc_stealing(Workbook* wb, int threads, ParallelStats* stats) {
+    if (threads < 1 || wb->trace) {
+        threads = 1; // Traces would interleave
+    }
+    simd_active_name(); // Pick the SIMD kernels before the workers start
+
+    int n = wb->count;
+    StealJob job;
+    job.wb = wb;
+    job.threads = threads;
+    job.remaining = wb->order_count;
+    job.pending = (int*)malloc((wb->node_count + 1) * sizeof(int));
+    memcpy(job.pending, wb->indegree, (wb->node_count + 1) * sizeof(int));
+    job.stats = (WorkerStats*)calloc(threads, sizeof(WorkerStats));
+    job.deques = (ReadyDeque*)malloc(threads * sizeof(ReadyDeque));
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_init(&job.deques[t].lock, NULL);
+        job.deques[t].cells = (int*)malloc((n + 1) * sizeof(int));
+        job.deques[t].top = 0;
+        job.deques[t].bottom = 0;
+    }
+
+    // Deal the cells with no formula dependencies out round-robin.
+    // Cells on (or after) a cycle never become ready and are not counted.
+    int dealt = 0;
+    for (int k = 0; k < wb->order_count; k++) {
+        int cell = wb->order[k];
+        if (wb->indegree[cell] == 0) {
+            ReadyDeque* dq = &job.deques[dealt++ % threads];
+            dq->cells[dq->bottom++] = cell;
+        }
+    }
+
+    // The calling thread is worker 0
+    RangeHelpers helpers = detach_range_helpers(wb->symtab);
+    pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    StealWorker* args = (StealWorker*)malloc(threads * sizeof(StealWorker));
+    for (int t = 0; t < threads; t++) {
+        args[t].job = &job;
+        args[t].id = t;
+    }
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[t], NULL, steal_worker, &args[t]) != 0) {
+            fprintf(stderr, "Fatal: Could not start worker thread\n");
+            exit(1);
+        }
+    }
+    steal_worker(&args[0]);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    attach_range_helpers(wb->symtab, helpers);
+
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&job.deques[t].lock);
+        free(job.deques[t].cells);
+    }
+    if (stats != NULL) {
+        stats->threads = threads;
+        stats->workers = job.stats;
+    } else {
+        free(job.stats);
+    }
+    free(job.deques);
+    free(job.pending);
+    free(workers);
+    free(args);
+    symtab_clear_dirty(wb->symtab);
+}
+
+void parallel_stats_print(const ParallelStats* stats) {
+    printf("Worker | Cells    | Steals   | Idle\n");
+    printf("-------|----------|----------|----------\n");
+    for (int t = 0; t < stats->threads; t++) {
+        const WorkerStats* w = &stats->workers[t];
+        printf("%-6d | %-8ld | %-8ld | %ld\n", t, w->executed, w->steals, w->idle);
+    }
+}
+
+void parallel_stats_free(ParallelStats* stats) {
+    free(stats->workers);
+    stats->workers = NULL;
+    stats->threads = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * --- Parallel Recalculation Header ---
+ *
+ * Multi-core recalculation of a scheduled workbook. Each
+ * worker thread owns a VM; all of them share the compiled
+ * bytecode (read-only) and the symbol table, where each
+ * formula cell writes only its own value slot.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "workbook.h"
+
+/*
+ * Load-balance counters of one work-stealing worker.
+ */
+typedef struct {
+    long executed;      // Cells this worker evaluated
+    long steals;        // Cells taken from other workers' deques
+    long idle;          // Times every deque was empty and the worker yielded
+} WorkerStats;
+
+/*
+ * Counters of a whole work-stealing recalculation.
+ */
+typedef struct {
+    int threads;
+    WorkerStats* workers; // One entry per thread
+} ParallelStats;
+
+/* --- Public API --- */
+
+/**
+ * @brief Gets the number of online CPUs (at least 1).
+ */
+int parallel_cpu_count(void);
+
+/**
+ * @brief Evaluates every scheduled cell, one dependency level at a
+ * time: the cells of a level are shared out between 'threads'
+ * workers, and all workers wait for each other before the next level.
+ * Call after workbook_schedule(). With 1 thread (or tracing on) this
+ * is the same as workbook_recalc().
+ */
+void parallel_recalc_levels(Workbook* wb, int threads);
+
+/**
+ * @brief Evaluates every scheduled cell with a work-stealing scheduler.
+ * Each worker has its own deque of ready cells. Finishing a cell
+ * decrements its dependents' pending counters, and a dependent that
+ * reaches zero is pushed on the finishing worker's deque. Idle workers
+ * steal the oldest cell from another deque. There are no barriers, so
+ * a long chain does not hold up the rest of the sheet.
+ * Call after workbook_schedule().
+ * @param stats If not NULL, filled with per-worker counters
+ * (free with parallel_stats_free()).
+ */
+void parallel_recalc_stealing(Workbook* wb, int threads, ParallelStats* stats);
+
+/**
+ * @brief Prints one line of counters per worker.
+ */
+void parallel_stats_print(const ParallelStats* stats);
+
+/**
+ * @brief Frees the counters filled in by parallel_recalc_stealing().
+ */
+void parallel_stats_free(ParallelStats* stats);
+
+
+#endif // PARALLEL_H
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* Include all project headers */
 #include "ast.h"
@@ -26,11 +27,20 @@
 #include "runtime.h"
 #include "interpreter.h"
 #include "vm.h"
+#include "regir.h"
+#include "regvm.h"
+#include "workbook.h"
+#include "simd.h"
+#include "parallel.h"
+#include "jit.h"
+#include "aot.h"
 
 
 /* External function declarations */
 int yylex(void);
 void yyerror(const char *s);
+void lexer_begin_string(const char* text); // Defined in lexer.l
+void lexer_end_string(void);
 extern int yylineno; // Get line number from lexer
 extern FILE* yyin;   // Flex input stream
 
@@ -41,18 +51,34 @@ ASTNode* ast_root = NULL;
 int g_token_count = 0;
 int g_node_count = 0;
 
+/* Where the lexer and the AST constructors allocate (see ast.h) */
+Arena ast_arena;
+
 /* --- Global Flags --- */
 PrintFormat ast_print_format = PRINT_NONE; // Default to no AST
 int optimize_code = 0; // Off by default
 int trace_vm = 0;      // Off by default
 int verbose = 0;       // Off by default
 int show_bytecode = 0; // Off by default
-typedef enum { MODE_VM, MODE_AST } ExecMode;
+typedef enum { MODE_VM, MODE_AST, MODE_REGVM } ExecMode;
 ExecMode execution_mode = MODE_VM; // Default
 
 /* Global I/O and System Pointers */
 const char* input_file = NULL;
 const char* cells_file = NULL;
+const char* scenarios_file = NULL; // '--scenarios <file>': evaluate the formula per input row
+const char* sheet_file = NULL;
+const char** sheet_edits = NULL; // '--set KEY=VALUE' edits, applied after recalc
+int sheet_edit_count = 0;
+int sheet_threads = 1; // '--threads N' worker threads for sheet recalculation
+int sheet_steal = 0;   // '--schedule=steal': work stealing instead of levels
+int bench_runs = 0;    // '--bench N': time both VMs over N runs
+int opcode_stats = 0;  // '--opcode-stats': count opcode sequences over a sheet
+int range_cache = 0;   // '--range-cache': share range aggregates between cells
+int range_index = 0;   // '--range-index': index often-aggregated columns
+int formula_cache = 0; // '--formula-cache': compile each formula template once
+int jit_threshold = 0; // '--jit N': native code for formulas run N times
+int aot_compile = 0;   // '--aot': compile the whole sheet to C and load it
 ErrorSystem* error_system = NULL;
 SymbolTable* symbol_table = NULL;
 char* current_formula_string = NULL;
@@ -67,17 +93,29 @@ char* current_formula_string = NULL;
     #include "ast.h"
 }
 
+/*
+ * Declarations for other modules that need to parse
+ * formulas (e.g., the workbook compiling a whole sheet).
+ */
+%code provides {
+    ASTNode* parse_formula_string(const char* text, int line);
+}
+
 /* --- Yacc Union (yylval) --- */
 %union {
     double num;       /* For NUMBER tokens */
-    char *str;        /* For CELL_REF, RANGE, STRING */
+    CellCoord coord;  /* For CELL_REF (decoded by the lexer) */
+    CellRange range;  /* For RANGE (decoded by the lexer) */
+    char *str;        /* For STRING */
     ASTNode *node;    /* For all grammar non-terminals */
     int token_id;     /* For function name tokens */
 }
 
 /* --- Token Declarations --- */
 %token <num> NUMBER
-%token <str> STRING CELL_REF RANGE
+%token <coord> CELL_REF
+%token <range> RANGE
+%token <str> STRING
 %token <token_id> SUM AVERAGE MIN MAX IF
 %token AND OR NOT
 %token LPAREN RPAREN COMMA COLON
@@ -334,8 +372,22 @@ void print_help(const char* prog_name) {
     printf("OPTIONS:\n");
     printf("  --input <file>    Read formula from <file>.\n");
     printf("  --cells <file>    Load cell values from <file> (format: A1=10.5).\n");
+    printf("  --sheet <file>    Recalculate a whole sheet (format: A1=10.5, C1==A1*2).\n");
+    printf("  --set KEY=VALUE   With --sheet: edit a value cell, then recalculate only its dependents.\n");
+    printf("  --threads N       With --sheet: recalculate on N threads (0 = one per CPU).\n");
+    printf("  --schedule=levels With --threads: run one dependency level at a time (Default).\n");
+    printf("  --schedule=steal  With --threads: work-stealing scheduler, prints per-worker counters.\n");
+    printf("  --opcode-stats    With --sheet: print the most frequent opcode pairs and triples.\n");
+    printf("  --range-cache     With --sheet: compute each large SUM/AVERAGE/MIN/MAX range once.\n");
+    printf("  --range-index     With --sheet: prefix sums and MIN/MAX tables for often-aggregated columns.\n");
+    printf("  --formula-cache   With --sheet: compile each formula shape once, rebase it for the other cells.\n");
+    printf("  --jit N           Compile a formula to x86-64 code once it has run N times (sheet, --bench).\n");
+    printf("  --aot             With --sheet: compile every formula to one C file with cc, recalculate natively.\n");
     printf("  --mode=ast        Execute using the AST Interpreter (Phase 6.1).\n");
     printf("  --mode=vm         Execute using the VM (Default, Phase 6.2).\n");
+    printf("  --mode=regvm      Execute using the register-based VM.\n");
+    printf("  --bench N         Run the formula N times on both VMs and compare them.\n");
+    printf("  --scenarios <file> Evaluate the formula once per row of <file> (header: A1,B1), in VM lanes.\n");
     printf("  --ast-tree        Show AST as a tree (box-drawing).\n");
     printf("  --ast-dot         Show AST in Graphviz .dot format.\n");
     printf("  --ast-lisp        Show AST in Lisp S-expression format.\n");
@@ -343,6 +395,8 @@ void print_help(const char* prog_name) {
     printf("  --bytecode        Show the generated stack-based bytecode.\n");
     printf("  --trace           Show VM/Interpreter execution trace.\n");
     printf("  --optimize        Enable bytecode constant-folding optimization.\n");
+    printf("  --simd=<isa>      Aggregate kernels: auto (default), avx2, sse2 or scalar.\n");
+    printf("  --deterministic   Sum ranges with Kahan summation, identical on every --simd.\n");
     printf("  --verbose         Show all compilation phase headers.\n");
     printf("  --help            Show this help message.\n\n");
 }
@@ -354,15 +408,15 @@ void print_help(const char* prog_name) {
 void load_cell_data(SymbolTable* table, const char* filename) {
     if (filename == NULL) {
         if (verbose) printf("✓ No --cells file. Loading default test data.\n");
-        symtab_define_cell(table, "A1", 10.0, "Formula for A1", 1);
-        symtab_define_cell(table, "A2", 20.0, "Formula for A2", 2);
-        symtab_define_cell(table, "A3", 30.0, "Formula for A3", 3);
-        symtab_define_cell(table, "B1", 5.0, "Formula for B1", 4);
-        symtab_define_cell(table, "B2", 7.0, "Formula for B2", 5);
-        symtab_define_cell(table, "Z1", 0.0, "=Z2", 10);
-        symtab_define_cell(table, "Z2", 0.0, "=Z1", 11);
-        symtab_add_dependency(table, "Z1", "Z2");
-        symtab_add_dependency(table, "Z2", "Z1");
+        symtab_define_cell(table, cellref_from_string("A1"), 10.0, "Formula for A1", 1);
+        symtab_define_cell(table, cellref_from_string("A2"), 20.0, "Formula for A2", 2);
+        symtab_define_cell(table, cellref_from_string("A3"), 30.0, "Formula for A3", 3);
+        symtab_define_cell(table, cellref_from_string("B1"), 5.0, "Formula for B1", 4);
+        symtab_define_cell(table, cellref_from_string("B2"), 7.0, "Formula for B2", 5);
+        symtab_define_cell(table, cellref_from_string("Z1"), 0.0, "=Z2", 10);
+        symtab_define_cell(table, cellref_from_string("Z2"), 0.0, "=Z1", 11);
+        symtab_add_dependency(table, cellref_from_string("Z1"), cellref_from_string("Z2"));
+        symtab_add_dependency(table, cellref_from_string("Z2"), cellref_from_string("Z1"));
         return;
     }
 
@@ -380,8 +434,13 @@ void load_cell_data(SymbolTable* table, const char* filename) {
         char* value_str = strtok(NULL, "\n");
         
         if (key != NULL && value_str != NULL) {
-            double value = atof(value_str);
-            symtab_define_cell(table, key, value, line, line_num);
+            CellCoord coord = cellref_from_string(key);
+            if (coord == CELL_COORD_INVALID) {
+                fprintf(stderr, "Warning: Skipping invalid cell reference '%s' (line %d).\n", key, line_num);
+            } else {
+                double value = atof(value_str);
+                symtab_define_cell(table, coord, value, line, line_num);
+            }
         }
         line_num++;
     }
@@ -420,6 +479,22 @@ void parse_flags(int argc, char* argv[]) {
             execution_mode = MODE_AST;
         } else if (strcmp(arg, "--mode=vm") == 0 || strcmp(arg, "--execute") == 0) {
             execution_mode = MODE_VM;
+        } else if (strcmp(arg, "--mode=regvm") == 0) {
+            execution_mode = MODE_REGVM;
+        } else if (strcmp(arg, "--bench") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                bench_runs = atoi(argv[++i]); // Consume next argument
+            } else {
+                fprintf(stderr, "Error: --bench requires a run count.\n");
+                exit(1);
+            }
+        } else if (strncmp(arg, "--simd=", 7) == 0) {
+            if (simd_select(arg + 7) != 0) {
+                fprintf(stderr, "Error: '%s' is not supported on this CPU.\n", arg + 7);
+                exit(1);
+            }
+        } else if (strcmp(arg, "--deterministic") == 0) {
+            simd_set_deterministic(1);
         } else if (strcmp(arg, "--input") == 0) {
             if (i + 1 < argc) {
                 input_file = argv[++i]; // Consume next argument
@@ -427,6 +502,59 @@ void parse_flags(int argc, char* argv[]) {
                 fprintf(stderr, "Error: --input requires a filename.\n");
                 exit(1);
             }
+        } else if (strcmp(arg, "--sheet") == 0) {
+            if (i + 1 < argc) {
+                sheet_file = argv[++i]; // Consume next argument
+            } else {
+                fprintf(stderr, "Error: --sheet requires a filename.\n");
+                exit(1);
+            }
+        } else if (strcmp(arg, "--set") == 0) {
+            if (i + 1 < argc && strchr(argv[i + 1], '=') != NULL) {
+                sheet_edits = (const char**)realloc(sheet_edits, (sheet_edit_count + 1) * sizeof(char*));
+                sheet_edits[sheet_edit_count++] = argv[++i]; // Consume next argument
+            } else {
+                fprintf(stderr, "Error: --set requires KEY=VALUE.\n");
+                exit(1);
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+                sheet_threads = atoi(argv[++i]); // Consume next argument
+                if (sheet_threads == 0) {
+                    sheet_threads = parallel_cpu_count();
+                }
+            } else {
+                fprintf(stderr, "Error: --threads requires a thread count.\n");
+                exit(1);
+            }
+        } else if (strcmp(arg, "--schedule=levels") == 0) {
+            sheet_steal = 0;
+        } else if (strcmp(arg, "--schedule=steal") == 0) {
+            sheet_steal = 1;
+        } else if (strcmp(arg, "--opcode-stats") == 0) {
+            opcode_stats = 1;
+        } else if (strcmp(arg, "--range-cache") == 0) {
+            range_cache = 1;
+        } else if (strcmp(arg, "--range-index") == 0) {
+            range_index = 1;
+        } else if (strcmp(arg, "--formula-cache") == 0) {
+            formula_cache = 1;
+        } else if (strcmp(arg, "--aot") == 0) {
+            aot_compile = 1;
+        } else if (strcmp(arg, "--jit") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                jit_threshold = atoi(argv[++i]); // Consume next argument
+            } else {
+                fprintf(stderr, "Error: --jit requires a run count.\n");
+                exit(1);
+            }
+        } else if (strcmp(arg, "--scenarios") == 0) {
+            if (i + 1 < argc) {
+                scenarios_file = argv[++i]; // Consume next argument
+            } else {
+                fprintf(stderr, "Error: --scenarios requires a filename.\n");
+                exit(1);
+            }
         } else if (strcmp(arg, "--cells") == 0) {
             if (i + 1 < argc) {
                 cells_file = argv[++i]; // Consume next argument
@@ -441,6 +569,424 @@ void parse_flags(int argc, char* argv[]) {
     }
 }
 
+// Nanoseconds on a monotonic clock
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Runs one formula 'runs' times on the stack VM and on the
+ * register VM, and prints code size, operand traffic (stack slots
+ * pushed or popped, registers read or written, counted over the
+ * code) and time per evaluation. The batch VM row is one call to
+ * vm_execute_batch() with 'runs' identical scenarios.
+ */
+void run_benchmark(CodeArray* bytecode, RegCode* reg_code, SymbolTable* table, int runs) {
+    // 1. Static operand traffic
+    int stack_traffic = 0;
+    for (int i = 0; i < bytecode->count; i++) {
+        const Instruction* inst = &bytecode->code[i];
+        switch (opcode_generic(inst->opcode)) {
+            case OP_PUSH: case OP_PUSH_CELL: case OP_PUSH_RANGE:
+            case OP_HALT: case OP_JMP_IF_FALSE:
+            case OP_STORE_LOCAL: case OP_LOAD_LOCAL:
+            case OP_ADD_CELL_CELL: case OP_SUB_CELL_CELL: case OP_MUL_CELL_CELL:
+            case OP_ADD_CELL_CONST: case OP_MUL_CELL_CONST:
+                stack_traffic += 1; break;
+            case OP_NEG: case OP_NOT:
+            case OP_ADD_CELL: case OP_MUL_CONST:
+                stack_traffic += 2; break;
+            case OP_CALL:
+                stack_traffic += inst->operand.func_call.arg_count + 1; break;
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ:
+                stack_traffic += 2; break;
+            case OP_JMP: case OP_NOP:
+                break;
+            default:
+                stack_traffic += 3; break; // Binary: two pops, one push
+        }
+    }
+    int reg_traffic = reg_code->loads_count + reg_code->args_count; // Prologue writes, call reads
+    for (int i = 0; i < reg_code->count; i++) {
+        const RegInstruction* inst = &reg_code->code[i];
+        reg_traffic += (inst->dst >= 0) + (inst->a >= 0) + (inst->b >= 0);
+    }
+
+    // 2. Timing
+    VM* vm = vm_create(NULL, table);
+    double start = now_ns();
+    double stack_sum = 0.0;
+    for (int r = 0; r < runs; r++) {
+        vm_load(vm, bytecode);
+        Value v = vm_execute(vm);
+        stack_sum += get_numeric(v);
+        free_value(v);
+    }
+    double stack_ns = (now_ns() - start) / runs;
+    vm_free(vm);
+
+    RegVM* rvm = regvm_create(table);
+    start = now_ns();
+    double reg_sum = 0.0;
+    for (int r = 0; r < runs; r++) {
+        Value v = regvm_execute(rvm, reg_code);
+        reg_sum += get_numeric(v);
+        free_value(v);
+    }
+    double reg_ns = (now_ns() - start) / runs;
+    regvm_free(rvm);
+
+    // 3. The stack VM on all runs at once, in lanes (no input columns)
+    vm = vm_create(bytecode, table);
+    double* batch_results = (double*)malloc(runs * sizeof(double));
+    ValueType* batch_types = (ValueType*)malloc(runs * sizeof(ValueType));
+    if (batch_results == NULL || batch_types == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for benchmark results\n");
+        exit(1);
+    }
+    VMBatch batch = { runs, NULL, NULL, 0, batch_results, batch_types, NULL };
+    start = now_ns();
+    int in_lanes = vm_execute_batch(vm, &batch);
+    double batch_ns = (now_ns() - start) / runs;
+    double batch_sum = 0.0;
+    for (int r = 0; r < runs; r++) {
+        batch_sum += batch_results[r];
+    }
+    free(batch_results);
+    free(batch_types);
+    vm_free(vm);
+
+    // 4. The stack VM with its native tier (--jit N)
+    double jit_ns = 0.0;
+    double jit_sum = stack_sum;
+    if (jit_threshold > 0) {
+        vm = vm_create(NULL, table);
+        vm->jit_threshold = jit_threshold;
+        start = now_ns();
+        jit_sum = 0.0;
+        for (int r = 0; r < runs; r++) {
+            vm_load(vm, bytecode);
+            Value v = vm_execute(vm);
+            jit_sum += get_numeric(v);
+            free_value(v);
+        }
+        jit_ns = (now_ns() - start) / runs;
+        vm_free(vm);
+    }
+
+    print_phase_header("BENCHMARK");
+    printf("%d runs per engine\n\n", runs);
+    printf("Engine      | Instructions | Operand Traffic | ns/eval\n");
+    printf("------------|--------------|-----------------|----------\n");
+    printf("Stack VM    | %-12d | %-15d | %.1f\n", bytecode->count, stack_traffic, stack_ns);
+    printf("Register VM | %-12d | %-15d | %.1f\n", reg_code->count, reg_traffic, reg_ns);
+    printf("Batch VM    | %-12d | %-15s | %.1f\n", bytecode->count,
+        in_lanes ? "lane vectors" : "(one by one)", batch_ns);
+    if (jit_threshold > 0) {
+        char size[32];
+        snprintf(size, sizeof(size), "%d bytes", bytecode->jit != NULL ? bytecode->jit->code_bytes : 0);
+        printf("Native JIT  | %-12s | %-15s | %.1f\n",
+            bytecode->jit != NULL ? size : "(declined)", "registers", jit_ns);
+    }
+    if (reg_ns > 0) {
+        printf("Speedup:    %.2fx\n", stack_ns / reg_ns);
+    }
+    if (jit_threshold > 0 && jit_ns > 0) {
+        printf("JIT:        %.2fx\n", stack_ns / jit_ns);
+    }
+    if (stack_sum != reg_sum && !(stack_sum != stack_sum && reg_sum != reg_sum)) {
+        printf("Warning: the two VMs returned different results.\n");
+    }
+    if (stack_sum != batch_sum && !(stack_sum != stack_sum && batch_sum != batch_sum)) {
+        printf("Warning: the batch VM returned different results.\n");
+    }
+    if (stack_sum != jit_sum && !(stack_sum != stack_sum && jit_sum != jit_sum)) {
+        printf("Warning: the JIT returned different results.\n");
+    }
+}
+
+/**
+ * @brief Evaluates the formula once per row of a scenarios file and
+ * prints each result. The first line names the input cells, each
+ * further line holds their values for one scenario:
+ *
+ *     A1,B1
+ *     10,5
+ *     12,0.5
+ *
+ * Cells not named keep their --cells value.
+ */
+void run_scenarios(CodeArray* bytecode, SymbolTable* table, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open scenarios file '%s'.\n", filename);
+        return;
+    }
+
+    // 1. Header: the input cells
+    char line[4096];
+    CellCoord* cells = NULL;
+    int cell_count = 0;
+    int line_num = 0;
+    while (cell_count == 0 && fgets(line, sizeof(line), file)) {
+        line_num++;
+        for (char* field = strtok(line, ", \t\r\n"); field != NULL; field = strtok(NULL, ", \t\r\n")) {
+            CellCoord coord = cellref_from_string(field);
+            if (coord == CELL_COORD_INVALID) {
+                fprintf(stderr, "Error: Invalid cell reference '%s' in scenarios header (line %d).\n", field, line_num);
+                free(cells);
+                fclose(file);
+                return;
+            }
+            cells = (CellCoord*)realloc(cells, (cell_count + 1) * sizeof(CellCoord));
+            cells[cell_count++] = coord;
+        }
+    }
+
+    // 2. One column per input cell
+    double** columns = (double**)calloc(cell_count + 1, sizeof(double*));
+    int count = 0, capacity = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_num++;
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue; // Blank line
+        }
+        if (count == capacity) {
+            capacity = capacity < 64 ? 64 : capacity * 2;
+            for (int k = 0; k < cell_count; k++) {
+                columns[k] = (double*)realloc(columns[k], capacity * sizeof(double));
+                if (columns[k] == NULL) {
+                    fprintf(stderr, "Fatal: Out of memory reading scenarios\n");
+                    exit(1);
+                }
+            }
+        }
+        int k = 0;
+        for (char* field = strtok(line, ", \t\r\n"); field != NULL && k <= cell_count;
+             field = strtok(NULL, ", \t\r\n"), k++) {
+            if (k < cell_count) {
+                columns[k][count] = atof(field);
+            }
+        }
+        if (k != cell_count) {
+            fprintf(stderr, "Warning: Skipping scenario with %d value(s) instead of %d (line %d).\n",
+                k, cell_count, line_num);
+            continue;
+        }
+        count++;
+    }
+    fclose(file);
+
+    // 3. All scenarios in one batch
+    double* results = (double*)malloc((count + 1) * sizeof(double));
+    ValueType* types = (ValueType*)malloc((count + 1) * sizeof(ValueType));
+    const char** errors = (const char**)malloc((count + 1) * sizeof(char*));
+    if (results == NULL || types == NULL || errors == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for scenario results\n");
+        exit(1);
+    }
+    VMBatch batch = { count, cells, (const double* const*)columns, cell_count, results, types, errors };
+    VM* vm = vm_create(bytecode, table);
+    int in_lanes = vm_execute_batch(vm, &batch);
+    vm_free(vm);
+
+    print_phase_header("SCENARIOS");
+    printf("%d scenario(s) over %d input cell(s), %s\n\n", count, cell_count,
+        in_lanes ? "evaluated in VM lanes" : "evaluated one by one");
+    for (int i = 0; i < count; i++) {
+        printf("%-4d |", i + 1);
+        for (int k = 0; k < cell_count; k++) {
+            char name[CELLREF_MAX];
+            printf(" %s=%g", cellref_format(cells[k], name), columns[k][i]);
+        }
+        printf(" | ");
+        switch (types[i]) {
+            case TYPE_BOOLEAN: printf(results[i] != 0 ? "TRUE" : "FALSE"); break;
+            case TYPE_ERROR:   printf("#ERROR: %s", errors[i]); break;
+            default:           printf("%f", results[i]); break;
+        }
+        printf("\n");
+    }
+
+    for (int k = 0; k < cell_count; k++) {
+        free(columns[k]);
+    }
+    free(columns);
+    free(cells);
+    free(results);
+    free(types);
+    free(errors);
+}
+
+/**
+ * @brief Parses a single formula held in a string.
+ * 'line' is used for error messages (e.g., the line in a sheet file).
+ * Returns the AST (in ast_arena, freed by free_all_asts()), or NULL
+ * on a syntax error.
+ */
+ASTNode* parse_formula_string(const char* text, int line) {
+    ast_root = NULL;
+    yylineno = line;
+
+    lexer_begin_string(text);
+    int status = yyparse();
+    lexer_end_string();
+
+    ASTNode* root = (status == 0) ? ast_root : NULL;
+    ast_root = NULL; // The caller decides when to free it
+    return root;
+}
+
+/**
+ * @brief Loads, compiles and recalculates a whole sheet.
+ */
+int run_sheet(const char* filename) {
+    print_header(NULL);
+    printf("Input Sheet: %s\n", filename);
+
+    Workbook* wb = workbook_create(symbol_table, error_system);
+    wb->trace = trace_vm;
+    wb->jit_threshold = jit_threshold;
+    if (formula_cache) {
+        wb->formula_cache = formula_cache_create(); // Freed with the workbook
+    }
+
+    print_phase_header("LOADING SHEET");
+    int loaded = workbook_load(wb, filename);
+    if (loaded < 0) {
+        workbook_free(wb);
+        return 1;
+    }
+    printf("✓ Loaded %d cell(s), %d formula(s)\n", loaded, wb->count);
+
+    print_phase_header("PHASE 1-5: COMPILATION");
+    int failed = workbook_compile(wb, optimize_code);
+    printf("✓ Compiled %d of %d formula(s)\n", wb->count - failed, wb->count);
+    if (wb->formula_cache != NULL) {
+        formula_cache_print_stats(wb->formula_cache);
+    }
+    if (show_bytecode) {
+        for (int i = 0; i < wb->count; i++) {
+            if (wb->cells[i].code != NULL) {
+                char name[CELLREF_MAX];
+                printf("%s:\n", cellref_format(wb->cells[i].coord, name));
+                print_bytecode(wb->cells[i].code);
+            }
+        }
+    }
+    if (opcode_stats) {
+        OpcodeStats* stats = opcode_stats_create();
+        for (int i = 0; i < wb->count; i++) {
+            if (wb->cells[i].code != NULL) {
+                opcode_stats_add(stats, wb->cells[i].code);
+            }
+        }
+        print_phase_header("OPCODE SEQUENCES");
+        opcode_stats_print(stats, 10);
+        opcode_stats_free(stats);
+    }
+
+    print_phase_header("DEPENDENCY ORDERING");
+    int cyclic = workbook_schedule(wb);
+    printf("✓ Ordered %d formula(s), %d on a cycle\n", wb->order_count, cyclic);
+
+    AotModel* model = NULL;
+    if (aot_compile) {
+        print_phase_header("AHEAD-OF-TIME COMPILATION");
+        const char* reason = NULL;
+        model = aot_build(wb, &reason);
+        if (model != NULL) {
+            printf("✓ Compiled %d formula(s) to native code (%d C function(s), %ld bytes)\n",
+                model->formula_count, model->shape_count, model->source_bytes);
+        } else {
+            printf("AOT: not compiled (%s), recalculating on the VM\n", reason);
+        }
+    }
+
+    print_phase_header("PHASE 6: RECALCULATION");
+    if (range_cache) {
+        symbol_table->range_cache = range_cache_create(); // Freed with the table
+    }
+    if (range_index) {
+        symbol_table->range_index = range_index_create(); // Freed with the table
+    }
+    double recalc_start = now_ns();
+    if (model != NULL) {
+        aot_recalc(model, wb);
+        printf("✓ Recalculated %d formula(s) natively\n", model->formula_count);
+    } else if (sheet_threads > 1 && sheet_steal) {
+        ParallelStats stats;
+        parallel_recalc_stealing(wb, sheet_threads, &stats);
+        printf("✓ Recalculated on %d thread(s) with work stealing\n", stats.threads);
+        parallel_stats_print(&stats);
+        parallel_stats_free(&stats);
+    } else if (sheet_threads > 1) {
+        parallel_recalc_levels(wb, sheet_threads);
+        printf("✓ Recalculated %d level(s) on %d thread(s)\n", wb->level_count, sheet_threads);
+    } else {
+        workbook_recalc(wb);
+    }
+    printf("✓ Recalculation took %.3f ms\n", (now_ns() - recalc_start) / 1e6);
+
+    if (sheet_edit_count > 0) {
+        print_phase_header("INCREMENTAL RECALCULATION");
+        int marked = 0;
+        for (int i = 0; i < sheet_edit_count; i++) {
+            char key[64];
+            const char* eq = strchr(sheet_edits[i], '=');
+            snprintf(key, sizeof(key), "%.*s", (int)(eq - sheet_edits[i]), sheet_edits[i]);
+            CellCoord coord = cellref_from_string(key);
+            if (coord == CELL_COORD_INVALID) {
+                fprintf(stderr, "Error: --set: invalid cell reference '%s'.\n", key);
+                continue;
+            }
+            const CellEntry* entry = symtab_get_cell(symbol_table, coord);
+            if (entry != NULL && entry->formula_id >= 0) {
+                // Its compiled formula (and JIT/AOT code) would still run; only values are edited
+                fprintf(stderr, "Error: --set: %s holds a formula, only value cells can be set.\n", key);
+                continue;
+            }
+            marked += symtab_set_value(symbol_table, coord, atof(eq + 1));
+            printf("✓ Set %s = %s\n", key, eq + 1);
+        }
+        int recalculated;
+        recalc_start = now_ns();
+        if (model != NULL) {
+            aot_recalc(model, wb); // No dirty tracking: every formula runs again
+            recalculated = model->formula_count;
+        } else {
+            recalculated = workbook_recalc_dirty(wb);
+        }
+        printf("✓ %d cell(s) marked dirty, recalculated %d of %d formula(s) in %.3f ms\n",
+            marked, recalculated, wb->count, (now_ns() - recalc_start) / 1e6);
+    }
+    if (symbol_table->range_cache != NULL) {
+        range_cache_print_stats(symbol_table->range_cache);
+    }
+    if (symbol_table->range_index != NULL) {
+        range_index_print_stats(symbol_table->range_index);
+    }
+    if (jit_threshold > 0) {
+        jit_print_stats();
+    }
+
+    printf("RECALCULATION RESULTS\n\n");
+    workbook_print_results(wb);
+    error_print_all(error_system);
+
+    print_summary(g_token_count, g_node_count, wb->instruction_count);
+    printf("Formulas:     %d\n", wb->count);
+
+    int status = (error_get_count(error_system) > 0) ? 1 : 0;
+    aot_free(model);
+    workbook_free(wb);
+    free(sheet_edits);
+    return status;
+}
+
 // Reads the entire input file into a string
 char* read_input_file(FILE* file) {
     fseek(file, 0, SEEK_END);
@@ -466,36 +1012,47 @@ int main(int argc, char* argv[]) {
     /* Parse command-line flags */
     parse_flags(argc, argv);
     
+    /* Whole-sheet mode: compile and recalculate every cell */
+    if (sheet_file != NULL) {
+        if (cells_file != NULL) {
+            load_cell_data(symbol_table, cells_file);
+        }
+        int status = run_sheet(sheet_file);
+        arena_release(&ast_arena);
+        symtab_free(symbol_table);
+        error_system_free(error_system);
+        return status;
+    }
+
     /* Load Cell Data */
     load_cell_data(symbol_table, cells_file);
 
     /* Set Input Stream */
-    FILE* input_stream = stdin;
+    FILE* input_stream;
     if (input_file != NULL) {
         input_stream = fopen(input_file, "r");
         if (input_stream == NULL) {
             fprintf(stderr, "Fatal Error: Could not open input file '%s'\n", input_file);
             exit(1);
         }
-        // Read formula for header
-        current_formula_string = read_input_file(input_stream);
-        // Reset file pointer for lexer
-        fseek(input_stream, 0, SEEK_SET);
     } else {
-        // Read from stdin
-        char line_buf[1024];
-        if (fgets(line_buf, sizeof(line_buf), stdin)) {
-            // Remove newline
-            char* newline = strrchr(line_buf, '\n');
-            if (newline) *newline = '\0';
-            current_formula_string = strdup(line_buf);
-            
-            // We can't rewind stdin, so we need a new way
-            // This is a common lex/yacc problem.
-            // For simplicity, we'll just print a generic header
-            // and assume yyin is still pointing to stdin.
+        // stdin can't be rewound, so it is copied to a temporary file
+        // that is read twice like an --input file
+        input_stream = tmpfile();
+        if (input_stream == NULL) {
+            fprintf(stderr, "Fatal Error: Could not buffer the formula from stdin\n");
+            exit(1);
+        }
+        char chunk[4096];
+        size_t length;
+        while ((length = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            fwrite(chunk, 1, length, input_stream);
         }
     }
+    // Read formula for header
+    current_formula_string = read_input_file(input_stream);
+    // Reset file pointer for lexer
+    fseek(input_stream, 0, SEEK_SET);
     
     print_header(current_formula_string ? current_formula_string : "");
     yyin = input_stream; // Point lexer to the correct stream
@@ -529,26 +1086,45 @@ int main(int argc, char* argv[]) {
     printf("SYMBOL TABLE\n");
     symtab_print(symbol_table);
     
-    int semantic_errors = semantic_analysis(ast_root, symbol_table, error_system, "C1");
+    int semantic_errors = semantic_analysis(ast_root, symbol_table, error_system, cellref_from_string("C1"));
     if (semantic_errors > 0) {
         printf("\nCompilation failed with %d semantic error(s).\n", semantic_errors);
         error_print_all(error_system);
         goto cleanup;
     }
     printf("✓ Semantic analysis passed!\n");
+    if (optimize_code) {
+        ast_root = optimize_ast(ast_root, 1);
+    }
 
     // Phase 5: Code Generation
     print_phase_header("PHASE 5: CODE GENERATION");
     printf("STACK-BASED BYTECODE\n");
-    CodeArray* bytecode = generate_code(ast_root, symbol_table);
+    int shared = 0;
+    CodeArray* bytecode = generate_code_cse(ast_root, symbol_table, optimize_code, &shared);
     
     if (optimize_code) {
-        optimize_bytecode(bytecode);
+        printf("Optimizer: Common subexpression pass complete. %d subexpressions shared.\n", shared);
+        optimize_bytecode(bytecode, 1);
     }
     if (show_bytecode || verbose) {
         print_bytecode(bytecode);
     }
 
+    RegCode* reg_code = NULL;
+    if (execution_mode == MODE_REGVM || bench_runs > 0) {
+        printf("REGISTER BYTECODE\n");
+        reg_code = generate_reg_code(ast_root, symbol_table);
+        if (reg_code == NULL) {
+            printf("Formula needs more than %d registers; using the stack VM.\n", REG_FILE_SIZE);
+            if (execution_mode == MODE_REGVM) {
+                execution_mode = MODE_VM;
+            }
+        } else if (show_bytecode || verbose) {
+            print_reg_code(reg_code);
+        }
+    }
+
     // Phase 6: Execution
     print_phase_header("PHASE 6: EXECUTION");
     printf("EVALUATION RESULTS\n\n");
@@ -576,19 +1152,40 @@ int main(int argc, char* argv[]) {
         free_value(vm_result);
         vm_free(vm);
     }
+
+    if (execution_mode == MODE_REGVM) {
+        printf("Method 3: Register VM Execution\n");
+        RegVM* rvm = regvm_create(symbol_table);
+        rvm->trace = trace_vm;
+        Value reg_result = regvm_execute(rvm, reg_code);
+
+        printf("RESULT: ");
+        print_value(reg_result);
+        printf("\n");
+
+        free_value(reg_result);
+        regvm_free(rvm);
+    }
+
+    if (bench_runs > 0 && reg_code != NULL) {
+        run_benchmark(bytecode, reg_code, symbol_table, bench_runs);
+    }
+
+    if (scenarios_file != NULL) {
+        run_scenarios(bytecode, symbol_table, scenarios_file);
+    }
     
     // FIX: Pass the global counters
     print_summary(g_token_count, g_node_count, bytecode->count);
     free_bytecode(bytecode);
+    free_reg_code(reg_code);
 
 
 cleanup:
     /* --- Final Cleanup --- */
-    if (input_stream != stdin) {
-        fclose(input_stream);
-    }
+    fclose(input_stream);
     free(current_formula_string);
-    free_ast(ast_root);
+    arena_release(&ast_arena); // Every node and string of the formula at once
     symtab_free(symbol_table);
     error_system_free(error_system);
 
@@ -0,0 +1,229 @@
+/*
+ * --- Range Aggregate Cache Implementation ---
+ *
+ * Entries live in one array and are never removed: a dropped
+ * entry keeps its key and is filled again by its next reader.
+ * A hash table finds an entry by key; per-column lists find
+ * the entries a write may touch.
+ */
+
+#include "rangecache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* --- Private Helpers --- */
+
+static void cache_oom(void) {
+    fprintf(stderr, "Fatal: Out of memory growing range cache\n");
+    exit(1);
+}
+
+static unsigned int hash_key(RangeAggregate kind, CellRange range) {
+    unsigned int h = (unsigned int)kind * 2654435761u;
+    h = (h ^ (unsigned int)range.start) * 2246822519u;
+    h = (h ^ (unsigned int)range.end) * 3266489917u;
+    return h ^ (h >> 15);
+}
+
+// Gets the slot of a key: its entry's slot, or the empty slot where it goes
+static int find_slot(const RangeCache* cache, RangeAggregate kind, CellRange range) {
+    unsigned int mask = (unsigned int)cache->slot_count - 1;
+    unsigned int i = hash_key(kind, range) & mask;
+    for (;;) {
+        int e = cache->slots[i];
+        if (e < 0) {
+            return (int)i;
+        }
+        const RangeCacheEntry* entry = &cache->entries[e];
+        if (entry->kind == kind && entry->range.start == range.start && entry->range.end == range.end) {
+            return (int)i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// Doubles the hash table and re-inserts every entry
+static void grow_slots(RangeCache* cache) {
+    free(cache->slots);
+    cache->slot_count *= 2;
+    cache->slots = (int*)malloc(cache->slot_count * sizeof(int));
+    if (cache->slots == NULL) {
+        cache_oom();
+    }
+    memset(cache->slots, -1, cache->slot_count * sizeof(int));
+    for (int e = 0; e < cache->count; e++) {
+        const RangeCacheEntry* entry = &cache->entries[e];
+        cache->slots[find_slot(cache, entry->kind, entry->range)] = e;
+    }
+}
+
+// Records that an entry covers a column
+static void add_to_column(RangeCache* cache, int col, int e) {
+    if (col >= cache->column_count) {
+        int new_count = cache->column_count < 16 ? 16 : cache->column_count;
+        while (new_count <= col) {
+            new_count *= 2;
+        }
+        cache->columns = (RangeCacheColumn*)realloc(cache->columns, new_count * sizeof(RangeCacheColumn));
+        if (cache->columns == NULL) {
+            cache_oom();
+        }
+        memset(cache->columns + cache->column_count, 0,
+               (new_count - cache->column_count) * sizeof(RangeCacheColumn));
+        cache->column_count = new_count;
+    }
+    RangeCacheColumn* column = &cache->columns[col];
+    if (column->count >= column->capacity) {
+        column->capacity = column->capacity < 4 ? 4 : column->capacity * 2;
+        column->entries = (int*)realloc(column->entries, column->capacity * sizeof(int));
+        if (column->entries == NULL) {
+            cache_oom();
+        }
+    }
+    column->entries[column->count++] = e;
+}
+
+// 1 if 'x' can join an exact integer sum
+static int is_exact_integer(double x) {
+    return fabs(x) <= RANGE_CACHE_EXACT_LIMIT && x == floor(x);
+}
+
+// Applies one write to an entry whose range holds the cell
+static void patch_entry(RangeCache* cache, RangeCacheEntry* entry, double old_value, double new_value) {
+    if (entry->exact) {
+        switch (entry->kind) {
+            case RANGE_AGG_SUM:
+                if (is_exact_integer(new_value)) {
+                    double magnitude = entry->magnitude - fabs(old_value) + fabs(new_value);
+                    if (magnitude <= RANGE_CACHE_EXACT_LIMIT) {
+                        entry->magnitude = magnitude;
+                        entry->sum.sum += new_value - old_value;
+                        cache->deltas++;
+                        return;
+                    }
+                }
+                break;
+            case RANGE_AGG_MIN:
+                if (new_value < entry->extreme) {
+                    entry->extreme = new_value;
+                    cache->deltas++;
+                    return;
+                }
+                if (old_value > entry->extreme && new_value > entry->extreme) {
+                    return; // Neither was the minimum (NaN fails both tests)
+                }
+                break;
+            case RANGE_AGG_MAX:
+                if (new_value > entry->extreme) {
+                    entry->extreme = new_value;
+                    cache->deltas++;
+                    return;
+                }
+                if (old_value < entry->extreme && new_value < entry->extreme) {
+                    return;
+                }
+                break;
+        }
+    }
+    entry->valid = 0;
+    cache->drops++;
+}
+
+
+/* --- Public API --- */
+
+RangeCache* range_cache_create(void) {
+    RangeCache* cache = (RangeCache*)calloc(1, sizeof(RangeCache));
+    if (cache == NULL) {
+        cache_oom();
+    }
+    cache->slot_count = 64;
+    cache->slots = (int*)malloc(cache->slot_count * sizeof(int));
+    if (cache->slots == NULL) {
+        cache_oom();
+    }
+    memset(cache->slots, -1, cache->slot_count * sizeof(int));
+    return cache;
+}
+
+void range_cache_free(RangeCache* cache) {
+    if (cache == NULL) return;
+    for (int c = 0; c < cache->column_count; c++) {
+        free(cache->columns[c].entries);
+    }
+    free(cache->columns);
+    free(cache->slots);
+    free(cache->entries);
+    free(cache);
+}
+
+RangeCacheEntry* range_cache_lookup(RangeCache* cache, RangeAggregate kind, CellRange range) {
+    int slot = find_slot(cache, kind, range);
+    int e = cache->slots[slot];
+    if (e < 0) {
+        if (cache->count >= RANGE_CACHE_MAX_ENTRIES) {
+            return NULL;
+        }
+
+        // A new, unfilled entry
+        if (cache->count >= cache->capacity) {
+            cache->capacity = cache->capacity < 16 ? 16 : cache->capacity * 2;
+            cache->entries = (RangeCacheEntry*)realloc(cache->entries, cache->capacity * sizeof(RangeCacheEntry));
+            if (cache->entries == NULL) {
+                cache_oom();
+            }
+        }
+        e = cache->count++;
+        RangeCacheEntry* entry = &cache->entries[e];
+        memset(entry, 0, sizeof(RangeCacheEntry));
+        entry->kind = kind;
+        entry->range = range;
+        cache->slots[slot] = e;
+        for (int c = cell_col(range.start); c <= cell_col(range.end); c++) {
+            add_to_column(cache, c, e);
+        }
+        if (cache->count * 2 > cache->slot_count) {
+            grow_slots(cache);
+        }
+    }
+
+    RangeCacheEntry* entry = &cache->entries[e];
+    if (entry->valid) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    return entry;
+}
+
+void range_cache_note_write(RangeCache* cache, CellCoord coord, double old_value, double new_value) {
+    int col = cell_col(coord);
+    if (col >= cache->column_count || cache->columns[col].count == 0) {
+        return; // No cached range covers this column
+    }
+    if (memcmp(&old_value, &new_value, sizeof(double)) == 0) {
+        return; // Same bits, nothing changes
+    }
+
+    int row = cell_row(coord);
+    const RangeCacheColumn* column = &cache->columns[col];
+    for (int k = 0; k < column->count; k++) {
+        RangeCacheEntry* entry = &cache->entries[column->entries[k]];
+        if (entry->valid && row >= cell_row(entry->range.start) && row <= cell_row(entry->range.end)) {
+            patch_entry(cache, entry, old_value, new_value);
+        }
+    }
+}
+
+void range_cache_clear(RangeCache* cache) {
+    for (int e = 0; e < cache->count; e++) {
+        cache->entries[e].valid = 0;
+    }
+}
+
+void range_cache_print_stats(const RangeCache* cache) {
+    printf("✓ Range cache: %d range(s), %ld hit(s), %ld miss(es), %ld delta update(s), %ld drop(s)\n",
+        cache->count, cache->hits, cache->misses, cache->deltas, cache->drops);
+}
@@ -0,0 +1,114 @@
+/*
+ * --- Range Aggregate Cache Header ---
+ *
+ * Remembers the SUM, MIN or MAX of every large range a sheet
+ * aggregates, so a thousand cells computing SUM(B1:B10000)
+ * scan the column once. Entries are keyed by (aggregate,
+ * range) and stay valid across recalculations: every write
+ * to a cell inside a cached range either patches the entry
+ * (a delta update) or drops it, and its next reader scans
+ * the range again.
+ *
+ * A patched entry holds the same bits a fresh scan would:
+ * a SUM is only patched while its range holds integers whose
+ * magnitudes add up to at most 2^53, so any order of addition
+ * is exact; a MIN or MAX only when the new value moves it
+ * outward. Anything else drops the entry.
+ *
+ * The cache is not thread-safe. Parallel recalculation
+ * detaches it and starts over afterwards.
+ */
+
+#ifndef RANGECACHE_H
+#define RANGECACHE_H
+
+#include "cellref.h" // For CellRange
+#include "simd.h"    // For SimdSum
+
+#define RANGE_CACHE_MIN_CELLS 32      // Smaller ranges are cheaper to scan again
+#define RANGE_CACHE_MAX_ENTRIES 65536 // Later ranges are scanned every time
+#define RANGE_CACHE_EXACT_LIMIT 9007199254740992.0 // 2^53
+
+typedef enum {
+    RANGE_AGG_SUM, // Also AVERAGE: every cell of a range counts
+    RANGE_AGG_MIN,
+    RANGE_AGG_MAX
+} RangeAggregate;
+
+/*
+ * One cached aggregate.
+ */
+typedef struct {
+    RangeAggregate kind;
+    CellRange range;
+    int valid;          // 0 until filled, and again once dropped
+    int exact;          // 1 if writes may patch it (see above)
+    SimdSum sum;        // RANGE_AGG_SUM
+    double magnitude;   // RANGE_AGG_SUM: sum of the absolute values
+    double extreme;     // RANGE_AGG_MIN / RANGE_AGG_MAX
+} RangeCacheEntry;
+
+/*
+ * The entries covering one column, so a write only checks those.
+ */
+typedef struct {
+    int* entries;
+    int count;
+    int capacity;
+} RangeCacheColumn;
+
+typedef struct {
+    RangeCacheEntry* entries;
+    int count;
+    int capacity;
+    int* slots;         // Open addressing: entry index, -1 = empty
+    int slot_count;     // A power of two, at least twice 'count'
+    RangeCacheColumn* columns;
+    int column_count;
+
+    // Statistics
+    long hits;
+    long misses;
+    long deltas;        // Entries patched by a write
+    long drops;         // Entries dropped by a write
+} RangeCache;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Creates an empty cache.
+ */
+RangeCache* range_cache_create(void);
+
+/**
+ * @brief Frees the cache.
+ */
+void range_cache_free(RangeCache* cache);
+
+/**
+ * @brief Finds the entry for an aggregate of a range, adding an
+ * unfilled one if needed, and counts a hit or a miss. On a miss
+ * the caller scans the range, fills the entry and sets 'valid'.
+ * @return The entry, or NULL if the cache is full.
+ */
+RangeCacheEntry* range_cache_lookup(RangeCache* cache, RangeAggregate kind, CellRange range);
+
+/**
+ * @brief Patches or drops every entry whose range holds 'coord'.
+ * Call before the new value is stored.
+ */
+void range_cache_note_write(RangeCache* cache, CellCoord coord, double old_value, double new_value);
+
+/**
+ * @brief Drops every entry (e.g., after writes the cache did not see).
+ */
+void range_cache_clear(RangeCache* cache);
+
+/**
+ * @brief Prints the hit, miss, delta and drop counters.
+ */
+void range_cache_print_stats(const RangeCache* cache);
+
+
+#endif // RANGECACHE_H
@@ -0,0 +1,252 @@
+/*
+ * --- Column Range Index Implementation ---
+ *
+ * Builds the prefix sums and block sparse tables of a column
+ * from the cell store, and answers slices from them.
+ */
+
+#include "rangeindex.h"
+#include "rangecache.h" // For RANGE_CACHE_EXACT_LIMIT
+#include "simd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* --- Private Helpers --- */
+
+static void index_oom(void) {
+    fprintf(stderr, "Fatal: Out of memory building range index\n");
+    exit(1);
+}
+
+static int floor_log2(int n) {
+    int k = 0;
+    while ((2 << k) <= n) {
+        k++;
+    }
+    return k;
+}
+
+static void free_tables(ColumnIndex* column) {
+    for (int k = 0; k < column->levels; k++) {
+        free(column->mins[k]);
+        free(column->maxs[k]);
+    }
+    free(column->mins);
+    free(column->maxs);
+    free(column->prefix);
+    column->mins = NULL;
+    column->maxs = NULL;
+    column->prefix = NULL;
+    column->levels = 0;
+}
+
+// MIN or MAX of rows first .. last, all inside one block
+static double scan_block(const CellStore* grid, int col, int first, int last, int want_max) {
+    int len;
+    const double* values = cellstore_run(grid, cell_coord(col, first), last - first + 1, &len);
+    if (values == NULL) {
+        return 0.0; // An empty chunk
+    }
+    return want_max ? simd_max(values, len) : simd_min(values, len);
+}
+
+// Builds the tables of a column over at least rows 0 .. row_end
+static void build_column(RangeIndex* index, ColumnIndex* column, const CellStore* grid, int col, int row_end) {
+    int rows = 0;
+    if (col < grid->column_count) {
+        rows = grid->columns[col].chunk_count * CELLSTORE_CHUNK_ROWS;
+    }
+    if (rows <= row_end) {
+        rows = (row_end / RANGE_INDEX_BLOCK + 1) * RANGE_INDEX_BLOCK;
+    }
+    free_tables(column);
+    column->rows = rows;
+
+    // 1. Which tables give exact answers
+    column->magnitude = 0.0;
+    int integral = 1;
+    int ordered = 1;
+    for (int r = 0; r < rows; ) {
+        int len;
+        const double* values = cellstore_run(grid, cell_coord(col, r), rows - r, &len);
+        for (int i = 0; values != NULL && i < len; i++) {
+            double v = values[i];
+            column->magnitude += fabs(v);
+            integral &= (v == floor(v));
+            ordered &= !isnan(v) && !(v == 0.0 && signbit(v));
+        }
+        r += len;
+    }
+    column->sum_exact = integral && column->magnitude <= RANGE_CACHE_EXACT_LIMIT;
+    column->ordered = ordered;
+
+    // 2. Prefix sums: every partial sum is an exact integer
+    if (column->sum_exact) {
+        column->prefix = (double*)malloc((rows + 1) * sizeof(double));
+        if (column->prefix == NULL) {
+            index_oom();
+        }
+        column->prefix[0] = 0.0;
+        for (int r = 0; r < rows; r++) {
+            column->prefix[r + 1] = column->prefix[r] + cellstore_get(grid, cell_coord(col, r));
+        }
+    }
+
+    // 3. Sparse tables over blocks: level k covers 2^k blocks
+    if (column->ordered) {
+        int blocks = rows / RANGE_INDEX_BLOCK;
+        column->levels = floor_log2(blocks) + 1;
+        column->mins = (double**)malloc(column->levels * sizeof(double*));
+        column->maxs = (double**)malloc(column->levels * sizeof(double*));
+        if (column->mins == NULL || column->maxs == NULL) {
+            index_oom();
+        }
+        for (int k = 0; k < column->levels; k++) {
+            int count = blocks - (1 << k) + 1;
+            column->mins[k] = (double*)malloc(count * sizeof(double));
+            column->maxs[k] = (double*)malloc(count * sizeof(double));
+            if (column->mins[k] == NULL || column->maxs[k] == NULL) {
+                index_oom();
+            }
+            for (int b = 0; b < count; b++) {
+                if (k == 0) {
+                    int first = b * RANGE_INDEX_BLOCK;
+                    int last = first + RANGE_INDEX_BLOCK - 1;
+                    column->mins[0][b] = scan_block(grid, col, first, last, 0);
+                    column->maxs[0][b] = scan_block(grid, col, first, last, 1);
+                } else {
+                    int half = 1 << (k - 1);
+                    column->mins[k][b] = fmin(column->mins[k - 1][b], column->mins[k - 1][b + half]);
+                    column->maxs[k][b] = fmax(column->maxs[k - 1][b], column->maxs[k - 1][b + half]);
+                }
+            }
+        }
+    }
+
+    column->built = 1;
+    column->queries = 0;
+    index->builds++;
+}
+
+// Gets a column's index for a query up to row_end, building it once
+// the column has been queried often enough. NULL: scan instead.
+static ColumnIndex* ready_column(RangeIndex* index, const CellStore* grid, int col, int row_end) {
+    if (col >= index->column_count) {
+        int new_count = index->column_count < 16 ? 16 : index->column_count;
+        while (new_count <= col) {
+            new_count *= 2;
+        }
+        index->columns = (ColumnIndex*)realloc(index->columns, new_count * sizeof(ColumnIndex));
+        if (index->columns == NULL) {
+            index_oom();
+        }
+        memset(index->columns + index->column_count, 0,
+               (new_count - index->column_count) * sizeof(ColumnIndex));
+        index->column_count = new_count;
+    }
+
+    ColumnIndex* column = &index->columns[col];
+    if (!column->built || row_end >= column->rows) {
+        if (++column->queries < RANGE_INDEX_THRESHOLD) {
+            return NULL;
+        }
+        build_column(index, column, grid, col, row_end);
+    }
+    return column;
+}
+
+
+/* --- Public API --- */
+
+RangeIndex* range_index_create(void) {
+    RangeIndex* index = (RangeIndex*)calloc(1, sizeof(RangeIndex));
+    if (index == NULL) {
+        index_oom();
+    }
+    return index;
+}
+
+void range_index_free(RangeIndex* index) {
+    if (index == NULL) return;
+    for (int c = 0; c < index->column_count; c++) {
+        free_tables(&index->columns[c]);
+    }
+    free(index->columns);
+    free(index);
+}
+
+int range_index_sum(RangeIndex* index, const CellStore* grid, int col, int row_start, int row_end,
+                    double* sum, double* magnitude) {
+    ColumnIndex* column = ready_column(index, grid, col, row_end);
+    if (column == NULL || !column->sum_exact) {
+        return 0;
+    }
+    *sum = column->prefix[row_end + 1] - column->prefix[row_start];
+    *magnitude = column->magnitude;
+    index->answered++;
+    return 1;
+}
+
+int range_index_extreme(RangeIndex* index, const CellStore* grid, int col, int row_start, int row_end,
+                        int want_max, double* result) {
+    ColumnIndex* column = ready_column(index, grid, col, row_end);
+    if (column == NULL || !column->ordered) {
+        return 0;
+    }
+
+    int first_block = row_start / RANGE_INDEX_BLOCK;
+    int last_block = row_end / RANGE_INDEX_BLOCK;
+    if (first_block == last_block) {
+        *result = scan_block(grid, col, row_start, row_end, want_max);
+        index->answered++;
+        return 1;
+    }
+
+    // Partial blocks at both ends, whole blocks in between
+    double left = scan_block(grid, col, row_start, (first_block + 1) * RANGE_INDEX_BLOCK - 1, want_max);
+    double right = scan_block(grid, col, last_block * RANGE_INDEX_BLOCK, row_end, want_max);
+    double value = want_max ? fmax(left, right) : fmin(left, right);
+    int lo = first_block + 1;
+    int hi = last_block - 1;
+    if (lo <= hi) {
+        int k = floor_log2(hi - lo + 1);
+        double** table = want_max ? column->maxs : column->mins;
+        double a = table[k][lo];
+        double b = table[k][hi - (1 << k) + 1];
+        value = want_max ? fmax(value, fmax(a, b)) : fmin(value, fmin(a, b));
+    }
+    *result = value;
+    index->answered++;
+    return 1;
+}
+
+void range_index_note_write(RangeIndex* index, CellCoord coord, double old_value, double new_value) {
+    int col = cell_col(coord);
+    if (col >= index->column_count || memcmp(&old_value, &new_value, sizeof(double)) == 0) {
+        return;
+    }
+    ColumnIndex* column = &index->columns[col];
+    if (column->built) {
+        column->built = 0;
+        index->stale++;
+    }
+    column->queries = 0;
+}
+
+void range_index_clear(RangeIndex* index) {
+    for (int c = 0; c < index->column_count; c++) {
+        index->columns[c].built = 0;
+        index->columns[c].queries = 0;
+    }
+}
+
+void range_index_print_stats(const RangeIndex* index) {
+    int indexed = 0;
+    for (int c = 0; c < index->column_count; c++) {
+        indexed += index->columns[c].built;
+    }
+    printf("✓ Range index: %d column(s) indexed, %ld build(s), %ld slice(s) answered, %ld stale\n",
+        indexed, index->builds, index->answered, index->stale);
+}
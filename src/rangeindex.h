@@ -0,0 +1,113 @@
+/*
+ * --- Column Range Index Header ---
+ *
+ * An optional per-column index for read-mostly data columns
+ * that many formulas aggregate over different windows
+ * (SUM(B1:B10), SUM(B2:B11), ...), where the range cache
+ * (rangecache.h) never sees the same range twice.
+ *
+ * A column is indexed once it has been queried
+ * RANGE_INDEX_THRESHOLD times:
+ * - prefix sums answer a SUM or AVERAGE slice in O(1);
+ * - a sparse table over blocks of RANGE_INDEX_BLOCK rows
+ *   answers MIN and MAX with two table reads plus a scan of
+ *   at most two partial blocks.
+ *
+ * Answers must be the same bits as a scan. So prefix sums are
+ * only kept for columns of integers whose magnitudes add up to
+ * at most 2^53 (every sum is then exact), and MIN/MAX tables
+ * only for columns without NaN or -0.0.
+ *
+ * A write to an indexed column marks it stale, and resets its
+ * query count: it is rebuilt once it has been queried
+ * RANGE_INDEX_THRESHOLD times again, so a column that changes
+ * as often as it is read is simply scanned.
+ *
+ * Not thread-safe (queries build tables); parallel
+ * recalculation detaches it.
+ */
+
+#ifndef RANGEINDEX_H
+#define RANGEINDEX_H
+
+#include "cellstore.h" // For CellStore
+
+#define RANGE_INDEX_THRESHOLD 8 // Queries before a column is indexed
+#define RANGE_INDEX_BLOCK 64    // Rows per sparse table block (divides CELLSTORE_CHUNK_ROWS)
+
+/*
+ * The index of one column.
+ */
+typedef struct {
+    int queries;        // Since the last build or write
+    int built;          // 1 while the tables match the column
+    int rows;           // Rows covered: 0 .. rows - 1
+
+    int sum_exact;      // 1 if 'prefix' is kept
+    double magnitude;   // Sum of the absolute values of the column
+    double* prefix;     // prefix[r] = sum of rows 0 .. r - 1
+
+    int ordered;        // 1 if the MIN/MAX tables are kept
+    int levels;         // Sparse table levels
+    double** mins;      // mins[k][b] = MIN of blocks b .. b + 2^k - 1
+    double** maxs;
+} ColumnIndex;
+
+typedef struct {
+    ColumnIndex* columns;
+    int column_count;
+
+    // Statistics
+    long builds;
+    long answered;      // Column slices answered from the tables
+    long stale;         // Writes that made a built column stale
+} RangeIndex;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Creates an empty index (no column is indexed yet).
+ */
+RangeIndex* range_index_create(void);
+
+/**
+ * @brief Frees the index and all its tables.
+ */
+void range_index_free(RangeIndex* index);
+
+/**
+ * @brief Sums rows row_start .. row_end of a column, if the column
+ * is (or now gets) indexed with exact prefix sums.
+ * @param magnitude Set to the sum of absolute values of the whole
+ * column, so the caller can check that adding 'sum' stays exact.
+ * @return 1 if answered, 0 if the caller must scan.
+ */
+int range_index_sum(RangeIndex* index, const CellStore* grid, int col, int row_start, int row_end,
+                    double* sum, double* magnitude);
+
+/**
+ * @brief Gets the MIN (want_max = 0) or MAX (want_max = 1) of rows
+ * row_start .. row_end of a column, if it is (or now gets) indexed.
+ * @return 1 if answered, 0 if the caller must scan.
+ */
+int range_index_extreme(RangeIndex* index, const CellStore* grid, int col, int row_start, int row_end,
+                        int want_max, double* result);
+
+/**
+ * @brief Marks a column stale if a write changes one of its cells.
+ */
+void range_index_note_write(RangeIndex* index, CellCoord coord, double old_value, double new_value);
+
+/**
+ * @brief Marks every column stale (e.g., after writes it did not see).
+ */
+void range_index_clear(RangeIndex* index);
+
+/**
+ * @brief Prints the build, answer and stale counters.
+ */
+void range_index_print_stats(const RangeIndex* index);
+
+
+#endif // RANGEINDEX_H
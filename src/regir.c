@@ -0,0 +1,493 @@
+/*
+ * --- Register Bytecode Implementation ---
+ *
+ * Code generation: a post-order walk like codegen.c, except
+ * that each node returns a register instead of pushing it.
+ * Numbers, cells and ranges become prologue loads, so only
+ * operators, IFs and function calls emit instructions. A
+ * caller that needs the result in a particular register (both
+ * branches of an IF must write the same one) passes it down.
+ *
+ * Register allocation: every virtual register is written once
+ * per path and read once, and the code has no loops, so its
+ * live interval is simply [first mention, last mention]. The
+ * intervals are mapped onto physical registers by linear scan.
+ */
+
+#include "regir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "parser.tab.h" // For token enums (PLUS, MINUS, etc.)
+
+
+/* --- Private Helpers --- */
+
+static RegCode* create_reg_code(void) {
+    RegCode* code = (RegCode*)calloc(1, sizeof(RegCode));
+    if (code == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for register code\n");
+        exit(1);
+    }
+    return code;
+}
+
+// Grows 'array' (of 'size'-byte items) to hold at least 'needed' items
+static void* grow(void* array, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+    while (*capacity < needed) {
+        *capacity = *capacity < 8 ? 8 : *capacity * 2;
+    }
+    array = realloc(array, *capacity * size);
+    if (array == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for register code\n");
+        exit(1);
+    }
+    return array;
+}
+
+// Appends an instruction and returns its index
+static int emit(RegCode* code, RegOpCode opcode, int dst, int a, int b, int line) {
+    code->code = (RegInstruction*)grow(code->code, &code->capacity, code->count + 1, sizeof(RegInstruction));
+    RegInstruction* inst = &code->code[code->count];
+    memset(inst, 0, sizeof(*inst));
+    inst->opcode = opcode;
+    inst->line = line;
+    inst->dst = dst;
+    inst->a = a;
+    inst->b = b;
+    return code->count++;
+}
+
+// Finds or adds a prologue load; returns its (virtual) register
+static int intern_load(RegCode* code, RegLoad load) {
+    for (int i = 0; i < code->loads_count; i++) {
+        const RegLoad* old = &code->loads[i];
+        if (old->kind != load.kind) {
+            continue;
+        }
+        if ((load.kind == LOAD_CONST && memcmp(&old->as.number, &load.as.number, sizeof(double)) == 0) ||
+            (load.kind == LOAD_CELL && old->as.cell.coord == load.as.cell.coord) ||
+            (load.kind == LOAD_RANGE && old->as.range.start == load.as.range.start &&
+                                        old->as.range.end == load.as.range.end)) {
+            return old->reg;
+        }
+    }
+    code->loads = (RegLoad*)grow(code->loads, &code->loads_capacity, code->loads_count + 1, sizeof(RegLoad));
+    load.reg = code->vreg_count++;
+    code->loads[code->loads_count++] = load;
+    return load.reg;
+}
+
+static int load_const(RegCode* code, double number) {
+    RegLoad load;
+    memset(&load, 0, sizeof(load));
+    load.kind = LOAD_CONST;
+    load.as.number = number;
+    return intern_load(code, load);
+}
+
+// Moves 'src' into 'dst' if the caller asked for a register, and it is not already there
+static int place(RegCode* code, int src, int dst, int line) {
+    if (dst < 0 || src == dst) {
+        return src;
+    }
+    emit(code, ROP_MOV, dst, src, -1, line);
+    return dst;
+}
+
+static RegOpCode binary_opcode(int op_token) {
+    switch (op_token) {
+        case PLUS:     return ROP_ADD;
+        case MINUS:    return ROP_SUB;
+        case MULTIPLY: return ROP_MUL;
+        case DIVIDE:   return ROP_DIV;
+        case POWER:    return ROP_POW;
+        case GT:       return ROP_GT;
+        case LT:       return ROP_LT;
+        case GTE:      return ROP_GTE;
+        case LTE:      return ROP_LTE;
+        case NE:       return ROP_NEQ;
+        case EQUALS:   return ROP_EQ;
+        case AND:      return ROP_AND;
+        default:       return ROP_OR;
+    }
+}
+
+
+/* --- Code Generation --- */
+
+/*
+ * Generates 'node' and returns the register holding its value. If
+ * 'dst' is not -1, the value is guaranteed to be in register 'dst'.
+ */
+static int gen_expr(ASTNode* node, RegCode* code, SymbolTable* table, int dst) {
+    int line = node->line;
+
+    switch (node->type) {
+        case NODE_NUMBER:
+            return place(code, load_const(code, node->data.number), dst, line);
+
+        case NODE_STRING:
+            // Same placeholder as the stack code generator
+            return place(code, load_const(code, 0.0), dst, line);
+
+        case NODE_CELL_REF: {
+            RegLoad load;
+            memset(&load, 0, sizeof(load));
+            load.kind = LOAD_CELL;
+            load.as.cell.coord = node->data.cell;
+            load.as.cell.id = symtab_intern(table, node->data.cell);
+            return place(code, intern_load(code, load), dst, line);
+        }
+
+        case NODE_RANGE: {
+            RegLoad load;
+            memset(&load, 0, sizeof(load));
+            load.kind = LOAD_RANGE;
+            load.as.range = node->data.range;
+            return place(code, intern_load(code, load), dst, line);
+        }
+
+        case NODE_UNARY_OP: {
+            ASTNode* child = node->data.op.left;
+            int is_neg = (node->data.op.op_token == MINUS);
+            if (is_neg && child->type == NODE_NUMBER) {
+                return place(code, load_const(code, -child->data.number), dst, line); // -5 is a constant
+            }
+            int a = gen_expr(child, code, table, -1);
+            int d = dst >= 0 ? dst : code->vreg_count++;
+            emit(code, is_neg ? ROP_NEG : ROP_NOT, d, a, -1, line);
+            return d;
+        }
+
+        case NODE_BINARY_OP: {
+            int a = gen_expr(node->data.op.left, code, table, -1);
+            int b = gen_expr(node->data.op.right, code, table, -1);
+            int d = dst >= 0 ? dst : code->vreg_count++;
+            emit(code, binary_opcode(node->data.op.op_token), d, a, b, line);
+            return d;
+        }
+
+        case NODE_FUNCTION_CALL: {
+            ASTNode* args = node->data.func.arguments;
+
+            if (node->data.func.function_token == IF) {
+                ASTNode* cond_node = args->data.arg.expression;
+                ASTNode* true_node = args->data.arg.next_arg->data.arg.expression;
+                ASTNode* false_node = args->data.arg.next_arg->data.arg.next_arg->data.arg.expression;
+
+                // Both branches write the same register
+                int cond = gen_expr(cond_node, code, table, -1);
+                int false_jump = emit(code, ROP_JMP_IF_FALSE, -1, cond, -1, line);
+                int d = dst >= 0 ? dst : code->vreg_count++;
+                gen_expr(true_node, code, table, d);
+                int end_jump = emit(code, ROP_JMP, -1, -1, -1, line);
+                code->code[false_jump].extra.address = code->count;
+                gen_expr(false_node, code, table, d);
+                code->code[end_jump].extra.address = code->count;
+                return d;
+            }
+
+            // 1. Arguments, in order (collected first: nested calls append too)
+            int arg_count = 0;
+            for (ASTNode* arg = args; arg != NULL; arg = arg->data.arg.next_arg) {
+                arg_count++;
+            }
+            int* regs = (int*)malloc((arg_count + 1) * sizeof(int));
+            if (regs == NULL) {
+                fprintf(stderr, "Fatal: Out of memory for register code\n");
+                exit(1);
+            }
+            int k = 0;
+            for (ASTNode* arg = args; arg != NULL; arg = arg->data.arg.next_arg) {
+                regs[k++] = gen_expr(arg->data.arg.expression, code, table, -1);
+            }
+
+            // 2. Copy them into the shared argument table
+            code->args = (int*)grow(code->args, &code->args_capacity, code->args_count + arg_count, sizeof(int));
+            memcpy(&code->args[code->args_count], regs, arg_count * sizeof(int));
+            free(regs);
+
+            // 3. The call
+            int d = dst >= 0 ? dst : code->vreg_count++;
+            int index = emit(code, ROP_CALL, d, -1, -1, line);
+            code->code[index].extra.call.info.token = node->data.func.function_token;
+            code->code[index].extra.call.info.arg_count = arg_count;
+            code->code[index].extra.call.first_arg = code->args_count;
+            code->args_count += arg_count;
+            return d;
+        }
+
+        default:
+            fprintf(stderr, "Code-gen error: Unknown AST node type %d\n", node->type);
+            return place(code, load_const(code, 0.0), dst, line);
+    }
+}
+
+
+/* --- Linear-Scan Register Allocation --- */
+
+// Live interval of one virtual register
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+} LiveInterval;
+
+static int compare_start(const void* x, const void* y) {
+    const LiveInterval* a = (const LiveInterval*)x;
+    const LiveInterval* b = (const LiveInterval*)y;
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    }
+    return a->end - b->end;
+}
+
+// Widens the interval of 'vreg' to include 'pc'
+static void mention(LiveInterval* intervals, int vreg, int pc) {
+    if (vreg >= 0) {
+        LiveInterval* iv = &intervals[vreg];
+        if (pc < iv->start) iv->start = pc;
+        if (pc > iv->end) iv->end = pc;
+    }
+}
+
+/*
+ * Maps virtual registers to physical ones: loads get 0..loads_count-1
+ * for the whole run, temporaries share the rest. Returns 0 if there
+ * are too few registers.
+ */
+static int allocate_registers(RegCode* code) {
+    int n = code->vreg_count;
+    LiveInterval* intervals = (LiveInterval*)malloc((n + 1) * sizeof(LiveInterval));
+    int* physical = (int*)malloc((n + 1) * sizeof(int));
+    int* active = (int*)malloc((n + 1) * sizeof(int));     // Interval indices, by end
+    int* free_regs = (int*)malloc((n + 1) * sizeof(int));  // Released physical registers
+    if (intervals == NULL || physical == NULL || active == NULL || free_regs == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for register allocation\n");
+        exit(1);
+    }
+
+    // 1. Loads are pinned, grouped by kind so the prologue needs no switch
+    RegLoad* sorted = (RegLoad*)malloc((code->loads_count + 1) * sizeof(RegLoad));
+    if (sorted == NULL) {
+        fprintf(stderr, "Fatal: Out of memory for register allocation\n");
+        exit(1);
+    }
+    int sorted_count = 0;
+    for (int kind = LOAD_CONST; kind <= LOAD_RANGE; kind++) {
+        for (int i = 0; i < code->loads_count; i++) {
+            if ((int)code->loads[i].kind == kind) {
+                sorted[sorted_count++] = code->loads[i];
+            }
+        }
+        if (kind == LOAD_CONST) code->const_loads = sorted_count;
+        if (kind == LOAD_CELL) code->cell_loads = sorted_count - code->const_loads;
+    }
+    memcpy(code->loads, sorted, code->loads_count * sizeof(RegLoad));
+    free(sorted);
+
+    for (int v = 0; v < n; v++) {
+        physical[v] = -1;
+    }
+    for (int i = 0; i < code->loads_count; i++) {
+        physical[code->loads[i].reg] = i;
+    }
+
+    // 2. Intervals of the temporaries
+    for (int v = 0; v < n; v++) {
+        intervals[v].vreg = v;
+        intervals[v].start = INT_MAX;
+        intervals[v].end = -1;
+    }
+    for (int pc = 0; pc < code->count; pc++) {
+        RegInstruction* inst = &code->code[pc];
+        mention(intervals, inst->a, pc);
+        mention(intervals, inst->b, pc);
+        mention(intervals, inst->dst, pc);
+        if (inst->opcode == ROP_CALL) {
+            for (int k = 0; k < inst->extra.call.info.arg_count; k++) {
+                mention(intervals, code->args[inst->extra.call.first_arg + k], pc);
+            }
+        }
+    }
+    for (int i = 0; i < code->loads_count; i++) {
+        intervals[code->loads[i].reg].start = INT_MAX; // Not allocated below
+    }
+    qsort(intervals, n, sizeof(LiveInterval), compare_start);
+
+    // 3. Scan. An interval ending where the next starts can hand over its
+    // register: every instruction reads its sources before writing 'dst'.
+    int active_count = 0;
+    int free_count = 0;
+    int used = code->loads_count;
+    int ok = used <= REG_FILE_SIZE;
+    for (int i = 0; ok && i < n && intervals[i].start != INT_MAX; i++) {
+        LiveInterval* iv = &intervals[i];
+
+        int kept = 0;
+        for (int k = 0; k < active_count; k++) {
+            LiveInterval* old = &intervals[active[k]];
+            if (old->end <= iv->start) {
+                free_regs[free_count++] = physical[old->vreg];
+            } else {
+                active[kept++] = active[k];
+            }
+        }
+        active_count = kept;
+
+        if (free_count > 0) {
+            physical[iv->vreg] = free_regs[--free_count];
+        } else if (used < REG_FILE_SIZE) {
+            physical[iv->vreg] = used++;
+        } else {
+            ok = 0; // Would need spilling: too big for the register VM
+            break;
+        }
+
+        // Keep 'active' sorted by end
+        int k = active_count++;
+        while (k > 0 && intervals[active[k - 1]].end > iv->end) {
+            active[k] = active[k - 1];
+            k--;
+        }
+        active[k] = i;
+    }
+
+    // 4. Rewrite
+    if (ok) {
+        for (int pc = 0; pc < code->count; pc++) {
+            RegInstruction* inst = &code->code[pc];
+            if (inst->a >= 0) inst->a = physical[inst->a];
+            if (inst->b >= 0) inst->b = physical[inst->b];
+            if (inst->dst >= 0) inst->dst = physical[inst->dst];
+        }
+        for (int k = 0; k < code->args_count; k++) {
+            code->args[k] = physical[code->args[k]];
+        }
+        for (int i = 0; i < code->loads_count; i++) {
+            code->loads[i].reg = i;
+        }
+        code->reg_count = used;
+    }
+
+    free(intervals);
+    free(physical);
+    free(active);
+    free(free_regs);
+    return ok;
+}
+
+
+/* --- Public API --- */
+
+RegCode* generate_reg_code(ASTNode* root, SymbolTable* table) {
+    if (root == NULL) {
+        return NULL;
+    }
+
+    RegCode* code = create_reg_code();
+    int result = gen_expr(root, code, table, -1);
+    emit(code, ROP_HALT, -1, result, -1, root->line);
+
+    if (!allocate_registers(code)) {
+        free_reg_code(code);
+        return NULL;
+    }
+    return code;
+}
+
+void free_reg_code(RegCode* code) {
+    if (code == NULL) return;
+    free(code->code);
+    free(code->loads);
+    free(code->args);
+    free(code);
+}
+
+
+/* --- Debugging --- */
+
+static const char* reg_opcode_name(RegOpCode opcode) {
+    switch (opcode) {
+        case ROP_HALT:         return "HALT";
+        case ROP_MOV:          return "MOV";
+        case ROP_ADD:          return "ADD";
+        case ROP_SUB:          return "SUB";
+        case ROP_MUL:          return "MUL";
+        case ROP_DIV:          return "DIV";
+        case ROP_POW:          return "POW";
+        case ROP_EQ:           return "EQ";
+        case ROP_NEQ:          return "NEQ";
+        case ROP_GT:           return "GT";
+        case ROP_LT:           return "LT";
+        case ROP_GTE:          return "GTE";
+        case ROP_LTE:          return "LTE";
+        case ROP_AND:          return "AND";
+        case ROP_OR:           return "OR";
+        case ROP_NEG:          return "NEG";
+        case ROP_NOT:          return "NOT";
+        case ROP_JMP:          return "JMP";
+        case ROP_JMP_IF_FALSE: return "JMP_IF_FALSE";
+        case ROP_CALL:         return "CALL";
+        default:               return "UNKNOWN";
+    }
+}
+
+static const char* func_name(int func_token) {
+    switch (func_token) {
+        case SUM:     return "SUM";
+        case AVERAGE: return "AVERAGE";
+        case MIN:     return "MIN";
+        case MAX:     return "MAX";
+        case NOT:     return "NOT";
+        default:      return "UNKNOWN_FUNC";
+    }
+}
+
+void print_reg_instruction(const RegCode* code, int index) {
+    const RegInstruction* inst = &code->code[index];
+    printf("%04d: %-12s ", index, reg_opcode_name(inst->opcode));
+    switch (inst->opcode) {
+        case ROP_JMP:
+            printf("-> %d", inst->extra.address);
+            break;
+        case ROP_JMP_IF_FALSE:
+            printf("r%d -> %d", inst->a, inst->extra.address);
+            break;
+        case ROP_CALL:
+            printf("r%d, %s(", inst->dst, func_name(inst->extra.call.info.token));
+            for (int k = 0; k < inst->extra.call.info.arg_count; k++) {
+                printf(k > 0 ? ", r%d" : "r%d", code->args[inst->extra.call.first_arg + k]);
+            }
+            printf(")");
+            break;
+        default:
+            if (inst->dst >= 0) printf("r%d, ", inst->dst);
+            printf("r%d", inst->a);
+            if (inst->b >= 0) printf(", r%d", inst->b);
+    }
+    printf("\n");
+}
+
+void print_reg_code(RegCode* code) {
+    char name[CELLRANGE_MAX];
+    printf("--- Register Bytecode (%d registers) ---\n", code->reg_count);
+    for (int i = 0; i < code->loads_count; i++) {
+        const RegLoad* load = &code->loads[i];
+        printf("LOAD  r%-3d = ", load->reg);
+        switch (load->kind) {
+            case LOAD_CONST: printf("%f\n", load->as.number); break;
+            case LOAD_CELL:  printf("%s\n", cellref_format(load->as.cell.coord, name)); break;
+            case LOAD_RANGE: printf("%s\n", cellrange_format(load->as.range, name)); break;
+        }
+    }
+    for (int i = 0; i < code->count; i++) {
+        print_reg_instruction(code, i);
+    }
+    printf("----------------\n");
+}
@@ -0,0 +1,134 @@
+/*
+ * --- Register Bytecode Header ---
+ *
+ * A second, register-based instruction set for the same
+ * formulas. Each instruction is three-address: a destination
+ * register and up to two source registers. Leaves never need
+ * their own instruction, so "A1*2+B1" is two instructions
+ * instead of five.
+ *
+ * The generator assigns a new virtual register to every
+ * intermediate result, then maps them onto a small register
+ * file with linear-scan allocation.
+ */
+
+#ifndef REGIR_H
+#define REGIR_H
+
+#include "ast.h"
+#include "symtab.h"
+#include "ir.h" // For CellOperand, FuncCallInfo
+
+#define REG_FILE_SIZE 256 // Physical registers per register VM
+
+/* --- Register OpCodes --- */
+typedef enum {
+    ROP_HALT,        // Return a
+    ROP_MOV,         // dst = a
+
+    // Binary Ops: dst = a <op> b
+    ROP_ADD,
+    ROP_SUB,
+    ROP_MUL,
+    ROP_DIV,
+    ROP_POW,
+    ROP_EQ,
+    ROP_NEQ,
+    ROP_GT,
+    ROP_LT,
+    ROP_GTE,
+    ROP_LTE,
+    ROP_AND,
+    ROP_OR,
+
+    // Unary Ops: dst = <op> a
+    ROP_NEG,
+    ROP_NOT,
+
+    // Control Flow
+    ROP_JMP,         // Jump to 'address'
+    ROP_JMP_IF_FALSE,// Jump to 'address' if a is false
+
+    // Functions: dst = f(args[first_arg] .. args[first_arg + arg_count - 1])
+    ROP_CALL
+} RegOpCode;
+
+/* --- Register Loads --- */
+
+/*
+ * Constants, cells and ranges live in registers of their own,
+ * filled by a short prologue before each run. Every instruction
+ * operand is then a register, so handlers never decode operand
+ * kinds. A cell or constant used twice is loaded once.
+ */
+typedef enum {
+    LOAD_CONST,
+    LOAD_CELL,
+    LOAD_RANGE  // Only as a function argument
+} RegLoadKind;
+
+typedef struct {
+    RegLoadKind kind;
+    int reg;
+    union {
+        double number;
+        CellOperand cell;
+        CellRange range;
+    } as;
+} RegLoad;
+
+// A three-address instruction: dst = a <op> b
+typedef struct {
+    RegOpCode opcode;
+    int line; // For debugging
+    int dst;  // Destination register, or -1
+    int a;    // Source registers, or -1
+    int b;
+    union {
+        int address;    // For jumps
+        struct {
+            FuncCallInfo info;
+            int first_arg; // Index into RegCode.args
+        } call;         // For ROP_CALL
+    } extra;
+} RegInstruction;
+
+/* --- Register Code --- */
+typedef struct {
+    RegInstruction* code;
+    int capacity;
+    int count;
+    RegLoad* loads;     // The prologue: constants, then cells, then ranges
+    int loads_capacity;
+    int loads_count;
+    int const_loads;    // Number of LOAD_CONST entries
+    int cell_loads;     // Number of LOAD_CELL entries
+    int* args;          // Argument registers of every ROP_CALL, back to back
+    int args_capacity;
+    int args_count;
+    int vreg_count;     // Virtual registers used by the generator
+    int reg_count;      // Physical registers after allocation
+} RegCode;
+
+
+/* --- Public Functions --- */
+
+/**
+ * @brief Generates register bytecode for an AST and allocates its
+ * registers.
+ * @return A new RegCode, or NULL if the expression needs more than
+ * REG_FILE_SIZE registers (loads plus live temporaries).
+ */
+RegCode* generate_reg_code(ASTNode* root, SymbolTable* table);
+
+/**
+ * @brief Frees register bytecode.
+ */
+void free_reg_code(RegCode* code);
+
+// Debugging
+void print_reg_code(RegCode* code);
+void print_reg_instruction(const RegCode* code, int index);
+
+
+#endif // REGIR_H
@@ -0,0 +1,359 @@
+/*
+ * --- Register Virtual Machine Implementation ---
+ *
+ * Like vm.c: a fast loop with computed-goto dispatch (or a
+ * switch) and no trace tests, and a separate traced loop.
+ * The generator emits only valid registers and jump targets,
+ * so neither loop checks bounds.
+ *
+ * Values own no memory (see value.h), so registers are read
+ * and overwritten freely and nothing is freed when a run
+ * ends early.
+ */
+
+#include "regvm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "parser.tab.h" // For SUM, AVERAGE, MIN, MAX, NOT
+#include "runtime.h"    // For rt_... functions
+
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define REGVM_COMPUTED_GOTO 1 // Same build switch as vm.c
+#endif
+
+#define REGVM_INLINE_ARGS 16 // Call arguments gathered without malloc
+
+
+/* --- Public API --- */
+
+RegVM* regvm_create(SymbolTable* table) {
+    RegVM* vm = (RegVM*)malloc(sizeof(RegVM));
+    if (vm == NULL) {
+        return NULL;
+    }
+    vm->symtab = table;
+    vm->trace = 0;
+    for (int i = 0; i < REG_FILE_SIZE; i++) {
+        vm->regs[i] = create_number_value(0.0);
+    }
+    return vm;
+}
+
+void regvm_free(RegVM* vm) {
+    free(vm); // Registers never own memory
+}
+
+
+/* --- Register Access --- */
+
+// Reads a register as a number
+static inline double read_number(const Value* reg) {
+    if (reg->type == TYPE_NUMBER) {
+        return reg->as.number; // The common case
+    }
+    return get_numeric(*reg);
+}
+
+// Reads a register as a truth value
+static inline int read_truth(const Value* reg) {
+    return is_truthy(*reg);
+}
+
+// Fills the load registers (constants, then cells, then ranges)
+static inline void run_prologue(RegVM* vm, const RegCode* code) {
+    const RegLoad* load = code->loads;
+    const RegLoad* cells = load + code->const_loads;
+    const RegLoad* ranges = cells + code->cell_loads;
+    const RegLoad* end = load + code->loads_count;
+    Value* regs = vm->regs; // Load i is register i
+    for (; load < cells; load++, regs++) {
+        *regs = create_number_value(load->as.number);
+    }
+    for (; load < ranges; load++, regs++) {
+        *regs = create_number_value(symtab_value(vm->symtab, load->as.cell.coord));
+    }
+    for (; load < end; load++, regs++) {
+        *regs = create_range_value(load->as.range);
+    }
+}
+
+// Calls a built-in on the instruction's argument registers
+static Value call_builtin(RegVM* vm, const RegCode* code, const RegInstruction* inst) {
+    int arg_count = inst->extra.call.info.arg_count;
+    const int* regs = &code->args[inst->extra.call.first_arg];
+
+    Value inline_args[REGVM_INLINE_ARGS];
+    Value* args = inline_args;
+    if (arg_count > REGVM_INLINE_ARGS) {
+        args = (Value*)malloc(arg_count * sizeof(Value));
+        if (args == NULL) {
+            fprintf(stderr, "Fatal: Out of memory for call arguments\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < arg_count; i++) {
+        args[i] = vm->regs[regs[i]]; // Borrowed: loads can be shared
+    }
+
+    Value result;
+    switch (inst->extra.call.info.token) {
+        case SUM:     result = rt_sum(args, arg_count, vm->symtab); break;
+        case AVERAGE: result = rt_average(args, arg_count, vm->symtab); break;
+        case MIN:     result = rt_min(args, arg_count, vm->symtab); break;
+        case MAX:     result = rt_max(args, arg_count, vm->symtab); break;
+        case NOT:     result = rt_not(args, arg_count, vm->symtab); break;
+        default:      result = create_error(ERROR_UNKNOWN_FUNCTION);
+    }
+
+    if (args != inline_args) {
+        free(args);
+    }
+    return result;
+}
+
+// Applies an arithmetic or comparison opcode
+static Value binary_op(RegOpCode opcode, double x, double y) {
+    switch (opcode) {
+        case ROP_ADD: return create_number_value(x + y);
+        case ROP_SUB: return create_number_value(x - y);
+        case ROP_MUL: return create_number_value(x * y);
+        case ROP_DIV: return create_number_value(x / y);
+        case ROP_POW: return create_number_value(pow(x, y));
+        case ROP_GT:  return create_boolean_value(x > y);
+        case ROP_LT:  return create_boolean_value(x < y);
+        case ROP_GTE: return create_boolean_value(x >= y);
+        case ROP_LTE: return create_boolean_value(x <= y);
+        case ROP_EQ:  return create_boolean_value(x == y);
+        default:      return create_boolean_value(x != y);
+    }
+}
+
+
+/* --- Main Execution Loop --- */
+
+#ifdef REGVM_COMPUTED_GOTO
+#define RVM_CASE(op)   L_##op
+#define RVM_DISPATCH() goto *dispatch[ip->opcode]
+#else
+#define RVM_CASE(op)   case op
+#define RVM_DISPATCH() continue
+#endif
+
+#define RVM_NEXT()     { ip++; RVM_DISPATCH(); }
+
+// Handler for an arithmetic opcode
+#define RVM_ARITH(op, expr)                                 \
+    RVM_CASE(op): {                                         \
+        double x = read_number(&regs[ip->a]);               \
+        double y = read_number(&regs[ip->b]);               \
+        regs[ip->dst] = create_number_value(expr);          \
+        RVM_NEXT();                                         \
+    }
+
+// Handler for a comparison opcode
+#define RVM_COMPARE(op, cmp)                                \
+    RVM_CASE(op): {                                         \
+        double x = read_number(&regs[ip->a]);               \
+        double y = read_number(&regs[ip->b]);               \
+        regs[ip->dst] = create_boolean_value(x cmp y);      \
+        RVM_NEXT();                                         \
+    }
+
+static Value regvm_run(RegVM* vm, const RegCode* code) {
+    const RegInstruction* base = code->code;
+    const RegInstruction* ip = base;
+    Value* regs = vm->regs;
+    run_prologue(vm, code);
+
+#ifdef REGVM_COMPUTED_GOTO
+    static const void* dispatch[] = {
+        [ROP_HALT] = &&L_ROP_HALT,       [ROP_MOV] = &&L_ROP_MOV,
+        [ROP_ADD] = &&L_ROP_ADD,         [ROP_SUB] = &&L_ROP_SUB,
+        [ROP_MUL] = &&L_ROP_MUL,         [ROP_DIV] = &&L_ROP_DIV,
+        [ROP_POW] = &&L_ROP_POW,         [ROP_EQ] = &&L_ROP_EQ,
+        [ROP_NEQ] = &&L_ROP_NEQ,         [ROP_GT] = &&L_ROP_GT,
+        [ROP_LT] = &&L_ROP_LT,           [ROP_GTE] = &&L_ROP_GTE,
+        [ROP_LTE] = &&L_ROP_LTE,         [ROP_AND] = &&L_ROP_AND,
+        [ROP_OR] = &&L_ROP_OR,           [ROP_NEG] = &&L_ROP_NEG,
+        [ROP_NOT] = &&L_ROP_NOT,         [ROP_JMP] = &&L_ROP_JMP,
+        [ROP_JMP_IF_FALSE] = &&L_ROP_JMP_IF_FALSE,
+        [ROP_CALL] = &&L_ROP_CALL,
+    };
+    RVM_DISPATCH();
+#else
+    for (;;) switch (ip->opcode) {
+#endif
+
+    RVM_CASE(ROP_HALT):
+        return regs[ip->a]; // Success!
+
+    RVM_CASE(ROP_MOV):
+        regs[ip->dst] = regs[ip->a];
+        RVM_NEXT();
+
+    // --- Binary Operators ---
+    RVM_ARITH(ROP_ADD, x + y)
+    RVM_ARITH(ROP_SUB, x - y)
+    RVM_ARITH(ROP_MUL, x * y)
+    RVM_ARITH(ROP_POW, pow(x, y))
+
+    RVM_CASE(ROP_DIV): {
+        double x = read_number(&regs[ip->a]);
+        double y = read_number(&regs[ip->b]);
+        if (y == 0) {
+            return create_error(ERROR_DIV_ZERO); // Propagate error
+        }
+        regs[ip->dst] = create_number_value(x / y);
+        RVM_NEXT();
+    }
+
+    RVM_COMPARE(ROP_GT, >)
+    RVM_COMPARE(ROP_LT, <)
+    RVM_COMPARE(ROP_GTE, >=)
+    RVM_COMPARE(ROP_LTE, <=)
+    RVM_COMPARE(ROP_EQ, ==)
+    RVM_COMPARE(ROP_NEQ, !=)
+
+    RVM_CASE(ROP_AND): {
+        int x = read_truth(&regs[ip->a]);
+        int y = read_truth(&regs[ip->b]);
+        regs[ip->dst] = create_boolean_value(x && y);
+        RVM_NEXT();
+    }
+
+    RVM_CASE(ROP_OR): {
+        int x = read_truth(&regs[ip->a]);
+        int y = read_truth(&regs[ip->b]);
+        regs[ip->dst] = create_boolean_value(x || y);
+        RVM_NEXT();
+    }
+
+    // --- Unary Operators ---
+    RVM_CASE(ROP_NEG):
+        regs[ip->dst] = create_number_value(-read_number(&regs[ip->a]));
+        RVM_NEXT();
+
+    RVM_CASE(ROP_NOT):
+        regs[ip->dst] = create_boolean_value(!read_truth(&regs[ip->a]));
+        RVM_NEXT();
+
+    // --- Control Flow ---
+    RVM_CASE(ROP_JMP_IF_FALSE):
+        ip = read_truth(&regs[ip->a]) ? ip + 1 : base + ip->extra.address;
+        RVM_DISPATCH();
+
+    RVM_CASE(ROP_JMP):
+        ip = base + ip->extra.address; // JUMP
+        RVM_DISPATCH();
+
+    // --- Functions ---
+    RVM_CASE(ROP_CALL):
+        regs[ip->dst] = call_builtin(vm, code, ip);
+        if (regs[ip->dst].type == TYPE_ERROR) {
+            return regs[ip->dst]; // Propagate error
+        }
+        RVM_NEXT();
+
+#ifndef REGVM_COMPUTED_GOTO
+    default:
+        return create_error(ERROR_UNKNOWN_OPCODE);
+    }
+#endif
+}
+
+#undef RVM_COMPARE
+#undef RVM_ARITH
+#undef RVM_NEXT
+#undef RVM_DISPATCH
+#undef RVM_CASE
+
+
+
+/* --- Traced Execution Loop --- */
+
+/*
+ * Same semantics as regvm_run(), printing each instruction and
+ * the register it writes. Only used with --trace.
+ */
+static Value regvm_run_traced(RegVM* vm, const RegCode* code) {
+    run_prologue(vm, code);
+    int pc = 0;
+    for (;;) {
+        const RegInstruction* inst = &code->code[pc];
+        print_reg_instruction(code, pc);
+        pc++;
+
+        switch (inst->opcode) {
+            case ROP_HALT:
+                return vm->regs[inst->a]; // Success!
+
+            case ROP_MOV:
+                vm->regs[inst->dst] = vm->regs[inst->a];
+                break;
+
+            case ROP_AND:
+            case ROP_OR: {
+                int x = read_truth(&vm->regs[inst->a]);
+                int y = read_truth(&vm->regs[inst->b]);
+                vm->regs[inst->dst] = create_boolean_value(inst->opcode == ROP_AND ? (x && y) : (x || y));
+                break;
+            }
+
+            case ROP_NEG:
+                vm->regs[inst->dst] = create_number_value(-read_number(&vm->regs[inst->a]));
+                break;
+
+            case ROP_NOT:
+                vm->regs[inst->dst] = create_boolean_value(!read_truth(&vm->regs[inst->a]));
+                break;
+
+            case ROP_JMP_IF_FALSE:
+                if (!read_truth(&vm->regs[inst->a])) {
+                    pc = inst->extra.address; // JUMP
+                }
+                continue;
+
+            case ROP_JMP:
+                pc = inst->extra.address; // JUMP
+                continue;
+
+            case ROP_CALL:
+                vm->regs[inst->dst] = call_builtin(vm, code, inst);
+                if (vm->regs[inst->dst].type == TYPE_ERROR) {
+                    return vm->regs[inst->dst]; // Propagate error
+                }
+                break;
+
+            default: {
+                // --- Binary Operators ---
+                double x = read_number(&vm->regs[inst->a]);
+                double y = read_number(&vm->regs[inst->b]);
+                if (inst->opcode == ROP_DIV && y == 0) {
+                    return create_error(ERROR_DIV_ZERO); // Propagate error
+                }
+                vm->regs[inst->dst] = binary_op(inst->opcode, x, y);
+                break;
+            }
+        }
+
+        printf("    r%d = ", inst->dst);
+        print_value_inline(vm->regs[inst->dst]);
+        printf("\n");
+    }
+}
+
+
+/* --- Public Entry --- */
+
+Value regvm_execute(RegVM* vm, const RegCode* code) {
+    if (!vm->trace) {
+        return regvm_run(vm, code);
+    }
+
+    printf("--- REGISTER VM TRACE ---\n");
+    Value result = regvm_run_traced(vm, code);
+    printf("--- END TRACE ---\n");
+    return result;
+}
@@ -0,0 +1,40 @@
+/*
+ * --- Register Virtual Machine Header ---
+ *
+ * Runs the register bytecode from regir.h (--mode=regvm).
+ * It has the same semantics as the stack VM in vm.h: the
+ * same Value types, runtime calls and error results.
+ */
+
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "regir.h"
+#include "symtab.h"
+#include "value.h"
+
+typedef struct {
+    SymbolTable* symtab;        // Global symbol table
+    int trace;                  // Flag for tracing execution
+    Value regs[REG_FILE_SIZE];  // The register file
+} RegVM;
+
+/**
+ * @brief Creates a register VM. One VM can run any number of
+ * RegCode arrays, one after the other.
+ */
+RegVM* regvm_create(SymbolTable* table);
+
+/**
+ * @brief Frees the register VM.
+ */
+void regvm_free(RegVM* vm);
+
+/**
+ * @brief Runs register bytecode to its HALT.
+ * @return The final 'Value' result (the caller frees it).
+ */
+Value regvm_execute(RegVM* vm, const RegCode* code);
+
+
+#endif // REGVM_H
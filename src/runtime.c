@@ -6,161 +6,288 @@
  *
  * FIX: Removed local definitions of get_numeric and is_truthy,
  * as they are now provided by value.h.
+ *
+ * Range arguments are reduced in place: each column of the
+ * range is streamed from the cell store one contiguous run
+ * at a time, with no per-cell allocation or lookup, and
+ * each run is reduced by the SIMD kernels (simd.c).
+ *
+ * With a range cache (rangecache.h) attached to the symbol
+ * table, a large range that is the first argument of SUM,
+ * AVERAGE, MIN or MAX is looked up before it is scanned.
+ * Only the first: the cached value is the aggregate of the
+ * range alone, which is only what a scan would give if
+ * nothing was folded in before it.
+ *
+ * With a range index (rangeindex.h), each column of a range
+ * is answered from the column's prefix sums or MIN/MAX tables
+ * whenever that gives the same bits as scanning it.
+ *
+ * A range holding an error cell makes the function return that
+ * error; the cell store finds it before the cache or the index
+ * is asked.
  */
 
 #include "runtime.h"
+#include "simd.h"
+#include "rangeindex.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h> // For fmin, fmax
+#include <math.h> // For INFINITY, isnan, signbit
 
 
 /* --- Private Helpers --- */
 
-// Helper for SUM, AVG
-static void accumulate(ValueNode* args, double* sum, int* count) {
-    *sum = 0;
-    *count = 0;
-    ValueNode* current = args;
-    while (current != NULL) {
-        // Only accumulate numeric types
-        if (current->value.type == TYPE_NUMBER) {
-            *sum += current->value.as.number;
-            (*count)++;
-        }
-        current = current->next;
+// Running state of an aggregate
+typedef struct {
+    SimdSum sum;
+    double min;
+    double max;
+    int count;  // Number of numeric values seen
+    double magnitude; // Sum of absolute values (exact_kernel only)
+    int integral;     // 1 while every value is an integer (exact_kernel only)
+    int ordered;      // 1 while no value is NaN (exact_kernel only)
+} Aggregate;
+
+// Folds 'n' values into the aggregate; 'values' is NULL for a run of empty (0.0) cells
+typedef void (*RunKernel)(Aggregate* acc, const double* values, int n);
+
+static void sum_kernel(Aggregate* acc, const double* values, int n) {
+    if (values != NULL) {
+        simd_sum(&acc->sum, values, n);
     }
+    acc->count += n;
 }
 
-/* --- Public Functions --- */
+static void min_kernel(Aggregate* acc, const double* values, int n) {
+    acc->min = simd_min_step(acc->min, values ? simd_min(values, n) : 0.0);
+    acc->count += n;
+}
 
-Value rt_sum(ValueNode* args) {
-    double sum;
-    int count;
-    accumulate(args, &sum, &count);
-    return create_number_value(sum);
-}
-
-Value rt_average(ValueNode* args) {
-    double sum;
-    int count;
-    accumulate(args, &sum, &count);
-    
-    if (count == 0) {
-        return create_error_value("AVERAGE divide by zero (no numeric args)");
-    }
-    return create_number_value(sum / count);
-}
-
-Value rt_min(ValueNode* args) {
-    if (args == NULL) {
-        return create_number_value(0.0); // Excel returns 0 for MIN()
-    }
-    
-    double min_val = INFINITY;
-    int numeric_found = 0;
-    
-    ValueNode* current = args;
-    while (current != NULL) {
-        if (current->value.type == TYPE_NUMBER) {
-            if (!numeric_found) {
-                min_val = current->value.as.number;
-                numeric_found = 1;
-            } else {
-                min_val = fmin(min_val, current->value.as.number);
-            }
-        }
-        current = current->next;
-    }
-    
-    return create_number_value(numeric_found ? min_val : 0.0);
-}
-
-Value rt_max(ValueNode* args) {
-    if (args == NULL) {
-        return create_number_value(0.0); // Excel returns 0 for MAX()
-    }
-    
-    double max_val = -INFINITY;
-    int numeric_found = 0;
-    
-    ValueNode* current = args;
-    while (current != NULL) {
-        if (current->value.type == TYPE_NUMBER) {
-            if (!numeric_found) {
-                max_val = current->value.as.number;
-                numeric_found = 1;
-            } else {
-                max_val = fmax(max_val, current->value.as.number);
-            }
+static void max_kernel(Aggregate* acc, const double* values, int n) {
+    acc->max = simd_max_step(acc->max, values ? simd_max(values, n) : 0.0);
+    acc->count += n;
+}
+
+// Checks whether a cached aggregate of these values can take delta updates
+static void exact_kernel(Aggregate* acc, const double* values, int n) {
+    if (values != NULL) {
+        for (int i = 0; i < n; i++) {
+            acc->magnitude += fabs(values[i]);
+            acc->integral &= (values[i] == floor(values[i]));
+            acc->ordered &= !isnan(values[i]);
         }
-        current = current->next;
     }
-    
-    return create_number_value(numeric_found ? max_val : 0.0);
+    acc->count += n;
 }
 
-Value rt_not(ValueNode* args) {
-    if (args == NULL || args->next != NULL) {
-        return create_error_value("NOT expects exactly 1 argument");
+// Streams every cell of a range through the kernel, column by column
+static void reduce_range(CellRange range, SymbolTable* table, RunKernel kernel, Aggregate* acc) {
+    int col_start = cell_col(range.start);
+    int col_end = cell_col(range.end);
+    int row_start = cell_row(range.start);
+    int row_end = cell_row(range.end);
+
+    for (int c = col_start; c <= col_end; c++) {
+        int r = row_start;
+        while (r <= row_end) {
+            int len;
+            const double* values = cellstore_run(&table->grid, cell_coord(c, r), row_end - r + 1, &len);
+            kernel(acc, values, len);
+            r += len;
+        }
     }
-    return create_boolean_value(!is_truthy(args->value));
 }
 
+static void init_aggregate(Aggregate* acc) {
+    acc->sum.sum = 0.0;
+    acc->sum.compensation = 0.0;
+    acc->min = INFINITY;
+    acc->max = -INFINITY;
+    acc->count = 0;
+    acc->magnitude = 0.0;
+    acc->integral = 1;
+    acc->ordered = 1;
+}
 
-/* --- Helper Implementations --- */
+static int range_cells(CellRange range) {
+    return (cell_col(range.end) - cell_col(range.start) + 1) *
+           (cell_row(range.end) - cell_row(range.start) + 1);
+}
 
-void free_value_list(ValueNode* head) {
-    while (head != NULL) {
-        ValueNode* temp = head;
-        head = head->next;
-        free_value(temp->value);
-        free(temp);
+// Folds rows row_start .. row_end of a column from the range index.
+// Returns 0 if the index can't give exactly what a scan would.
+static int fold_column_indexed(SymbolTable* table, RangeAggregate kind, int col,
+                               int row_start, int row_end, Aggregate* acc) {
+    RangeIndex* index = table->range_index;
+    if (kind == RANGE_AGG_SUM) {
+        // An exact integer total stays exact while it can't pass 2^53
+        double sum, magnitude;
+        if (acc->sum.compensation != 0.0 || acc->sum.sum != floor(acc->sum.sum) ||
+            !range_index_sum(index, &table->grid, col, row_start, row_end, &sum, &magnitude) ||
+            fabs(acc->sum.sum) + magnitude > RANGE_CACHE_EXACT_LIMIT) {
+            return 0;
+        }
+        acc->sum.sum += sum;
+    } else {
+        // Without NaN or -0.0, a MIN or MAX is the same in any order
+        double extreme;
+        double current = (kind == RANGE_AGG_MIN) ? acc->min : acc->max;
+        if ((current == 0.0 && signbit(current)) ||
+            !range_index_extreme(index, &table->grid, col, row_start, row_end,
+                                 kind == RANGE_AGG_MAX, &extreme)) {
+            return 0;
+        }
+        if (kind == RANGE_AGG_MIN) {
+            acc->min = simd_min_step(acc->min, extreme);
+        } else {
+            acc->max = simd_max_step(acc->max, extreme);
+        }
     }
+    acc->count += row_end - row_start + 1;
+    return 1;
 }
 
-ValueNode* rt_expand_range(const char* range_str, SymbolTable* table) {
-    char col_start, col_end;
-    int row_start, row_end;
-    
-    if (sscanf(range_str, "%c%d:%c%d", &col_start, &row_start, &col_end, &row_end) != 4) {
-        // Not a valid range, treat as a single string.
-        return NULL;
+// Folds a range for an aggregate: column by column from the range
+// index where it can answer, by a scan otherwise
+static void fold_range(CellRange range, SymbolTable* table, RangeAggregate kind,
+                       RunKernel kernel, Aggregate* acc) {
+    if (table->range_index == NULL) {
+        reduce_range(range, table, kernel, acc);
+        return;
+    }
+    int row_start = cell_row(range.start);
+    int row_end = cell_row(range.end);
+    for (int c = cell_col(range.start); c <= cell_col(range.end); c++) {
+        if (!fold_column_indexed(table, kind, c, row_start, row_end, acc)) {
+            CellRange column = { cell_coord(c, row_start), cell_coord(c, row_end) };
+            reduce_range(column, table, kernel, acc);
+        }
+    }
+}
+
+// Folds a range into a fresh aggregate through the range cache.
+// Returns 0 if the cache is full (the caller scans instead).
+static int reduce_range_cached(CellRange range, SymbolTable* table, RangeAggregate kind,
+                               RunKernel kernel, Aggregate* acc) {
+    RangeCacheEntry* entry = range_cache_lookup(table->range_cache, kind, range);
+    if (entry == NULL) {
+        return 0;
+    }
+    if (!entry->valid) {
+        Aggregate check;
+        init_aggregate(&check);
+        fold_range(range, table, kind, kernel, acc);
+        reduce_range(range, table, exact_kernel, &check);
+        entry->sum = acc->sum;
+        entry->magnitude = check.magnitude;
+        entry->extreme = (kind == RANGE_AGG_MIN) ? acc->min : acc->max;
+        entry->exact = (kind == RANGE_AGG_SUM)
+            ? (check.integral && check.magnitude <= RANGE_CACHE_EXACT_LIMIT)
+            : check.ordered;
+        entry->valid = 1;
+        return 1;
     }
-    
-    ValueNode* head = NULL;
-    ValueNode* tail = NULL;
-    
-    // Loop from A1 to B10 (e.g.)
-    for (char c = col_start; c <= col_end; c++) {
-        for (int r = row_start; r <= row_end; r++) {
-            char cell_ref_str[16];
-            snprintf(cell_ref_str, 16, "%c%d", c, r);
-            
-            CellEntry* cell = symtab_get_cell(table, cell_ref_str);
-            Value val;
-            if (cell != NULL && cell->is_defined) {
-                val = create_number_value(cell->value);
-            } else {
-                val = create_number_value(0.0); // Undefined cells are 0
+
+    acc->sum = entry->sum;
+    acc->min = entry->extreme;
+    acc->max = entry->extreme;
+    acc->count = range_cells(range);
+    return 1;
+}
+
+// Folds every argument: numbers directly, ranges through the kernel.
+// Other types (strings, booleans) are skipped. Returns 0, with the
+// error in 'error', if an argument is an error or a range holds one.
+static int reduce_args(const Value* args, int arg_count, SymbolTable* table,
+                       RangeAggregate kind, RunKernel kernel, Aggregate* acc, Value* error) {
+    init_aggregate(acc);
+
+    for (int i = 0; i < arg_count; i++) {
+        if (args[i].type == TYPE_NUMBER) {
+            kernel(acc, &args[i].as.number, 1);
+        } else if (args[i].type == TYPE_ERROR) {
+            *error = args[i];
+            return 0;
+        } else if (args[i].type == TYPE_RANGE) {
+            CellRange range = args[i].as.range;
+            double stored;
+            if (cellstore_find_error(&table->grid, range, &stored)) {
+                *error = cell_value(stored);
+                return 0;
             }
-            
-            // Create a new list node
-            ValueNode* new_node = (ValueNode*)malloc(sizeof(ValueNode));
-            new_node->value = val;
-            new_node->next = NULL;
-            
-            // Append to list
-            if (head == NULL) {
-                head = new_node;
-                tail = new_node;
-            } else {
-                tail->next = new_node;
-                tail = new_node;
+            if (table->range_cache != NULL && acc->count == 0 &&
+                range_cells(range) >= RANGE_CACHE_MIN_CELLS &&
+                reduce_range_cached(range, table, kind, kernel, acc)) {
+                continue;
             }
+            fold_range(range, table, kind, kernel, acc);
         }
     }
-    
-    return head;
+    return 1;
+}
+
+/* --- Public Functions --- */
+
+Value rt_sum(const Value* args, int arg_count, SymbolTable* table) {
+    Aggregate acc;
+    Value error;
+    if (!reduce_args(args, arg_count, table, RANGE_AGG_SUM, sum_kernel, &acc, &error)) {
+        return error;
+    }
+    return create_number_value(acc.sum.sum + acc.sum.compensation);
+}
+
+Value rt_average(const Value* args, int arg_count, SymbolTable* table) {
+    Aggregate acc;
+    Value error;
+    if (!reduce_args(args, arg_count, table, RANGE_AGG_SUM, sum_kernel, &acc, &error)) {
+        return error;
+    }
+
+    if (acc.count == 0) {
+        return create_error(ERROR_AVERAGE_EMPTY);
+    }
+    return create_number_value((acc.sum.sum + acc.sum.compensation) / acc.count);
 }
 
+Value rt_min(const Value* args, int arg_count, SymbolTable* table) {
+    Aggregate acc;
+    Value error;
+    if (!reduce_args(args, arg_count, table, RANGE_AGG_MIN, min_kernel, &acc, &error)) {
+        return error;
+    }
+
+    // Excel returns 0 for MIN() with no numeric args
+    return create_number_value(acc.count > 0 ? acc.min : 0.0);
+}
+
+Value rt_max(const Value* args, int arg_count, SymbolTable* table) {
+    Aggregate acc;
+    Value error;
+    if (!reduce_args(args, arg_count, table, RANGE_AGG_MAX, max_kernel, &acc, &error)) {
+        return error;
+    }
+
+    // Excel returns 0 for MAX() with no numeric args
+    return create_number_value(acc.count > 0 ? acc.max : 0.0);
+}
+
+Value rt_not(const Value* args, int arg_count, SymbolTable* table) {
+    if (arg_count != 1) {
+        return create_error(ERROR_NOT_ARITY);
+    }
+    if (args[0].type == TYPE_RANGE) {
+        // A range is only one argument if it is a single cell
+        if (args[0].as.range.start != args[0].as.range.end) {
+            return create_error(ERROR_NOT_ARITY);
+        }
+        Value cell = cell_value(symtab_value(table, args[0].as.range.start));
+        if (cell.type == TYPE_ERROR) {
+            return cell;
+        }
+        return create_boolean_value(cell.as.number == 0);
+    }
+    return create_boolean_value(!is_truthy(args[0]));
+}
@@ -12,41 +12,24 @@
 #define RUNTIME_H
 
 #include "value.h"      // Provides Value struct and helpers
-#include "symtab.h"     // For expanding ranges
+#include "symtab.h"     // For reading range cells
 
-/* --- Argument List Struct --- */
+/* --- Built-in Function Implementations --- */
 /*
- * A simple linked list of values, used to pass
- * evaluated arguments to runtime functions.
+ * Each function takes its evaluated arguments as an array
+ * (for the VM, a slice of its own stack). A TYPE_RANGE
+ * argument is read straight from the symbol table's grid;
+ * undefined cells in a range count as 0. An error argument,
+ * or the first error cell of a range, is the result.
  */
-typedef struct ValueNode {
-    Value value;
-    struct ValueNode* next;
-} ValueNode;
-
-/* --- Built-in Function Implementations --- */
 
-Value rt_sum(ValueNode* args);
-Value rt_average(ValueNode* args);
-Value rt_min(ValueNode* args);
-Value rt_max(ValueNode* args);
-Value rt_not(ValueNode* args);
+Value rt_sum(const Value* args, int arg_count, SymbolTable* table);
+Value rt_average(const Value* args, int arg_count, SymbolTable* table);
+Value rt_min(const Value* args, int arg_count, SymbolTable* table);
+Value rt_max(const Value* args, int arg_count, SymbolTable* table);
+Value rt_not(const Value* args, int arg_count, SymbolTable* table);
 // Note: IF, AND, OR are handled by interpreter/VM logic
 // for lazy evaluation.
 
-/* --- Helper Functions --- */
-
-/**
- * @brief Expands a range string (e.g., "A1:B10") into a list
- * of ValueNodes by looking up each cell in the symbol table.
- */
-ValueNode* rt_expand_range(const char* range_str, SymbolTable* table);
-
-/**
- * @brief Frees an entire ValueNode list.
- */
-void free_value_list(ValueNode* head);
-
 
 #endif // RUNTIME_H
-
@@ -17,7 +17,7 @@
 typedef struct {
     SymbolTable* table;
     ErrorSystem* errors;
-    const char* this_cell_ref; // The cell we are currently defining (e.g., "C1")
+    CellCoord this_cell;       // The cell we are currently defining (e.g., C1)
     int error_count;
 } SemanticContext;
 
@@ -27,50 +27,73 @@ typedef struct {
 // static ValueType get_node_type(ASTNode* node, SemanticContext* ctx); // REMOVED - This belongs to Phase 4/Evaluation
 static void semantic_traverse(ASTNode* node, SemanticContext* ctx);
 static void check_function_args(ASTNode* node, SemanticContext* ctx);
-static void check_range(const char* range_str, int line, SemanticContext* ctx);
+static void check_range(CellRange range, int line, SemanticContext* ctx);
 
 /* --- Public API --- */
 
-int semantic_analysis(ASTNode* node, SymbolTable* table, ErrorSystem* errors, const char* this_cell_ref) {
+int semantic_analysis(ASTNode* node, SymbolTable* table, ErrorSystem* errors, CellCoord this_cell) {
     if (node == NULL || table == NULL || errors == NULL) {
         return 0; // Nothing to do
     }
     
+    char name[CELLREF_MAX];
+    cellref_format(this_cell, name);
+    printf("Running semantic analysis for cell %s...\n", name);
+
+    // 1 & 2. Define the cell and traverse the AST to find all errors
+    int error_count = semantic_check_formula(node, table, errors, this_cell);
+    CellEntry* entry = symtab_get_cell(table, this_cell);
+
+    // 3. After traversal, check for circular dependencies
+    // We do this by checking all *direct* dependencies of this cell.
+    if (error_count == 0 && (entry->dep_count > 0 || entry->range_count > 0)) {
+        printf("Checking circular dependencies for %s...\n", name);
+        int found = 0;
+        for (int i = 0; i < entry->dep_count && !found; i++) {
+            CellEntry* dep = symtab_cell(table, entry->dependencies[i]);
+            if (dep->range_node) {
+                // A range: check the formula cells inside it
+                for (int k = 0; k < dep->dep_count && !found; k++) {
+                    CellCoord inner = symtab_cell(table, dep->dependencies[k])->coord;
+                    found = symtab_check_circular_dep(table, this_cell, inner, errors);
+                }
+            } else {
+                found = symtab_check_circular_dep(table, this_cell, dep->coord, errors);
+            }
+        }
+        if (found) {
+            error_count++; // Stop after the first circle is found
+        }
+    }
+
+    // FIX: Use the correct function name
+    return error_count + error_get_count(errors);
+}
+
+int semantic_check_formula(ASTNode* node, SymbolTable* table, ErrorSystem* errors, CellCoord this_cell) {
+    if (node == NULL || table == NULL || errors == NULL) {
+        return 0; // Nothing to do
+    }
+
     SemanticContext ctx;
     ctx.table = table;
     ctx.errors = errors;
-    ctx.this_cell_ref = this_cell_ref;
+    ctx.this_cell = this_cell;
     ctx.error_count = 0;
 
-    printf("Running semantic analysis for cell %s...\n", this_cell_ref);
-
     // 1. Get or create the cell entry we are defining
-    CellEntry* this_cell = symtab_get_cell(table, this_cell_ref);
-    if (this_cell == NULL) {
+    CellEntry* entry = symtab_get_cell(table, this_cell);
+    if (entry == NULL) {
         // This cell wasn't in the pre-defined list, so add it.
-        symtab_define_cell(table, this_cell_ref, 0.0, NULL, 0); // Line 0 for now
-        this_cell = symtab_get_cell(table, this_cell_ref);
+        symtab_define_cell(table, this_cell, 0.0, NULL, 0); // Line 0 for now
+        entry = symtab_get_cell(table, this_cell);
     }
-    this_cell->is_defined = 1; // We are now defining it
+    entry->is_defined = 1; // We are now defining it
 
     // 2. Recursively traverse the AST to find all errors
     semantic_traverse(node, &ctx);
 
-    // 3. After traversal, check for circular dependencies
-    // We do this by checking all *direct* dependencies of this cell.
-    if (ctx.error_count == 0 && this_cell->dep_count > 0) {
-        printf("Checking circular dependencies for %s...\n", this_cell_ref);
-        for (int i = 0; i < this_cell->dep_count; i++) {
-            if (symtab_check_circular_dep(table, this_cell_ref, this_cell->dependencies[i], errors)) {
-                ctx.error_count++;
-                // Stop after the first circle is found
-                break; 
-            }
-        }
-    }
-
-    // FIX: Use the correct function name
-    return ctx.error_count + error_get_count(errors);
+    return ctx.error_count;
 }
 
 
@@ -115,25 +138,26 @@ static void semantic_traverse(ASTNode* node, SemanticContext* ctx) {
     
     // 1. Check for undefined cell references
     if (node->type == NODE_CELL_REF) {
-        const char* ref = node->data.str_value;
+        CellCoord ref = node->data.cell;
         CellEntry* cell = symtab_get_cell(ctx->table, ref);
         
         if (cell == NULL || !cell->is_defined) {
             char msg[256];
-            snprintf(msg, 256, "Undefined cell reference: '%s'.", ref);
+            char name[CELLREF_MAX];
+            snprintf(msg, 256, "Undefined cell reference: '%s'.", cellref_format(ref, name));
             // FIX: Use node->line
             error_report(ctx->errors, ERROR_SEMANTIC, node->line, 0, msg, "Ensure this cell has a value.");
             ctx->error_count++;
         } else {
             // Add this as a dependency for the cell we are defining
-            symtab_add_dependency(ctx->table, ctx->this_cell_ref, ref);
+            symtab_add_dependency(ctx->table, ctx->this_cell, ref);
         }
     }
     
     // 2. Check for invalid ranges
     if (node->type == NODE_RANGE) {
         // FIX: Use node->line
-        check_range(node->data.str_value, node->line, ctx);
+        check_range(node->data.range, node->line, ctx);
     }
     
     // 3. Check for type mismatches
@@ -188,25 +212,30 @@ static void check_function_args(ASTNode* node, SemanticContext* ctx) {
     }
 }
 
-static void check_range(const char* range_str, int line, SemanticContext* ctx) {
-    char col_start, col_end;
-    int row_start, row_end;
-    
-    // sscanf "A1:B10" -> A, 1, B, 10
-    if (sscanf(range_str, "%c%d:%c%d", &col_start, &row_start, &col_end, &row_end) != 4) {
-        char msg[256];
-        snprintf(msg, 256, "Invalid range format: '%s'.", range_str);
-        error_report(ctx->errors, ERROR_SEMANTIC, line, 0, msg, "Expected format like A1:B10.");
+static void check_range(CellRange range, int line, SemanticContext* ctx) {
+    // The lexer leaves both corners invalid if it could not decode them
+    if (range.start == CELL_COORD_INVALID) {
+        error_report(ctx->errors, ERROR_SEMANTIC, line, 0, "Invalid range format.", "Expected format like A1:B10.");
         ctx->error_count++;
         return;
     }
 
+    int col_start = cell_col(range.start);
+    int col_end = cell_col(range.end);
+    int row_start = cell_row(range.start);
+    int row_end = cell_row(range.end);
+
     // Check if start is before end
     if (col_start > col_end || row_start > row_end) {
         char msg[256];
-        snprintf(msg, 256, "Invalid range: '%s'.", range_str);
+        char range_str[CELLRANGE_MAX];
+        snprintf(msg, 256, "Invalid range: '%s'.", cellrange_format(range, range_str));
         error_report(ctx->errors, ERROR_SEMANTIC, line, 0, msg, "Start of range must be top-left of end of range.");
         ctx->error_count++;
+        return;
     }
+
+    // The range is a dependency of the cell we are defining
+    symtab_add_range_dependency(ctx->table, ctx->this_cell, range);
 }
 
@@ -22,10 +22,23 @@
  * @param node The root of the AST.
  * @param table The symbol table to use for lookups.
  * @param errors The error reporting system to log errors.
- * @param this_cell_ref The reference of the cell we are defining (e.g., "C1").
+ * @param this_cell The cell we are defining (e.g., C1).
  * @return int The total number of semantic errors found.
  */
-int semantic_analysis(ASTNode* node, SymbolTable* table, ErrorSystem* errors, const char* this_cell_ref);
+int semantic_analysis(ASTNode* node, SymbolTable* table, ErrorSystem* errors, CellCoord this_cell);
+
+/**
+ * @brief Checks a single formula cell without printing or
+ * checking for circular dependencies.
+ *
+ * Reports undefined cells, bad ranges and bad function
+ * arguments, and records every referenced cell in the
+ * dependency list of 'this_cell'. Used by the workbook,
+ * which orders all cells (and finds cycles) in one pass.
+ *
+ * @return int The number of errors found in this formula.
+ */
+int semantic_check_formula(ASTNode* node, SymbolTable* table, ErrorSystem* errors, CellCoord this_cell);
 
 
 #endif // SEMANTIC_H
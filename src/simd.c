@@ -0,0 +1,365 @@
+/*
+ * --- SIMD Aggregate Kernels Implementation ---
+ *
+ * One set of kernels per instruction set. The AVX2 and SSE2
+ * sets are compiled with per-function target attributes, so
+ * the rest of the program needs no special flags and still
+ * runs on CPUs without them.
+ *
+ * Deterministic sums: element i of a run goes to lane i % 8,
+ * each lane is a Kahan sum, and the lanes are combined in a
+ * fixed tree. Only the lane width of the loop differs between
+ * implementations, never the order of operations per lane.
+ */
+
+#include "simd.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#define SIMD_LANES 8 // Lanes of a deterministic sum, for every implementation
+
+
+/* --- Kernel Sets --- */
+
+typedef struct {
+    const char* name;
+    double (*sum)(const double* values, int n);
+    // Kahan-sums 'blocks' blocks of SIMD_LANES values into the lanes 's' and 'c'
+    void (*kahan_lanes)(const double* values, int blocks, double* s, double* c);
+    double (*min)(const double* values, int n);
+    double (*max)(const double* values, int n);
+} KernelSet;
+
+
+/* --- Scalar Kernels --- */
+
+static double sum_scalar(const double* values, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+// One Kahan step: adds 'x' to the lane sum 's' with compensation 'c'
+static inline void kahan_step(double* s, double* c, double x) {
+    double y = x - *c;
+    double t = *s + y;
+    *c = (t - *s) - y;
+    *s = t;
+}
+
+static void kahan_lanes_scalar(const double* values, int blocks, double* s, double* c) {
+    for (int b = 0; b < blocks; b++) {
+        for (int j = 0; j < SIMD_LANES; j++) {
+            kahan_step(&s[j], &c[j], values[b * SIMD_LANES + j]);
+        }
+    }
+}
+
+static double min_scalar(const double* values, int n) {
+    double min_val = values[0];
+    for (int i = 1; i < n; i++) {
+        min_val = simd_min_step(min_val, values[i]);
+    }
+    return min_val;
+}
+
+static double max_scalar(const double* values, int n) {
+    double max_val = values[0];
+    for (int i = 1; i < n; i++) {
+        max_val = simd_max_step(max_val, values[i]);
+    }
+    return max_val;
+}
+
+// Each SIMD lane keeps the first of its own equal values, which need not
+// be the first of the run, so when the lanes end on a zero, or saw only
+// NaN (still at the starting infinity), the run is taken in order instead
+static inline double min_fixup(const double* values, int n, double min_val) {
+    return (min_val == 0 || min_val == INFINITY) ? min_scalar(values, n) : min_val;
+}
+
+static inline double max_fixup(const double* values, int n, double max_val) {
+    return (max_val == 0 || max_val == -INFINITY) ? max_scalar(values, n) : max_val;
+}
+
+static const KernelSet scalar_kernels = {
+    "scalar", sum_scalar, kahan_lanes_scalar, min_scalar, max_scalar
+};
+
+
+#ifdef SIMD_X86
+
+/* --- SSE2 Kernels --- */
+
+__attribute__((target("sse2")))
+static double sum_sse2(const double* values, int n) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(values + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(values + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    double sum = lanes[0] + lanes[1];
+    for (; i < n; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+__attribute__((target("sse2")))
+static void kahan_lanes_sse2(const double* values, int blocks, double* s, double* c) {
+    __m128d sv[4], cv[4];
+    for (int k = 0; k < 4; k++) {
+        sv[k] = _mm_loadu_pd(s + 2 * k);
+        cv[k] = _mm_loadu_pd(c + 2 * k);
+    }
+    for (int b = 0; b < blocks; b++) {
+        for (int k = 0; k < 4; k++) {
+            __m128d y = _mm_sub_pd(_mm_loadu_pd(values + b * SIMD_LANES + 2 * k), cv[k]);
+            __m128d t = _mm_add_pd(sv[k], y);
+            cv[k] = _mm_sub_pd(_mm_sub_pd(t, sv[k]), y);
+            sv[k] = t;
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        _mm_storeu_pd(s + 2 * k, sv[k]);
+        _mm_storeu_pd(c + 2 * k, cv[k]);
+    }
+}
+
+// Note: the data operand comes first, so a NaN cell is skipped like fmin() does
+__attribute__((target("sse2")))
+static double min_sse2(const double* values, int n) {
+    __m128d acc = _mm_set1_pd(INFINITY);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_min_pd(_mm_loadu_pd(values + i), acc);
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double min_val = simd_min_step(lanes[0], lanes[1]);
+    for (; i < n; i++) {
+        min_val = simd_min_step(min_val, values[i]);
+    }
+    return min_fixup(values, n, min_val);
+}
+
+__attribute__((target("sse2")))
+static double max_sse2(const double* values, int n) {
+    __m128d acc = _mm_set1_pd(-INFINITY);
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_max_pd(_mm_loadu_pd(values + i), acc);
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double max_val = simd_max_step(lanes[0], lanes[1]);
+    for (; i < n; i++) {
+        max_val = simd_max_step(max_val, values[i]);
+    }
+    return max_fixup(values, n, max_val);
+}
+
+static const KernelSet sse2_kernels = {
+    "sse2", sum_sse2, kahan_lanes_sse2, min_sse2, max_sse2
+};
+
+
+/* --- AVX2 Kernels --- */
+
+__attribute__((target("avx2")))
+static double sum_avx2(const double* values, int n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(values + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(values + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2")))
+static void kahan_lanes_avx2(const double* values, int blocks, double* s, double* c) {
+    __m256d s0 = _mm256_loadu_pd(s);
+    __m256d s1 = _mm256_loadu_pd(s + 4);
+    __m256d c0 = _mm256_loadu_pd(c);
+    __m256d c1 = _mm256_loadu_pd(c + 4);
+    for (int b = 0; b < blocks; b++) {
+        const double* block = values + b * SIMD_LANES;
+        __m256d y0 = _mm256_sub_pd(_mm256_loadu_pd(block), c0);
+        __m256d y1 = _mm256_sub_pd(_mm256_loadu_pd(block + 4), c1);
+        __m256d t0 = _mm256_add_pd(s0, y0);
+        __m256d t1 = _mm256_add_pd(s1, y1);
+        c0 = _mm256_sub_pd(_mm256_sub_pd(t0, s0), y0);
+        c1 = _mm256_sub_pd(_mm256_sub_pd(t1, s1), y1);
+        s0 = t0;
+        s1 = t1;
+    }
+    _mm256_storeu_pd(s, s0);
+    _mm256_storeu_pd(s + 4, s1);
+    _mm256_storeu_pd(c, c0);
+    _mm256_storeu_pd(c + 4, c1);
+}
+
+__attribute__((target("avx2")))
+static double min_avx2(const double* values, int n) {
+    __m256d acc = _mm256_set1_pd(INFINITY);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_min_pd(_mm256_loadu_pd(values + i), acc);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double min_val = simd_min_step(simd_min_step(lanes[0], lanes[1]), simd_min_step(lanes[2], lanes[3]));
+    for (; i < n; i++) {
+        min_val = simd_min_step(min_val, values[i]);
+    }
+    return min_fixup(values, n, min_val);
+}
+
+__attribute__((target("avx2")))
+static double max_avx2(const double* values, int n) {
+    __m256d acc = _mm256_set1_pd(-INFINITY);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_max_pd(_mm256_loadu_pd(values + i), acc);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double max_val = simd_max_step(simd_max_step(lanes[0], lanes[1]), simd_max_step(lanes[2], lanes[3]));
+    for (; i < n; i++) {
+        max_val = simd_max_step(max_val, values[i]);
+    }
+    return max_fixup(values, n, max_val);
+}
+
+static const KernelSet avx2_kernels = {
+    "avx2", sum_avx2, kahan_lanes_avx2, min_avx2, max_avx2
+};
+
+#endif // SIMD_X86
+
+
+/* --- Selection --- */
+
+static const KernelSet* active = NULL; // Picked on first use
+static int deterministic = 0;
+
+// Gets the widest kernel set the CPU supports
+static const KernelSet* detect_kernels(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static inline const KernelSet* kernels(void) {
+    if (active == NULL) {
+        active = detect_kernels();
+    }
+    return active;
+}
+
+int simd_select(const char* name) {
+    if (strcmp(name, "auto") == 0) {
+        active = detect_kernels();
+        return 0;
+    }
+    if (strcmp(name, "scalar") == 0) {
+        active = &scalar_kernels;
+        return 0;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        active = &sse2_kernels;
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        active = &avx2_kernels;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char* simd_active_name(void) {
+    return kernels()->name;
+}
+
+void simd_set_deterministic(int on) {
+    deterministic = on;
+}
+
+
+/* --- Public Kernels --- */
+
+// Adds 'x' to a running sum, keeping the rounding error (Neumaier)
+static void compensated_add(SimdSum* acc, double x) {
+    double t = acc->sum + x;
+    if (fabs(acc->sum) >= fabs(x)) {
+        acc->compensation += (acc->sum - t) + x;
+    } else {
+        acc->compensation += (x - t) + acc->sum;
+    }
+    acc->sum = t;
+}
+
+void simd_sum(SimdSum* acc, const double* values, int n) {
+    if (!deterministic) {
+        acc->sum += kernels()->sum(values, n);
+        return;
+    }
+
+    // 1. Full blocks through the active implementation
+    double s[SIMD_LANES] = { 0 };
+    double c[SIMD_LANES] = { 0 };
+    int blocks = n / SIMD_LANES;
+    kernels()->kahan_lanes(values, blocks, s, c);
+
+    // 2. The tail goes to lanes 0.., exactly as a full block would
+    for (int i = blocks * SIMD_LANES, j = 0; i < n; i++, j++) {
+        kahan_step(&s[j], &c[j], values[i]);
+    }
+
+    // 3. Fixed combine tree: ((0+1)+(2+3)) + ((4+5)+(6+7))
+    double lane[SIMD_LANES];
+    for (int j = 0; j < SIMD_LANES; j++) {
+        lane[j] = s[j] - c[j];
+    }
+    double run = ((lane[0] + lane[1]) + (lane[2] + lane[3])) +
+                 ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+    compensated_add(acc, run);
+}
+
+double simd_min(const double* values, int n) {
+    return kernels()->min(values, n);
+}
+
+double simd_max(const double* values, int n) {
+    return kernels()->max(values, n);
+}
@@ -0,0 +1,82 @@
+/*
+ * --- SIMD Aggregate Kernels Header ---
+ *
+ * Vectorized reductions over contiguous runs of doubles,
+ * used by the runtime for SUM, AVERAGE, MIN and MAX over
+ * ranges. The widest implementation the CPU supports
+ * (AVX2, SSE2 or scalar) is picked at runtime on first use.
+ *
+ * In deterministic mode, sums use 8-lane Kahan summation
+ * with a fixed lane layout and combine order, so every
+ * implementation returns the same bits for the same input.
+ * MIN and MAX return the same bits on every implementation
+ * in both modes: of equal values (+0 and -0), the first one
+ * in the run wins, as with fmin()/fmax() in order.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * A running, compensated sum. Add the two parts for the total.
+ * 'compensation' stays 0 outside deterministic mode.
+ */
+typedef struct {
+    double sum;
+    double compensation;
+} SimdSum;
+
+/* --- Ordered MIN/MAX Steps --- */
+
+/**
+ * @brief fmin(acc, x) with the tie spelled out: of +0 and -0 the
+ * running minimum 'acc' is kept, and a NaN is skipped. Which zero
+ * fmin() itself returns depends on the compiler and the C library.
+ */
+static inline double simd_min_step(double acc, double x) {
+    return (x < acc || acc != acc) ? x : acc;
+}
+
+/**
+ * @brief fmax(acc, x) with the tie spelled out (see simd_min_step).
+ */
+static inline double simd_max_step(double acc, double x) {
+    return (x > acc || acc != acc) ? x : acc;
+}
+
+/* --- Public API --- */
+
+/**
+ * @brief Forces an implementation: "auto", "avx2", "sse2" or "scalar".
+ * @return 0 on success, -1 if the name is unknown or the CPU
+ * does not support it (the selection is left unchanged).
+ */
+int simd_select(const char* name);
+
+/**
+ * @brief Gets the name of the active implementation (e.g., "avx2").
+ */
+const char* simd_active_name(void);
+
+/**
+ * @brief Turns deterministic (width-independent) summation on or off.
+ */
+void simd_set_deterministic(int on);
+
+/**
+ * @brief Adds 'n' values into a running sum.
+ */
+void simd_sum(SimdSum* acc, const double* values, int n);
+
+/**
+ * @brief Gets the minimum of 'n' values (n >= 1).
+ */
+double simd_min(const double* values, int n);
+
+/**
+ * @brief Gets the maximum of 'n' values (n >= 1).
+ */
+double simd_max(const double* values, int n);
+
+
+#endif // SIMD_H
@@ -0,0 +1,85 @@
+/*
+ * --- String Pool Implementation ---
+ *
+ * An open-addressing hash table (FNV-1a, linear probing) of
+ * pointers into an arena that is never reset. The table
+ * doubles once it is half full.
+ */
+
+#include "strpool.h"
+#include "arena.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRPOOL_MIN_CAPACITY 64 // Slots in the first table (a power of two)
+
+static Arena pool_arena;         // The texts themselves
+static const char** pool_slots;  // NULL marks a free slot
+static int pool_capacity;
+static int pool_count;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* --- Private Helpers --- */
+
+static uint32_t hash_text(const char* text, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Moves every string into a table twice as big
+static void grow_pool(void) {
+    int capacity = pool_capacity < STRPOOL_MIN_CAPACITY ? STRPOOL_MIN_CAPACITY : pool_capacity * 2;
+    const char** slots = (const char**)calloc(capacity, sizeof(const char*));
+    if (slots == NULL) {
+        fprintf(stderr, "Fatal: Out of memory growing string pool\n");
+        exit(1);
+    }
+    for (int i = 0; i < pool_capacity; i++) {
+        const char* text = pool_slots[i];
+        if (text == NULL) {
+            continue;
+        }
+        uint32_t slot = hash_text(text, strlen(text)) & (capacity - 1);
+        while (slots[slot] != NULL) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot] = text;
+    }
+    free(pool_slots);
+    pool_slots = slots;
+    pool_capacity = capacity;
+}
+
+
+/* --- Public API --- */
+
+const char* strpool_intern(const char* text) {
+    size_t len = strlen(text);
+    uint32_t hash = hash_text(text, len);
+
+    pthread_mutex_lock(&pool_lock);
+    if (2 * (pool_count + 1) > pool_capacity) {
+        grow_pool();
+    }
+    uint32_t slot = hash & (pool_capacity - 1);
+    while (pool_slots[slot] != NULL) {
+        if (strcmp(pool_slots[slot], text) == 0) {
+            const char* found = pool_slots[slot];
+            pthread_mutex_unlock(&pool_lock);
+            return found;
+        }
+        slot = (slot + 1) & (pool_capacity - 1);
+    }
+    const char* copy = arena_strndup(&pool_arena, text, len);
+    pool_slots[slot] = copy;
+    pool_count++;
+    pthread_mutex_unlock(&pool_lock);
+    return copy;
+}
@@ -0,0 +1,25 @@
+/*
+ * --- String Pool Header ---
+ *
+ * An immortal pool of interned strings. A TYPE_STRING Value too
+ * long to keep inline points into this pool instead of owning a
+ * heap copy, so copying or dropping a Value never allocates or
+ * frees anything. Each distinct text is stored once, and stays
+ * until the program exits: nothing is ever removed.
+ *
+ * Thread-safe (the parallel recalculation may intern strings).
+ */
+
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+/* --- Public API --- */
+
+/**
+ * @brief Returns the pool's copy of 'text', adding it on first use.
+ * Equal texts always get the same pointer.
+ */
+const char* strpool_intern(const char* text);
+
+
+#endif // STRPOOL_H
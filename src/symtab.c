@@ -1,11 +1,17 @@
 /*
  * --- Symbol Table Implementation ---
  *
- * Implements a hash table for cell storage.
+ * Implements the cell metadata table on top of the value grid.
  *
  * FIX:
  * 1. Added symtab_print() function.
  * 2. Updated symtab_check_circular_dep to use struct.
+ * 3. Cells live in a dense array indexed by id; the grid
+ *    maps a packed coordinate to that id, so no lookup ever
+ *    hashes or compares strings.
+ * 4. Edges are deduplicated in O(1): the dependencies of the
+ *    cell being extended carry a mark, so no list is searched.
+ * 5. Readers of the same range share one range node.
  */
 
 #include "symtab.h"
@@ -13,54 +19,191 @@
 #include <string.h>
 #include <stdio.h>
 
-/* --- Hash Function --- */
-// djb2 hash algorithm
-static unsigned long hash_string(const char* str) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    return hash;
-}
-
-/* --- Private: Find/Resize --- */
-static CellEntry* find_entry(CellEntry* entries, int capacity, const char* key) {
-    unsigned long hash = hash_string(key);
-    int index = (int)(hash & (capacity - 1));
-    
-    for (;;) {
-        CellEntry* entry = &entries[index];
-        if (entry->key == NULL) {
-            // Found an empty slot
-            return entry;
-        } else if (strcmp(key, entry->key) == 0) {
-            // Found the key
-            return entry;
-        }
-        
-        index = (index + 1) & (capacity - 1); // Linear probe
-    }
-}
-
-static void resize_table(SymbolTable* table) {
-    int old_capacity = table->capacity;
-    CellEntry* old_entries = table->entries;
-    
-    table->capacity = old_capacity < 8 ? 8 : old_capacity * 2;
-    table->entries = (CellEntry*)calloc(table->capacity, sizeof(CellEntry));
-    table->count = 0; // Will be recounted
-    
-    // Re-hash all old entries
-    for (int i = 0; i < old_capacity; i++) {
-        if (old_entries[i].key != NULL) {
-            CellEntry* dest = find_entry(table->entries, table->capacity, old_entries[i].key);
-            // Just move the data
-            *dest = old_entries[i];
-            table->count++;
-        }
-    }
-    
-    free(old_entries);
+/* --- Private Helpers --- */
+
+// Appends an id to an int array, doubling its size at powers of two
+static void append_id(int** ids, int* count, int id) {
+    if ((*count & (*count - 1)) == 0) {
+        *ids = (int*)realloc(*ids, (*count ? *count * 2 : 1) * sizeof(int));
+        if (*ids == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing dependency list\n");
+            exit(1);
+        }
+    }
+    (*ids)[(*count)++] = id;
+}
+
+// Records the edge this_id -> target_id (and its reverse) unless it exists.
+// The edges of one cell are added together, so on switching to a new
+// cell its existing dependencies are marked once; a marked target
+// is already a dependency.
+static void add_edge(SymbolTable* table, int this_id, int target_id) {
+    if (table->dep_cell != this_id) {
+        table->dep_cell = this_id;
+        table->dep_epoch++;
+        CellEntry* entry = &table->cells[this_id];
+        for (int i = 0; i < entry->dep_count; i++) {
+            table->cells[entry->dependencies[i]].dep_mark = table->dep_epoch;
+        }
+    }
+    CellEntry* target = &table->cells[target_id];
+    if (target->dep_mark == table->dep_epoch) {
+        return;
+    }
+    target->dep_mark = table->dep_epoch;
+    append_id(&table->cells[this_id].dependencies, &table->cells[this_id].dep_count, target_id);
+    append_id(&target->dependents, &target->dependent_count, this_id);
+}
+
+// Gets a column's range dependencies, growing the directory if needed
+static DependencyColumn* dependency_column(SymbolTable* table, int col) {
+    if (col >= table->dep_column_count) {
+        int count = table->dep_column_count < 4 ? 4 : table->dep_column_count * 2;
+        if (count <= col) {
+            count = col + 1;
+        }
+        table->dep_columns = (DependencyColumn*)realloc(table->dep_columns, count * sizeof(DependencyColumn));
+        if (table->dep_columns == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing dependency index\n");
+            exit(1);
+        }
+        memset(table->dep_columns + table->dep_column_count, 0,
+               (count - table->dep_column_count) * sizeof(DependencyColumn));
+        table->dep_column_count = count;
+    }
+    return &table->dep_columns[col];
+}
+
+static const SymbolTable* sort_table; // For compare_rows
+
+// Sorts cell ids by row
+static int compare_rows(const void* a, const void* b) {
+    int x = cell_row(sort_table->cells[*(const int*)a].coord);
+    int y = cell_row(sort_table->cells[*(const int*)b].coord);
+    return (x > y) - (x < y);
+}
+
+// Adds edges from 'this_id' to the formula cells of rows row_start .. row_end of a column
+static void add_formula_edges(SymbolTable* table, int this_id, int col, int row_start, int row_end) {
+    if (col >= table->dep_column_count || table->dep_columns[col].formula_count == 0) {
+        return;
+    }
+    DependencyColumn* column = &table->dep_columns[col];
+    if (!column->formulas_sorted) {
+        sort_table = table;
+        qsort(column->formulas, column->formula_count, sizeof(int), compare_rows);
+        column->formulas_sorted = 1;
+    }
+
+    // Binary search for the first formula at or below row_start
+    int lo = 0, hi = column->formula_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cell_row(table->cells[column->formulas[mid]].coord) < row_start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (int k = lo; k < column->formula_count; k++) {
+        int id = column->formulas[k];
+        if (cell_row(table->cells[id].coord) > row_end) {
+            break;
+        }
+        add_edge(table, this_id, id);
+    }
+}
+
+// Appends a blank entry and returns its id (the caller maps 'coord' to it)
+static int new_entry(SymbolTable* table, CellCoord coord) {
+    if (table->count >= table->cells_capacity) {
+        table->cells_capacity = table->cells_capacity < 8 ? 8 : table->cells_capacity * 2;
+        table->cells = (CellEntry*)realloc(table->cells, table->cells_capacity * sizeof(CellEntry));
+        if (table->cells == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing symbol table\n");
+            exit(1);
+        }
+    }
+    int id = table->count++;
+    memset(&table->cells[id], 0, sizeof(CellEntry));
+    table->cells[id].coord = coord;
+    table->cells[id].formula_id = -1;
+    return id;
+}
+
+static unsigned int hash_range(CellRange range) {
+    return ((unsigned int)range.start * 2654435761u) ^ ((unsigned int)range.end * 2246822519u);
+}
+
+// Gets the slot of a range node: its own slot, or the empty slot where it goes
+static int find_range_slot(const SymbolTable* table, CellRange range) {
+    unsigned int mask = (unsigned int)table->range_slot_count - 1;
+    unsigned int i = hash_range(range) & mask;
+    while (table->range_slots[i] >= 0) {
+        const CellRange* r = &table->cells[table->range_slots[i]].ranges[0];
+        if (r->start == range.start && r->end == range.end) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return (int)i;
+}
+
+// Gets the node of a range, creating it on first use: it watches the
+// range's columns and depends on the formula cells already inside it
+static int range_node(SymbolTable* table, CellRange range) {
+    if ((table->range_node_count + 1) * 2 > table->range_slot_count) {
+        int* old = table->range_slots;
+        int old_count = table->range_slot_count;
+        table->range_slot_count = old_count < 64 ? 64 : old_count * 2;
+        table->range_slots = (int*)malloc(table->range_slot_count * sizeof(int));
+        if (table->range_slots == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing range nodes\n");
+            exit(1);
+        }
+        memset(table->range_slots, -1, table->range_slot_count * sizeof(int));
+        for (int k = 0; k < old_count; k++) {
+            if (old[k] >= 0) {
+                table->range_slots[find_range_slot(table, table->cells[old[k]].ranges[0])] = old[k];
+            }
+        }
+        free(old);
+    }
+    int slot = find_range_slot(table, range);
+    if (table->range_slots[slot] >= 0) {
+        return table->range_slots[slot];
+    }
+
+    int id = new_entry(table, CELL_COORD_INVALID);
+    CellEntry* node = &table->cells[id];
+    node->range_node = 1;
+    node->ranges = (CellRange*)malloc(sizeof(CellRange));
+    if (node->ranges == NULL) {
+        fprintf(stderr, "Fatal: Out of memory growing range nodes\n");
+        exit(1);
+    }
+    node->ranges[0] = range;
+    node->range_count = 1;
+    table->range_slots[slot] = id;
+    table->range_node_count++;
+
+    int row_start = cell_row(range.start);
+    int row_end = cell_row(range.end);
+    for (int c = cell_col(range.start); c <= cell_col(range.end); c++) {
+        DependencyColumn* column = dependency_column(table, c);
+        if (column->watch_count >= column->watch_capacity) {
+            column->watch_capacity = column->watch_capacity < 4 ? 4 : column->watch_capacity * 2;
+            column->watches = (RangeWatch*)realloc(column->watches, column->watch_capacity * sizeof(RangeWatch));
+            if (column->watches == NULL) {
+                fprintf(stderr, "Fatal: Out of memory growing dependency index\n");
+                exit(1);
+            }
+        }
+        RangeWatch watch = { row_start, row_end, id };
+        column->watches[column->watch_count++] = watch;
+        add_formula_edges(table, id, c, row_start, row_end);
+    }
+    return id;
 }
 
 
@@ -68,126 +211,448 @@ static void resize_table(SymbolTable* table) {
 
 SymbolTable* symtab_create() {
     SymbolTable* table = (SymbolTable*)malloc(sizeof(SymbolTable));
+    cellstore_init(&table->grid);
     table->count = 0;
-    table->capacity = 0;
-    table->entries = NULL;
-    resize_table(table); // Initialize
+    table->cells = NULL;
+    table->cells_capacity = 0;
+    table->dirty = NULL;
+    table->dirty_count = 0;
+    table->dirty_capacity = 0;
+    table->dep_columns = NULL;
+    table->dep_column_count = 0;
+    table->dep_cell = -1;
+    table->dep_epoch = 0;
+    table->range_slots = NULL;
+    table->range_slot_count = 0;
+    table->range_node_count = 0;
+    table->range_cache = NULL;
+    table->range_index = NULL;
     return table;
 }
 
 void symtab_free(SymbolTable* table) {
-    for (int i = 0; i < table->capacity; i++) {
-        if (table->entries[i].key != NULL) {
-            // Free heap-allocated data
-            free(table->entries[i].key);
-            free(table->entries[i].formula_str);
-            free(table->entries[i].dependencies);
-        }
+    for (int id = 0; id < table->count; id++) {
+        // Free heap-allocated data
+        CellEntry* entry = &table->cells[id];
+        free(entry->formula_str);
+        free(entry->dependencies);
+        free(entry->dependents);
+        free(entry->ranges);
+    }
+    for (int c = 0; c < table->dep_column_count; c++) {
+        free(table->dep_columns[c].watches);
+        free(table->dep_columns[c].formulas);
     }
-    free(table->entries);
+    free(table->dep_columns);
+    free(table->range_slots);
+    free(table->cells);
+    cellstore_free(&table->grid);
+    free(table->dirty);
+    range_cache_free(table->range_cache);
+    range_index_free(table->range_index);
     free(table);
 }
 
-CellEntry* symtab_get_cell(SymbolTable* table, const char* key) {
-    if (table->count == 0) return NULL;
-    
-    unsigned long hash = hash_string(key);
-    int index = (int)(hash & (table->capacity - 1));
-    
-    for (;;) {
-        CellEntry* entry = &table->entries[index];
-        if (entry->key == NULL) {
-            // Reached an empty slot, key is not present
-            return NULL;
-        }
-        if (strcmp(key, entry->key) == 0) {
-            return entry; // Found it
-        }
-        index = (index + 1) & (table->capacity - 1);
+int symtab_intern(SymbolTable* table, CellCoord coord) {
+    int existing = cellstore_id(&table->grid, coord);
+    if (existing >= 0) {
+        return existing;
     }
+
+    // New (undefined) cell
+    int id = new_entry(table, coord);
+    cellstore_set_id(&table->grid, coord, id);
+    return id;
 }
 
-void symtab_define_cell(SymbolTable* table, const char* key, double value, const char* formula, int line) {
-    if (table->count + 1 > table->capacity * SYMTAB_LOAD_FACTOR) {
-        resize_table(table);
-    }
-    
-    CellEntry* entry = find_entry(table->entries, table->capacity, key);
-    if (entry->key == NULL) {
-        // New entry
-        table->count++;
-        entry->key = strdup(key);
-    } else {
-        // Overwriting, free old formula
-        free(entry->formula_str);
-    }
-    
-    entry->value = value;
+CellEntry* symtab_get_cell(SymbolTable* table, CellCoord coord) {
+    int id = symtab_lookup(table, coord);
+    return (id >= 0) ? &table->cells[id] : NULL;
+}
+
+void symtab_define_cell(SymbolTable* table, CellCoord coord, double value, const char* formula, int line) {
+    CellEntry* entry = symtab_cell(table, symtab_intern(table, coord));
+    free(entry->formula_str); // Overwriting, free old formula (NULL if new)
+
+    symtab_store_value(table, coord, value);
     entry->formula_str = (formula != NULL) ? strdup(formula) : NULL;
     entry->line = line;
     entry->is_defined = 1;
     // Note: Dependencies are managed by the semantic analyzer
 }
 
-void symtab_add_dependency(SymbolTable* table, const char* this_cell_key, const char* depends_on_key) {
-    CellEntry* entry = symtab_get_cell(table, this_cell_key);
-    if (entry == NULL) {
+void symtab_add_dependency(SymbolTable* table, CellCoord this_cell, CellCoord depends_on) {
+    if (symtab_lookup(table, this_cell) < 0) {
         // This shouldn't happen if semantic analysis is correct
-        symtab_define_cell(table, this_cell_key, 0, NULL, 0);
-        entry = symtab_get_cell(table, this_cell_key);
+        symtab_define_cell(table, this_cell, 0, NULL, 0);
     }
-    
-    // Check if dependency already exists
-    for (int i = 0; i < entry->dep_count; i++) {
-        if (strcmp(entry->dependencies[i], depends_on_key) == 0) {
-            return; // Already in list
+    int this_id = symtab_lookup(table, this_cell);
+    int target_id = symtab_intern(table, depends_on);
+    add_edge(table, this_id, target_id);
+}
+
+void symtab_add_range_dependency(SymbolTable* table, CellCoord this_cell, CellRange range) {
+    if (symtab_lookup(table, this_cell) < 0) {
+        symtab_define_cell(table, this_cell, 0, NULL, 0);
+    }
+    int this_id = symtab_lookup(table, this_cell);
+    CellEntry* entry = &table->cells[this_id];
+    for (int i = 0; i < entry->range_count; i++) {
+        if (entry->ranges[i].start == range.start && entry->ranges[i].end == range.end) {
+            return; // Read twice, one dependency
+        }
+    }
+    if ((entry->range_count & (entry->range_count - 1)) == 0) {
+        entry->ranges = (CellRange*)realloc(entry->ranges,
+            (entry->range_count ? entry->range_count * 2 : 1) * sizeof(CellRange));
+        if (entry->ranges == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing range dependencies\n");
+            exit(1);
         }
     }
-    
-    // Add new dependency
-    entry->dep_count++;
-    entry->dependencies = (char**)realloc(entry->dependencies, entry->dep_count * sizeof(char*));
-    entry->dependencies[entry->dep_count - 1] = strdup(depends_on_key);
+    entry->ranges[entry->range_count++] = range;
+    add_edge(table, this_id, range_node(table, range)); // May move 'entry'
+
+    // A formula reading its own cell depends on itself
+    int col = cell_col(this_cell);
+    int row = cell_row(this_cell);
+    if (col >= cell_col(range.start) && col <= cell_col(range.end) &&
+        row >= cell_row(range.start) && row <= cell_row(range.end)) {
+        add_edge(table, this_id, this_id);
+    }
 }
 
-// Recursive helper for circular dependency check
-static int check_dep_recursive(SymbolTable* table, const char* this_cell_key, const char* check_cell_key, ErrorSystem* errors) {
-    if (strcmp(this_cell_key, check_cell_key) == 0) {
-        return 1; // Found a circle!
+void symtab_set_formula(SymbolTable* table, CellCoord coord, int formula_id) {
+    int id = symtab_intern(table, coord);
+    CellEntry* entry = &table->cells[id];
+    if ((entry->formula_id >= 0) == (formula_id >= 0)) {
+        entry->formula_id = formula_id;
+        return;
+    }
+    entry->formula_id = formula_id;
+
+    DependencyColumn* column = dependency_column(table, cell_col(coord));
+    if (formula_id < 0) {
+        for (int k = 0; k < column->formula_count; k++) {
+            if (column->formulas[k] == id) {
+                memmove(&column->formulas[k], &column->formulas[k + 1],
+                        (column->formula_count - k - 1) * sizeof(int));
+                column->formula_count--;
+                break;
+            }
+        }
+        return;
     }
-    
-    CellEntry* check_cell = symtab_get_cell(table, check_cell_key);
-    if (check_cell == NULL || check_cell->dep_count == 0) {
+    if (column->formula_count >= column->formula_capacity) {
+        column->formula_capacity = column->formula_capacity < 4 ? 4 : column->formula_capacity * 2;
+        column->formulas = (int*)realloc(column->formulas, column->formula_capacity * sizeof(int));
+        if (column->formulas == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing dependency index\n");
+            exit(1);
+        }
+    }
+    column->formulas[column->formula_count++] = id;
+    column->formulas_sorted = 0;
+
+    // Range nodes made before the cell became a formula now depend on it
+    int row = cell_row(coord);
+    for (int k = 0; k < column->watch_count; k++) {
+        RangeWatch watch = column->watches[k];
+        if (row >= watch.row_start && row <= watch.row_end) {
+            add_edge(table, watch.reader, id);
+        }
+    }
+}
+
+// Adds a cell to the dirty list
+static void push_dirty(SymbolTable* table, int id) {
+    if (table->dirty_count >= table->dirty_capacity) {
+        table->dirty_capacity = table->dirty_capacity < 8 ? 8 : table->dirty_capacity * 2;
+        table->dirty = (int*)realloc(table->dirty, table->dirty_capacity * sizeof(int));
+    }
+    table->cells[id].dirty = 1;
+    table->dirty[table->dirty_count++] = id;
+}
+
+int symtab_set_value(SymbolTable* table, CellCoord coord, double value) {
+    CellEntry* entry = symtab_get_cell(table, coord);
+    if (entry == NULL || !entry->is_defined) {
+        symtab_define_cell(table, coord, value, NULL, 0);
+    }
+    int id = symtab_lookup(table, coord);
+    symtab_store_value(table, coord, value);
+
+    // Walk the downstream cone. The dirty list doubles as the work list,
+    // and cells already dirty are not walked again.
+    int first = table->dirty_count;
+    int next = first;
+
+    // The nodes of the ranges holding the cell
+    int col = cell_col(coord);
+    int row = cell_row(coord);
+    if (col < table->dep_column_count) {
+        const DependencyColumn* column = &table->dep_columns[col];
+        for (int k = 0; k < column->watch_count; k++) {
+            const RangeWatch* watch = &column->watches[k];
+            if (row >= watch->row_start && row <= watch->row_end && !table->cells[watch->reader].dirty) {
+                push_dirty(table, watch->reader);
+            }
+        }
+    }
+
+    CellEntry* cell = &table->cells[id];
+    for (int i = 0; i < cell->dependent_count; i++) {
+        if (!table->cells[cell->dependents[i]].dirty) {
+            push_dirty(table, cell->dependents[i]);
+        }
+    }
+    while (next < table->dirty_count) {
+        cell = &table->cells[table->dirty[next++]];
+        for (int i = 0; i < cell->dependent_count; i++) {
+            if (!table->cells[cell->dependents[i]].dirty) {
+                push_dirty(table, cell->dependents[i]);
+            }
+        }
+    }
+
+    int marked = 0;
+    for (int k = first; k < table->dirty_count; k++) {
+        marked += !table->cells[table->dirty[k]].range_node;
+    }
+    return marked;
+}
+
+void symtab_clear_dirty(SymbolTable* table) {
+    for (int i = 0; i < table->dirty_count; i++) {
+        table->cells[table->dirty[i]].dirty = 0;
+    }
+    table->dirty_count = 0;
+}
+
+/* --- Cycle Detection --- */
+
+// A growable string, used to build cycle paths of any length
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+} PathBuffer;
+
+static void path_append(PathBuffer* buf, const char* part) {
+    size_t n = strlen(part);
+    if (buf->length + n + 1 > buf->capacity) {
+        buf->capacity = (buf->length + n + 1) * 2;
+        buf->text = (char*)realloc(buf->text, buf->capacity);
+    }
+    memcpy(buf->text + buf->length, part, n + 1);
+    buf->length += n;
+}
+
+static void path_append_cell(PathBuffer* buf, SymbolTable* table, int id) {
+    char name[CELLRANGE_MAX];
+    if (table->cells[id].range_node) {
+        path_append(buf, cellrange_format(table->cells[id].ranges[0], name)); // A range node
+        return;
+    }
+    path_append(buf, cellref_format(table->cells[id].coord, name));
+}
+
+int symtab_check_circular_dep(SymbolTable* table, CellCoord this_cell, CellCoord check_cell, ErrorSystem* errors) {
+    int target = symtab_lookup(table, this_cell);
+    int start = symtab_lookup(table, check_cell);
+    if (target < 0 || start < 0) {
         return 0; // No dependencies, no circle
     }
-    
-    for (int i = 0; i < check_cell->dep_count; i++) {
-        if (check_dep_recursive(table, this_cell_key, check_cell->dependencies[i], errors)) {
-            // Log the dependency path as we unwind
-            char msg[128];
-            snprintf(msg, 128, " -> %s", check_cell_key);
-            error_report_message(errors, msg);
-            return 1;
+
+    // Iterative DFS from 'check_cell'. 'parent' doubles as the
+    // visited set (-2 = not visited), so every cell is walked once.
+    int* parent = (int*)malloc(table->count * sizeof(int));
+    int* stack = (int*)malloc(table->count * sizeof(int));
+    for (int i = 0; i < table->count; i++) {
+        parent[i] = -2;
+    }
+    int top = 0;
+    int found_from = -1; // The cell whose dependency closes the circle
+    parent[start] = -1;
+    stack[top++] = start;
+
+    if (start == target) {
+        found_from = target;
+    }
+    while (top > 0 && found_from < 0) {
+        int v = stack[--top];
+        CellEntry* entry = &table->cells[v];
+        for (int i = 0; i < entry->dep_count; i++) {
+            int w = entry->dependencies[i];
+            if (w == target) {
+                found_from = v; // Found a circle!
+                break;
+            }
+            if (parent[w] == -2) {
+                parent[w] = v;
+                stack[top++] = w;
+            }
+        }
+    }
+
+    if (found_from >= 0) {
+        // Walk the parents back to 'check_cell' to rebuild the path
+        int length = 0;
+        for (int v = found_from; v >= 0 && v != target; v = parent[v]) {
+            stack[length++] = v;
         }
+
+        PathBuffer path = { NULL, 0, 0 };
+        path_append(&path, "Circular dependency detected: ");
+        path_append_cell(&path, table, target);
+        for (int i = length - 1; i >= 0; i--) {
+            path_append(&path, " -> ");
+            path_append_cell(&path, table, stack[i]);
+        }
+        path_append(&path, " -> ");
+        path_append_cell(&path, table, target);
+
+        error_report(errors, ERROR_SEMANTIC, 0, 0, path.text, "Remove the dependency.");
+        free(path.text);
     }
-    return 0;
+
+    free(parent);
+    free(stack);
+    return found_from >= 0;
 }
 
-int symtab_check_circular_dep(SymbolTable* table, const char* this_cell_key, const char* check_cell_key, ErrorSystem* errors) {
-    if (check_dep_recursive(table, this_cell_key, check_cell_key, errors)) {
-        // We found a circle, now create the full error message
-        char final_msg[512];
-        snprintf(final_msg, 512, "Circular dependency detected: %s -> %s", this_cell_key, check_cell_key);
-        
-        // Append the rest of the path from the error system
-        strncat(final_msg, error_get_messages(errors), 512 - strlen(final_msg) - 1);
-        error_clear_messages(errors); // Clear partial messages
-        
-        // Report the final, complete error
-        error_report(errors, ERROR_SEMANTIC, 0, 0, final_msg, "Remove the dependency.");
-        return 1;
+// Reports one cycle inside the strongly connected component 'comp'
+// by following dependencies that stay inside it until a cell repeats.
+static void report_cycle(SymbolTable* table, int root, const int* component, int comp,
+                         int* walk_pos, int* path, ErrorSystem* errors) {
+    int steps = 0;
+    int cur = root;
+    while (walk_pos[cur] < 0) {
+        walk_pos[cur] = steps;
+        path[steps++] = cur;
+        CellEntry* entry = &table->cells[cur];
+        int next = -1;
+        for (int i = 0; i < entry->dep_count && next < 0; i++) {
+            if (component[entry->dependencies[i]] == comp) {
+                next = entry->dependencies[i];
+            }
+        }
+        cur = next; // Every cell of a cyclic component has one
+    }
+
+    PathBuffer msg = { NULL, 0, 0 };
+    path_append(&msg, "Circular dependency detected: ");
+    for (int i = walk_pos[cur]; i < steps; i++) {
+        path_append_cell(&msg, table, path[i]);
+        path_append(&msg, " -> ");
     }
-    return 0;
+    path_append_cell(&msg, table, cur);
+
+    error_report(errors, ERROR_SEMANTIC, table->cells[cur].line, 0, msg.text, "Remove the dependency.");
+    free(msg.text);
+}
+
+int symtab_find_cycles(SymbolTable* table, ErrorSystem* errors) {
+    int n = table->count;
+    int* index = (int*)malloc((n + 1) * sizeof(int));      // DFS discovery order, -1 = unvisited
+    int* low = (int*)malloc((n + 1) * sizeof(int));        // Tarjan low-link
+    int* next_dep = (int*)calloc(n + 1, sizeof(int));      // Next dependency to visit
+    int* component = (int*)malloc((n + 1) * sizeof(int));  // SCC id, -1 = not assigned yet
+    int* walk_pos = (int*)malloc((n + 1) * sizeof(int));   // Position on a reported path
+    char* on_stack = (char*)calloc(n + 1, 1);
+    int* scc_stack = (int*)malloc((n + 1) * sizeof(int));
+    int* call_stack = (int*)malloc((n + 1) * sizeof(int));
+    int* path = (int*)malloc((n + 1) * sizeof(int));
+
+    for (int i = 0; i < n; i++) {
+        index[i] = -1;
+        component[i] = -1;
+        walk_pos[i] = -1;
+        table->cells[i].on_cycle = 0;
+    }
+
+    int counter = 0;
+    int components = 0;
+    int cycles = 0;
+    int scc_top = 0;
+
+    for (int root = 0; root < n; root++) {
+        if (index[root] >= 0) {
+            continue;
+        }
+
+        // Iterative Tarjan: 'call_stack' replaces the recursion
+        int call_top = 0;
+        index[root] = low[root] = counter++;
+        scc_stack[scc_top++] = root;
+        on_stack[root] = 1;
+        call_stack[call_top++] = root;
+
+        while (call_top > 0) {
+            int v = call_stack[call_top - 1];
+            CellEntry* entry = &table->cells[v];
+
+            if (next_dep[v] < entry->dep_count) {
+                int w = entry->dependencies[next_dep[v]++];
+                if (index[w] < 0) {
+                    // Descend into w
+                    index[w] = low[w] = counter++;
+                    scc_stack[scc_top++] = w;
+                    on_stack[w] = 1;
+                    call_stack[call_top++] = w;
+                } else if (on_stack[w] && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+                continue;
+            }
+
+            // All dependencies of v are done: return to the caller
+            call_top--;
+            if (call_top > 0) {
+                int u = call_stack[call_top - 1];
+                if (low[v] < low[u]) {
+                    low[u] = low[v];
+                }
+            }
+            if (low[v] != index[v]) {
+                continue;
+            }
+
+            // v is the root of a component: pop it
+            int comp = components++;
+            int size = 0;
+            int w;
+            do {
+                w = scc_stack[--scc_top];
+                on_stack[w] = 0;
+                component[w] = comp;
+                size++;
+            } while (w != v);
+
+            int self_loop = 0;
+            for (int i = 0; i < entry->dep_count && !self_loop; i++) {
+                self_loop = (entry->dependencies[i] == v);
+            }
+            if (size > 1 || self_loop) {
+                for (int i = scc_top; i < scc_top + size; i++) {
+                    table->cells[scc_stack[i]].on_cycle = 1;
+                }
+                report_cycle(table, v, component, comp, walk_pos, path, errors);
+                cycles++;
+            }
+        }
+    }
+
+    free(index);
+    free(low);
+    free(next_dep);
+    free(component);
+    free(walk_pos);
+    free(on_stack);
+    free(scc_stack);
+    free(call_stack);
+    free(path);
+    return cycles;
 }
 
 /**
@@ -196,18 +661,21 @@ int symtab_check_circular_dep(SymbolTable* table, const char* this_cell_key, con
 void symtab_print(SymbolTable* table) {
     printf("Cell | Value   | Status\n");
     printf("-----|---------|----------\n");
-    
-    for (int i = 0; i < table->capacity; i++) {
-        CellEntry* entry = &table->entries[i];
-        if (entry->key != NULL) {
-            // Only print defined cells for the clean output
-            if(entry->is_defined && entry->formula_str != NULL) {
-                printf("%-4s | %-7.2f | %s\n",
-                    entry->key,
-                    entry->value,
-                    "DEFINED");
+
+    for (int id = 0; id < table->count; id++) {
+        CellEntry* entry = &table->cells[id];
+        // Only print defined cells for the clean output
+        if(entry->is_defined && entry->formula_str != NULL) {
+            char name[CELLREF_MAX];
+            double value = symtab_value(table, entry->coord);
+            if (cellstore_is_error(value)) {
+                printf("%-4s | %-7s | %s\n", cellref_format(entry->coord, name), "#ERROR", "DEFINED");
+                continue;
             }
+            printf("%-4s | %-7.2f | %s\n",
+                cellref_format(entry->coord, name),
+                value,
+                "DEFINED");
         }
     }
 }
-
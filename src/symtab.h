@@ -8,38 +8,110 @@
  * 1. Added symtab_print() declaration.
  * 2. Included error.h to get ErrorSystem type.
  * 3. Fixed prototype for symtab_check_circular_dep.
+ * 4. Cells are keyed by packed coordinates (cellref.h) and
+ *    stored in a dense array, so compiled code can refer
+ *    to a cell by its integer id.
+ * 5. Values live in a columnar grid (cellstore.h); the
+ *    cell entries are only a metadata side table.
+ * 6. Every write goes past the range cache (rangecache.h)
+ *    and the range index (rangeindex.h), if attached.
+ * 7. A range dependency is kept as a range, not one edge per
+ *    cell: only the formula cells inside it get edges, and
+ *    a per-column index finds the readers of any other cell.
+ * 8. Every distinct range read is one range node, shared by
+ *    all its readers, so N cells reading a range of M formula
+ *    cells make N + M edges, not N * M.
  */
 
 #ifndef SYMTAB_H
 #define SYMTAB_H
 
-#include "error.h" // For ErrorSystem
-
-#define SYMTAB_LOAD_FACTOR 0.75
+#include "error.h"   // For ErrorSystem
+#include "cellref.h" // For CellCoord
+#include "cellstore.h" // For CellStore
+#include "rangecache.h" // For RangeCache
+#include "rangeindex.h" // For RangeIndex
 
 /*
- * Represents a single cell (e.g., A1) in the table.
+ * Metadata of a single cell (e.g., A1). Its value is in the grid.
  */
 typedef struct {
-    char* key;          // The cell reference (e.g., "A1")
+    CellCoord coord;    // The cell reference (e.g., A1 = column 0, row 0)
     char* formula_str;  // The raw formula string (e.g., "=B1+C1")
-    double value;       // The last calculated numeric value
     int is_defined;     // 1 if this cell has a value/formula, 0 otherwise
     int line;           // Line number where this was defined (in cells file)
-    
+
     // For dependency tracking (Prompt 4.2)
-    char** dependencies; // Array of cell keys this cell depends on
+    int* dependencies;  // Ids of the cells this cell depends on
     int dep_count;      // Number of dependencies
+    int* dependents;    // Reverse edges: ids of the cells that depend on this cell
+    int dependent_count; // Number of dependents
+    CellRange* ranges;  // Ranges this cell's formula reads
+    int range_count;
+    int dep_mark;       // Equals SymbolTable.dep_epoch if already a dependency of 'dep_cell'
+
+    int dirty;          // 1 if this cell must be recalculated
+    int on_cycle;       // 1 if symtab_find_cycles() found this cell on a cycle
+    int formula_id;     // Index of this cell in the workbook's formula list, -1 for plain values
+    int range_node;     // 1 if this entry is a range node (no cell): its range is ranges[0]
 } CellEntry;
 
 
 /*
- * The main symbol table structure (a hash table).
+ * A range read over one column, and the range node standing for it.
+ *
+ * A range node is an entry of its own, with no coordinate: it depends
+ * on the formula cells inside the range, and the cells reading the
+ * range depend on it. Ordering, cycles and dirty marking go through
+ * it like through any cell.
+ */
+typedef struct {
+    int row_start;
+    int row_end;
+    int reader;         // Id of the range node
+} RangeWatch;
+
+/*
+ * The range dependencies of one column: the ranges crossing it,
+ * and its formula cells (the only cells in a range that get edges).
+ */
+typedef struct {
+    RangeWatch* watches;
+    int watch_count;
+    int watch_capacity;
+    int* formulas;       // Ids of the column's formula cells
+    int formula_count;
+    int formula_capacity;
+    int formulas_sorted; // 1 while 'formulas' is sorted by row
+} DependencyColumn;
+
+
+/*
+ * The main symbol table structure: the value grid, which also
+ * maps each coordinate to a cell id, and the dense array of cell
+ * metadata indexed by that id. Ids never change once assigned.
  */
 typedef struct {
-    int count;      // Number of entries
-    int capacity;   // Size of the entries array
-    CellEntry* entries; // The hash table array
+    CellStore grid;     // Values (0.0 if undefined) and ids, by coordinate
+    int count;          // Number of cells
+    CellEntry* cells;   // The cells' metadata, indexed by id
+    int cells_capacity;
+
+    // Cells marked dirty since the last symtab_clear_dirty()
+    int* dirty;         // Ids of the dirty cells
+    int dirty_count;
+    int dirty_capacity;
+
+    DependencyColumn* dep_columns; // Range dependencies, by column
+    int dep_column_count;
+    int dep_cell;       // Cell whose dependencies carry the current 'dep_epoch' mark
+    int dep_epoch;
+    int* range_slots;   // Open addressing by range: range node id, -1 = empty
+    int range_slot_count; // A power of two, at least twice 'range_node_count'
+    int range_node_count;
+
+    RangeCache* range_cache; // Cached range aggregates, NULL if off (owned)
+    RangeIndex* range_index; // Per-column range index, NULL if off (owned)
 } SymbolTable;
 
 
@@ -56,28 +128,112 @@ SymbolTable* symtab_create();
 void symtab_free(SymbolTable* table);
 
 /**
- * @brief Gets a pointer to a cell entry by its key (e.g., "A1").
- * Returns NULL if the key is not found.
+ * @brief Gets the id of a cell, or -1 if it is not in the table.
+ */
+static inline int symtab_lookup(SymbolTable* table, CellCoord coord) {
+    return cellstore_id(&table->grid, coord);
+}
+
+/**
+ * @brief Gets the id of a cell, adding an (undefined) entry if needed.
+ * Used by the code generator to resolve cell references once.
  */
-CellEntry* symtab_get_cell(SymbolTable* table, const char* key);
+int symtab_intern(SymbolTable* table, CellCoord coord);
+
+/**
+ * @brief Gets a cell by id. Ids come from symtab_lookup/symtab_intern.
+ * Note: the pointer is invalidated when a new cell is added.
+ */
+static inline CellEntry* symtab_cell(SymbolTable* table, int id) {
+    return &table->cells[id];
+}
+
+/**
+ * @brief Gets a cell's value. Undefined cells are 0.0.
+ */
+static inline double symtab_value(SymbolTable* table, CellCoord coord) {
+    return cellstore_get(&table->grid, coord);
+}
+
+/**
+ * @brief Stores a computed value for a cell (no dirty marking).
+ */
+static inline void symtab_store_value(SymbolTable* table, CellCoord coord, double value) {
+    if (table->range_cache != NULL) {
+        range_cache_note_write(table->range_cache, coord, cellstore_get(&table->grid, coord), value);
+    }
+    if (table->range_index != NULL) {
+        range_index_note_write(table->range_index, coord, cellstore_get(&table->grid, coord), value);
+    }
+    cellstore_set(&table->grid, coord, value);
+}
+
+/**
+ * @brief Gets a pointer to a cell entry by its coordinate.
+ * Returns NULL if the cell is not found.
+ */
+CellEntry* symtab_get_cell(SymbolTable* table, CellCoord coord);
 
 /**
  * @brief Defines or updates a cell's value in the table.
  */
-void symtab_define_cell(SymbolTable* table, const char* key, double value, const char* formula, int line);
+void symtab_define_cell(SymbolTable* table, CellCoord coord, double value, const char* formula, int line);
+
+/**
+ * @brief Records that 'this_cell' depends on 'depends_on', and the
+ * reverse edge ('depends_on' has 'this_cell' as a dependent). An
+ * entry is created for 'depends_on' if needed, but it is not marked
+ * as defined.
+ */
+void symtab_add_dependency(SymbolTable* table, CellCoord this_cell, CellCoord depends_on);
+
+/**
+ * @brief Records that 'this_cell' reads every cell of 'range'. The
+ * range is kept as one dependency, on the range's node (created on
+ * its first read): the formula cells inside it get edges from the
+ * node (for ordering and cycles), while the other cells find it
+ * through the column index when they are edited. A range holding
+ * 'this_cell' itself makes a self-dependency.
+ */
+void symtab_add_range_dependency(SymbolTable* table, CellCoord this_cell, CellRange range);
 
 /**
- * @brief Records that 'this_cell_key' depends on 'depends_on_key'.
+ * @brief Sets the formula id of a cell (its index in the workbook's
+ * formula list, -1 for a plain value). A new formula cell gets an
+ * edge from every range already covering it.
  */
-void symtab_add_dependency(SymbolTable* table, const char* this_cell_key, const char* depends_on_key);
+void symtab_set_formula(SymbolTable* table, CellCoord coord, int formula_id);
 
 /**
- * @brief Checks if evaluating 'this_cell_key' would cause a circular
- * dependency by following the chain to 'check_cell_key'.
+ * @brief Sets a cell's value (defining it if needed) and marks every
+ * cell that transitively depends on it as dirty.
+ * @return The number of cells newly marked dirty (range nodes are
+ * marked too, but not counted).
+ */
+int symtab_set_value(SymbolTable* table, CellCoord coord, double value);
+
+/**
+ * @brief Clears the dirty flag of every cell marked since the last call.
+ */
+void symtab_clear_dirty(SymbolTable* table);
+
+/**
+ * @brief Checks if evaluating 'this_cell' would cause a circular
+ * dependency by following the chain to 'check_cell'.
+ * Iterative, and visits every cell at most once.
  *
  * FIX: Changed 'struct ErrorSystem*' to 'ErrorSystem*'
  */
-int symtab_check_circular_dep(SymbolTable* table, const char* this_cell_key, const char* check_cell_key, ErrorSystem* errors);
+int symtab_check_circular_dep(SymbolTable* table, CellCoord this_cell, CellCoord check_cell, ErrorSystem* errors);
+
+/**
+ * @brief Finds every cycle in the whole dependency graph in one
+ * O(V+E) pass (iterative Tarjan SCC). Each cyclic component is
+ * reported once with a full path (e.g., A1 -> B1 -> A1), and its
+ * cells get 'on_cycle' set.
+ * @return The number of cycles (cyclic components) found.
+ */
+int symtab_find_cycles(SymbolTable* table, ErrorSystem* errors);
 
 /**
  * @brief Prints the contents of the symbol table.
@@ -86,4 +242,3 @@ void symtab_print(SymbolTable* table);
 
 
 #endif // SYMTAB_H
-
@@ -9,6 +9,14 @@
  * 1. Added 'print_value_inline' function prototype.
  * 2. Added 'is_truthy' function prototype.
  * 3. Added 'get_numeric' function prototype.
+ * 4. Added TYPE_RANGE, so ranges reach the runtime as
+ *    coordinates instead of strings.
+ * 5. Values no longer own memory: short strings are stored
+ *    inline, longer ones are interned (strpool.h), and errors
+ *    carry an ErrorCode with a static message. Making, copying
+ *    or dropping a Value never allocates.
+ * 6. Added cell_value/cell_from_value: a formula's error is
+ *    stored in its cell (cellstore.h), so readers get it back.
  */
 
 #ifndef VALUE_H
@@ -17,23 +25,72 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "cellref.h" // For CellRange
+#include "cellstore.h" // For the stored form of errors
+#include "strpool.h" // For strpool_intern
 
 /* --- Value Type Enum --- */
 typedef enum {
     TYPE_NUMBER,
     TYPE_BOOLEAN,
     TYPE_STRING,
-    TYPE_ERROR
+    TYPE_ERROR,
+    TYPE_RANGE   // Only as a function argument (e.g., SUM(A1:A3))
 } ValueType;
 
 
+/* --- Error Codes --- */
+// The errors the evaluators raise themselves (ERROR_OTHER: any other message)
+typedef enum {
+    ERROR_OTHER,
+    ERROR_DIV_ZERO,
+    ERROR_AVERAGE_EMPTY,
+    ERROR_NOT_ARITY,
+    ERROR_UNKNOWN_FUNCTION,
+    ERROR_EMPTY_STACK,
+    ERROR_UNKNOWN_OPCODE,
+    ERROR_BAD_SYNTAX,     // The workbook's errors for cells it could not evaluate
+    ERROR_BAD_FORMULA,
+    ERROR_CIRCULAR,
+    ERROR_CIRCULAR_INPUT
+} ErrorCode;
+
+/**
+ * @brief Gets the message of an error code.
+ */
+static inline const char* error_code_message(ErrorCode code) {
+    switch (code) {
+        case ERROR_DIV_ZERO:         return "Division by zero";
+        case ERROR_AVERAGE_EMPTY:    return "AVERAGE divide by zero (no numeric args)";
+        case ERROR_NOT_ARITY:        return "NOT expects exactly 1 argument";
+        case ERROR_UNKNOWN_FUNCTION: return "Unknown function call in VM";
+        case ERROR_EMPTY_STACK:      return "VM Halted on empty stack";
+        case ERROR_UNKNOWN_OPCODE:   return "VM Error: Unknown opcode";
+        case ERROR_BAD_SYNTAX:       return "Syntax error";
+        case ERROR_BAD_FORMULA:      return "Semantic error";
+        case ERROR_CIRCULAR:         return "Circular reference";
+        case ERROR_CIRCULAR_INPUT:   return "Depends on a circular reference";
+        default:                     return "VM Error: Unknown error";
+    }
+}
+
+
 /* --- Value Struct --- */
+#define VALUE_INLINE_STRING 15 // Longest string kept inside the Value itself
+
 typedef struct {
     ValueType type;
+    unsigned char inline_string; // TYPE_STRING: the text is in 'as.small'
     union {
         double number;
         int boolean;
-        char* string; // Dynamically allocated
+        const char* string; // Interned: never freed
+        char small[VALUE_INLINE_STRING + 1];
+        struct {
+            ErrorCode code;
+            const char* message; // Static: never freed
+        } error;
+        CellRange range;
     } as;
 } Value;
 
@@ -57,24 +114,53 @@ static inline Value create_boolean_value(int b) {
 static inline Value create_string_value(const char* str) {
     Value val;
     val.type = TYPE_STRING;
-    val.as.string = strdup(str); // Copy the string
+    size_t len = strlen(str);
+    val.inline_string = (len <= VALUE_INLINE_STRING);
+    if (val.inline_string) {
+        memcpy(val.as.small, str, len + 1);
+    } else {
+        val.as.string = strpool_intern(str);
+    }
     return val;
 }
 
+static inline Value create_error(ErrorCode code) {
+    Value val;
+    val.type = TYPE_ERROR;
+    val.as.error.code = code;
+    val.as.error.message = error_code_message(code);
+    return val;
+}
+
+/* 'msg' is borrowed, so it must never be freed (e.g., a literal) */
 static inline Value create_error_value(const char* msg) {
     Value val;
     val.type = TYPE_ERROR;
-    val.as.string = strdup(msg); // Store error message in string
+    val.as.error.code = ERROR_OTHER;
+    val.as.error.message = msg;
+    return val;
+}
+
+static inline Value create_range_value(CellRange range) {
+    Value val;
+    val.type = TYPE_RANGE;
+    val.as.range = range;
     return val;
 }
 
-/* Free any dynamic data (like strings) */
+/* Values own no memory; kept so callers need not know which types are plain */
 static inline void free_value(Value val) {
-    if (val.type == TYPE_STRING || val.type == TYPE_ERROR) {
-        if (val.as.string != NULL) {
-            free(val.as.string);
-        }
+    (void)val;
+}
+
+/**
+ * @brief Gets the text of a TYPE_STRING value, or the message of a TYPE_ERROR.
+ */
+static inline const char* value_string(const Value* val) {
+    if (val->type == TYPE_ERROR) {
+        return val->as.error.message;
     }
+    return val->inline_string ? val->as.small : val->as.string;
 }
 
 
@@ -87,8 +173,9 @@ static inline int is_truthy(Value val) {
     switch (val.type) {
         case TYPE_NUMBER:  return val.as.number != 0;
         case TYPE_BOOLEAN: return val.as.boolean;
-        case TYPE_STRING:  return val.as.string[0] != '\0'; // Not empty
+        case TYPE_STRING:  return value_string(&val)[0] != '\0'; // Not empty
         case TYPE_ERROR:   return 0; // Errors are false
+        case TYPE_RANGE:   return 0;
         default:           return 0;
     }
 }
@@ -103,7 +190,28 @@ static inline double get_numeric(Value val) {
     if (val.type == TYPE_BOOLEAN) {
         return val.as.boolean ? 1.0 : 0.0;
     }
-    return 0.0; // Strings, errors, etc., are 0
+    return 0.0; // Strings, errors, ranges, etc., are 0
+}
+
+/**
+ * @brief Gets the value of a cell as stored in the grid: its number,
+ * or the error its formula produced.
+ */
+static inline Value cell_value(double x) {
+    if (cellstore_is_error(x)) {
+        return create_error((ErrorCode)cellstore_error_code(x));
+    }
+    return create_number_value(x);
+}
+
+/**
+ * @brief Gets the grid's form of a formula result (its error, if any).
+ */
+static inline double cell_from_value(Value val) {
+    if (val.type == TYPE_ERROR) {
+        return cellstore_error(val.as.error.code);
+    }
+    return get_numeric(val);
 }
 
 
@@ -121,11 +229,16 @@ static inline void print_value(Value val) {
             printf(val.as.boolean ? "TRUE" : "FALSE");
             break;
         case TYPE_STRING:
-            printf("\"%s\"", val.as.string);
+            printf("\"%s\"", value_string(&val));
             break;
         case TYPE_ERROR:
-            printf("#ERROR: %s", val.as.string);
+            printf("#ERROR: %s", val.as.error.message);
             break;
+        case TYPE_RANGE: {
+            char buf[CELLRANGE_MAX];
+            printf("%s", cellrange_format(val.as.range, buf));
+            break;
+        }
         default:
             printf("UNKNOWN_VALUE");
             break;
@@ -145,11 +258,16 @@ static inline void print_value_inline(Value val) {
             printf(val.as.boolean ? "T" : "F");
             break;
         case TYPE_STRING:
-            printf("\"%.10s...\"", val.as.string);
+            printf("\"%.10s...\"", value_string(&val));
             break;
         case TYPE_ERROR:
             printf("#ERR");
             break;
+        case TYPE_RANGE: {
+            char buf[CELLRANGE_MAX];
+            printf("%s", cellrange_format(val.as.range, buf));
+            break;
+        }
         default:
             printf("?");
             break;
@@ -17,12 +17,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
 
 // FIX: Include headers for missing definitions
 #include "parser.tab.h" // For SUM, AVERAGE, MIN, MAX, NOT
 #include "ir.h"         // For print_instruction
 #include "value.h"      // For print_value_inline, get_numeric, etc.
-#include "runtime.h"    // FIX: Added for ValueNode and rt_... functions
+#include "runtime.h"    // FIX: Added for rt_... functions
+#include "jit.h"
+
+
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1 // Labels as values: one indirect jump per handler
+#endif
 
 
 /* --- VM Helpers --- */
@@ -30,6 +37,7 @@ static void vm_push(VM* vm, Value val);
 static Value vm_pop(VM* vm);
 static void vm_print_stack(VM* vm);
 static Value vm_run(VM* vm);
+static Value vm_run_traced(VM* vm);
 
 /* --- Public API --- */
 
@@ -44,6 +52,7 @@ VM* vm_create(CodeArray* code, SymbolTable* table) {
     vm->pc = 0;
     vm->stack_top = 0;
     vm->trace = 0;
+    vm->jit_threshold = 0;
     
     return vm;
 }
@@ -58,98 +67,697 @@ void vm_free(VM* vm) {
     }
 }
 
+void vm_load(VM* vm, CodeArray* code) {
+    // Free anything left behind by an earlier (failed) run
+    for (int i = 0; i < vm->stack_top; i++) {
+        free_value(vm->stack[i]);
+    }
+    vm->code = code;
+    vm->pc = 0;
+    vm->stack_top = 0;
+}
+
 Value vm_execute(VM* vm) {
-    if (vm->trace) {
-        printf("--- VM TRACE ---\n");
+    if (vm->code->verified == 0) {
+        vm_verify(vm->code);
     }
-    
-    Value result = vm_run(vm);
-    
-    if (vm->trace) {
-        printf("--- END TRACE ---\n");
+    if (vm->code->verified < 0) {
+        return create_error_value(vm->code->verify_error);
     }
-    
+
+    // Hot code runs natively; declined code and bail-outs stay on the VM
+    CodeArray* code = vm->code;
+    if (vm->jit_threshold > 0 && !vm->trace) {
+        if (code->jit_status == 0 && ++code->exec_count >= vm->jit_threshold) {
+            code->jit = jit_compile(code, vm->symtab);
+            code->jit_status = (code->jit != NULL) ? 1 : -1;
+        }
+        Value result;
+        if (code->jit != NULL && jit_run(code->jit, vm->locals, &result)) {
+            return result;
+        }
+    }
+
+    if (!vm->trace) {
+        return vm_run(vm);
+    }
+
+    printf("--- VM TRACE ---\n");
+    Value result = vm_run_traced(vm);
+    printf("--- END TRACE ---\n");
     return result;
 }
 
 
-/* --- Stack Operations --- */
+/* --- Verification --- */
 
-static void vm_push(VM* vm, Value val) {
-    if (vm->stack_top >= VM_STACK_SIZE) {
-        // This should be a runtime error, but we'll crash
-        fprintf(stderr, "VM Error: Stack overflow\n");
+// Records why 'code' was rejected
+static int reject(CodeArray* code, const char* reason) {
+    code->verified = -1;
+    code->verify_error = reason;
+    return 0;
+}
+
+/*
+ * Walks every reachable path, tracking the stack depth before each
+ * instruction. Paths that meet (after an IF) must agree on it.
+ */
+int vm_verify(CodeArray* code) {
+    // Native code was made from the old instructions
+    jit_free(code->jit);
+    code->jit = NULL;
+    code->jit_status = 0;
+    code->exec_count = 0;
+
+    int n = code->count;
+    int* depth = (int*)malloc((n + 1) * sizeof(int));
+    int* work = (int*)malloc((n + 1) * sizeof(int));
+    if (depth == NULL || work == NULL) {
+        fprintf(stderr, "Fatal: Out of memory verifying bytecode\n");
         exit(1);
     }
-    vm->stack[vm->stack_top++] = val;
+    for (int i = 0; i < n; i++) {
+        depth[i] = -1; // Not reached yet
+    }
+
+    const char* error = NULL;
+    int work_count = 0;
+    if (n == 0) {
+        error = "VM Error: Empty bytecode";
+    } else {
+        depth[0] = 0;
+        work[work_count++] = 0;
+    }
+
+    while (work_count > 0 && error == NULL) {
+        int pc = work[--work_count];
+        int d = depth[pc];
+        const Instruction* inst = &code->code[pc];
+
+        // 1. Stack effect: 'pops' values in, 'd' after
+        int pops = 0;
+        int falls_through = 1;
+        int jumps = 0;
+        switch (opcode_generic(inst->opcode)) { // Typed ops have the same effect
+            case OP_HALT:
+                falls_through = 0; // An empty stack is reported when it runs
+                break;
+            case OP_PUSH:
+            case OP_PUSH_CELL:
+            case OP_PUSH_RANGE:
+                d++;
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+            case OP_EQ: case OP_NEQ: case OP_GT: case OP_LT: case OP_GTE:
+            case OP_LTE: case OP_AND: case OP_OR:
+                pops = 2;
+                d--;
+                break;
+            case OP_NEG:
+            case OP_NOT:
+                pops = 1;
+                break;
+            case OP_JMP:
+                falls_through = 0;
+                jumps = 1;
+                break;
+            case OP_JMP_IF_FALSE:
+                pops = 1;
+                d--;
+                jumps = 1;
+                break;
+            case OP_CALL:
+                pops = inst->operand.func_call.arg_count;
+                if (pops < 0) {
+                    error = "VM Error: Negative argument count";
+                }
+                d += 1 - pops;
+                break;
+            case OP_STORE_LOCAL:
+            case OP_LOAD_LOCAL:
+                if (inst->operand.slot < 0 || inst->operand.slot >= MAX_LOCAL_SLOTS) {
+                    error = "VM Error: Local slot out of range";
+                }
+                pops = (inst->opcode == OP_STORE_LOCAL); // Stores a copy, no pop
+                d += (inst->opcode == OP_LOAD_LOCAL);
+                break;
+            case OP_ADD_CELL_CELL: case OP_SUB_CELL_CELL: case OP_MUL_CELL_CELL:
+            case OP_ADD_CELL_CONST: case OP_MUL_CELL_CONST:
+                d++;
+                break;
+            case OP_ADD_CELL:
+            case OP_MUL_CONST:
+                pops = 1;
+                break;
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ:
+                pops = 2;
+                d -= 2;
+                jumps = 1;
+                break;
+            case OP_NOP:
+                break;
+            default:
+                error = "VM Error: Unknown opcode";
+        }
+        if (error != NULL) {
+            break;
+        }
+        if (depth[pc] < pops) {
+            error = "VM Error: Stack underflow";
+            break;
+        }
+        if (d > VM_STACK_SIZE) {
+            error = "VM Error: Stack overflow";
+            break;
+        }
+
+        // 2. Successors: in bounds, and consistent where paths meet
+        int succ[2];
+        int succ_count = 0;
+        if (falls_through) {
+            if (pc + 1 >= n) {
+                error = "VM Error: PC out of bounds"; // Runs off the end
+                break;
+            }
+            succ[succ_count++] = pc + 1;
+        }
+        if (jumps) {
+            int target = inst->operand.address;
+            if (target < 0 || target >= n) {
+                error = "VM Error: Jump out of bounds";
+                break;
+            }
+            succ[succ_count++] = target;
+        }
+        for (int k = 0; k < succ_count; k++) {
+            int s = succ[k];
+            if (depth[s] < 0) {
+                depth[s] = d;
+                work[work_count++] = s;
+            } else if (depth[s] != d) {
+                error = "VM Error: Inconsistent stack depth";
+                break;
+            }
+        }
+    }
+
+    free(depth);
+    free(work);
+    if (error != NULL) {
+        return reject(code, error);
+    }
+    code->verified = 1;
+    code->verify_error = NULL;
+    return 1;
 }
 
-static Value vm_pop(VM* vm) {
-    if (vm->stack_top == 0) {
-        fprintf(stderr, "VM Error: Stack underflow\n");
-        exit(1);
+
+/* --- Shared Operations --- */
+
+// Applies a binary opcode. Consumes 'a' and 'b'.
+static inline Value binary_op(OpCode opcode, Value a, Value b) {
+    // FIX: get_numeric is in value.h
+    double a_num = get_numeric(a);
+    double b_num = get_numeric(b);
+    
+    Value result;
+    switch (opcode) {
+        case OP_ADD: result = create_number_value(a_num + b_num); break;
+        case OP_SUB: result = create_number_value(a_num - b_num); break;
+        case OP_MUL: result = create_number_value(a_num * b_num); break;
+        case OP_DIV:
+            if (b_num == 0) result = create_error(ERROR_DIV_ZERO);
+            else result = create_number_value(a_num / b_num);
+            break;
+        case OP_POW: result = create_number_value(pow(a_num, b_num)); break;
+        
+        case OP_GT:  result = create_boolean_value(a_num > b_num); break;
+        case OP_LT:  result = create_boolean_value(a_num < b_num); break;
+        case OP_GTE: result = create_boolean_value(a_num >= b_num); break;
+        case OP_LTE: result = create_boolean_value(a_num <= b_num); break;
+        case OP_EQ:  result = create_boolean_value(a_num == b_num); break;
+        case OP_NEQ: result = create_boolean_value(a_num != b_num); break;
+
+        // FIX: is_truthy is in value.h
+        case OP_AND: result = create_boolean_value(is_truthy(a) && is_truthy(b)); break;
+        case OP_OR:  result = create_boolean_value(is_truthy(a) || is_truthy(b)); break;
+        
+        default: result = create_error_value("Unhandled binary op");
+    }
+    
+    free_value(a);
+    free_value(b);
+    return result;
+}
+
+// Calls a built-in on the 'arg_count' values at 'args'. Does not free them.
+static inline Value call_builtin(VM* vm, FuncCallInfo call, const Value* args) {
+    // FIX: Need parser.tab.h for these tokens
+    switch (call.token) {
+        case SUM:     return rt_sum(args, call.arg_count, vm->symtab);
+        case AVERAGE: return rt_average(args, call.arg_count, vm->symtab);
+        case MIN:     return rt_min(args, call.arg_count, vm->symtab);
+        case MAX:     return rt_max(args, call.arg_count, vm->symtab);
+        case NOT:     return rt_not(args, call.arg_count, vm->symtab);
+        // IF is handled by JMP ops, not OP_CALL
+        default:      return create_error(ERROR_UNKNOWN_FUNCTION);
+    }
+}
+
+
+// The plain binary opcode a superinstruction applies (OP_ADD_CELL_CELL -> OP_ADD)
+static OpCode superinstruction_op(OpCode opcode) {
+    switch (opcode) {
+        case OP_ADD_CELL_CELL: case OP_ADD_CELL_CONST: case OP_ADD_CELL: return OP_ADD;
+        case OP_SUB_CELL_CELL:                                           return OP_SUB;
+        case OP_MUL_CELL_CELL: case OP_MUL_CELL_CONST: case OP_MUL_CONST: return OP_MUL;
+        case OP_JMP_IF_NOT_GT:  return OP_GT;
+        case OP_JMP_IF_NOT_LT:  return OP_LT;
+        case OP_JMP_IF_NOT_GTE: return OP_GTE;
+        case OP_JMP_IF_NOT_LTE: return OP_LTE;
+        case OP_JMP_IF_NOT_EQ:  return OP_EQ;
+        case OP_JMP_IF_NOT_NEQ: return OP_NEQ;
+        default:                return opcode;
     }
-    // Note: We return the value, but if it was a string,
-    // the *caller* is now responsible for freeing it.
-    return vm->stack[--vm->stack_top];
 }
 
+
+/* --- Main Execution Loop --- */
+
 /*
- * FIX: Removed unused vm_peek function
+ * The fast loop. The code has been verified, so there are no
+ * bounds or stack checks, and tracing has its own loop below.
+ * 'ip' points at the current instruction and 'sp' one past the
+ * top of the stack; both are written back to the VM on exit.
+ *
+ * With GCC/Clang each handler jumps straight to the next one
+ * through a label table; elsewhere the same handlers become
+ * the cases of a switch.
  */
 
-/* --- Main Execution Loop --- */
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(op)   L_##op
+#define VM_DISPATCH() goto *dispatch[ip->opcode]
+#else
+#define VM_CASE(op)   case op
+#define VM_DISPATCH() continue
+#endif
+
+#define VM_NEXT() { ip++; VM_DISPATCH(); }
+#define VM_SAVE() { vm->pc = (int)(ip - code); vm->stack_top = (int)(sp - stack); }
+
+// Ends the run with the error a cell holds, if it holds one
+#define VM_CHECK_CELL(x)                                    \
+    if (cellstore_is_error(x)) {                            \
+        VM_SAVE();                                          \
+        return cell_value(x);                               \
+    }
+
+// Handler for an arithmetic opcode
+#define VM_ARITH(op, expr)                                  \
+    VM_CASE(op): {                                          \
+        Value b = *--sp;                                    \
+        Value a = sp[-1];                                   \
+        double x = get_numeric(a), y = get_numeric(b);      \
+        free_value(a);                                      \
+        free_value(b);                                      \
+        sp[-1] = create_number_value(expr);                 \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a typed arithmetic opcode: the result overwrites the
+// left operand's payload, whose tag is already TYPE_NUMBER
+#define VM_ARITH_NUM(op, expr)                              \
+    VM_CASE(op): {                                          \
+        sp--;                                               \
+        double x = sp[-1].as.number, y = sp[0].as.number;   \
+        sp[-1].as.number = (expr);                          \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a typed comparison opcode
+#define VM_COMPARE_NUM(op, cmp)                             \
+    VM_CASE(op): {                                          \
+        sp--;                                               \
+        double x = sp[-1].as.number, y = sp[0].as.number;   \
+        sp[-1] = create_boolean_value(x cmp y);             \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a comparison opcode
+#define VM_COMPARE(op, cmp)                                 \
+    VM_CASE(op): {                                          \
+        Value b = *--sp;                                    \
+        Value a = sp[-1];                                   \
+        double x = get_numeric(a), y = get_numeric(b);      \
+        free_value(a);                                      \
+        free_value(b);                                      \
+        sp[-1] = create_boolean_value(x cmp y);             \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a superinstruction on two cells
+#define VM_CELL_CELL(op, expr)                              \
+    VM_CASE(op): {                                          \
+        double x = symtab_value(vm->symtab, ip->operand.cells.a); \
+        double y = symtab_value(vm->symtab, ip->operand.cells.b); \
+        VM_CHECK_CELL(x)                                    \
+        VM_CHECK_CELL(y)                                    \
+        *sp++ = create_number_value(expr);                  \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a superinstruction on a cell and a constant
+#define VM_CELL_CONST(op, expr)                             \
+    VM_CASE(op): {                                          \
+        double x = symtab_value(vm->symtab, ip->operand.cell_const.coord); \
+        double y = ip->operand.cell_const.number;           \
+        VM_CHECK_CELL(x)                                    \
+        *sp++ = create_number_value(expr);                  \
+        VM_NEXT();                                          \
+    }
+
+// Handler for a fused comparison + JMP_IF_FALSE
+#define VM_COMPARE_JUMP(op, cmp)                            \
+    VM_CASE(op): {                                          \
+        Value b = *--sp;                                    \
+        Value a = *--sp;                                    \
+        double x = get_numeric(a), y = get_numeric(b);      \
+        free_value(a);                                      \
+        free_value(b);                                      \
+        ip = (x cmp y) ? ip + 1 : code + ip->operand.address; \
+        VM_DISPATCH();                                      \
+    }
 
 static Value vm_run(VM* vm) {
-    for (;;) {
-        if (vm->pc >= vm->code->count) {
-            return create_error_value("VM Error: PC out of bounds");
+    const Instruction* code = vm->code->code;
+    const Instruction* ip = code + vm->pc;
+    Value* stack = vm->stack;
+    Value* sp = stack + vm->stack_top;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* dispatch[] = {
+        [OP_HALT] = &&L_OP_HALT,         [OP_PUSH] = &&L_OP_PUSH,
+        [OP_PUSH_CELL] = &&L_OP_PUSH_CELL, [OP_PUSH_RANGE] = &&L_OP_PUSH_RANGE,
+        [OP_ADD] = &&L_OP_ADD,           [OP_SUB] = &&L_OP_SUB,
+        [OP_MUL] = &&L_OP_MUL,           [OP_DIV] = &&L_OP_DIV,
+        [OP_POW] = &&L_OP_POW,           [OP_EQ] = &&L_OP_EQ,
+        [OP_NEQ] = &&L_OP_NEQ,           [OP_GT] = &&L_OP_GT,
+        [OP_LT] = &&L_OP_LT,             [OP_GTE] = &&L_OP_GTE,
+        [OP_LTE] = &&L_OP_LTE,           [OP_AND] = &&L_OP_AND,
+        [OP_OR] = &&L_OP_OR,             [OP_NEG] = &&L_OP_NEG,
+        [OP_NOT] = &&L_OP_NOT,           [OP_JMP] = &&L_OP_JMP,
+        [OP_JMP_IF_FALSE] = &&L_OP_JMP_IF_FALSE,
+        [OP_CALL] = &&L_OP_CALL,         [OP_NOP] = &&L_OP_NOP,
+        [OP_STORE_LOCAL] = &&L_OP_STORE_LOCAL, [OP_LOAD_LOCAL] = &&L_OP_LOAD_LOCAL,
+        [OP_ADD_NUM] = &&L_OP_ADD_NUM,   [OP_SUB_NUM] = &&L_OP_SUB_NUM,
+        [OP_MUL_NUM] = &&L_OP_MUL_NUM,   [OP_DIV_NUM] = &&L_OP_DIV_NUM,
+        [OP_POW_NUM] = &&L_OP_POW_NUM,   [OP_EQ_NUM] = &&L_OP_EQ_NUM,
+        [OP_NEQ_NUM] = &&L_OP_NEQ_NUM,   [OP_GT_NUM] = &&L_OP_GT_NUM,
+        [OP_LT_NUM] = &&L_OP_LT_NUM,     [OP_GTE_NUM] = &&L_OP_GTE_NUM,
+        [OP_LTE_NUM] = &&L_OP_LTE_NUM,   [OP_NEG_NUM] = &&L_OP_NEG_NUM,
+        [OP_ADD_CELL_CELL] = &&L_OP_ADD_CELL_CELL,
+        [OP_SUB_CELL_CELL] = &&L_OP_SUB_CELL_CELL,
+        [OP_MUL_CELL_CELL] = &&L_OP_MUL_CELL_CELL,
+        [OP_ADD_CELL_CONST] = &&L_OP_ADD_CELL_CONST,
+        [OP_MUL_CELL_CONST] = &&L_OP_MUL_CELL_CONST,
+        [OP_ADD_CELL] = &&L_OP_ADD_CELL, [OP_MUL_CONST] = &&L_OP_MUL_CONST,
+        [OP_JMP_IF_NOT_GT] = &&L_OP_JMP_IF_NOT_GT,
+        [OP_JMP_IF_NOT_LT] = &&L_OP_JMP_IF_NOT_LT,
+        [OP_JMP_IF_NOT_GTE] = &&L_OP_JMP_IF_NOT_GTE,
+        [OP_JMP_IF_NOT_LTE] = &&L_OP_JMP_IF_NOT_LTE,
+        [OP_JMP_IF_NOT_EQ] = &&L_OP_JMP_IF_NOT_EQ,
+        [OP_JMP_IF_NOT_NEQ] = &&L_OP_JMP_IF_NOT_NEQ,
+    };
+    VM_DISPATCH();
+#else
+    for (;;) switch (ip->opcode) {
+#endif
+
+    VM_CASE(OP_HALT): {
+        if (sp == stack) {
+            VM_SAVE();
+            return create_error(ERROR_EMPTY_STACK);
         }
-        
+        Value final_result = *--sp;
+        VM_SAVE();
+        return final_result; // Success!
+    }
+
+    VM_CASE(OP_PUSH): {
+        *sp++ = create_number_value(ip->operand.number);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_PUSH_CELL): {
+        // Direct grid read: undefined cells are 0, errors end the run
+        double x = symtab_value(vm->symtab, ip->operand.cell.coord);
+        VM_CHECK_CELL(x)
+        *sp++ = create_number_value(x);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_PUSH_RANGE): {
+        // Push the range itself. OP_CALL reads its cells in place.
+        *sp++ = create_range_value(ip->operand.range);
+        VM_NEXT();
+    }
+
+    // --- Binary Operators ---
+    VM_ARITH(OP_ADD, x + y)
+    VM_ARITH(OP_SUB, x - y)
+    VM_ARITH(OP_MUL, x * y)
+    VM_ARITH(OP_POW, pow(x, y))
+
+    VM_CASE(OP_DIV): {
+        Value b = *--sp;
+        Value a = *--sp;
+        double x = get_numeric(a), y = get_numeric(b);
+        free_value(a);
+        free_value(b);
+        if (y == 0) {
+            VM_SAVE();
+            return create_error(ERROR_DIV_ZERO); // Propagate error
+        }
+        *sp++ = create_number_value(x / y);
+        VM_NEXT();
+    }
+
+    VM_COMPARE(OP_GT, >)
+    VM_COMPARE(OP_LT, <)
+    VM_COMPARE(OP_GTE, >=)
+    VM_COMPARE(OP_LTE, <=)
+    VM_COMPARE(OP_EQ, ==)
+    VM_COMPARE(OP_NEQ, !=)
+
+    VM_CASE(OP_AND): {
+        Value b = *--sp;
+        Value a = sp[-1];
+        int truth = is_truthy(a) && is_truthy(b);
+        free_value(a);
+        free_value(b);
+        sp[-1] = create_boolean_value(truth);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_OR): {
+        Value b = *--sp;
+        Value a = sp[-1];
+        int truth = is_truthy(a) || is_truthy(b);
+        free_value(a);
+        free_value(b);
+        sp[-1] = create_boolean_value(truth);
+        VM_NEXT();
+    }
+
+    // --- Unary Operators ---
+    VM_CASE(OP_NEG): {
+        Value a = sp[-1];
+        double x = get_numeric(a);
+        free_value(a);
+        sp[-1] = create_number_value(-x);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_NOT): {
+        Value a = sp[-1];
+        int truth = is_truthy(a);
+        free_value(a);
+        sp[-1] = create_boolean_value(!truth);
+        VM_NEXT();
+    }
+
+    // --- Control Flow ---
+    VM_CASE(OP_JMP_IF_FALSE): {
+        Value cond = *--sp;
+        int truth = is_truthy(cond);
+        free_value(cond);
+        ip = truth ? ip + 1 : code + ip->operand.address;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_JMP): {
+        ip = code + ip->operand.address; // JUMP
+        VM_DISPATCH();
+    }
+
+    // --- Functions ---
+    VM_CASE(OP_CALL): {
+        // The args are the top 'arg_count' stack slots, in order
+        FuncCallInfo call = ip->operand.func_call;
+        Value* args = sp - call.arg_count;
+        Value result = call_builtin(vm, call, args);
+        for (int i = 0; i < call.arg_count; i++) {
+            free_value(args[i]);
+        }
+        sp = args;
+        if (result.type == TYPE_ERROR) {
+            VM_SAVE();
+            return result; // Propagate error
+        }
+        *sp++ = result;
+        VM_NEXT();
+    }
+
+    // --- Locals ---
+    VM_CASE(OP_STORE_LOCAL):
+        vm->locals[ip->operand.slot] = get_numeric(sp[-1]);
+        VM_NEXT();
+
+    VM_CASE(OP_LOAD_LOCAL):
+        *sp++ = create_number_value(vm->locals[ip->operand.slot]);
+        VM_NEXT();
+
+    // --- Typed Numeric Operators ---
+    VM_ARITH_NUM(OP_ADD_NUM, x + y)
+    VM_ARITH_NUM(OP_SUB_NUM, x - y)
+    VM_ARITH_NUM(OP_MUL_NUM, x * y)
+    VM_ARITH_NUM(OP_POW_NUM, pow(x, y))
+
+    VM_CASE(OP_DIV_NUM): {
+        sp -= 2;
+        if (sp[1].as.number == 0) {
+            VM_SAVE();
+            return create_error(ERROR_DIV_ZERO); // Propagate error
+        }
+        sp[0].as.number /= sp[1].as.number;
+        sp++;
+        VM_NEXT();
+    }
+
+    VM_COMPARE_NUM(OP_GT_NUM, >)
+    VM_COMPARE_NUM(OP_LT_NUM, <)
+    VM_COMPARE_NUM(OP_GTE_NUM, >=)
+    VM_COMPARE_NUM(OP_LTE_NUM, <=)
+    VM_COMPARE_NUM(OP_EQ_NUM, ==)
+    VM_COMPARE_NUM(OP_NEQ_NUM, !=)
+
+    VM_CASE(OP_NEG_NUM):
+        sp[-1].as.number = -sp[-1].as.number;
+        VM_NEXT();
+
+    // --- Superinstructions ---
+    VM_CELL_CELL(OP_ADD_CELL_CELL, x + y)
+    VM_CELL_CELL(OP_SUB_CELL_CELL, x - y)
+    VM_CELL_CELL(OP_MUL_CELL_CELL, x * y)
+    VM_CELL_CONST(OP_ADD_CELL_CONST, x + y)
+    VM_CELL_CONST(OP_MUL_CELL_CONST, x * y)
+
+    VM_CASE(OP_ADD_CELL): {
+        Value a = sp[-1];
+        double x = get_numeric(a);
+        double y = symtab_value(vm->symtab, ip->operand.cell.coord);
+        VM_CHECK_CELL(y)
+        free_value(a);
+        sp[-1] = create_number_value(x + y);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_MUL_CONST): {
+        Value a = sp[-1];
+        double x = get_numeric(a);
+        free_value(a);
+        sp[-1] = create_number_value(x * ip->operand.number);
+        VM_NEXT();
+    }
+
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_GT, >)
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_LT, <)
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_GTE, >=)
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_LTE, <=)
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_EQ, ==)
+    VM_COMPARE_JUMP(OP_JMP_IF_NOT_NEQ, !=)
+
+    VM_CASE(OP_NOP):
+        VM_NEXT();
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        VM_SAVE();
+        return create_error(ERROR_UNKNOWN_OPCODE); // Rejected by vm_verify()
+    }
+#endif
+}
+
+#undef VM_COMPARE_JUMP
+#undef VM_CELL_CONST
+#undef VM_CELL_CELL
+#undef VM_COMPARE_NUM
+#undef VM_ARITH_NUM
+#undef VM_COMPARE
+#undef VM_ARITH
+#undef VM_CHECK_CELL
+#undef VM_SAVE
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+
+
+/* --- Traced Execution Loop --- */
+
+/*
+ * Same semantics as vm_run(), printing each instruction and
+ * the stack before it runs. Only used with --trace-vm.
+ */
+static Value vm_run_traced(VM* vm) {
+    for (;;) {
         // Fetch
-        Instruction instruction = vm->code->code[vm->pc];
+        const Instruction* instruction = &vm->code->code[vm->pc];
         
-        if (vm->trace) {
-            printf("%04d: ", vm->pc);
-            // FIX: print_instruction is declared in ir.h
-            print_instruction(instruction, vm->pc);
-            vm_print_stack(vm);
-        }
+        printf("%04d: ", vm->pc);
+        // FIX: print_instruction is declared in ir.h
+        print_instruction(*instruction, vm->pc);
+        vm_print_stack(vm);
         
         // Decode & Execute
         vm->pc++; // Increment *before* executing
         
-        switch (instruction.opcode) {
+        switch (opcode_generic(instruction->opcode)) {
             case OP_HALT: {
                 if (vm->stack_top == 0) {
-                    return create_error_value("VM Halted on empty stack");
+                    return create_error(ERROR_EMPTY_STACK);
                 }
                 Value final_result = vm_pop(vm);
                 return final_result; // Success!
             }
             
-            case OP_PUSH: {
-                vm_push(vm, create_number_value(instruction.operand.number));
+            case OP_PUSH:
+                vm_push(vm, create_number_value(instruction->operand.number));
                 break;
-            }
             
             case OP_PUSH_CELL: {
-                const char* cell_ref = instruction.operand.cell_ref;
-                CellEntry* cell = symtab_get_cell(vm->symtab, cell_ref);
-                if (cell != NULL && cell->is_defined) {
-                    vm_push(vm, create_number_value(cell->value));
-                } else {
-                    vm_push(vm, create_number_value(0.0)); // Treat undefined as 0
+                Value cell = cell_value(symtab_value(vm->symtab, instruction->operand.cell.coord));
+                if (cell.type == TYPE_ERROR) {
+                    return cell; // Propagate error
                 }
+                vm_push(vm, cell);
                 break;
             }
             
-            case OP_PUSH_RANGE: {
-                // Push the range string itself. OP_CALL will handle it.
-                vm_push(vm, create_string_value(instruction.operand.range_str));
+            case OP_PUSH_RANGE:
+                vm_push(vm, create_range_value(instruction->operand.range));
                 break;
-            }
-
 
             // --- Binary Operators ---
             case OP_ADD:
@@ -167,39 +775,7 @@ static Value vm_run(VM* vm) {
             case OP_OR: {
                 Value b = vm_pop(vm);
                 Value a = vm_pop(vm);
-                
-                // FIX: get_numeric is in value.h
-                double a_num = get_numeric(a);
-                double b_num = get_numeric(b);
-                
-                Value result;
-                switch(instruction.opcode) {
-                    case OP_ADD: result = create_number_value(a_num + b_num); break;
-                    case OP_SUB: result = create_number_value(a_num - b_num); break;
-                    case OP_MUL: result = create_number_value(a_num * b_num); break;
-                    case OP_DIV:
-                        if (b_num == 0) result = create_error_value("Division by zero");
-                        else result = create_number_value(a_num / b_num);
-                        break;
-                    case OP_POW: result = create_number_value(pow(a_num, b_num)); break;
-                    
-                    case OP_GT:  result = create_boolean_value(a_num > b_num); break;
-                    case OP_LT:  result = create_boolean_value(a_num < b_num); break;
-                    case OP_GTE: result = create_boolean_value(a_num >= b_num); break;
-                    case OP_LTE: result = create_boolean_value(a_num <= b_num); break;
-                    case OP_EQ:  result = create_boolean_value(a_num == b_num); break;
-                    case OP_NEQ: result = create_boolean_value(a_num != b_num); break;
-
-                    // FIX: is_truthy is in value.h
-                    case OP_AND: result = create_boolean_value(is_truthy(a) && is_truthy(b)); break;
-                    case OP_OR:  result = create_boolean_value(is_truthy(a) || is_truthy(b)); break;
-                    
-                    default: result = create_error_value("Unhandled binary op");
-                }
-                
-                free_value(a);
-                free_value(b);
-                
+                Value result = binary_op(opcode_generic(instruction->opcode), a, b);
                 if (result.type == TYPE_ERROR) {
                     return result; // Propagate error
                 }
@@ -213,7 +789,7 @@ static Value vm_run(VM* vm) {
                 Value a = vm_pop(vm);
                 Value result;
                 
-                if (instruction.opcode == OP_NEG) {
+                if (opcode_generic(instruction->opcode) == OP_NEG) {
                     result = create_number_value(-get_numeric(a));
                 } else {
                     result = create_boolean_value(!is_truthy(a));
@@ -228,82 +804,705 @@ static Value vm_run(VM* vm) {
             case OP_JMP_IF_FALSE: {
                 Value cond = vm_pop(vm);
                 if (!is_truthy(cond)) {
-                    vm->pc = instruction.operand.address; // JUMP
+                    vm->pc = instruction->operand.address; // JUMP
                 }
                 free_value(cond);
                 break;
             }
             
-            case OP_JMP: {
-                vm->pc = instruction.operand.address; // JUMP
+            case OP_JMP:
+                vm->pc = instruction->operand.address; // JUMP
                 break;
-            }
 
             // --- Functions ---
             case OP_CALL: {
-                // FIX: Use 'func_call' member
-                int func_token = instruction.operand.func_call.token;
-                int arg_count = instruction.operand.func_call.arg_count;
-                
-                // 1. Pop args off stack and build ValueNode list
-                // (Args are pushed in order, so pop in reverse)
-                ValueNode* arg_head = NULL;
-                for (int i = 0; i < arg_count; i++) {
-                    Value val = vm_pop(vm);
-                    
-                    // Handle ranges (which were pushed as strings)
-                    if (val.type == TYPE_STRING) {
-                        ValueNode* range_vals = rt_expand_range(val.as.string, vm->symtab);
-                        if (range_vals != NULL) {
-                            // It was a range. Find tail and append.
-                            ValueNode* tail = range_vals;
-                            while(tail->next != NULL) {
-                                tail = tail->next;
-                            }
-                            tail->next = arg_head;
-                            arg_head = range_vals;
-                            free_value(val); // Free the range string
-                            continue; // Move to next arg
-                        }
-                    }
-                    
-                    // Not a range, just prepend
-                    ValueNode* new_node = (ValueNode*)malloc(sizeof(ValueNode));
-                    new_node->value = val;
-                    new_node->next = arg_head;
-                    arg_head = new_node;
+                FuncCallInfo call = instruction->operand.func_call;
+                Value* args = &vm->stack[vm->stack_top - call.arg_count];
+                Value result = call_builtin(vm, call, args);
+                for (int i = 0; i < call.arg_count; i++) {
+                    free_value(args[i]);
                 }
-                
-                // 2. Call runtime function
-                Value result;
-                // FIX: Need parser.tab.h for these tokens
-                switch (func_token) {
-                    case SUM:     result = rt_sum(arg_head); break;
-                    case AVERAGE: result = rt_average(arg_head); break;
-                    case MIN:     result = rt_min(arg_head); break;
-                    case MAX:     result = rt_max(arg_head); break;
-                    case NOT:     result = rt_not(arg_head); break;
-                    // IF is handled by JMP ops, not OP_CALL
-                    
-                    default:
-                        result = create_error_value("Unknown function call in VM");
+                vm->stack_top -= call.arg_count;
+                if (result.type == TYPE_ERROR) {
+                    return result; // Propagate error
                 }
-                
-                free_value_list(arg_head); // Clean up args
-                vm_push(vm, result);       // Push result
+                vm_push(vm, result);
                 break;
             }
                 
+            // --- Locals ---
+            case OP_STORE_LOCAL:
+                vm->locals[instruction->operand.slot] = get_numeric(vm->stack[vm->stack_top - 1]);
+                break;
+
+            case OP_LOAD_LOCAL:
+                vm_push(vm, create_number_value(vm->locals[instruction->operand.slot]));
+                break;
+
+            // --- Superinstructions: the plain op on the fused operands ---
+            case OP_ADD_CELL_CELL:
+            case OP_SUB_CELL_CELL:
+            case OP_MUL_CELL_CELL:
+            case OP_ADD_CELL_CONST:
+            case OP_MUL_CELL_CONST:
+            case OP_ADD_CELL:
+            case OP_MUL_CONST: {
+                Value a, b;
+                switch (instruction->opcode) {
+                    case OP_ADD_CELL_CELL: case OP_SUB_CELL_CELL: case OP_MUL_CELL_CELL:
+                        a = cell_value(symtab_value(vm->symtab, instruction->operand.cells.a));
+                        b = cell_value(symtab_value(vm->symtab, instruction->operand.cells.b));
+                        break;
+                    case OP_ADD_CELL_CONST: case OP_MUL_CELL_CONST:
+                        a = cell_value(symtab_value(vm->symtab, instruction->operand.cell_const.coord));
+                        b = create_number_value(instruction->operand.cell_const.number);
+                        break;
+                    case OP_ADD_CELL:
+                        a = vm_pop(vm);
+                        b = cell_value(symtab_value(vm->symtab, instruction->operand.cell.coord));
+                        break;
+                    default: // OP_MUL_CONST
+                        a = vm_pop(vm);
+                        b = create_number_value(instruction->operand.number);
+                        break;
+                }
+                if (a.type == TYPE_ERROR || b.type == TYPE_ERROR) {
+                    return (a.type == TYPE_ERROR) ? a : b; // Propagate error
+                }
+                vm_push(vm, binary_op(superinstruction_op(instruction->opcode), a, b));
+                break;
+            }
+
+            case OP_JMP_IF_NOT_GT:
+            case OP_JMP_IF_NOT_LT:
+            case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE:
+            case OP_JMP_IF_NOT_EQ:
+            case OP_JMP_IF_NOT_NEQ: {
+                Value b = vm_pop(vm);
+                Value a = vm_pop(vm);
+                Value cond = binary_op(superinstruction_op(instruction->opcode), a, b);
+                if (!is_truthy(cond)) {
+                    vm->pc = instruction->operand.address; // JUMP
+                }
+                free_value(cond);
+                break;
+            }
+
             case OP_NOP:
                 // Do nothing
                 break;
 
             default:
-                return create_error_value("VM Error: Unknown opcode");
+                return create_error(ERROR_UNKNOWN_OPCODE);
+        }
+    }
+}
+
+
+/* --- Batch Execution --- */
+
+/*
+ * A block of up to VM_BATCH_LANES scenarios runs through the code
+ * in one pass. Every stack slot holds one double per lane (the
+ * get_numeric() of the lane's value, so booleans are 0/1 and
+ * ranges 0) and masks of the lanes whose value is not a number;
+ * a lane is truthy exactly when its double is nonzero.
+ * Arithmetic works on LANE_WIDTH lanes per vector operation.
+ * A lane that meets an error (a zero divisor, a failed call, an
+ * error cell) ends with it, as a scalar run does.
+ *
+ * Lanes take their own way through an IF. Jumps only go forward,
+ * so the code is walked once from start to end: 'active' holds
+ * the lanes at the current instruction, and a lane that jumps
+ * waits in 'pending' at its target. While any lane waits, writes
+ * are masked to the active lanes, so the waiting lanes' slots
+ * survive. Function calls run lane by lane on the runtime.
+ */
+
+// Stores one scenario's result
+static void batch_store(VMBatch* batch, int i, Value result) {
+    batch->results[i] = get_numeric(result);
+    batch->types[i] = result.type;
+    if (batch->errors != NULL) {
+        batch->errors[i] = (result.type == TYPE_ERROR) ? result.as.error.message : NULL;
+    }
+}
+
+// Writes scenario 'i''s inputs to the grid, keeping the old values in 'saved'
+static void batch_patch(VM* vm, const VMBatch* batch, int i, double* saved) {
+    for (int k = 0; k < batch->input_count; k++) {
+        saved[k] = symtab_value(vm->symtab, batch->input_cells[k]);
+        symtab_store_value(vm->symtab, batch->input_cells[k], batch->inputs[k][i]);
+    }
+}
+
+// Undoes batch_patch() (backwards, in case a cell is listed twice)
+static void batch_restore(VM* vm, const VMBatch* batch, const double* saved) {
+    for (int k = batch->input_count - 1; k >= 0; k--) {
+        symtab_store_value(vm->symtab, batch->input_cells[k], saved[k]);
+    }
+}
+
+// Runs the scenarios one by one on the scalar VM
+static void batch_scalar(VM* vm, VMBatch* batch) {
+    CodeArray* code = vm->code;
+    double* saved = (double*)malloc((batch->input_count + 1) * sizeof(double));
+    if (saved == NULL) {
+        fprintf(stderr, "Fatal: Out of memory running a batch\n");
+        exit(1);
+    }
+    for (int i = 0; i < batch->count; i++) {
+        batch_patch(vm, batch, i, saved);
+        vm_load(vm, code);
+        batch_store(batch, i, vm_execute(vm));
+        batch_restore(vm, batch, saved);
+    }
+    free(saved);
+}
+
+#if defined(__GNUC__) && !defined(VM_NO_BATCH_VECTOR)
+
+#define LANE_WIDTH  4 // Doubles per vector (two SSE2 or one AVX register)
+#define LANE_GROUPS (VM_BATCH_LANES / LANE_WIDTH)
+
+typedef double LaneVec __attribute__((vector_size(LANE_WIDTH * sizeof(double))));
+typedef long long LaneBits __attribute__((vector_size(LANE_WIDTH * sizeof(double))));
+
+typedef struct {
+    LaneVec num[LANE_GROUPS];  // get_numeric() of each lane's value
+    uint64_t boolean;          // Lanes holding a TYPE_BOOLEAN
+    uint64_t range;            // Lanes holding a TYPE_RANGE (in 'ranges')
+    CellRange ranges[VM_BATCH_LANES];
+} LaneSlot;
+
+// What one block needs, allocated once per vm_execute_batch()
+typedef struct {
+    LaneSlot* slots;
+    LaneVec (*locals)[LANE_GROUPS];
+    LaneVec (*inputs)[LANE_GROUPS];  // The block's input columns
+    uint64_t* pending;               // Lanes waiting at each instruction
+    int* pending_depth;              // Stack depth they wait with
+    int* input_of;                   // Input column of each instruction's cell(s), -1 for the grid
+    double* saved;                   // batch_patch() scratch
+    Value* args;                     // OP_CALL arguments of one lane
+} BatchState;
+
+// Lane masks of the 16 patterns of LANE_WIDTH lanes
+#define LANE_NIBBLE(n) { -(long long)((n) & 1), -(long long)((n) >> 1 & 1), \
+                         -(long long)((n) >> 2 & 1), -(long long)((n) >> 3 & 1) }
+static const LaneBits lane_nibbles[16] = {
+    LANE_NIBBLE(0),  LANE_NIBBLE(1),  LANE_NIBBLE(2),  LANE_NIBBLE(3),
+    LANE_NIBBLE(4),  LANE_NIBBLE(5),  LANE_NIBBLE(6),  LANE_NIBBLE(7),
+    LANE_NIBBLE(8),  LANE_NIBBLE(9),  LANE_NIBBLE(10), LANE_NIBBLE(11),
+    LANE_NIBBLE(12), LANE_NIBBLE(13), LANE_NIBBLE(14), LANE_NIBBLE(15),
+};
+#undef LANE_NIBBLE
+
+// Copies the lanes of 'mask' from 'value' to 'dst'
+static inline void lane_write(LaneVec* dst, const LaneVec* value, uint64_t mask) {
+    for (int g = 0; g < LANE_GROUPS; g++) {
+        unsigned nibble = (unsigned)(mask >> (g * LANE_WIDTH)) & 0xF;
+        if (nibble == 0xF) {
+            dst[g] = value[g];
+        } else if (nibble != 0) {
+            LaneBits m = lane_nibbles[nibble];
+            dst[g] = (LaneVec)(((LaneBits)value[g] & m) | ((LaneBits)dst[g] & ~m));
+        }
+    }
+}
+
+// Sets the type of the lanes of 'mask' (TYPE_NUMBER or TYPE_BOOLEAN)
+static inline void lane_type(LaneSlot* slot, uint64_t mask, ValueType type) {
+    slot->boolean = (type == TYPE_BOOLEAN) ? (slot->boolean | mask) : (slot->boolean & ~mask);
+    slot->range &= ~mask;
+}
+
+static inline void lane_broadcast(LaneVec* out, double x) {
+    LaneVec v = { x, x, x, x };
+    for (int g = 0; g < LANE_GROUPS; g++) {
+        out[g] = v;
+    }
+}
+
+// The lanes whose value is nonzero (truthy)
+static inline uint64_t lane_bits(const LaneVec* v) {
+    uint64_t bits = 0;
+    for (int g = 0; g < LANE_GROUPS; g++) {
+        for (int j = 0; j < LANE_WIDTH; j++) {
+            bits |= (uint64_t)(v[g][j] != 0) << (g * LANE_WIDTH + j);
+        }
+    }
+    return bits;
+}
+
+// A cell's value in every lane: its input column, or the grid.
+// Returns 0, or 1 if the grid cell holds an error (in '*error').
+static inline int lane_cell(VM* vm, const BatchState* st, int input, CellCoord coord,
+                            LaneVec* out, ErrorCode* error) {
+    if (input >= 0) {
+        memcpy(out, st->inputs[input], sizeof(LaneVec) * LANE_GROUPS);
+        return 0;
+    }
+    double x = symtab_value(vm->symtab, coord);
+    if (cellstore_is_error(x)) {
+        *error = (ErrorCode)cellstore_error_code(x);
+        return 1;
+    }
+    lane_broadcast(out, x);
+    return 0;
+}
+
+// Applies a plain binary opcode to every lane. Returns the result's type.
+static ValueType lane_binary(OpCode opcode, const LaneVec* x, const LaneVec* y, LaneVec* r) {
+    const LaneVec one = { 1.0, 1.0, 1.0, 1.0 };
+    const LaneVec zero = { 0.0, 0.0, 0.0, 0.0 };
+    for (int g = 0; g < LANE_GROUPS; g++) {
+        LaneVec a = x[g], b = y[g];
+        switch (opcode) {
+            case OP_ADD: r[g] = a + b; break;
+            case OP_SUB: r[g] = a - b; break;
+            case OP_MUL: r[g] = a * b; break;
+            case OP_DIV: r[g] = a / b; break; // Zero divisors are caught by the caller
+            case OP_POW:
+                for (int j = 0; j < LANE_WIDTH; j++) {
+                    r[g][j] = pow(a[j], b[j]);
+                }
+                break;
+            case OP_GT:  r[g] = (LaneVec)((a > b) & (LaneBits)one); break;
+            case OP_LT:  r[g] = (LaneVec)((a < b) & (LaneBits)one); break;
+            case OP_GTE: r[g] = (LaneVec)((a >= b) & (LaneBits)one); break;
+            case OP_LTE: r[g] = (LaneVec)((a <= b) & (LaneBits)one); break;
+            case OP_EQ:  r[g] = (LaneVec)((a == b) & (LaneBits)one); break;
+            case OP_NEQ: r[g] = (LaneVec)((a != b) & (LaneBits)one); break;
+            case OP_AND: r[g] = (LaneVec)((a != zero) & (b != zero) & (LaneBits)one); break;
+            case OP_OR:  r[g] = (LaneVec)(((a != zero) | (b != zero)) & (LaneBits)one); break;
+            default:     r[g] = zero; break; // Not a binary opcode
+        }
+    }
+    return (opcode == OP_ADD || opcode == OP_SUB || opcode == OP_MUL ||
+            opcode == OP_DIV || opcode == OP_POW) ? TYPE_NUMBER : TYPE_BOOLEAN;
+}
+
+// Rebuilds lane 'l' of a slot as a Value
+static inline Value lane_value(const LaneSlot* slot, int l) {
+    uint64_t bit = (uint64_t)1 << l;
+    Value v;
+    if (slot->range & bit) {
+        v = create_range_value(slot->ranges[l]);
+    } else if (slot->boolean & bit) {
+        v = create_boolean_value(slot->num[l / LANE_WIDTH][l % LANE_WIDTH] != 0);
+    } else {
+        v = create_number_value(slot->num[l / LANE_WIDTH][l % LANE_WIDTH]);
+    }
+    return v;
+}
+
+static inline int range_holds(CellRange range, CellCoord coord) {
+    return cell_col(coord) >= cell_col(range.start) && cell_col(coord) <= cell_col(range.end) &&
+           cell_row(coord) >= cell_row(range.start) && cell_row(coord) <= cell_row(range.end);
+}
+
+// Ends the lanes of 'lanes' with an error
+static void lane_error(VMBatch* batch, int base, uint64_t lanes, ErrorCode code) {
+    for (int l = 0; l < VM_BATCH_LANES; l++) {
+        if (lanes >> l & 1) {
+            batch->results[base + l] = 0.0;
+            batch->types[base + l] = TYPE_ERROR;
+            if (batch->errors != NULL) batch->errors[base + l] = error_code_message(code);
         }
     }
 }
 
+// Runs OP_CALL lane by lane; the result replaces the arguments.
+// Lanes whose call fails end with its error; returns their mask.
+static uint64_t lane_call(VM* vm, VMBatch* batch, BatchState* st, FuncCallInfo call,
+                          LaneSlot* args, int base, uint64_t active, uint64_t mask) {
+    LaneVec result[LANE_GROUPS];
+    uint64_t boolean = 0, error = 0;
+    for (int l = 0; l < VM_BATCH_LANES; l++) {
+        if (!(active >> l & 1)) {
+            continue;
+        }
+        // A range over an input cell must see the scenario's value
+        int patch = 0;
+        for (int a = 0; a < call.arg_count; a++) {
+            st->args[a] = lane_value(&args[a], l);
+            for (int k = 0; k < batch->input_count && st->args[a].type == TYPE_RANGE && !patch; k++) {
+                patch = range_holds(st->args[a].as.range, batch->input_cells[k]);
+            }
+        }
+        if (patch) {
+            batch_patch(vm, batch, base + l, st->saved);
+        }
+        Value v = call_builtin(vm, call, st->args);
+        if (patch) {
+            batch_restore(vm, batch, st->saved);
+        }
+        result[l / LANE_WIDTH][l % LANE_WIDTH] = get_numeric(v);
+        if (v.type == TYPE_BOOLEAN) {
+            boolean |= (uint64_t)1 << l;
+        } else if (v.type == TYPE_ERROR) {
+            error |= (uint64_t)1 << l;
+            lane_error(batch, base, (uint64_t)1 << l, v.as.error.code);
+        }
+    }
+
+    LaneSlot* dst = args; // Also right for 0 arguments: the slot above the stack
+    lane_write(dst->num, result, mask);
+    dst->boolean = (dst->boolean & ~mask) | (boolean & mask);
+    dst->range &= ~mask;
+    return error;
+}
+
+// Stores the result of the lanes of 'done'
+static void lane_halt(VMBatch* batch, const LaneSlot* top, int base, uint64_t done) {
+    for (int l = 0; l < VM_BATCH_LANES; l++) {
+        if (!(done >> l & 1)) {
+            continue;
+        }
+        int i = base + l;
+        if (top == NULL) {
+            batch->results[i] = 0.0;
+            batch->types[i] = TYPE_ERROR;
+            if (batch->errors != NULL) batch->errors[i] = error_code_message(ERROR_EMPTY_STACK);
+            continue;
+        }
+        Value v = lane_value(top, l);
+        batch->results[i] = get_numeric(v);
+        batch->types[i] = v.type;
+        if (batch->errors != NULL) {
+            batch->errors[i] = (v.type == TYPE_ERROR) ? v.as.error.message : NULL;
+        }
+    }
+}
+
+// Runs scenarios base .. base + n - 1 (n <= VM_BATCH_LANES)
+static void batch_block(VM* vm, VMBatch* batch, BatchState* st, int base, int n) {
+    const CodeArray* code = vm->code;
+    LaneSlot* slots = st->slots;
+
+    // This block's slice of each input column (lanes past 'n' are 0)
+    for (int k = 0; k < batch->input_count; k++) {
+        for (int l = 0; l < VM_BATCH_LANES; l++) {
+            st->inputs[k][l / LANE_WIDTH][l % LANE_WIDTH] = (l < n) ? batch->inputs[k][base + l] : 0.0;
+        }
+    }
+    memset(st->pending, 0, code->count * sizeof(uint64_t));
+
+    uint64_t active = (n == VM_BATCH_LANES) ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+    uint64_t waiting = 0;
+    int d = 0; // Stack depth
+    LaneVec x[LANE_GROUPS], y[LANE_GROUPS], r[LANE_GROUPS];
+    ErrorCode error;
+
+    for (int pc = 0; pc < code->count && (active | waiting) != 0; pc++) {
+        if (st->pending[pc] != 0) {
+            active |= st->pending[pc];
+            waiting &= ~st->pending[pc];
+            d = st->pending_depth[pc];
+        }
+        if (active == 0) {
+            continue; // Only lanes that jumped past this point
+        }
+        // Lanes outside 'active' only matter while some wait for a jump
+        uint64_t mask = (waiting != 0) ? active : ~(uint64_t)0;
+        const Instruction* inst = &code->code[pc];
+        const int* input = &st->input_of[2 * pc];
+        OpCode opcode = opcode_generic(inst->opcode);
+
+        switch (opcode) {
+            case OP_HALT:
+                lane_halt(batch, d > 0 ? &slots[d - 1] : NULL, base, active);
+                active = 0;
+                break;
+
+            case OP_PUSH:
+                lane_broadcast(r, inst->operand.number);
+                lane_write(slots[d].num, r, mask);
+                lane_type(&slots[d++], mask, TYPE_NUMBER);
+                break;
+
+            case OP_PUSH_CELL:
+                if (lane_cell(vm, st, input[0], inst->operand.cell.coord, r, &error)) {
+                    lane_error(batch, base, active, error);
+                    active = 0;
+                    break;
+                }
+                lane_write(slots[d].num, r, mask);
+                lane_type(&slots[d++], mask, TYPE_NUMBER);
+                break;
+
+            case OP_PUSH_RANGE:
+                lane_broadcast(r, 0.0);
+                lane_write(slots[d].num, r, mask);
+                lane_type(&slots[d], mask, TYPE_NUMBER);
+                slots[d].range |= mask;
+                for (int l = 0; l < VM_BATCH_LANES; l++) {
+                    if (mask >> l & 1) {
+                        slots[d].ranges[l] = inst->operand.range;
+                    }
+                }
+                d++;
+                break;
+
+            case OP_DIV: {
+                uint64_t zero = active & ~lane_bits(slots[d - 1].num);
+                if (zero != 0) {
+                    lane_error(batch, base, zero, ERROR_DIV_ZERO);
+                    active &= ~zero;
+                    if (waiting != 0) mask = active;
+                }
+            }
+            // Fall through
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_POW:
+            case OP_EQ: case OP_NEQ: case OP_GT: case OP_LT: case OP_GTE:
+            case OP_LTE: case OP_AND: case OP_OR: {
+                ValueType type = lane_binary(opcode, slots[d - 2].num, slots[d - 1].num, r);
+                lane_write(slots[d - 2].num, r, mask);
+                lane_type(&slots[d - 2], mask, type);
+                d--;
+                break;
+            }
+
+            case OP_NEG:
+                for (int g = 0; g < LANE_GROUPS; g++) {
+                    r[g] = -slots[d - 1].num[g];
+                }
+                lane_write(slots[d - 1].num, r, mask);
+                lane_type(&slots[d - 1], mask, TYPE_NUMBER);
+                break;
+
+            case OP_NOT:
+                lane_broadcast(x, 0.0);
+                lane_binary(OP_EQ, slots[d - 1].num, x, r);
+                lane_write(slots[d - 1].num, r, mask);
+                lane_type(&slots[d - 1], mask, TYPE_BOOLEAN);
+                break;
+
+            case OP_JMP: {
+                int target = inst->operand.address;
+                st->pending[target] |= active;
+                st->pending_depth[target] = d;
+                waiting |= active;
+                active = 0;
+                break;
+            }
+
+            case OP_JMP_IF_FALSE:
+            case OP_JMP_IF_NOT_GT: case OP_JMP_IF_NOT_LT: case OP_JMP_IF_NOT_GTE:
+            case OP_JMP_IF_NOT_LTE: case OP_JMP_IF_NOT_EQ: case OP_JMP_IF_NOT_NEQ: {
+                uint64_t truth;
+                if (opcode == OP_JMP_IF_FALSE) {
+                    truth = lane_bits(slots[--d].num);
+                } else {
+                    lane_binary(superinstruction_op(opcode), slots[d - 2].num, slots[d - 1].num, r);
+                    truth = lane_bits(r);
+                    d -= 2;
+                }
+                uint64_t jump = active & ~truth;
+                if (jump != 0) {
+                    int target = inst->operand.address;
+                    st->pending[target] |= jump;
+                    st->pending_depth[target] = d;
+                    waiting |= jump;
+                    active &= ~jump;
+                }
+                break;
+            }
+
+            case OP_CALL: {
+                FuncCallInfo call = inst->operand.func_call;
+                d -= call.arg_count;
+                active &= ~lane_call(vm, batch, st, call, &slots[d], base, active, mask);
+                d++;
+                break;
+            }
+
+            case OP_STORE_LOCAL:
+                lane_write(st->locals[inst->operand.slot], slots[d - 1].num, mask);
+                break;
+
+            case OP_LOAD_LOCAL:
+                lane_write(slots[d].num, st->locals[inst->operand.slot], mask);
+                lane_type(&slots[d++], mask, TYPE_NUMBER);
+                break;
+
+            case OP_ADD_CELL_CELL: case OP_SUB_CELL_CELL: case OP_MUL_CELL_CELL:
+                if (lane_cell(vm, st, input[0], inst->operand.cells.a, x, &error) ||
+                    lane_cell(vm, st, input[1], inst->operand.cells.b, y, &error)) {
+                    lane_error(batch, base, active, error);
+                    active = 0;
+                    break;
+                }
+                lane_binary(superinstruction_op(opcode), x, y, r);
+                lane_write(slots[d].num, r, mask);
+                lane_type(&slots[d++], mask, TYPE_NUMBER);
+                break;
+
+            case OP_ADD_CELL_CONST: case OP_MUL_CELL_CONST:
+                if (lane_cell(vm, st, input[0], inst->operand.cell_const.coord, x, &error)) {
+                    lane_error(batch, base, active, error);
+                    active = 0;
+                    break;
+                }
+                lane_broadcast(y, inst->operand.cell_const.number);
+                lane_binary(superinstruction_op(opcode), x, y, r);
+                lane_write(slots[d].num, r, mask);
+                lane_type(&slots[d++], mask, TYPE_NUMBER);
+                break;
+
+            case OP_ADD_CELL: case OP_MUL_CONST:
+                if (opcode == OP_ADD_CELL) {
+                    if (lane_cell(vm, st, input[0], inst->operand.cell.coord, y, &error)) {
+                        lane_error(batch, base, active, error);
+                        active = 0;
+                        break;
+                    }
+                } else {
+                    lane_broadcast(y, inst->operand.number);
+                }
+                lane_binary(superinstruction_op(opcode), slots[d - 1].num, y, r);
+                lane_write(slots[d - 1].num, r, mask);
+                lane_type(&slots[d - 1], mask, TYPE_NUMBER);
+                break;
+
+            default: // OP_NOP
+                break;
+        }
+    }
+}
+
+// Runs the scenarios in blocks of lanes. Returns 0 if the code does not allow it.
+static int batch_lanes(VM* vm, VMBatch* batch) {
+    const CodeArray* code = vm->code;
+    int n = code->count;
+
+    // 1. Forward jumps only (the code is walked once), and a bound on the depth
+    int pushes = 1;
+    for (int pc = 0; pc < n; pc++) {
+        const Instruction* inst = &code->code[pc];
+        if (opcode_is_jump(inst->opcode) && inst->operand.address <= pc) {
+            return 0;
+        }
+        pushes++;
+    }
+    if (pushes > VM_STACK_SIZE + 1) {
+        pushes = VM_STACK_SIZE + 1;
+    }
+
+    // 2. Where each instruction's cells come from (the last listing of an input wins)
+    BatchState st;
+    st.input_of = (int*)malloc(2 * n * sizeof(int));
+    st.pending = (uint64_t*)malloc(n * sizeof(uint64_t));
+    st.pending_depth = (int*)malloc(n * sizeof(int));
+    st.saved = (double*)malloc((batch->input_count + 1) * sizeof(double));
+    st.args = (Value*)malloc(VM_STACK_SIZE * sizeof(Value));
+    st.slots = (LaneSlot*)aligned_alloc(sizeof(LaneVec), pushes * sizeof(LaneSlot));
+    st.locals = aligned_alloc(sizeof(LaneVec), (code->local_count + 1) * sizeof(*st.locals));
+    st.inputs = aligned_alloc(sizeof(LaneVec), (batch->input_count + 1) * sizeof(*st.inputs));
+    if (st.input_of == NULL || st.pending == NULL || st.pending_depth == NULL || st.saved == NULL ||
+        st.args == NULL || st.slots == NULL || st.locals == NULL || st.inputs == NULL) {
+        fprintf(stderr, "Fatal: Out of memory running a batch\n");
+        exit(1);
+    }
+    memset(st.slots, 0, pushes * sizeof(LaneSlot));
+    for (int pc = 0; pc < n; pc++) {
+        const Instruction* inst = &code->code[pc];
+        CellCoord cells[2];
+        int cell_count = 0;
+        switch (inst->opcode) {
+            case OP_PUSH_CELL: case OP_ADD_CELL:
+                cells[cell_count++] = inst->operand.cell.coord;
+                break;
+            case OP_ADD_CELL_CELL: case OP_SUB_CELL_CELL: case OP_MUL_CELL_CELL:
+                cells[cell_count++] = inst->operand.cells.a;
+                cells[cell_count++] = inst->operand.cells.b;
+                break;
+            case OP_ADD_CELL_CONST: case OP_MUL_CELL_CONST:
+                cells[cell_count++] = inst->operand.cell_const.coord;
+                break;
+            default:
+                break;
+        }
+        st.input_of[2 * pc] = st.input_of[2 * pc + 1] = -1;
+        for (int c = 0; c < cell_count; c++) {
+            for (int k = 0; k < batch->input_count; k++) {
+                if (batch->input_cells[k] == cells[c]) {
+                    st.input_of[2 * pc + c] = k;
+                }
+            }
+        }
+    }
+
+    // 3. The blocks
+    for (int base = 0; base < batch->count; base += VM_BATCH_LANES) {
+        int lanes = batch->count - base;
+        batch_block(vm, batch, &st, base, lanes < VM_BATCH_LANES ? lanes : VM_BATCH_LANES);
+    }
+
+    free(st.input_of);
+    free(st.pending);
+    free(st.pending_depth);
+    free(st.saved);
+    free(st.args);
+    free(st.slots);
+    free(st.locals);
+    free(st.inputs);
+    return 1;
+}
+
+#else
+
+static int batch_lanes(VM* vm, VMBatch* batch) {
+    (void)vm;
+    (void)batch;
+    return 0; // No vector types: one scenario at a time
+}
+
+#endif
+
+int vm_execute_batch(VM* vm, VMBatch* batch) {
+    if (vm->code->verified == 0) {
+        vm_verify(vm->code);
+    }
+    if (vm->code->verified < 0) {
+        for (int i = 0; i < batch->count; i++) {
+            batch->results[i] = 0.0;
+            batch->types[i] = TYPE_ERROR;
+            if (batch->errors != NULL) batch->errors[i] = vm->code->verify_error;
+        }
+        return 0;
+    }
+    if (vm->trace || !batch_lanes(vm, batch)) {
+        batch_scalar(vm, batch);
+        return 0;
+    }
+    return 1;
+}
+
+
+/* --- Stack Operations --- */
+
+// Used by the traced loop only; the verifier has ruled out both errors
+static void vm_push(VM* vm, Value val) {
+    if (vm->stack_top >= VM_STACK_SIZE) {
+        fprintf(stderr, "VM Error: Stack overflow\n");
+        exit(1);
+    }
+    vm->stack[vm->stack_top++] = val;
+}
+
+static Value vm_pop(VM* vm) {
+    if (vm->stack_top == 0) {
+        fprintf(stderr, "VM Error: Stack underflow\n");
+        exit(1);
+    }
+    // Note: We return the value, but if it was a string,
+    // the *caller* is now responsible for freeing it.
+    return vm->stack[--vm->stack_top];
+}
+
 
 /* --- Debugging Helpers --- */
 
@@ -3,6 +3,13 @@
  *
  * Defines the VM struct, stack size, and
  * the main execution function.
+ *
+ * Bytecode is verified once (jump targets, stack depth,
+ * a final HALT) before it first runs, so the dispatch loop
+ * itself does no bounds checks.
+ *
+ * vm_execute_batch() evaluates one formula for many input
+ * scenarios at once, with a vector of lanes in every stack slot.
  */
 
 #ifndef VM_H
@@ -15,16 +22,36 @@
 // Define a fixed size for the VM's value stack
 #define VM_STACK_SIZE 256
 
+#define VM_BATCH_LANES 64 // Scenarios per pass over the code (one bit each in a lane mask)
+
 typedef struct {
     CodeArray* code;      // The bytecode to run
     SymbolTable* symtab;  // Global symbol table
     int pc;               // Program Counter
     int stack_top;        // Stack pointer
     Value stack[VM_STACK_SIZE]; // The value stack
+    double locals[MAX_LOCAL_SLOTS]; // Shared subexpressions of the running formula
     
     int trace;            // Flag for tracing execution
+    int jit_threshold;    // Compile code to native after this many runs (0 = never, see jit.h)
 } VM;
 
+/*
+ * Scenarios for vm_execute_batch(), in columns: scenario i reads
+ * inputs[k][i] for the cell input_cells[k], and the symbol table
+ * for every other cell.
+ */
+typedef struct {
+    int count;                    // Scenarios
+    const CellCoord* input_cells;
+    const double* const* inputs;  // One column of 'count' values per input cell
+    int input_count;
+
+    double* results;              // Out: get_numeric() of each scenario's result
+    ValueType* types;             // Out: its type
+    const char** errors;          // Out: messages of TYPE_ERROR results, else NULL (may be NULL)
+} VMBatch;
+
 /**
  * @brief Creates a new Virtual Machine.
  * @param code The bytecode array to execute.
@@ -39,11 +66,41 @@ VM* vm_create(CodeArray* code, SymbolTable* table);
 void vm_free(VM* vm);
 
 /**
- * @brief Executes the VM's bytecode.
- * @return The final 'Value' result of the computation.
+ * @brief Points an existing VM at a new bytecode array and
+ * resets its program counter and stack. This lets one VM
+ * evaluate every formula of a sheet.
+ */
+void vm_load(VM* vm, CodeArray* code);
+
+/**
+ * @brief Checks that bytecode is safe to run without runtime checks:
+ * every opcode is known, every jump lands inside the code, the stack
+ * never underflows or grows past VM_STACK_SIZE, and every path ends
+ * in OP_HALT. The outcome is kept in the CodeArray, so this is only
+ * done again after the code changes.
+ * @return 1 if the code is valid, 0 otherwise (see code->verify_error).
+ */
+int vm_verify(CodeArray* code);
+
+/**
+ * @brief Executes the VM's bytecode, verifying it first if needed.
+ * @return The final 'Value' result of the computation, or an
+ * error value if the bytecode failed verification.
  */
 Value vm_execute(VM* vm);
 
+/**
+ * @brief Evaluates the VM's bytecode once per scenario of 'batch',
+ * VM_BATCH_LANES scenarios per pass: each instruction is dispatched
+ * once for the whole block and works on all its lanes. Lanes that
+ * disagree at an IF are masked. Results are those of vm_execute()
+ * with each scenario's inputs stored in the cells; error messages
+ * are static strings.
+ * @return 1 if the scenarios ran in lanes, 0 if they had to run one
+ * by one (code with backward jumps, or no vector types in the compiler).
+ */
+int vm_execute_batch(VM* vm, VMBatch* batch);
+
 
 #endif // VM_H
 
@@ -0,0 +1,420 @@
+/*
+ * --- Workbook Recalculation Implementation ---
+ *
+ * Loads a whole sheet, compiles every formula cell once,
+ * orders the cells by their dependencies and evaluates
+ * all of them in one pass on a single VM.
+ */
+
+#include "workbook.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "parser.tab.h" // For parse_formula_string
+#include "semantic.h"
+#include "codegen.h"
+#include "optimizer.h"
+#include "vm.h"
+
+#define SHEET_LINE_MAX 4096
+
+
+/* --- Private Helpers --- */
+
+// Trims leading and trailing whitespace in place
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str)) str++;
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return str;
+}
+
+// Appends a new formula cell and returns its index
+static int add_formula_cell(Workbook* wb, CellCoord coord, const char* formula, int line) {
+    if (wb->count >= wb->capacity) {
+        wb->capacity = wb->capacity < 8 ? 8 : wb->capacity * 2;
+        wb->cells = (FormulaCell*)realloc(wb->cells, wb->capacity * sizeof(FormulaCell));
+        if (wb->cells == NULL) {
+            fprintf(stderr, "Fatal: Out of memory growing workbook\n");
+            exit(1);
+        }
+    }
+    FormulaCell* fc = &wb->cells[wb->count];
+    fc->coord = coord;
+    fc->cell_id = symtab_lookup(wb->symtab, coord);
+    fc->formula_str = strdup(formula);
+    fc->line = line;
+    fc->code = NULL;
+    fc->result = create_number_value(0.0);
+    return wb->count++;
+}
+
+// Sorts positions in the topological order
+static int compare_positions(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Replaces a cell's result and mirrors it into the symbol table
+void workbook_store_result(Workbook* wb, FormulaCell* fc, Value result) {
+    free_value(fc->result);
+    fc->result = result;
+
+    symtab_store_value(wb->symtab, fc->coord, cell_from_value(result)); // Errors reach the dependents
+}
+
+
+/* --- Public API --- */
+
+Workbook* workbook_create(SymbolTable* table, ErrorSystem* errors) {
+    Workbook* wb = (Workbook*)calloc(1, sizeof(Workbook));
+    wb->symtab = table;
+    wb->errors = errors;
+    return wb;
+}
+
+void workbook_free(Workbook* wb) {
+    if (wb == NULL) return;
+    for (int i = 0; i < wb->count; i++) {
+        FormulaCell* fc = &wb->cells[i];
+        free(fc->formula_str);
+        free_bytecode(fc->code);
+        free_value(fc->result);
+    }
+    free(wb->cells);
+    free(wb->order);
+    free(wb->position);
+    free(wb->edge_start);
+    free(wb->edges);
+    free(wb->indegree);
+    free(wb->level_order);
+    free(wb->level_start);
+    formula_cache_free(wb->formula_cache);
+    free(wb);
+}
+
+int workbook_load(Workbook* wb, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Could not open sheet file '%s'.\n", filename);
+        return -1;
+    }
+
+    char line[SHEET_LINE_MAX];
+    int line_num = 0;
+    int loaded = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_num++;
+
+        char* eq = strchr(line, '=');
+        if (eq == NULL) {
+            continue; // Blank or malformed line
+        }
+        *eq = '\0';
+        char* key = trim(line);
+        char* content = trim(eq + 1);
+        if (*key == '\0') {
+            continue;
+        }
+
+        CellCoord coord = cellref_from_string(key);
+        if (coord == CELL_COORD_INVALID) {
+            char msg[256];
+            snprintf(msg, 256, "Invalid cell reference '%s'.", key);
+            error_report(wb->errors, ERROR_SEMANTIC, line_num, 0, msg, "Use a column letter and a row number (e.g., B12).");
+            continue;
+        }
+
+        CellEntry* existing = symtab_get_cell(wb->symtab, coord);
+        if (existing != NULL && existing->formula_id >= 0) {
+            char msg[256];
+            snprintf(msg, 256, "Cell '%s' is defined more than once.", key);
+            error_report(wb->errors, ERROR_SEMANTIC, line_num, 0, msg, "Keep only one definition per cell.");
+            continue;
+        }
+
+        if (content[0] == '=') {
+            // Formula cell: computed later, starts at 0
+            symtab_define_cell(wb->symtab, coord, 0.0, content, line_num);
+            int id = add_formula_cell(wb, coord, content + 1, line_num);
+            symtab_set_formula(wb->symtab, coord, id);
+        } else {
+            symtab_define_cell(wb->symtab, coord, atof(content), NULL, line_num);
+        }
+        loaded++;
+    }
+    fclose(file);
+    return loaded;
+}
+
+int workbook_compile(Workbook* wb, int optimize) {
+    int failed = 0;
+    wb->instruction_count = 0;
+
+    for (int i = 0; i < wb->count; i++) {
+        FormulaCell* fc = &wb->cells[i];
+
+        // A formula shaped like an earlier one reuses its bytecode
+        int shaped = 0;
+        if (wb->formula_cache != NULL) {
+            shaped = formula_cache_shape(wb->formula_cache, fc->formula_str, fc->coord);
+            if (shaped) {
+                fc->code = formula_cache_instantiate(wb->formula_cache, wb->symtab, fc->coord, fc->line);
+                if (fc->code != NULL) {
+                    wb->instruction_count += fc->code->count;
+                    continue;
+                }
+            }
+        }
+
+        // Phase 1 & 2: Parsing (the tree only lives until the code is generated)
+        ASTNode* ast = parse_formula_string(fc->formula_str, fc->line);
+        if (ast == NULL) {
+            free_all_asts(); // What was built before the syntax error
+            workbook_store_result(wb, fc, create_error(ERROR_BAD_SYNTAX));
+            failed++;
+            continue;
+        }
+
+        // Phase 4: Semantic Analysis (cycles are found by workbook_schedule)
+        if (semantic_check_formula(ast, wb->symtab, wb->errors, fc->coord) > 0) {
+            free_all_asts();
+            workbook_store_result(wb, fc, create_error(ERROR_BAD_FORMULA));
+            failed++;
+            continue;
+        }
+
+        // Phase 5: Code Generation
+        if (optimize) {
+            ast = optimize_ast(ast, 0);
+        }
+        fc->code = generate_code_cse(ast, wb->symtab, optimize, NULL);
+        free_all_asts(); // Rewinds the arena for the next formula
+        if (optimize) {
+            optimize_bytecode(fc->code, 0);
+        }
+        vm_verify(fc->code); // Now, so worker threads only read the result
+        wb->instruction_count += fc->code->count;
+        if (shaped) {
+            formula_cache_add(wb->formula_cache, fc->coord, fc->cell_id, fc->code);
+        }
+    }
+    return failed;
+}
+
+int workbook_schedule(Workbook* wb) {
+    // Report every cycle, with its path, before ordering
+    symtab_find_cycles(wb->symtab, wb->errors);
+
+    SymbolTable* table = wb->symtab;
+    int n = wb->count;
+
+    // 1. The graph's nodes: the formula cells, then the range nodes
+    // with formula cells inside (the others order nothing)
+    int* node_of_id = (int*)malloc((table->count + 1) * sizeof(int));
+    int nodes = n;
+    for (int id = 0; id < table->count; id++) {
+        CellEntry* entry = symtab_cell(table, id);
+        node_of_id[id] = entry->formula_id;
+        if (entry->range_node) {
+            node_of_id[id] = -1;
+            for (int d = 0; d < entry->dep_count && node_of_id[id] < 0; d++) {
+                if (symtab_cell(table, entry->dependencies[d])->formula_id >= 0) {
+                    node_of_id[id] = nodes++;
+                }
+            }
+        }
+    }
+    int* id_of_node = (int*)malloc((nodes + 1) * sizeof(int));
+    for (int id = 0; id < table->count; id++) {
+        if (node_of_id[id] >= 0) {
+            id_of_node[node_of_id[id]] = id;
+        }
+    }
+    wb->node_count = nodes;
+
+    free(wb->edge_start);
+    free(wb->edges);
+    free(wb->indegree);
+    wb->indegree = (int*)calloc(nodes + 1, sizeof(int));
+    wb->edge_start = (int*)calloc(nodes + 1, sizeof(int)); // CSR offsets of dependents
+    int edge_count = 0;
+
+    // 2. Count the edges: dependency -> dependent, between nodes only
+    for (int v = 0; v < nodes; v++) {
+        CellEntry* entry = symtab_cell(table, id_of_node[v]);
+        for (int d = 0; d < entry->dep_count; d++) {
+            int u = node_of_id[entry->dependencies[d]];
+            if (u >= 0) {
+                wb->edge_start[u]++;
+                wb->indegree[v]++;
+                edge_count++;
+            }
+        }
+    }
+
+    // 3. Turn the counts into offsets and fill in the dependents
+    int offset = 0;
+    for (int v = 0; v <= nodes; v++) {
+        int out_degree = wb->edge_start[v];
+        wb->edge_start[v] = offset;
+        offset += out_degree;
+    }
+    wb->edges = (int*)malloc((edge_count + 1) * sizeof(int));
+    int* fill = (int*)malloc((nodes + 1) * sizeof(int));
+    memcpy(fill, wb->edge_start, (nodes + 1) * sizeof(int));
+    for (int v = 0; v < nodes; v++) {
+        CellEntry* entry = symtab_cell(table, id_of_node[v]);
+        for (int d = 0; d < entry->dep_count; d++) {
+            int u = node_of_id[entry->dependencies[d]];
+            if (u >= 0) {
+                wb->edges[fill[u]++] = v;
+            }
+        }
+    }
+    free(node_of_id);
+    free(id_of_node);
+
+    // 4. Kahn's algorithm over 'queue'; the formula cells also go to 'order'.
+    // A cell's level is settled once all its dependencies are done. A range
+    // node passes on the level of its latest formula cell.
+    int* remaining = (int*)malloc((nodes + 1) * sizeof(int));
+    memcpy(remaining, wb->indegree, (nodes + 1) * sizeof(int));
+    int* level = (int*)calloc(nodes + 1, sizeof(int));
+    int* queue = (int*)malloc((nodes + 1) * sizeof(int));
+    free(wb->order);
+    wb->order = (int*)malloc((n + 1) * sizeof(int));
+    int head = 0;
+    int queued = 0;
+    int tail = 0;
+    for (int v = 0; v < nodes; v++) {
+        if (remaining[v] == 0) {
+            queue[queued++] = v;
+        }
+    }
+    wb->level_count = 0;
+    while (head < queued) {
+        int node = queue[head++];
+        int next_level = level[node];
+        if (node < n) {
+            wb->order[tail++] = node;
+            next_level++;
+            if (next_level > wb->level_count) {
+                wb->level_count = next_level;
+            }
+        }
+        for (int e = wb->edge_start[node]; e < wb->edge_start[node + 1]; e++) {
+            int dependent = wb->edges[e];
+            if (level[dependent] < next_level) {
+                level[dependent] = next_level;
+            }
+            if (--remaining[dependent] == 0) {
+                queue[queued++] = dependent;
+            }
+        }
+    }
+    wb->order_count = tail;
+    free(queue);
+
+    free(wb->position);
+    wb->position = (int*)malloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        wb->position[i] = -1;
+    }
+    for (int k = 0; k < tail; k++) {
+        wb->position[wb->order[k]] = k;
+    }
+
+    // 5. Group the ordered cells by level (counting sort)
+    free(wb->level_start);
+    free(wb->level_order);
+    wb->level_start = (int*)calloc(wb->level_count + 1, sizeof(int));
+    wb->level_order = (int*)malloc((tail + 1) * sizeof(int));
+    for (int k = 0; k < tail; k++) {
+        wb->level_start[level[wb->order[k]] + 1]++;
+    }
+    for (int l = 0; l < wb->level_count; l++) {
+        wb->level_start[l + 1] += wb->level_start[l];
+    }
+    memcpy(fill, wb->level_start, (wb->level_count + 1) * sizeof(int));
+    for (int k = 0; k < tail; k++) {
+        wb->level_order[fill[level[wb->order[k]]]++] = wb->order[k];
+    }
+
+    // 6. Whatever is left is on, or downstream of, a cycle
+    int left_out = n - tail;
+    for (int i = 0; i < n && left_out > 0; i++) {
+        if (remaining[i] > 0) {
+            FormulaCell* fc = &wb->cells[i];
+            CellEntry* entry = symtab_cell(wb->symtab, fc->cell_id);
+            workbook_store_result(wb, fc, create_error(entry->on_cycle ?
+                ERROR_CIRCULAR : ERROR_CIRCULAR_INPUT));
+        }
+    }
+
+    free(remaining);
+    free(level);
+    free(fill);
+    return left_out;
+}
+
+void workbook_evaluate_cell(Workbook* wb, VM* vm, int index) {
+    FormulaCell* fc = &wb->cells[index];
+    if (fc->code == NULL) {
+        return; // Failed to compile, keeps its error
+    }
+    vm_load(vm, fc->code);
+    workbook_store_result(wb, fc, vm_execute(vm));
+}
+
+void workbook_recalc(Workbook* wb) {
+    VM* vm = vm_create(NULL, wb->symtab);
+    vm->trace = wb->trace;
+    vm->jit_threshold = wb->jit_threshold;
+
+    for (int k = 0; k < wb->order_count; k++) {
+        workbook_evaluate_cell(wb, vm, wb->order[k]);
+    }
+
+    vm_free(vm);
+    symtab_clear_dirty(wb->symtab);
+}
+
+int workbook_recalc_dirty(Workbook* wb) {
+    SymbolTable* table = wb->symtab;
+
+    // 1. Collect the order positions of the dirty formula cells
+    int* positions = (int*)malloc((table->dirty_count + 1) * sizeof(int));
+    int count = 0;
+    for (int i = 0; i < table->dirty_count; i++) {
+        CellEntry* entry = symtab_cell(table, table->dirty[i]);
+        if (entry->formula_id >= 0 && wb->position[entry->formula_id] >= 0) {
+            positions[count++] = wb->position[entry->formula_id];
+        }
+    }
+
+    // 2. Evaluate them in topological order
+    qsort(positions, count, sizeof(int), compare_positions);
+    VM* vm = vm_create(NULL, table);
+    vm->trace = wb->trace;
+    vm->jit_threshold = wb->jit_threshold;
+    for (int k = 0; k < count; k++) {
+        workbook_evaluate_cell(wb, vm, wb->order[positions[k]]);
+    }
+    vm_free(vm);
+
+    free(positions);
+    symtab_clear_dirty(table);
+    return count;
+}
+
+void workbook_print_results(Workbook* wb) {
+    char name[CELLREF_MAX];
+    for (int i = 0; i < wb->count; i++) {
+        printf("%-6s = ", cellref_format(wb->cells[i].coord, name));
+        print_value(wb->cells[i].result);
+        printf("\n");
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * --- Workbook Recalculation Header ---
+ *
+ * Defines the Workbook struct, which holds every formula
+ * cell of a sheet together with its compiled bytecode,
+ * and the functions to load, order and recalculate them
+ * in a single run.
+ */
+
+#ifndef WORKBOOK_H
+#define WORKBOOK_H
+
+#include "ast.h"
+#include "ir.h"
+#include "symtab.h"
+#include "error.h"
+#include "value.h"
+#include "vm.h"
+#include "formulacache.h"
+
+/*
+ * A single formula cell (e.g., C1 holding =A1+B1).
+ */
+typedef struct {
+    CellCoord coord;    // The cell reference (e.g., C1)
+    int cell_id;        // Id of the cell in the symbol table
+    char* formula_str;  // The formula text, without the leading '='
+    int line;           // Line number in the sheet file
+    CodeArray* code;    // Compiled bytecode, NULL if compilation failed
+    Value result;       // Result of the last recalculation
+} FormulaCell;
+
+/*
+ * A loaded sheet: the symbol table holds every cell's value,
+ * the formula list holds every cell that must be computed.
+ */
+typedef struct {
+    SymbolTable* symtab;   // Cell values and dependencies
+    ErrorSystem* errors;   // Where load/compile/cycle errors go
+
+    FormulaCell* cells;    // All formula cells, in sheet order
+    int count;
+    int capacity;
+
+    int* order;            // Topological evaluation order (indices into 'cells')
+    int order_count;       // Cells in 'order' (cells on a cycle are left out)
+    int* position;         // Position of each cell in 'order', -1 if left out
+
+    // Dependency graph (CSR): the nodes that depend on node i are
+    // edges[edge_start[i] .. edge_start[i + 1]). Nodes 0 .. count - 1 are
+    // the formula cells; the others are range nodes (symtab.h), which
+    // stand between the formula cells of a range and its readers.
+    int* edge_start;
+    int* edges;
+    int* indegree;         // Number of nodes each node depends on
+    int node_count;
+
+    // Dependency levels: a cell's level is one more than the highest level
+    // of its dependencies. The cells of level L are
+    // level_order[level_start[L] .. level_start[L + 1]) and can run concurrently.
+    int* level_order;
+    int* level_start;
+    int level_count;
+
+    int instruction_count; // Total bytecode size (for the summary)
+    int trace;             // Trace every VM run
+    FormulaCache* formula_cache; // NULL: every formula is compiled on its own
+    int jit_threshold;     // Serial recalculation: native code after this many runs (0 = never)
+} Workbook;
+
+
+/* --- Public API --- */
+
+/**
+ * @brief Creates an empty workbook on top of a symbol table.
+ */
+Workbook* workbook_create(SymbolTable* table, ErrorSystem* errors);
+
+/**
+ * @brief Frees the workbook, its ASTs, bytecode and formula cache.
+ * The symbol table and error system are not freed.
+ */
+void workbook_free(Workbook* wb);
+
+/**
+ * @brief Loads a sheet file. Each line is 'KEY=CONTENT', where a
+ * CONTENT starting with '=' is a formula (e.g., C1==A1+B1) and
+ * anything else is a plain number (e.g., A1=10).
+ * @return The number of cells loaded, or -1 if the file can't be read.
+ */
+int workbook_load(Workbook* wb, const char* filename);
+
+/**
+ * @brief Parses, checks and compiles every formula cell. With a
+ * formula cache, a cell whose template was already compiled gets
+ * a rebased copy of that bytecode instead. Each formula's tree is
+ * freed (by rewinding ast_arena) as soon as its code is generated.
+ * @param optimize 1 to run the bytecode optimizer on each cell.
+ * @return The number of cells that failed to compile.
+ */
+int workbook_compile(Workbook* wb, int optimize);
+
+/**
+ * @brief Reports every cycle in the sheet (symtab_find_cycles), then
+ * builds the dependency graph between formula cells and orders them
+ * topologically (Kahn's algorithm) and by dependency level. Cells
+ * that are on, or downstream of, a cycle are left out of the order.
+ * @return The number of cells left out.
+ */
+int workbook_schedule(Workbook* wb);
+
+/**
+ * @brief Evaluates formula cell 'index' on the given VM and stores the
+ * result. Safe to call from several threads at once for cells that
+ * do not depend on each other: each writes only its own grid slot.
+ */
+void workbook_evaluate_cell(Workbook* wb, VM* vm, int index);
+
+/**
+ * @brief Replaces a cell's result and mirrors it into the symbol
+ * table (an error as an error cell, see cellstore.h). Used by every
+ * recalculation path.
+ */
+void workbook_store_result(Workbook* wb, FormulaCell* fc, Value result);
+
+/**
+ * @brief Evaluates every scheduled cell in order on a single VM,
+ * storing each result back into the symbol table.
+ */
+void workbook_recalc(Workbook* wb);
+
+/**
+ * @brief Re-evaluates only the cells marked dirty in the symbol table
+ * (see symtab_set_value), in topological order, then clears the marks.
+ * @return The number of cells re-evaluated.
+ */
+int workbook_recalc_dirty(Workbook* wb);
+
+/**
+ * @brief Prints the result of every formula cell, in sheet order.
+ */
+void workbook_print_results(Workbook* wb);
+
+
+#endif // WORKBOOK_H
@@ -22,6 +22,7 @@
  * 2. The YYSTYPE union definition
  */
 #include "parser.tab.h"
+#include "arena.h"
 
 /* --- Function Prototypes --- */
 void print_token_table_header();
@@ -46,6 +47,9 @@ extern FILE* yyin;       // Input stream
  */
 extern YYSTYPE yylval;
 
+// STRING and ERROR text is copied into the parser's arena (see lexer.l)
+extern Arena ast_arena;
+
 /* --- Main Program --- */
 int main(int argc, char** argv) {
     int token;
@@ -93,14 +97,6 @@ int main(int argc, char** argv) {
             }
         }
 
-        // Free memory if strdup was used (for strings, cells, ranges)
-        if (token == CELL_REF || token == RANGE || token == STRING || token == ERROR) {
-            if (yylval.str) {
-                free(yylval.str);
-                yylval.str = NULL; // Avoid double-free
-            }
-        }
-
         if (token == 0 || token == EOF || token == ERROR) {
             // yylex() returns 0 on EOF
             break; // Stop on error or end
@@ -113,6 +109,7 @@ int main(int argc, char** argv) {
     if (yyin) {
         fclose(yyin);
     }
+    arena_release(&ast_arena); // Every STRING and ERROR text at once
 
     return 0;
 }
@@ -137,7 +134,13 @@ const char* get_token_value(int token_type, YYSTYPE lval) {
             return num_buffer;
 
         case CELL_REF:
+            // Cell references are decoded to a coordinate by the lexer
+            return cellref_format(lval.coord, num_buffer);
+
         case RANGE:
+            // So are ranges, to a pair of coordinates
+            return cellrange_format(lval.range, num_buffer);
+
         case STRING:
         case ERROR:
             // These types store a char* in yylval.str